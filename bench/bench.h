@@ -0,0 +1,27 @@
+/* The workloads of `make bench` are bare-metal programs started at DRAM_BASE
+ * in M-mode, except the ones run by --user. They report the completion by
+ * HTIF, see include/htif.h.
+ *
+ * The layout is fixed instead of relying on relocations: the code is in the
+ * first page, .tohost is the second one and the data starts from the third. */
+
+#define BENCH_TOHOST 0x1000
+#define BENCH_DATA 0x2000
+
+// the address where the program is loaded
+#define BENCH_BASE(reg) auipc reg, 0
+
+// the locations watched by the host, which should be in every workload
+#define BENCH_TOHOST_SECTION                 \
+    .section .tohost, "aw", @progbits; \
+    .align 3;                                \
+    tohost: .dword 0;                        \
+    fromhost: .dword 0
+
+// exit with code 0 through HTIF
+#define BENCH_EXIT(base)          \
+    li t0, BENCH_TOHOST;          \
+    add t0, base, t0;             \
+    li t1, 1;                     \
+    1: sd t1, 0(t0);              \
+    j 1b
@@ -0,0 +1,471 @@
+/* The microbenchmarks of the hot components of the emulator, which are timed
+ * on the host without running any guest, so a regression of the whole-guest
+ * benchmark could be attributed to one of them:
+ *
+ * - decode: __decode for the mixes of instructions
+ * - translate: addr_translate without paging, and the Sv39 walk of the page
+ *   tables which are warm or cold in the host cache
+ * - bus: the dispatch of read_bus / write_bus to each region
+ * - mem: read_mem / write_mem of each width
+ * - icache: the hit and miss of the instruction cache, if built by ICACHE=1
+ *
+ * Each case is run several times for warm-up, and then timed for a number of
+ * repetitions. The min, median, mean and standard deviation of the time per
+ * operation are reported. Only the components given by the arguments are run,
+ * or all of them if there is none.
+ *
+ *   $ make microbench
+ *   $ build/microbench decode translate */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "clint.h"
+#include "cpu.h"
+#include "ctrl.h"
+#include "plic.h"
+#include "uart.h"
+#include "virtio_blk.h"
+
+#define MICRO_WARMUP 3
+#define MICRO_REPEAT 15
+// the operations in each repetition
+#define MICRO_OPS (1 << 18)
+
+// the results are accumulated here, so the operations aren't optimized out
+static volatile uint64_t sink;
+
+typedef struct {
+    const char *component;
+    const char *name;
+    /* run n operations of the case, and return false if any of them fails
+     * unexpectedly */
+    bool (*run)(riscv_cpu *cpu, const void *arg, uint64_t n);
+    const void *arg;
+    // set up the CPU before the case is run, if not NULL
+    void (*setup)(riscv_cpu *cpu, const void *arg);
+} micro_case;
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* decode */
+
+typedef struct {
+    const uint32_t *instr;
+    size_t count;
+} decode_mix;
+
+static const uint32_t alu_instr[] = {
+    0x00510093, // addi x1, x2, 5
+    0x002081b3, // add x3, x1, x2
+    0x00331293, // slli x5, x6, 3
+    0x123453b7, // lui x7, 0x12345
+    0x40a48433, // sub x8, x9, x10
+    0x02d605b3, // mul x11, x12, x13
+    0x0307d733, // divu x14, x15, x16
+};
+
+static const uint32_t mem_instr[] = {
+    0x00813283, // ld x5, 8(x2)
+    0x00513823, // sd x5, 16(x2)
+    0x00452303, // lw x6, 4(x10)
+    0x00652023, // sw x6, 0(x10)
+    0x0015c383, // lbu x7, 1(x11)
+    0x006522af, // amoadd.w x5, x6, (x10)
+};
+
+static const uint32_t branch_instr[] = {
+    0x00208463, // beq x1, x2, 8
+    0xfe419ee3, // bne x3, x4, -4
+    0x0020c463, // blt x1, x2, 8
+    0x010000ef, // jal x1, 16
+    0x00008067, // jalr x0, 0(x1)
+};
+
+static const uint32_t compressed_instr[] = {
+    0x0505, // c.addi a0, 1
+    0x4501, // c.li a0, 0
+    0x852e, // c.mv a0, a1
+    0x4188, // c.lw a0, 0(a1)
+    0xa011, // c.j 4
+    0x952e, // c.add a0, a1
+    0x650c, // c.ld a1, 8(a0)
+};
+
+static const uint32_t vector_instr[] = {
+    0x010572d7, // vsetvli x5, x10, e32, m1, tu, mu
+    0x022180d7, // vadd.vv v1, v2, v3
+    0x02056087, // vle32.v v1, (x10)
+    0x020560a7, // vse32.v v1, (x10)
+    0x96536257, // vmul.vx v4, v5, x6
+};
+
+#define DECODE_MIX(list) {list, sizeof(list) / sizeof(list[0])}
+static const decode_mix decode_alu = DECODE_MIX(alu_instr);
+static const decode_mix decode_mem = DECODE_MIX(mem_instr);
+static const decode_mix decode_branch = DECODE_MIX(branch_instr);
+static const decode_mix decode_compressed = DECODE_MIX(compressed_instr);
+static const decode_mix decode_vector = DECODE_MIX(vector_instr);
+
+static bool run_decode(riscv_cpu *cpu, const void *arg, uint64_t n)
+{
+    const decode_mix *mix = arg;
+
+    for (uint64_t i = 0, j = 0; i < n; i++) {
+        if (!decode_cpu(cpu, mix->instr[j]))
+            return false;
+        sink += (uintptr_t) cpu->instr.exec_func;
+        if (++j == mix->count)
+            j = 0;
+    }
+    return true;
+}
+
+/* translate
+ *
+ * The page tables are built in DRAM from PT_BASE. The warm case translates a
+ * few pages repeatedly, so the PTEs stay in the host cache. The cold case
+ * visits pages at the stride of 2 MiB over 4 GiB in a random order, where each
+ * of them has its own last-level table, so every walk touches PTEs which are
+ * unlikely to be cached. */
+
+#define PT_BASE (DRAM_BASE + 0x1000000UL)
+#define PTE_TABLE 0x1UL
+// V | R | W | X | A | D
+#define PTE_LEAF 0xcfUL
+#define WARM_PAGES 8
+#define COLD_PAGES 2048
+#define COLD_STRIDE 0x200000UL
+// the root, the tables of 1 GiB and the last-level tables
+#define PT_PAGES (1 + 4 + COLD_PAGES)
+
+typedef struct {
+    uint64_t *vaddr;
+    size_t count;
+} translate_set;
+
+static uint64_t pt_next;
+static uint64_t warm_vaddr[WARM_PAGES];
+static uint64_t cold_vaddr[COLD_PAGES];
+static const translate_set translate_warm = {warm_vaddr, WARM_PAGES};
+static const translate_set translate_cold = {cold_vaddr, COLD_PAGES};
+static const translate_set translate_bare = {warm_vaddr, WARM_PAGES};
+
+static uint64_t *pte_ptr(riscv_cpu *cpu, uint64_t table, uint64_t index)
+{
+    return (uint64_t *) (cpu->bus.memory.mem + (table - DRAM_BASE)) + index;
+}
+
+static uint64_t alloc_table()
+{
+    uint64_t table = pt_next;
+    pt_next += 1UL << PAGE_SHIFT;
+    return table;
+}
+
+static void map_page(riscv_cpu *cpu, uint64_t root, uint64_t vaddr)
+{
+    uint64_t table = root;
+    for (int level = LEVELS - 1; level > 0; level--) {
+        uint64_t index = (vaddr >> (PAGE_SHIFT + 9 * level)) & 0x1ff;
+        uint64_t *pte = pte_ptr(cpu, table, index);
+        if (!(*pte & PTE_TABLE))
+            *pte = (alloc_table() >> PAGE_SHIFT) << 10 | PTE_TABLE;
+        table = (*pte >> 10) << PAGE_SHIFT;
+    }
+
+    // all the pages are mapped to the first 4 MiB of DRAM
+    uint64_t paddr = DRAM_BASE + (vaddr & 0x3ff000);
+    *pte_ptr(cpu, table, (vaddr >> PAGE_SHIFT) & 0x1ff) =
+        (paddr >> PAGE_SHIFT) << 10 | PTE_LEAF;
+}
+
+static void setup_paging(riscv_cpu *cpu, const void *arg)
+{
+    if (arg == &translate_bare) {
+        cpu->mode.mode = MACHINE;
+        write_csr(&cpu->csr, SATP, 0);
+        for (size_t i = 0; i < WARM_PAGES; i++)
+            warm_vaddr[i] = DRAM_BASE + (i << PAGE_SHIFT);
+        return;
+    }
+
+    memset(cpu->bus.memory.mem + (PT_BASE - DRAM_BASE), 0,
+           PT_PAGES << PAGE_SHIFT);
+    pt_next = PT_BASE;
+    uint64_t root = alloc_table();
+
+    for (size_t i = 0; i < WARM_PAGES; i++) {
+        warm_vaddr[i] = (i << PAGE_SHIFT) | 0x123;
+        map_page(cpu, root, warm_vaddr[i]);
+    }
+    for (size_t i = 0; i < COLD_PAGES; i++) {
+        cold_vaddr[i] = COLD_STRIDE * i + (1UL << PAGE_SHIFT);
+        map_page(cpu, root, cold_vaddr[i]);
+    }
+    // shuffle the order to defeat the prefetcher of the host
+    srand(1);
+    for (size_t i = COLD_PAGES - 1; i > 0; i--) {
+        size_t j = rand() % (i + 1);
+        uint64_t tmp = cold_vaddr[i];
+        cold_vaddr[i] = cold_vaddr[j];
+        cold_vaddr[j] = tmp;
+    }
+
+    cpu->mode.mode = SUPERVISOR;
+    write_csr(&cpu->csr, SATP, 8UL << 60 | root >> PAGE_SHIFT);
+}
+
+static bool run_translate(riscv_cpu *cpu, const void *arg, uint64_t n)
+{
+    const translate_set *set = arg;
+
+    for (uint64_t i = 0, j = 0; i < n; i++) {
+        sink += translate_cpu(cpu, set->vaddr[j], Access_Load);
+        if (cpu->exc.exception != NoException)
+            return false;
+        if (++j == set->count)
+            j = 0;
+    }
+    return true;
+}
+
+/* bus and mem */
+
+typedef struct {
+    uint64_t addr;
+    uint8_t size;
+    bool write;
+    uint64_t value;
+} bus_access;
+
+#define BUS_READ(a, s) {.addr = (a), .size = (s)}
+#define BUS_WRITE(a, s, v) \
+    {.addr = (a), .size = (s), .write = true, .value = (v)}
+static const bus_access bus_read_dram = BUS_READ(DRAM_BASE + 0x1000, 64);
+static const bus_access bus_read_boot = BUS_READ(BOOT_ROM_BASE, 32);
+static const bus_access bus_read_ctrl = BUS_READ(CTRL_CHECKPOINT, 32);
+static const bus_access bus_read_clint = BUS_READ(CLINT_MTIME, 64);
+static const bus_access bus_read_plic = BUS_READ(PLIC_PRIORITY + 4, 32);
+static const bus_access bus_read_uart = BUS_READ(UART_LCR, 8);
+static const bus_access bus_read_virtio =
+    BUS_READ(VIRTIO_BASE + VIRTIO_MMIO_MAGIC_VALUE, 32);
+static const bus_access bus_write_dram = BUS_WRITE(DRAM_BASE + 0x1000, 64, 1);
+static const bus_access bus_write_ctrl = BUS_WRITE(CTRL_CHECKPOINT, 32, 1);
+static const bus_access bus_write_clint = BUS_WRITE(CLINT_MTIMECMP, 64, -1);
+static const bus_access bus_write_plic = BUS_WRITE(PLIC_PRIORITY + 4, 32, 1);
+static const bus_access bus_write_uart = BUS_WRITE(UART_LCR, 8, 3);
+static const bus_access bus_write_virtio =
+    BUS_WRITE(VIRTIO_BASE + VIRTIO_MMIO_QUEUE_SEL, 32, 0);
+
+static bool run_bus(riscv_cpu *cpu, const void *arg, uint64_t n)
+{
+    const bus_access *a = arg;
+    riscv_exception *exc = &cpu->exc;
+
+    for (uint64_t i = 0; i < n; i++) {
+        if (a->write)
+            write_bus(&cpu->bus, a->addr, a->size, a->value, exc);
+        else
+            sink += read_bus(&cpu->bus, a->addr, a->size, exc);
+        if (exc->exception != NoException)
+            return false;
+    }
+    return true;
+}
+
+static const bus_access mem_read_8 = BUS_READ(DRAM_BASE, 8);
+static const bus_access mem_read_16 = BUS_READ(DRAM_BASE, 16);
+static const bus_access mem_read_32 = BUS_READ(DRAM_BASE, 32);
+static const bus_access mem_read_64 = BUS_READ(DRAM_BASE, 64);
+static const bus_access mem_write_8 = BUS_WRITE(DRAM_BASE, 8, 0);
+static const bus_access mem_write_16 = BUS_WRITE(DRAM_BASE, 16, 0);
+static const bus_access mem_write_32 = BUS_WRITE(DRAM_BASE, 32, 0);
+static const bus_access mem_write_64 = BUS_WRITE(DRAM_BASE, 64, 0);
+
+// access the aligned addresses sequentially in a window of 64 KiB
+static bool run_mem(riscv_cpu *cpu, const void *arg, uint64_t n)
+{
+    const bus_access *a = arg;
+    riscv_mem *mem = &cpu->bus.memory;
+    uint64_t step = a->size >> 3;
+
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t addr = a->addr + ((i * step) & 0xffff);
+        if (a->write)
+            write_mem(mem, addr, a->size, i, &cpu->exc);
+        else
+            sink += read_mem(mem, addr, a->size, &cpu->exc);
+    }
+    return cpu->exc.exception == NoException;
+}
+
+/* icache */
+
+#ifdef ICACHE_CONFIG
+// the hit case cycles through the ways of a set, and the miss case through more
+#define ICACHE_HIT_ADDRS CACHE_WAY_CNT
+#define ICACHE_MISS_ADDRS (CACHE_WAY_CNT * 4)
+// the addresses which are mapped to the same set
+#define ICACHE_ADDR(i) (DRAM_BASE + ((uint64_t) (i) << (1 + CACHE_INDEX_BIT)))
+
+static const int icache_hit = ICACHE_HIT_ADDRS;
+static const int icache_miss = ICACHE_MISS_ADDRS;
+
+static void setup_icache(riscv_cpu *cpu,
+                         __attribute__((unused)) const void *arg)
+{
+    invalid_icache(&cpu->icache);
+    for (int i = 0; i < ICACHE_HIT_ADDRS; i++)
+        write_icache(&cpu->icache, ICACHE_ADDR(i), cpu->instr);
+}
+
+// a miss is followed by the fill as tick_cpu does after decoding
+static bool run_icache(riscv_cpu *cpu, const void *arg, uint64_t n)
+{
+    int count = *(const int *) arg;
+
+    for (uint64_t i = 0, j = 0; i < n; i++) {
+        uint64_t addr = ICACHE_ADDR(j);
+        riscv_instr *instr = read_icache(&cpu->icache, addr);
+        if (instr)
+            sink += instr->instr;
+        else
+            write_icache(&cpu->icache, addr, cpu->instr);
+        if (++j == (uint64_t) count)
+            j = 0;
+    }
+    return true;
+}
+#endif
+
+static const micro_case cases[] = {
+    {"decode", "alu", run_decode, &decode_alu, NULL},
+    {"decode", "mem", run_decode, &decode_mem, NULL},
+    {"decode", "branch", run_decode, &decode_branch, NULL},
+    {"decode", "compressed", run_decode, &decode_compressed, NULL},
+    {"decode", "vector", run_decode, &decode_vector, NULL},
+    {"translate", "bare", run_translate, &translate_bare, setup_paging},
+    {"translate", "warm", run_translate, &translate_warm, setup_paging},
+    {"translate", "cold", run_translate, &translate_cold, setup_paging},
+    {"bus", "read-dram", run_bus, &bus_read_dram, NULL},
+    {"bus", "read-boot", run_bus, &bus_read_boot, NULL},
+    {"bus", "read-ctrl", run_bus, &bus_read_ctrl, NULL},
+    {"bus", "read-clint", run_bus, &bus_read_clint, NULL},
+    {"bus", "read-plic", run_bus, &bus_read_plic, NULL},
+    {"bus", "read-uart", run_bus, &bus_read_uart, NULL},
+    {"bus", "read-virtio", run_bus, &bus_read_virtio, NULL},
+    {"bus", "write-dram", run_bus, &bus_write_dram, NULL},
+    {"bus", "write-ctrl", run_bus, &bus_write_ctrl, NULL},
+    {"bus", "write-clint", run_bus, &bus_write_clint, NULL},
+    {"bus", "write-plic", run_bus, &bus_write_plic, NULL},
+    {"bus", "write-uart", run_bus, &bus_write_uart, NULL},
+    {"bus", "write-virtio", run_bus, &bus_write_virtio, NULL},
+    {"mem", "read-8", run_mem, &mem_read_8, NULL},
+    {"mem", "read-16", run_mem, &mem_read_16, NULL},
+    {"mem", "read-32", run_mem, &mem_read_32, NULL},
+    {"mem", "read-64", run_mem, &mem_read_64, NULL},
+    {"mem", "write-8", run_mem, &mem_write_8, NULL},
+    {"mem", "write-16", run_mem, &mem_write_16, NULL},
+    {"mem", "write-32", run_mem, &mem_write_32, NULL},
+    {"mem", "write-64", run_mem, &mem_write_64, NULL},
+#ifdef ICACHE_CONFIG
+    {"icache", "hit", run_icache, &icache_hit, setup_icache},
+    {"icache", "miss", run_icache, &icache_miss, setup_icache},
+#endif
+};
+
+static bool run_case(riscv_cpu *cpu, const micro_case *c)
+{
+    double ns[MICRO_REPEAT];
+
+    if (c->setup)
+        c->setup(cpu, c->arg);
+    cpu->exc.exception = NoException;
+
+    for (int i = 0; i < MICRO_WARMUP + MICRO_REPEAT; i++) {
+        double start = now_ns();
+        bool ok = c->run(cpu, c->arg, MICRO_OPS);
+        double end = now_ns();
+        if (!ok) {
+            ERROR("%s %s: failed with exception %d\n", c->component, c->name,
+                  cpu->exc.exception);
+            cpu->exc.exception = NoException;
+            return false;
+        }
+        if (i >= MICRO_WARMUP)
+            ns[i - MICRO_WARMUP] = (end - start) / MICRO_OPS;
+    }
+
+    qsort(ns, MICRO_REPEAT, sizeof(double), cmp_double);
+    double mean = 0, var = 0;
+    for (int i = 0; i < MICRO_REPEAT; i++)
+        mean += ns[i] / MICRO_REPEAT;
+    for (int i = 0; i < MICRO_REPEAT; i++)
+        var += (ns[i] - mean) * (ns[i] - mean) / MICRO_REPEAT;
+
+    printf("%-10s %-13s %10.2f %10.2f %10.2f %10.2f\n", c->component, c->name,
+           ns[0], ns[MICRO_REPEAT / 2], mean, sqrt(var));
+    fflush(stdout);
+    return true;
+}
+
+static bool selected(const micro_case *c, int argc, char *argv[])
+{
+    if (argc <= 1)
+        return true;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], c->component))
+            return true;
+    }
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    riscv_config config = {
+        .binary = "",
+        .rfs_name = "",
+        .initrd = "",
+        .snapshot = "",
+        .restore = "",
+        .checkpoint = "",
+        .fork_server = "",
+    };
+
+    riscv_cpu *cpu = calloc(1, sizeof(riscv_cpu));
+    if (!cpu || !init_cpu(cpu, &config)) {
+        ERROR("Failed to initialize the CPU\n");
+        return 1;
+    }
+
+#ifndef ICACHE_CONFIG
+    ERROR("icache is skipped, which is enabled by ICACHE=1\n");
+#endif
+
+    int failed = 0;
+    printf("%-10s %-13s %10s %10s %10s %10s\n", "component", "case",
+           "min ns/op", "median", "mean", "stddev");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (selected(&cases[i], argc, argv))
+            failed += !run_case(cpu, &cases[i]);
+    }
+
+    free_cpu(cpu);
+    free(cpu);
+    return failed;
+}
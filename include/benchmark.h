@@ -0,0 +1,20 @@
+#ifndef RISCV_BENCHMARK
+#define RISCV_BENCHMARK
+
+/* The built-in benchmark runs a fixed set of workloads, which are the boot of
+ * xv6 to the shell and the pre-built programs in bench/, so no cross toolchain
+ * is needed. The paths are relative to the top of the tree.
+ *
+ * The result of each workload is printed in a line of stable columns:
+ *
+ *   workload       seconds     instructions       MIPS  result
+ *   xv6-boot         2.345        123456789     52.650  ok
+ */
+
+// a workload which runs more instructions than this is failed
+#define BENCH_INSN_LIMIT 2000000000UL
+
+// Return the number of the failed workloads.
+int run_benchmark(void);
+
+#endif
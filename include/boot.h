@@ -4,14 +4,20 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "config.h"
 #include "exception.h"
 
+// the device tree is placed right after the reset vector in the boot ROM
+#define BOOT_FDT_OFFSET 0x20
+
 typedef struct {
     uint8_t *boot_mem;
     size_t boot_mem_size;
 } riscv_boot;
 
-bool init_boot(riscv_boot *boot, uint64_t entry_addr);
+bool init_boot(riscv_boot *boot,
+               uint64_t entry_addr,
+               const riscv_config *config);
 uint64_t read_boot(riscv_boot *boot,
                    uint64_t addr,
                    uint64_t size,
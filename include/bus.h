@@ -3,11 +3,26 @@
 
 #include "boot.h"
 #include "clint.h"
+#include "ctrl.h"
+#include "htif.h"
 #include "memory.h"
 #include "plic.h"
 #include "uart.h"
 #include "virtio_blk.h"
 
+/* The devices on the bus, whose accesses are counted for the statistics.
+ * BUS_HOST is the MMIO handled by the callbacks of the host. */
+typedef enum {
+    BUS_CTRL,
+    BUS_CLINT,
+    BUS_PLIC,
+    BUS_UART,
+    BUS_VIRTIO,
+    BUS_BOOT,
+    BUS_HOST,
+    BUS_DEVICE_COUNT,
+} riscv_bus_device;
+
 typedef struct {
     riscv_mem memory;
     riscv_clint clint;
@@ -15,9 +30,24 @@ typedef struct {
     riscv_uart uart;
     riscv_virtio_blk virtio_blk;
     riscv_boot boot;
+    riscv_ctrl ctrl;
+    riscv_htif htif;
+    riscv_callbacks callbacks;
+    uint64_t mmio_reads[BUS_DEVICE_COUNT];
+    uint64_t mmio_writes[BUS_DEVICE_COUNT];
 } riscv_bus;
 
-bool init_bus(riscv_bus *bus, const char *filename, const char *rfs_name);
+/* Called after DRAM is written without going through the bus, so the stores
+ * to the locations watched by the devices, i.e. .tohost, are still seen. */
+static inline void notify_dram_write(riscv_bus *bus,
+                                     uint64_t addr,
+                                     uint64_t len)
+{
+    if (htif_is_tohost(&bus->htif, addr, len))
+        handle_htif(&bus->htif, &bus->memory, &bus->callbacks);
+}
+
+bool init_bus(riscv_bus *bus, const riscv_config *config);
 uint64_t read_bus(riscv_bus *bus,
                   uint64_t addr,
                   uint8_t size,
@@ -27,6 +57,6 @@ bool write_bus(riscv_bus *bus,
                uint8_t size,
                uint64_t value,
                riscv_exception *exc);
-void tick_bus(riscv_bus *bus, riscv_csr *csr);
+void tick_bus(riscv_bus *bus, riscv_csr *csr, uint64_t ticks);
 void free_bus(riscv_bus *bus);
 #endif
@@ -36,5 +36,5 @@ bool write_clint(riscv_clint *clint,
                  uint8_t size,
                  uint64_t value,
                  riscv_exception *exc);
-void tick_clint(riscv_clint *clint, riscv_csr *csr);
+void tick_clint(riscv_clint *clint, riscv_csr *csr, uint64_t ticks);
 #endif
@@ -3,7 +3,6 @@
 
 #include "log.h"
 
-#define DTB_FILENAME "emu.dtb"
 #define ERROR(...) fprintf(stderr, __VA_ARGS__)
 
 #endif
@@ -0,0 +1,101 @@
+#ifndef RISCV_CONFIG
+#define RISCV_CONFIG
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The reason why the machine stops running */
+typedef enum {
+    // not stopped yet, e.g. the budget of instructions is used up
+    EMU_RUNNING,
+    // the guest shuts down the machine, e.g. through SBI
+    EMU_SHUTDOWN,
+    // the guest hits a fatal trap
+    EMU_TRAP,
+} riscv_emu_state;
+
+/* The source of mtime and the time CSR, see timebase.h */
+typedef enum {
+    // one tick per instruction, which is deterministic
+    TIMEBASE_INSTRET,
+    // the monotonic clock of the host scaled to the timebase-frequency
+    TIMEBASE_HOST,
+} riscv_timebase_mode;
+
+/* The callbacks to the host which embeds the emulator. Each of them is
+ * optional, and receives opaque as the first argument. */
+typedef struct {
+    void *opaque;
+    /* The access to the address which belongs to no device. Return false to
+     * raise the access fault as usual. */
+    bool (*mmio_read)(void *opaque,
+                      uint64_t addr,
+                      uint8_t size,
+                      uint64_t *value);
+    bool (*mmio_write)(void *opaque,
+                       uint64_t addr,
+                       uint8_t size,
+                       uint64_t value);
+    // the character sent by UART, which is printed to stdout by default
+    void (*uart_tx)(void *opaque, char c);
+    // the machine stops running
+    void (*exit)(void *opaque, riscv_emu_state state);
+} riscv_callbacks;
+
+/* The options to create an emulator, which are given by the command line or
+ * the host which embeds the emulator. Each path is an empty string or NULL if
+ * the file isn't provided, and it should be valid until the emulator is
+ * freed. */
+typedef struct {
+    // the binary to run, which is a Linux Image if sbi is set
+    const char *binary;
+    const char *rfs_name;
+    const char *initrd;
+    /* boot the binary in S-mode directly, the SBI calls are serviced by the
+     * emulator instead of the M-mode firmware */
+    bool sbi;
+    // the file to save the snapshot when it is requested
+    const char *snapshot;
+    // resume from the snapshot instead of booting the binary
+    const char *restore;
+    /* the prefix of the periodic checkpoints, which are saved as <prefix>.0,
+     * <prefix>.1, ... every checkpoint_interval instructions */
+    const char *checkpoint;
+    uint64_t checkpoint_interval;
+    // the socket of the fork server, which accepts the jobs at the checkpoint
+    const char *fork_server;
+    /* run the binary as a static Linux program by the user-mode emulation with
+     * the NULL-terminated arguments and environment, see user.h. The default
+     * arguments are the binary itself. */
+    bool user;
+    char *const *user_argv;
+    char *const *user_envp;
+    /* write the profile sampled every profile_interval instructions to the
+     * file when the emulator is freed, see profiler.h. The symbols are taken
+     * from the binary and the NULL-terminated extra ELF files. */
+    const char *profile;
+    uint64_t profile_interval;
+    char *const *profile_symbols;
+    // write the instruction mix to the file when the emulator is freed
+    const char *instr_stats;
+    /* append the statistics of the emulator to the file as JSON when it is
+     * freed, and also every stats_interval instructions unless it is 0, see
+     * stats.h */
+    const char *stats;
+    uint64_t stats_interval;
+    /* record the execution to the file by the tracer, see tracer.h. It is
+     * enabled when trace_start instructions are executed by run_emu, and
+     * could be toggled by trace_emu at any time. */
+    const char *trace;
+    uint64_t trace_start;
+    /* record the input from the host to the file, or replay the input
+     * recorded in the file instead of reading stdin, see replay.h */
+    const char *record;
+    const char *replay;
+    riscv_timebase_mode timebase;
+    // UART takes the input from stdin by a thread
+    bool console;
+    riscv_callbacks callbacks;
+} riscv_config;
+
+#endif
@@ -2,11 +2,31 @@
 #define RISCV_CPU
 
 #include "bus.h"
+#include "config.h"
 #include "csr.h"
 #include "exception.h"
 #include "icache.h"
+#include "instr_stats.h"
 #include "irq.h"
 #include "pte.h"
+#include "sbi.h"
+#include "stats.h"
+#include "timebase.h"
+#include "tracer.h"
+#include "user.h"
+#include "vector.h"
+
+/* The size of cache block in bytes for the cache-block operations, which could
+ * be changed by `make CBO_BLOCK_SIZE=...`. It should be a power of 2 and no
+ * larger than a page. */
+#ifndef CBO_BLOCK_SIZE
+#define CBO_BLOCK_SIZE 64
+#endif
+
+#if (CBO_BLOCK_SIZE <= 0) || (CBO_BLOCK_SIZE > 4096) || \
+    (CBO_BLOCK_SIZE & (CBO_BLOCK_SIZE - 1))
+#error "CBO_BLOCK_SIZE should be a power of 2 no larger than 4096"
+#endif
 
 typedef enum access Access;
 enum access { Access_Instr, Access_Load, Access_Store };
@@ -36,15 +56,27 @@ typedef struct CPU {
     riscv_instr instr;
     riscv_bus bus;
     riscv_csr csr;
+    riscv_sbi sbi;
+    riscv_user user;
 #ifdef ICACHE_CONFIG
     riscv_icache icache;
 #endif
+    // the instruction mix, which is only counted if it isn't NULL
+    riscv_instr_stats *instr_stats;
+    riscv_stats stats;
+    // the execution is recorded if it isn't NULL
+    riscv_tracer *tracer;
+    riscv_timebase timebase;
 
     uint64_t xreg[32];
     float64_reg_t freg[32];
+    /* the vector registers are contiguous, so a register group with LMUL > 1
+     * could be accessed as a single array */
+    uint8_t vreg[32 * VREG_SIZE] __attribute__((aligned(32)));
     uint64_t pc;
     // FIXME: we should maintain a reservation set but not a single u64
     uint64_t reservation;
+    riscv_logger *logger;
 } riscv_cpu;
 
 /* the *_S type means a special form of index to map the instruction. You can
@@ -56,9 +88,11 @@ typedef struct {
         FUNC3,
         FUNC4_S,
         FUNC5,
+        FUNC6,
         FUNC6_S,
         FUNC7,
         FUNC7_S,
+        RS1,
         RS2,
         WIDTH,
     } type;
@@ -77,7 +111,19 @@ typedef struct INSTR_ENTRY {
     char *entry_name;
 } riscv_instr_entry;
 
-bool init_cpu(riscv_cpu *cpu, const char *filename, const char *rfs_name);
+bool init_cpu(riscv_cpu *cpu, const riscv_config *config);
 bool tick_cpu(riscv_cpu *cpu);
 void free_cpu(riscv_cpu *cpu);
+
+/* The stages of tick_cpu, which are exposed for the microbenchmarks of the
+ * emulator in bench/micro.c. decode_cpu decodes instr to cpu->instr as if it
+ * is fetched, and translate_cpu translates the virtual address by the current
+ * mode and satp. The fault is reported by cpu->exc. */
+bool decode_cpu(riscv_cpu *cpu, uint32_t instr);
+uint64_t translate_cpu(riscv_cpu *cpu, uint64_t addr, Access access);
+
+/* Read the word in DRAM at the virtual address for the tools which inspect the
+ * guest, e.g. the profiler. It fails instead of raising the exception, and
+ * isn't counted by the performance counters. */
+bool peek_cpu(riscv_cpu *cpu, uint64_t addr, uint64_t *value);
 #endif
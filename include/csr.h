@@ -6,6 +6,15 @@
 
 #define CSR_CAPACITY 0x1000
 
+// Vector start position.
+#define VSTART 0x008
+// Fixed-point accrued saturation flag.
+#define VXSAT 0x009
+// Fixed-point rounding mode.
+#define VXRM 0x00a
+// Vector control and status register.
+#define VCSR 0x00f
+
 // Supervisor status register.
 #define SSTATUS 0x100
 // Supervisor exception delegation register.
@@ -18,6 +27,8 @@
 #define STVEC 0x105
 // Counter-Enable register.
 #define SCOUNTEREN 0x106
+// Supervisor environment configuration register.
+#define SENVCFG 0x10a
 /// Scratch register for supervisor trap handlers.
 #define SSCRATCH 0x140
 /// Supervisor exception program counter.
@@ -28,6 +39,8 @@
 #define STVAL 0x143
 // Supervisor interrupt pending.
 #define SIP 0x144
+// Supervisor timer compare (Sstc).
+#define STIMECMP 0x14d
 // Supervisor address translation and protection.
 #define SATP 0x180
 
@@ -45,6 +58,13 @@
 #define MISA 0x301
 // Machine counter enable.
 #define MCOUNTEREN 0x306
+// Machine environment configuration register.
+#define MENVCFG 0x30a
+// Machine counter-inhibit register.
+#define MCOUNTINHIBIT 0x320
+// Machine performance-monitoring event selectors.
+#define MHPMEVENT3 0x323
+#define MHPMEVENT31 0x33f
 // Scratch register for machine trap handlers.
 #define MSCRATCH 0x340
 // Machine exception program counter.
@@ -66,6 +86,14 @@
 #define PMPADDR2 0x3b2
 #define PMPADDR3 0x3b3
 
+// Machine cycle counter.
+#define MCYCLE 0xb00
+// Machine instructions-retired counter.
+#define MINSTRET 0xb02
+// Machine performance-monitoring counters.
+#define MHPMCOUNTER3 0xb03
+#define MHPMCOUNTER31 0xb1f
+
 // Cycle counter for RDCYCLE instruction.
 #define CYCLE 0xc00
 /* FIXME:
@@ -73,6 +101,17 @@
  * 2. should we invalid write for this register? */
 // Timer for RDTIME instruction.
 #define TIME 0xc01
+// Instructions-retired counter for RDINSTRET instruction.
+#define INSTRET 0xc02
+// Performance-monitoring counters.
+#define HPMCOUNTER3 0xc03
+#define HPMCOUNTER31 0xc1f
+// Vector length.
+#define VL 0xc20
+// Vector data type register.
+#define VTYPE 0xc21
+// VLEN/8 (vector register length in bytes).
+#define VLENB 0xc22
 
 // SSTATUS fields
 #define SSTATUS_UIE 0x1UL
@@ -80,6 +119,7 @@
 #define SSTATUS_UPIE 0x10UL
 #define SSTATUS_SPIE 0x20UL
 #define SSTATUS_SPP 0x100UL
+#define SSTATUS_VS 0x600UL
 #define SSTATUS_FS 0x6000UL
 #define SSTATUS_XS 0x18000UL
 #define SSTATUS_SUM 0x40000UL
@@ -87,10 +127,11 @@
 #define SSTATUS_UXL 0x300000000UL
 #define SSTATUS_UXL_64BIT 0x200000000UL
 #define SSTATUS_VISIBLE                                                   \
-    (SSTATUS_SIE | SSTATUS_SPIE | SSTATUS_SPP | SSTATUS_FS | SSTATUS_XS | \
-     SSTATUS_SUM | SSTATUS_MXR | SSTATUS_UXL)
-#define SSTATUS_WRITABLE \
-    (SSTATUS_SIE | SSTATUS_SPIE | SSTATUS_SPP | SSTATUS_SUM | SSTATUS_MXR)
+    (SSTATUS_SIE | SSTATUS_SPIE | SSTATUS_VS | SSTATUS_SPP | SSTATUS_FS | \
+     SSTATUS_XS | SSTATUS_SUM | SSTATUS_MXR | SSTATUS_UXL)
+#define SSTATUS_WRITABLE                                                  \
+    (SSTATUS_SIE | SSTATUS_SPIE | SSTATUS_VS | SSTATUS_SPP | SSTATUS_SUM | \
+     SSTATUS_MXR)
 
 
 // MSTATUS fields
@@ -119,6 +160,19 @@
 // All bits besides SSIP, USIP, and UEIP in the sip register are read-only
 #define SIP_WRITABLE (SIP_SSIP | SIP_USIP | SIP_UEIP)
 
+// MENVCFG / SENVCFG fields
+#define MENVCFG_CBIE 0x30UL
+#define MENVCFG_CBCFE 0x40UL
+#define MENVCFG_CBZE 0x80UL
+#define MENVCFG_STCE (1UL << 63)
+
+/* The bits of the counters in mcounteren, scounteren and mcountinhibit, where
+ * the bit of hpmcounter<n> is n */
+#define COUNTER_CY 0x1UL
+#define COUNTER_TM 0x2UL
+#define COUNTER_IR 0x4UL
+#define COUNTER_HPM 0xfffffff8UL
+
 // SATP fields
 #define SATP_PPN 0xfffffffffffUL
 
@@ -140,13 +194,43 @@
 /* macro for checking csr bit(single bit only) */
 #define check_csr_bit(csr, reg, mask) (!!((read_csr(csr, reg) & mask)))
 
+/* The events counted by mhpmcounter3 - 31, one of which is selected by writing
+ * it to the corresponding mhpmevent. The others don't count anything. */
+typedef enum {
+    HPM_NONE,
+    /* the address translations which walk the page tables. There is no TLB
+     * in the emulator, so each of them is also a TLB miss. */
+    HPM_PAGE_WALK,
+    // the exceptions taken, including the environment calls
+    HPM_EXCEPTION,
+    HPM_INTERRUPT,
+    // the loads and stores which access the devices, i.e. outside DRAM
+    HPM_MMIO,
+    // the instructions which miss in the instruction cache (ICACHE=1)
+    HPM_ICACHE_MISS,
+    HPM_EVENT_COUNT,
+} hpm_event;
+
 typedef struct {
     uint64_t reg[CSR_CAPACITY];
+    /* the bitmask of the counters which select each event, so an event is
+     * counted without looking up all the mhpmevent registers */
+    uint32_t hpm_counters[HPM_EVENT_COUNT];
 } riscv_csr;
 
+static inline void count_hpm(riscv_csr *csr, hpm_event event)
+{
+    uint32_t counters = csr->hpm_counters[event] & ~csr->reg[MCOUNTINHIBIT];
+    while (counters) {
+        csr->reg[MHPMCOUNTER3 - 3 + __builtin_ctz(counters)]++;
+        counters &= counters - 1;
+    }
+}
+
 bool init_csr(riscv_csr *csr);
 uint64_t read_csr(riscv_csr *csr, uint16_t addr);
 void write_csr(riscv_csr *csr, uint16_t addr, uint64_t value);
-void tick_csr(riscv_csr *csr);
+// advance time by the ticks and the cycle counter by one
+void tick_csr(riscv_csr *csr, uint64_t ticks);
 
 #endif
@@ -0,0 +1,32 @@
+#ifndef RISCV_CTRL
+#define RISCV_CTRL
+
+/* The control device lets the guest talk to the emulator itself. It doesn't
+ * exist on real hardware, so the guest should only use it when it knows it is
+ * run by this emulator. */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "exception.h"
+#include "memmap.h"
+
+/* Writing any value marks the checkpoint, where the fork server starts to
+ * accept the jobs. It is ignored if the emulator isn't a fork server. */
+#define CTRL_CHECKPOINT (CTRL_BASE + 0x0)
+
+typedef struct {
+    bool checkpoint;
+} riscv_ctrl;
+
+uint64_t read_ctrl(riscv_ctrl *ctrl,
+                   uint64_t addr,
+                   uint8_t size,
+                   riscv_exception *exc);
+bool write_ctrl(riscv_ctrl *ctrl,
+                uint64_t addr,
+                uint8_t size,
+                uint64_t value,
+                riscv_exception *exc);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef RISCV_DIRTY
+#define RISCV_DIRTY
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The bitmap of the pages written since the last checkpoint, one bit for each
+ * page. It is NULL if nobody is tracking, and the marking is skipped. */
+
+#define DIRTY_PAGE_SHIFT 12
+#define DIRTY_PAGE_SIZE (1UL << DIRTY_PAGE_SHIFT)
+// the number of words in the bitmap of a region
+#define DIRTY_WORDS(size) \
+    ((((size) + DIRTY_PAGE_SIZE - 1) >> DIRTY_PAGE_SHIFT) / 64 + 1)
+
+static inline void mark_dirty(uint64_t *dirty, uint64_t off, uint64_t len)
+{
+    if (!dirty || !len)
+        return;
+
+    uint64_t last = (off + len - 1) >> DIRTY_PAGE_SHIFT;
+    for (uint64_t page = off >> DIRTY_PAGE_SHIFT; page <= last; page++)
+        dirty[page >> 6] |= 1UL << (page & 63);
+}
+
+static inline bool test_dirty(const uint64_t *dirty, uint64_t page)
+{
+    return dirty[page >> 6] & (1UL << (page & 63));
+}
+
+#endif
@@ -1,5 +1,12 @@
 #ifndef DTB_H
 #define DTB_H
 
-bool make_dtb(const char *dtb_filename);
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/* Generate the device tree blob of the machine, which is allocated by malloc.
+ * Return NULL on failure. */
+uint8_t *make_dtb(const riscv_config *config, size_t *size);
 #endif
@@ -22,9 +22,31 @@ struct elf {
     size_t sz;
 };
 
+typedef struct {
+    uint64_t addr;
+    // 0 if the size is unknown, e.g. a label in assembly
+    uint64_t size;
+    char *name;
+} elf_symbol_t;
+
+/* The code symbols of one or more ELF files sorted by their addresses, which
+ * could be looked up by the address after the files are closed. */
+typedef struct {
+    elf_symbol_t *symbols;
+    size_t count;
+    size_t capacity;
+} elf_symtab_t;
+
 int elf_init(elf_t *elf, uint8_t *data, size_t sz);
 int elf_lookup_shdr(elf_t *elf, char *name, Elf64_Shdr **output_sec_header);
 int elf_lookup_symbol(elf_t *elf, char *symbol, Elf64_Sym **sym);
+/* Add the code symbols of the ELF to the index, whose addresses are moved by
+ * bias, e.g. the base where a PIE is loaded. */
+int elf_symtab_add(elf_symtab_t *symtab, elf_t *elf, uint64_t bias);
+// the symbol which covers the address, or NULL if there is none
+const elf_symbol_t *elf_lookup_address(const elf_symtab_t *symtab,
+                                       uint64_t addr);
+void elf_symtab_free(elf_symtab_t *symtab);
 uint64_t elf_e_entry(elf_t *elf);
 void elf_phdr_iter_start(phdr_iter_t *it, uint32_t p_type);
 int elf_phdr_iter_next(elf_t *elf,
@@ -2,12 +2,62 @@
 #define RISCV_EMU
 
 #include "common.h"
+#include "config.h"
 
+/* The emulator could be embedded as the library libriscvemu. Each instance is
+ * independent of the others, so many of them could be run in one process, but
+ * an instance should only be used by one thread at a time. */
 typedef struct Emu riscv_emu;
 
-riscv_emu *create_emu(const char *filename, const char *rfs_name);
-void run_emu(riscv_emu *emu);
-int test_emu(riscv_emu *emu);
+riscv_emu *create_emu(const riscv_config *config);
+/* Run until the machine stops. The snapshot, checkpoints and fork server given
+ * by the config are served here. */
+riscv_emu_state run_emu(riscv_emu *emu);
+/* Run at most budget instructions, and return EMU_RUNNING if the machine could
+ * keep running. Once the machine stops, the same state is always returned. */
+riscv_emu_state run_emu_for(riscv_emu *emu, uint64_t budget);
+riscv_emu_state step_emu(riscv_emu *emu);
+
+// the instructions executed by run_emu, run_emu_for and test_emu
+uint64_t get_instret_emu(riscv_emu *emu);
+uint64_t get_reg_emu(riscv_emu *emu, int reg);
+void set_reg_emu(riscv_emu *emu, int reg, uint64_t value);
+uint64_t get_pc_emu(riscv_emu *emu);
+void set_pc_emu(riscv_emu *emu, uint64_t pc);
+/* Access DRAM by the physical address, which fails if the range isn't entirely
+ * in DRAM. */
+bool read_mem_emu(riscv_emu *emu, uint64_t addr, void *buf, uint64_t len);
+bool write_mem_emu(riscv_emu *emu,
+                   uint64_t addr,
+                   const void *buf,
+                   uint64_t len);
+
+/* Ask the running emulator to save the snapshot at the next instruction
+ * boundary, which is safe to call from a signal handler. */
+void request_snapshot_emu(riscv_emu *emu);
+/* Enable or disable the tracer given by the config between the instructions,
+ * which fails if there is no tracer. */
+bool trace_emu(riscv_emu *emu, bool enable);
+/* Write the statistics given by the config, which are also written when the
+ * emulator is freed. request_stats_emu asks the running emulator to write them
+ * at the next instruction boundary, which is safe to call from a signal
+ * handler. */
+void request_stats_emu(riscv_emu *emu);
+void write_stats_emu(riscv_emu *emu);
+/* Ask run_emu to return EMU_RUNNING at the next instruction boundary, which is
+ * also safe to call from a signal handler. */
+void request_stop_emu(riscv_emu *emu);
+bool snapshot_emu(riscv_emu *emu, const char *filename);
+bool restore_emu(riscv_emu *emu, const char *filename);
+/* The exit code of the program which exits by the user-mode emulation or HTIF,
+ * or -1 if the machine stops by a fatal trap. */
+int exit_code_emu(riscv_emu *emu);
+/* Run a riscv-tests program until it exits through HTIF, and return the exit
+ * code which is 0 if it passes, or the number of the failed case otherwise.
+ * It fails with -1 if the machine stops before, or it doesn't finish in limit
+ * instructions unless limit is 0. The instructions executed are returned by
+ * steps if it isn't NULL. */
+int test_emu(riscv_emu *emu, uint64_t limit, uint64_t *steps);
 int take_signature_emu(riscv_emu *emu, char *signature_out_file);
 void free_emu(riscv_emu *emu);
 
@@ -0,0 +1,51 @@
+#ifndef RISCV_FDT
+#define RISCV_FDT
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A minimal writer of flattened device tree (DTB) blob.
+ *
+ * Reference: https://github.com/devicetree-org/devicetree-specification
+ *
+ * The nodes and properties are appended to the structure block in order, and
+ * the property names are collected to the strings block. Any allocation
+ * failure is recorded and reported by fdt_finish, so the callers don't need to
+ * check each step. */
+
+#define FDT_MAGIC 0xd00dfeed
+#define FDT_VERSION 17
+#define FDT_LAST_COMP_VERSION 16
+
+#define FDT_BEGIN_NODE 0x1
+#define FDT_END_NODE 0x2
+#define FDT_PROP 0x3
+#define FDT_END 0x9
+
+typedef struct {
+    uint8_t *dt_struct;
+    size_t struct_size;
+    size_t struct_cap;
+    char *strings;
+    size_t strings_size;
+    size_t strings_cap;
+    bool error;
+} fdt_writer;
+
+void fdt_init(fdt_writer *fdt);
+void fdt_begin_node(fdt_writer *fdt, const char *name);
+void fdt_end_node(fdt_writer *fdt);
+void fdt_prop(fdt_writer *fdt, const char *name, const void *data, size_t len);
+void fdt_prop_empty(fdt_writer *fdt, const char *name);
+void fdt_prop_string(fdt_writer *fdt, const char *name, const char *str);
+void fdt_prop_u32(fdt_writer *fdt, const char *name, uint32_t value);
+void fdt_prop_cells(fdt_writer *fdt,
+                    const char *name,
+                    const uint32_t *cells,
+                    size_t n);
+/* Return the blob allocated by malloc, or NULL if any step fails. The writer
+ * is released in both cases. */
+uint8_t *fdt_finish(fdt_writer *fdt, size_t *size);
+
+#endif
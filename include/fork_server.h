@@ -0,0 +1,22 @@
+#ifndef RISCV_FORK_SERVER
+#define RISCV_FORK_SERVER
+
+#include <stdbool.h>
+
+#include "cpu.h"
+
+/* The fork server boots the guest once, and then runs a copy of the machine
+ * for each job from the checkpoint, which is marked by the guest through the
+ * control device.
+ *
+ * After the checkpoint, it listens on a Unix stream socket. A child is forked
+ * for each connection, which inherits the machine by copy-on-write, and the
+ * connection becomes the UART of the child: the guest receives the input from
+ * the client, and its output is sent back. The connection is closed when the
+ * child exits, e.g. the guest shuts down. */
+
+/* Return true in the child, which should continue to run the machine. The
+ * server itself only returns false when it fails to serve. */
+bool serve_fork(riscv_cpu *cpu, const char *path);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef RISCV_HTIF
+#define RISCV_HTIF
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "memory.h"
+
+/* The host-target interface used by riscv-tests and the proxy kernel. The
+ * binary talks to the host by storing a command to .tohost:
+ *
+ *   device (63:56) | command (55:48) | payload (47:0)
+ *
+ * - device 0, command 0: if the payload is odd, exit with code payload >> 1.
+ *   Otherwise the payload points to the syscall arguments, which are 8 words
+ *   of number and arguments, and the result is written back to the first one.
+ * - device 1, command 1: print the character in the low 8 bits.
+ *
+ * The command is handled when the store to .tohost finishes, i.e. it writes
+ * the last byte of .tohost, so the 32-bit halves written by riscv-tests are
+ * seen as a whole. The host then clears .tohost and sets .fromhost. */
+
+#define HTIF_SIZE 8
+
+typedef struct {
+    // the addresses of .tohost and .fromhost, 0 if the binary has none
+    uint64_t tohost;
+    uint64_t fromhost;
+    // the binary has asked to exit with the code
+    bool exited;
+    uint64_t exit_code;
+} riscv_htif;
+
+void init_htif(riscv_htif *htif, uint64_t tohost, uint64_t fromhost);
+
+// whether the store to DRAM of len bytes finishes a command
+static inline bool htif_is_tohost(const riscv_htif *htif,
+                                  uint64_t addr,
+                                  uint64_t len)
+{
+    uint64_t last = htif->tohost + HTIF_SIZE - 1;
+    return htif->tohost && addr <= last && addr + len > last;
+}
+
+void handle_htif(riscv_htif *htif,
+                 riscv_mem *mem,
+                 const riscv_callbacks *callbacks);
+
+#endif
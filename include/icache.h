@@ -26,6 +26,10 @@ typedef struct {
 
 typedef struct {
     riscv_icache_set set[CACHE_SET_CNT];
+    // the lookups and the invalidations for the statistics
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t flushes;
 } riscv_icache;
 
 bool init_icache(riscv_icache *icache);
@@ -23,6 +23,8 @@ typedef struct {
     uint8_t funct7;
 
     void (*exec_func)(riscv_cpu *cpu);
+    // the name of the entry in the decode table
+    const char *name;
 } riscv_instr;
 
 void R_decode(riscv_instr *instr);
@@ -44,5 +46,6 @@ void CB_decode(riscv_instr *instr);
 void CA_decode(riscv_instr *instr);
 void CR_decode(riscv_instr *instr);
 void FS_decode(riscv_instr *instr);
+void V_decode(riscv_instr *instr);
 
 #endif
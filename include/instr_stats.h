@@ -0,0 +1,57 @@
+#ifndef RISCV_INSTR_STATS
+#define RISCV_INSTR_STATS
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The instruction mix counts the instructions executed by the name of their
+ * entries in the decode table, e.g. "ADDI", for each privilege mode. Each
+ * entry name is a distinct string literal, so the pointer is the key of the
+ * open addressing table. */
+
+// the table is much larger than the number of instructions
+#define INSTR_STATS_BITS 11
+#define INSTR_STATS_SIZE (1 << INSTR_STATS_BITS)
+/* the entries inserted at most, so the probing always reaches an empty slot,
+ * and the instructions beyond them are counted as the overflow */
+#define INSTR_STATS_MAX (INSTR_STATS_SIZE * 3 / 4)
+
+typedef struct {
+    const char *name;
+    // indexed by the privilege mode
+    uint64_t count[4];
+} riscv_instr_count;
+
+typedef struct {
+    riscv_instr_count table[INSTR_STATS_SIZE];
+    uint32_t used;
+    riscv_instr_count overflow;
+} riscv_instr_stats;
+
+riscv_instr_stats *create_instr_stats(void);
+// the instructions are sorted by the times executed in all modes
+bool write_instr_stats(const riscv_instr_stats *stats, const char *filename);
+void free_instr_stats(riscv_instr_stats *stats);
+
+static inline void count_instr(riscv_instr_stats *stats,
+                               const char *name,
+                               uint8_t mode)
+{
+    // Fibonacci hashing of the pointer
+    uint64_t hash = (uintptr_t) name * 0x9e3779b97f4a7c15UL;
+    uint64_t i = hash >> (64 - INSTR_STATS_BITS);
+    while (stats->table[i].name != name && stats->table[i].name)
+        i = (i + 1) & (INSTR_STATS_SIZE - 1);
+
+    if (!stats->table[i].name) {
+        if (stats->used == INSTR_STATS_MAX) {
+            stats->overflow.count[mode & 0x3]++;
+            return;
+        }
+        stats->table[i].name = name;
+        stats->used++;
+    }
+    stats->table[i].count[mode & 0x3]++;
+}
+
+#endif
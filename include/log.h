@@ -5,13 +5,17 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+/* Each emulator has its own logger, which only exists in the DEBUG build and
+ * is NULL otherwise. */
+typedef struct logger riscv_logger;
+
 #ifdef DEBUG
-#define LOG_DEBUG(format, ...) log_debug(format, ##__VA_ARGS__)
-void log_debug(const char *format, ...);
+#define LOG_DEBUG(logger, format, ...) log_debug(logger, format, ##__VA_ARGS__)
+void log_debug(riscv_logger *logger, const char *format, ...);
 #else
-#define LOG_DEBUG(format, ...)
+#define LOG_DEBUG(logger, format, ...)
 #endif
 
-bool log_begin(void);
-void log_end(void);
+bool log_begin(riscv_logger **logger);
+void log_end(riscv_logger *logger);
 #endif /* LOG_H */
@@ -1,6 +1,26 @@
 #ifndef MACROS
 #define MACROS
 
+#include <stdint.h>
+#include <string.h>
+
+/* On little-endian host, the guest memory has the same layout as the host one,
+ * so an access of any alignment is done by a single (unaligned) host load or
+ * store through memcpy. */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define read_len(bit, ptr, value)         \
+    do {                                  \
+        uint##bit##_t __v;                \
+        memcpy(&__v, (ptr), sizeof(__v)); \
+        value = __v;                      \
+    } while (0)
+
+#define write_len(bit, ptr, value)        \
+    do {                                  \
+        uint##bit##_t __v = (value);      \
+        memcpy((ptr), &__v, sizeof(__v)); \
+    } while (0)
+#else
 #define read_len(bit, ptr, value)                             \
     do {                                                      \
         value = 0;                                            \
@@ -13,6 +33,7 @@
         for (int i = 0; i < ((bit) >> 3); i++)         \
             *((ptr) + i) = (value >> (i << 3)) & 0xff; \
     } while (0)
+#endif
 
 #define container_of(ptr, type, member)               \
     ({                                                \
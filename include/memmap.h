@@ -9,6 +9,11 @@
 #define DRAM_BASE 0x80000000UL
 #define DRAM_END (DRAM_BASE + DRAM_SIZE)
 
+/* The control device of the emulator, which is at the address of the SiFive
+ * test device in QEMU */
+#define CTRL_BASE 0x100000UL
+#define CTRL_END (CTRL_BASE + 0x1000)
+
 #define CLINT_BASE 0x2000000UL
 #define CLINT_END (CLINT_BASE + 0x10000)
 
@@ -40,4 +45,12 @@
 
 #define BOOT_ROM_BASE 0x1000
 
+/* The layout of DRAM when the kernel is booted by the built-in SBI. The kernel
+ * Image is placed at the offset it expects, while the device tree and the
+ * initrd are placed at the end of DRAM. */
+#define KERNEL_OFFSET 0x200000UL
+#define FDT_MAX_SIZE 0x10000UL
+#define FDT_ADDR (DRAM_END - FDT_MAX_SIZE)
+#define INITRD_START(size) ((FDT_ADDR - (size)) & ~0xfffUL)
+
 #endif
@@ -5,18 +5,27 @@
 #include <stdint.h>
 
 #include "elf_parser.h"
+#include "config.h"
+#include "dirty.h"
 #include "exception.h"
 
 typedef struct {
     elf_t elf;
     uint8_t *mem;
+    // DRAM is mapped from the snapshot instead of allocated by malloc
+    bool mapped;
+    struct Pager *pager;
+    // the pages written since the last checkpoint, see dirty.h
+    uint64_t *dirty;
     uint64_t sig_start;
     uint64_t sig_end;
     uint64_t tohost_addr;
+    uint64_t fromhost_addr;
+    // the address where the binary starts to run
+    uint64_t entry_addr;
 } riscv_mem;
 
-uint64_t get_entry_addr();
-bool init_mem(riscv_mem *mem, const char *filename);
+bool init_mem(riscv_mem *mem, const riscv_config *config);
 uint64_t read_mem(riscv_mem *mem,
                   uint64_t addr,
                   uint64_t size,
@@ -0,0 +1,34 @@
+#ifndef RISCV_PAGER
+#define RISCV_PAGER
+
+#include <stdint.h>
+
+#include "snapshot.h"
+
+/* Restore DRAM from a snapshot lazily: the pages are read from the file only
+ * when the guest touches them, so the latency of restoring doesn't depend on
+ * the size of DRAM.
+ *
+ * The missing pages are served by a thread through userfaultfd. If it isn't
+ * available (e.g. vm.unprivileged_userfaultfd=0), the uncompressed pages are
+ * mapped from the file by MAP_PRIVATE instead, and only the compressed ones are
+ * read up front. */
+
+typedef struct Pager riscv_pager;
+
+/* Return DRAM of the size which is backed by the pages of the snapshot file,
+ * or NULL if it can't be mapped, in which case the caller should read the
+ * pages by itself. The pager is set if a thread is started to serve the
+ * faults. Neither fd nor pages is needed after returning. */
+uint8_t *map_dram(int fd,
+                  const snapshot_page *pages,
+                  uint64_t count,
+                  uint64_t size,
+                  riscv_pager **pager);
+void unmap_dram(uint8_t *mem, uint64_t size, riscv_pager *pager);
+/* Load the pages which haven't been touched and release the pager, after which
+ * DRAM is an ordinary private mapping. This is required before fork, since the
+ * faults in the child are never delivered to the pager. */
+void settle_dram(riscv_pager *pager);
+
+#endif
@@ -45,6 +45,8 @@ typedef struct {
     uint32_t claim[2];
 
     bool update_irq;
+    // the times each of the first 32 sources is claimed
+    uint64_t claimed[32];
 } riscv_plic;
 
 uint64_t read_plic(riscv_plic *plic,
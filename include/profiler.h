@@ -0,0 +1,33 @@
+#ifndef RISCV_PROFILER
+#define RISCV_PROFILER
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "cpu.h"
+
+/* The sampling profiler takes a sample of the guest every interval
+ * instructions: the privilege mode, pc and the call stack unwound by the frame
+ * pointer. The stack is walked through the frames of the RISC-V ABI, where the
+ * return address is saved at fp - 8 and the previous fp at fp - 16, so the
+ * guest should be built with -fno-omit-frame-pointer to be unwound fully.
+ *
+ * The addresses are resolved by the symbols of the binary and the extra ELF
+ * files, e.g. vmlinux for a kernel loaded as the raw Image, and the samples
+ * of the same functions are merged. The profile is written as the folded
+ * stacks for flame graphs, one line for each stack from the mode to the
+ * innermost function, followed by the number of samples:
+ *
+ *   S-mode;handle_exception;do_page_fault;handle_mm_fault 42 */
+
+#define PROFILE_MAX_DEPTH 64
+
+typedef struct Profiler riscv_profiler;
+
+riscv_profiler *create_profiler(const riscv_config *config);
+void sample_profiler(riscv_profiler *prof, riscv_cpu *cpu);
+bool write_profiler(riscv_profiler *prof, const char *filename);
+void free_profiler(riscv_profiler *prof);
+
+#endif
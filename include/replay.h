@@ -0,0 +1,58 @@
+#ifndef RISCV_REPLAY
+#define RISCV_REPLAY
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Record the input from the host with the instructions executed when it is
+ * taken by the guest, and replay it at the same instructions, so the run could
+ * be reproduced exactly. mtime counts the instructions and virtio-blk
+ * completes each request when it is notified, so the only input which depends
+ * on the timing of the host is the characters received by UART.
+ *
+ * The log is a text file with one event per line after the header, e.g.
+ *
+ *   riscv-emulator replay 1
+ *   1024356 uart 0x6c
+ *
+ * so it could be read and edited by hand. */
+
+#define REPLAY_HEADER "riscv-emulator replay 1"
+
+typedef enum {
+    REPLAY_UART,
+} riscv_replay_type;
+
+typedef struct {
+    // the instructions executed by the emulator before the event
+    uint64_t instret;
+    riscv_replay_type type;
+    uint64_t value;
+} riscv_replay_event;
+
+typedef struct {
+    FILE *fp;
+    bool record;
+    // the next event to be replayed, which is valid if pending is set
+    bool pending;
+    riscv_replay_event next;
+    // the events recorded or replayed
+    uint64_t events;
+} riscv_replay;
+
+/* Open the log to record the events, or to replay the events in it. NULL is
+ * returned if the file can't be opened or isn't a log. */
+riscv_replay *create_replay(const char *filename, bool record);
+bool record_replay(riscv_replay *replay, const riscv_replay_event *event);
+// take the next event from the log, which fails at the end of the log
+bool next_replay(riscv_replay *replay);
+void free_replay(riscv_replay *replay);
+
+// whether the next event to be replayed happens at the instructions
+static inline bool replay_due(const riscv_replay *replay, uint64_t instret)
+{
+    return replay->pending && replay->next.instret == instret;
+}
+
+#endif
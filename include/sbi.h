@@ -0,0 +1,95 @@
+#ifndef RISCV_SBI
+#define RISCV_SBI
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Reference: https://github.com/riscv-non-isa/riscv-sbi-doc */
+
+// the version of SBI specification which is implemented (v1.0)
+#define SBI_SPEC_VERSION (1UL << 24)
+// the implementation ID isn't one of the registered ones
+#define SBI_IMPL_ID 0xffff
+#define SBI_IMPL_VERSION 1
+
+// legacy extensions, the extension ID is the function itself
+#define SBI_EXT_0_1_SET_TIMER 0x0
+#define SBI_EXT_0_1_CONSOLE_PUTCHAR 0x1
+#define SBI_EXT_0_1_CONSOLE_GETCHAR 0x2
+#define SBI_EXT_0_1_CLEAR_IPI 0x3
+#define SBI_EXT_0_1_SEND_IPI 0x4
+#define SBI_EXT_0_1_REMOTE_FENCE_I 0x5
+#define SBI_EXT_0_1_REMOTE_SFENCE_VMA 0x6
+#define SBI_EXT_0_1_REMOTE_SFENCE_VMA_ASID 0x7
+#define SBI_EXT_0_1_SHUTDOWN 0x8
+
+#define SBI_EXT_BASE 0x10
+#define SBI_EXT_TIME 0x54494d45
+#define SBI_EXT_IPI 0x735049
+#define SBI_EXT_RFENCE 0x52464e43
+#define SBI_EXT_HSM 0x48534d
+#define SBI_EXT_SRST 0x53525354
+#define SBI_EXT_PMU 0x504d55
+
+// function IDs of the base extension
+#define SBI_BASE_GET_SPEC_VERSION 0
+#define SBI_BASE_GET_IMP_ID 1
+#define SBI_BASE_GET_IMP_VERSION 2
+#define SBI_BASE_PROBE_EXT 3
+#define SBI_BASE_GET_MVENDORID 4
+#define SBI_BASE_GET_MARCHID 5
+#define SBI_BASE_GET_MIMPID 6
+
+// function IDs of the HSM extension
+#define SBI_HSM_HART_START 0
+#define SBI_HSM_HART_STOP 1
+#define SBI_HSM_HART_GET_STATUS 2
+#define SBI_HSM_HART_SUSPEND 3
+
+// function IDs of the PMU extension
+#define SBI_PMU_NUM_COUNTERS 0
+#define SBI_PMU_COUNTER_GET_INFO 1
+#define SBI_PMU_COUNTER_CFG_MATCH 2
+#define SBI_PMU_COUNTER_START 3
+#define SBI_PMU_COUNTER_STOP 4
+#define SBI_PMU_COUNTER_FW_READ 5
+
+#define SBI_PMU_CFG_SKIP_MATCH 0x1
+#define SBI_PMU_CFG_CLEAR_VALUE 0x2
+#define SBI_PMU_CFG_AUTO_START 0x4
+#define SBI_PMU_START_SET_INIT_VALUE 0x1
+#define SBI_PMU_STOP_RESET 0x1
+
+// the types of event_idx, which are in bits 19:16
+#define SBI_PMU_EVENT_HW 0
+#define SBI_PMU_EVENT_RAW 2
+// the codes of the hardware general events
+#define SBI_PMU_HW_CPU_CYCLES 1
+#define SBI_PMU_HW_INSTRUCTIONS 2
+
+#define SBI_HSM_STATE_STARTED 0
+#define SBI_HSM_SUSPEND_RET_DEFAULT 0
+
+// standard SBI error codes
+#define SBI_SUCCESS 0
+#define SBI_ERR_FAILED -1
+#define SBI_ERR_NOT_SUPPORTED -2
+#define SBI_ERR_INVALID_PARAM -3
+#define SBI_ERR_ALREADY_AVAILABLE -6
+#define SBI_ERR_ALREADY_STARTED -7
+#define SBI_ERR_ALREADY_STOPPED -8
+
+typedef struct {
+    bool enable;
+    // set by the system reset call to stop the emulator
+    bool shutdown;
+    // the counters which are configured by the PMU extension
+    uint32_t pmu_counters;
+} riscv_sbi;
+
+struct CPU;
+
+bool init_sbi(struct CPU *cpu);
+void sbi_ecall(struct CPU *cpu);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef RISCV_SNAPSHOT
+#define RISCV_SNAPSHOT
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cpu.h"
+
+/* A snapshot captures the whole machine: the CPU state, the devices and the
+ * contents of DRAM and the disk. It is a sequence of sections after the
+ * header, each section starts with its tag and the length of the payload.
+ *
+ * The fixed-size sections are dumped from the structures directly, so a
+ * snapshot can only be restored by the emulator built with the same
+ * configuration, which is checked by the section lengths.
+ *
+ * DRAM and the disk are stored sparsely: only the non-zero pages are written.
+ * Such a section starts with an index of the pages, which tells where the data
+ * of each page is in the file, so a page can be loaded without reading the
+ * others. The data is compressed by zlib if the emulator is built with
+ * `make ZLIB=1`, and the uncompressed pages are aligned to SNAPSHOT_PAGE_SIZE
+ * in the file to be mapped directly.
+ *
+ * A checkpoint could be incremental, which only has the pages written since
+ * its parent, the previous checkpoint in the same directory. Its DRAM and disk
+ * sections are applied on top of the chain of parents, and a page which becomes
+ * zero is stored with length 0. */
+
+#define SNAPSHOT_MAGIC "RVEMUSNP"
+#define SNAPSHOT_VERSION 4
+#define SNAPSHOT_PAGE_SIZE 4096
+// the limit of the name of parent and the length of a chain
+#define SNAPSHOT_NAME_MAX 256
+#define SNAPSHOT_MAX_CHAIN 65536
+
+typedef enum {
+    // the name of the parent, which is empty for a full snapshot
+    SNAPSHOT_PARENT = 1,
+    SNAPSHOT_CPU,
+    SNAPSHOT_CSR,
+    SNAPSHOT_SBI,
+    SNAPSHOT_CLINT,
+    SNAPSHOT_PLIC,
+    SNAPSHOT_UART,
+    SNAPSHOT_VIRTIO_BLK,
+    // the counters of the statistics, see stats.h
+    SNAPSHOT_STATS,
+    SNAPSHOT_DRAM,
+    SNAPSHOT_DISK,
+} snapshot_tag;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t vlen;
+} snapshot_header;
+
+typedef struct {
+    uint32_t tag;
+    uint32_t reserved;
+    uint64_t len;
+} snapshot_section;
+
+// the index of DRAM and disk sections, which is followed by count pages
+typedef struct {
+    uint64_t count;
+    // the offset of the file where the section ends
+    uint64_t end;
+} snapshot_index;
+
+// the index entry of each non-zero page, sorted by the page number
+typedef struct {
+    uint64_t page;
+    // the offset of the data in the file
+    uint64_t offset;
+    // the page is compressed if len < SNAPSHOT_PAGE_SIZE
+    uint32_t len;
+    uint32_t reserved;
+} snapshot_page;
+
+bool save_snapshot(riscv_cpu *cpu, const char *filename);
+/* Save only the pages written since the parent, which should be the last
+ * checkpoint. It is a full snapshot if there is no parent or the pages haven't
+ * been tracked since the parent, e.g. the last checkpoint failed. */
+bool save_checkpoint(riscv_cpu *cpu, const char *filename, const char *parent);
+// restore the snapshot, which could be the last one of a chain of checkpoints
+bool restore_snapshot(riscv_cpu *cpu, const char *filename);
+/* Read the data of the page from the snapshot file to the buffer, which has
+ * SNAPSHOT_PAGE_SIZE bytes. This is safe to be called from any thread. */
+bool load_snapshot_page(int fd, const snapshot_page *page, uint8_t *buf);
+
+#endif
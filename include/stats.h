@@ -0,0 +1,41 @@
+#ifndef RISCV_STATS
+#define RISCV_STATS
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The statistics of the emulator itself, which are always counted and
+ * invisible to the guest, unlike the hpm counters. The counters of the CPU are
+ * kept here, while the devices count their own accesses and transfers, e.g.
+ * riscv_uart and riscv_virtio_blk.
+ *
+ * write_stats appends them to the file as one JSON object per line, so the
+ * file of the periodic dumps could be followed by a dashboard. All of them are
+ * saved in a section of the snapshot, and continue after it is restored. */
+
+// the exception and interrupt codes which are counted
+#define STATS_CAUSES 16
+
+typedef struct {
+    /* The emulator has no TLB, so each translation of a paged address walks
+     * the page table, and SFENCE.VMA is only counted as a flush. */
+    uint64_t page_walks;
+    uint64_t tlb_flushes;
+    // indexed by the cause and the privilege mode where the trap happens
+    uint64_t exceptions[STATS_CAUSES][4];
+    uint64_t interrupts[STATS_CAUSES][4];
+} riscv_stats;
+
+static inline void count_trap(uint64_t traps[STATS_CAUSES][4],
+                              uint8_t cause,
+                              uint8_t mode)
+{
+    if (cause < STATS_CAUSES)
+        traps[cause][mode & 0x3]++;
+}
+
+struct CPU;
+
+bool write_stats(const struct CPU *cpu, uint64_t instret, const char *filename);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef RISCV_TEST_RUNNER
+#define RISCV_TEST_RUNNER
+
+/* Run a batch of riscv-tests programs in one process. Each of them has its own
+ * emulator, and they are run by a pool of threads concurrently.
+ *
+ * The result of each test is printed to stderr once it finishes, and the
+ * summary is printed to stdout as JSON after all of them finish:
+ *
+ *   {"passed": 1, "failed": 0, "seconds": 0.01, "tests": [
+ *     {"file": "rv64ui-p-add", "result": "pass", "instructions": 500,
+ *      "seconds": 0.01, "mips": 0.05}
+ *   ]}
+ */
+
+// the tests which don't finish in this number of instructions are failed
+#define TEST_INSN_LIMIT 100000000
+
+/* Each pattern is a test file or a glob of them. Run them by jobs threads, or
+ * the number of online processors if jobs is 0. Return the number of the
+ * failed tests, or -1 if the tests can't be run. */
+int run_tests(char *const patterns[], int count, int jobs);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef RISCV_TIMEBASE
+#define RISCV_TIMEBASE
+
+#include <stdint.h>
+
+#include "config.h"
+
+/* The source of mtime in CLINT and the time CSR, which both tick at the
+ * timebase-frequency given by the device tree.
+ *
+ * - TIMEBASE_INSTRET: they advance by one for each instruction, so the guest
+ *   runs in the same way on any host, but its clock is as fast as the
+ *   emulator.
+ * - TIMEBASE_HOST: they follow CLOCK_MONOTONIC of the host, so the clock of
+ *   the guest is the real one. The host clock is read every TIMEBASE_POLL
+ *   instructions.
+ *
+ * WFI skips the time to the next timer deadline with the former, and blocks
+ * the host until the deadline or the input of UART with the latter. */
+
+#define TIMEBASE_FREQ 10000000
+#define TIMEBASE_NSEC (1000000000 / TIMEBASE_FREQ)
+#define TIMEBASE_POLL 256
+/* the longest wait of WFI in ns, after which the requests from the signals,
+ * e.g. to save the snapshot, are served */
+#define TIMEBASE_MAX_WAIT 100000000
+
+typedef struct {
+    riscv_timebase_mode mode;
+    // the instructions left before the host clock is read
+    uint32_t countdown;
+    // the host time in ns, up to which the ticks have been counted
+    uint64_t host_ns;
+} riscv_timebase;
+
+void init_timebase(riscv_timebase *tb, riscv_timebase_mode mode);
+// read the host clock, and return the ticks since the last reading
+uint64_t poll_timebase(riscv_timebase *tb);
+/* Return the ns for WFI to wait for the ticks, which is no longer than
+ * TIMEBASE_MAX_WAIT. The time waited is counted by the next instruction. */
+uint64_t wait_timebase(riscv_timebase *tb, uint64_t ticks);
+
+// the ticks which mtime and time advance by for an instruction
+static inline uint64_t tick_timebase(riscv_timebase *tb)
+{
+    if (tb->mode == TIMEBASE_INSTRET)
+        return 1;
+    if (--tb->countdown)
+        return 0;
+    return poll_timebase(tb);
+}
+
+#endif
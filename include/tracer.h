@@ -0,0 +1,163 @@
+#ifndef RISCV_TRACER
+#define RISCV_TRACER
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* The tracer records the execution as compact binary records, which are
+ * converted to text by tools/tracedump.c. The records are filled into one of
+ * TRACE_BUFFERS buffers by the emulator, and the full ones are written to the
+ * file by a thread in the background, so the emulator only waits for the disk
+ * when all of the buffers are full. Nothing is recorded unless it is enabled.
+ *
+ * The file begins with TRACE_MAGIC, followed by the records. Each record has
+ * a header, and the optional fields given by its flags in order:
+ *
+ *   header (16 bytes) | rd value (8) | memory address (8), value (8)
+ *
+ * - TRACE_INSTR: an instruction retires. The register rd is recorded if its
+ *   value is changed, and the last memory access if there is any.
+ * - TRACE_EXCEPTION / TRACE_INTERRUPT: the trap is taken at pc, whose cause
+ *   is in the field of instr and tval follows as the rd value.
+ * - TRACE_START: the tracer is enabled, and instret of the emulator follows
+ *   as the rd value. */
+
+#define TRACE_MAGIC "RVTRACE1"
+#define TRACE_BUFFERS 4
+#define TRACE_BUFFER_SIZE (1 << 20)
+
+enum {
+    TRACE_INSTR,
+    TRACE_EXCEPTION,
+    TRACE_INTERRUPT,
+    TRACE_START,
+};
+
+// the flags of the optional fields
+#define TRACE_F_RD 0x1
+#define TRACE_F_MEM 0x2
+#define TRACE_F_STORE 0x4
+
+typedef struct {
+    uint64_t pc;
+    uint32_t instr;
+    uint8_t type;
+    uint8_t mode;
+    uint8_t flags;
+    uint8_t rd;
+} trace_header;
+
+#define TRACE_MAX_RECORD (sizeof(trace_header) + 3 * sizeof(uint64_t))
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    // the buffer is waiting to be written
+    bool full;
+} trace_buffer;
+
+typedef struct {
+    FILE *fp;
+    trace_buffer buffers[TRACE_BUFFERS];
+    // the buffer filled by the emulator and the next one to be written
+    int fill;
+    int write;
+
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool stop;
+
+    // the last memory access of the current instruction
+    bool mem;
+    bool store;
+    uint64_t mem_addr;
+    uint64_t mem_value;
+} riscv_tracer;
+
+riscv_tracer *create_tracer(const char *filename);
+// the records in the buffers are written before it returns
+void free_tracer(riscv_tracer *tracer);
+/* Write all of the records and flush the file, so the writer is idle and the
+ * FILE holds no buffered bytes when the emulator forks. */
+void flush_tracer(riscv_tracer *tracer);
+/* Drop the copy of the file inherited by a forked child without flushing it,
+ * so nothing is written to the trace of the parent when the child exits. */
+void drop_tracer(riscv_tracer *tracer);
+
+// give the filled buffer to the writer, and take the next one
+void trace_switch(riscv_tracer *tracer);
+
+static inline void trace_mem(riscv_tracer *tracer,
+                             uint64_t addr,
+                             uint64_t value,
+                             bool store)
+{
+    tracer->mem = true;
+    tracer->store = store;
+    tracer->mem_addr = addr;
+    tracer->mem_value = value;
+}
+
+static inline void trace_record(riscv_tracer *tracer,
+                                const trace_header *header,
+                                const uint64_t *fields,
+                                int nfields)
+{
+    trace_buffer *buf = &tracer->buffers[tracer->fill];
+    if (buf->len + TRACE_MAX_RECORD > TRACE_BUFFER_SIZE) {
+        trace_switch(tracer);
+        buf = &tracer->buffers[tracer->fill];
+    }
+
+    uint8_t *p = buf->data + buf->len;
+    __builtin_memcpy(p, header, sizeof(trace_header));
+    __builtin_memcpy(p + sizeof(trace_header), fields,
+                     nfields * sizeof(uint64_t));
+    buf->len += sizeof(trace_header) + nfields * sizeof(uint64_t);
+}
+
+static inline void trace_instr(riscv_tracer *tracer,
+                               uint64_t pc,
+                               uint32_t instr,
+                               uint8_t mode,
+                               uint8_t rd,
+                               bool rd_written,
+                               uint64_t rd_value)
+{
+    trace_header header = {
+        .pc = pc, .instr = instr, .type = TRACE_INSTR, .mode = mode, .rd = rd};
+    uint64_t fields[3];
+    int n = 0;
+    if (rd_written) {
+        header.flags |= TRACE_F_RD;
+        fields[n++] = rd_value;
+    }
+    if (tracer->mem) {
+        header.flags |= TRACE_F_MEM | (tracer->store ? TRACE_F_STORE : 0);
+        fields[n++] = tracer->mem_addr;
+        fields[n++] = tracer->mem_value;
+        tracer->mem = false;
+    }
+    trace_record(tracer, &header, fields, n);
+}
+
+static inline void trace_event(riscv_tracer *tracer,
+                               uint8_t type,
+                               uint64_t pc,
+                               uint8_t mode,
+                               uint32_t cause,
+                               uint64_t value)
+{
+    trace_header header = {.pc = pc,
+                           .instr = cause,
+                           .type = type,
+                           .mode = mode,
+                           .flags = TRACE_F_RD};
+    tracer->mem = false;
+    trace_record(tracer, &header, &value, 1);
+}
+
+#endif
@@ -7,6 +7,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "config.h"
 #include "exception.h"
 #include "memmap.h"
 
@@ -48,9 +49,29 @@ typedef struct {
     pthread_t child_tid;
     pthread_mutex_t lock;
     pthread_cond_t cond;
+    // whether the thread which reads stdin is running
+    bool console;
+    /* The input is kept by the thread until the emulator takes it by
+     * uart_take_input, instead of being received at once, so the emulator
+     * decides the instruction where it arrives, e.g. to record it. */
+    bool deferred;
+    bool has_input;
+    uint8_t input;
+    volatile int thread_stop;
+    const riscv_callbacks *callbacks;
+    // the characters sent and received by the guest
+    uint64_t tx_bytes;
+    uint64_t rx_bytes;
 } riscv_uart;
 
-bool init_uart(riscv_uart *uart);
+bool init_uart(riscv_uart *uart,
+               bool console,
+               bool deferred,
+               const riscv_callbacks *callbacks);
+/* Stop and restart the thread which reads the input from stdin, e.g. when
+ * stdin is replaced by another file. They do nothing without the console. */
+bool start_uart(riscv_uart *uart);
+void stop_uart(riscv_uart *uart);
 uint64_t read_uart(riscv_uart *uart,
                    uint64_t addr,
                    uint8_t size,
@@ -60,6 +81,15 @@ bool write_uart(riscv_uart *uart,
                 uint8_t size,
                 uint64_t value,
                 riscv_exception *exc);
+/* Receive the input kept by the thread if the receive register is empty, and
+ * return the character, or -1 if nothing is received. */
+int uart_take_input(riscv_uart *uart);
+/* Receive the character from the host directly, which fails if the receive
+ * register is still full. */
+bool uart_receive(riscv_uart *uart, uint8_t c);
+/* Block until the input arrives or the ns pass, e.g. for WFI. It returns at
+ * once if there is input which the emulator hasn't seen. */
+void wait_uart(riscv_uart *uart, uint64_t ns);
 bool uart_is_interrupt(riscv_uart *uart);
 void free_uart(riscv_uart *uart);
 
@@ -0,0 +1,48 @@
+#ifndef RISCV_USER
+#define RISCV_USER
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "memmap.h"
+
+/* The user-mode emulation runs a static RV64 Linux program without booting a
+ * kernel, like qemu-user. The program is loaded into a flat address space of
+ * USER_SIZE bytes starting from 0, which is backed by DRAM directly without
+ * page tables, and runs in U-mode. Each ecall is a Linux syscall serviced by
+ * the host, and any other trap kills the program.
+ *
+ *   0 ... program | brk -> ... <- mmap | stack (USER_STACK_SIZE) | USER_SIZE */
+
+#define USER_SIZE DRAM_SIZE
+#define USER_STACK_SIZE 0x800000UL
+// where a static PIE is loaded
+#define USER_PIE_BASE 0x10000UL
+// the number of files which could be opened by the program
+#define USER_FD_MAX 256
+
+typedef struct {
+    bool enable;
+    // set by exit or exit_group to stop the emulator
+    bool exited;
+    uint64_t exit_code;
+    uint64_t brk_start;
+    uint64_t brk;
+    /* the anonymous mappings are allocated downward from the stack, the space
+     * between brk and mmap_top has never been used */
+    uint64_t mmap_top;
+    // the path of the program, which is /proc/self/exe
+    const char *exe;
+    /* the host fd of each fd of the program, or -1 if it isn't open, so the
+     * program can't touch the files of the emulator */
+    int fds[USER_FD_MAX];
+} riscv_user;
+
+struct CPU;
+
+bool init_user(struct CPU *cpu, const riscv_config *config);
+void user_ecall(struct CPU *cpu);
+void free_user(struct CPU *cpu);
+
+#endif
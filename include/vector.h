@@ -0,0 +1,181 @@
+#ifndef RISCV_VECTOR
+#define RISCV_VECTOR
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Element kernels of the "V" extension.
+ *
+ * The kernels only know about flat arrays of elements. Everything related to
+ * the instruction semantic (vtype, register grouping, masking, the scalar
+ * operand) is resolved by the caller in cpu.c, so each kernel is a plain loop
+ * without cross-iteration dependency which gcc is able to turn into SIMD code
+ * of the host. On x86-64 the kernels are also built for AVX2 and the best
+ * version is selected when the program is loaded. */
+
+/* The length of each vector register in bits, which could be changed by
+ * `make VLEN=...`. It should be a power of 2 between 64 and 4096. */
+#ifndef VLEN
+#define VLEN 128
+#endif
+
+#if (VLEN < 64) || (VLEN > 4096) || (VLEN & (VLEN - 1))
+#error "VLEN should be a power of 2 between 64 and 4096"
+#endif
+
+// the size of each vector register in bytes
+#define VREG_SIZE (VLEN >> 3)
+// the maximum size of any operand element
+#define ELEN 64
+// the maximum size of a register group in bytes (LMUL = 8)
+#define VGROUP_MAX (VREG_SIZE * 8)
+
+// vtype fields
+#define VTYPE_VLMUL 0x7UL
+#define VTYPE_VSEW 0x38UL
+#define VTYPE_VTA 0x40UL
+#define VTYPE_VMA 0x80UL
+#define VTYPE_VILL (1UL << 63)
+
+/* All kernels are indexed by log2(SEW / 8). The entry is NULL if the operation
+ * is not defined for the element width, such as floating-point operation with
+ * 8-bit elements.
+ *
+ * For the arithmetic kernels, vs2 and vs1 are the source operand and vd is both
+ * the destination and the third source (for multiply-add). The unary kernels
+ * have the same prototype and ignore vs1. */
+typedef void (*vec_arith_fn)(void *vd,
+                             const void *vs2,
+                             const void *vs1,
+                             uint64_t vl);
+// write the result of comparison as one byte per element
+typedef void (*vec_cmp_fn)(uint8_t *res,
+                           const void *vs2,
+                           const void *vs1,
+                           uint64_t vl);
+/* reduce the active elements of vs2 into *acc, the elements are all active
+ * if mask is NULL */
+typedef void (*vec_red_fn)(void *acc,
+                           const void *vs2,
+                           const uint8_t *mask,
+                           uint64_t vl);
+
+// integer arithmetic
+extern const vec_arith_fn vec_add[4];
+extern const vec_arith_fn vec_sub[4];
+extern const vec_arith_fn vec_rsub[4];
+extern const vec_arith_fn vec_minu[4];
+extern const vec_arith_fn vec_min[4];
+extern const vec_arith_fn vec_maxu[4];
+extern const vec_arith_fn vec_max[4];
+extern const vec_arith_fn vec_and[4];
+extern const vec_arith_fn vec_or[4];
+extern const vec_arith_fn vec_xor[4];
+extern const vec_arith_fn vec_sll[4];
+extern const vec_arith_fn vec_srl[4];
+extern const vec_arith_fn vec_sra[4];
+extern const vec_arith_fn vec_mul[4];
+extern const vec_arith_fn vec_mulh[4];
+extern const vec_arith_fn vec_mulhu[4];
+extern const vec_arith_fn vec_mulhsu[4];
+extern const vec_arith_fn vec_divu[4];
+extern const vec_arith_fn vec_div[4];
+extern const vec_arith_fn vec_remu[4];
+extern const vec_arith_fn vec_rem[4];
+extern const vec_arith_fn vec_macc[4];
+extern const vec_arith_fn vec_nmsac[4];
+extern const vec_arith_fn vec_madd[4];
+extern const vec_arith_fn vec_nmsub[4];
+extern const vec_arith_fn vec_mv[4];
+
+// integer comparison
+extern const vec_cmp_fn vec_seq[4];
+extern const vec_cmp_fn vec_sne[4];
+extern const vec_cmp_fn vec_sltu[4];
+extern const vec_cmp_fn vec_slt[4];
+extern const vec_cmp_fn vec_sleu[4];
+extern const vec_cmp_fn vec_sle[4];
+extern const vec_cmp_fn vec_sgtu[4];
+extern const vec_cmp_fn vec_sgt[4];
+
+// integer reduction
+extern const vec_red_fn vec_redsum[4];
+extern const vec_red_fn vec_redand[4];
+extern const vec_red_fn vec_redor[4];
+extern const vec_red_fn vec_redxor[4];
+extern const vec_red_fn vec_redminu[4];
+extern const vec_red_fn vec_redmin[4];
+extern const vec_red_fn vec_redmaxu[4];
+extern const vec_red_fn vec_redmax[4];
+
+// floating-point arithmetic
+extern const vec_arith_fn vec_fadd[4];
+extern const vec_arith_fn vec_fsub[4];
+extern const vec_arith_fn vec_frsub[4];
+extern const vec_arith_fn vec_fmul[4];
+extern const vec_arith_fn vec_fdiv[4];
+extern const vec_arith_fn vec_frdiv[4];
+extern const vec_arith_fn vec_fmin[4];
+extern const vec_arith_fn vec_fmax[4];
+extern const vec_arith_fn vec_fsgnj[4];
+extern const vec_arith_fn vec_fsgnjn[4];
+extern const vec_arith_fn vec_fsgnjx[4];
+extern const vec_arith_fn vec_fmacc[4];
+extern const vec_arith_fn vec_fnmacc[4];
+extern const vec_arith_fn vec_fmsac[4];
+extern const vec_arith_fn vec_fnmsac[4];
+extern const vec_arith_fn vec_fmadd[4];
+extern const vec_arith_fn vec_fnmadd[4];
+extern const vec_arith_fn vec_fmsub[4];
+extern const vec_arith_fn vec_fnmsub[4];
+extern const vec_arith_fn vec_fsqrt[4];
+extern const vec_arith_fn vec_fcvt_xu_f[4];
+extern const vec_arith_fn vec_fcvt_x_f[4];
+extern const vec_arith_fn vec_fcvt_rtz_xu_f[4];
+extern const vec_arith_fn vec_fcvt_rtz_x_f[4];
+extern const vec_arith_fn vec_fcvt_f_xu[4];
+extern const vec_arith_fn vec_fcvt_f_x[4];
+
+// floating-point comparison
+extern const vec_cmp_fn vec_mfeq[4];
+extern const vec_cmp_fn vec_mfne[4];
+extern const vec_cmp_fn vec_mflt[4];
+extern const vec_cmp_fn vec_mfle[4];
+extern const vec_cmp_fn vec_mfgt[4];
+extern const vec_cmp_fn vec_mfge[4];
+
+// floating-point reduction
+extern const vec_red_fn vec_fredsum[4];
+extern const vec_red_fn vec_fredmin[4];
+extern const vec_red_fn vec_fredmax[4];
+
+// mask-register logical operations, indexed by funct6 - 0x18
+typedef enum {
+    VMANDN,
+    VMAND,
+    VMOR,
+    VMXOR,
+    VMORN,
+    VMNAND,
+    VMNOR,
+    VMXNOR,
+} vec_mask_op;
+
+void vec_splat(void *vd, uint64_t value, unsigned int sew, uint64_t vl);
+void vec_merge(void *vd,
+               const void *vs,
+               const uint8_t *mask,
+               unsigned int sew,
+               uint64_t vl);
+void vec_unpack_mask(uint8_t *mask, const uint8_t *v0, uint64_t vl);
+void vec_pack_mask(uint8_t *vd,
+                   const uint8_t *res,
+                   const uint8_t *mask,
+                   uint64_t vl);
+void vec_mask_logical(vec_mask_op op,
+                      uint8_t *vd,
+                      const uint8_t *vs2,
+                      const uint8_t *vs1,
+                      uint64_t vl);
+
+#endif
@@ -15,6 +15,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "dirty.h"
 #include "exception.h"
 
 /* The design base on 4.2.4 Legacy interface, and 4.2.2 MMIO Device Register
@@ -99,6 +100,14 @@ typedef struct {
     uint8_t config[8];
 
     uint8_t *rfsimg;
+    uint64_t rfsimg_size;
+    // the sectors of disk written since the last checkpoint, see dirty.h
+    uint64_t *dirty;
+
+    // the requests served and the bytes transferred for the statistics
+    uint64_t requests;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
 } riscv_virtio_blk;
 
 bool init_virtio_blk(riscv_virtio_blk *virtio_blk, const char *rfs_name);
@@ -40,6 +40,10 @@ $(LINUX_IMG): $(OPENSBI_SRC) $(LINUX_SRC)
 		CROSS_COMPILE=$(CROSS_COMPILE) \
 		FW_PAYLOAD_PATH=../../$(LINUX_SRC)/arch/riscv/boot/Image
 
+# the kernel Image alone for the built-in SBI, which is built with fw_payload
+LINUX_KERNEL_IMG=$(LINUX_SRC)/arch/riscv/boot/Image
+$(LINUX_KERNEL_IMG): $(LINUX_IMG)
+
 BUSYBOX_BIN=$(LINUX_OUT)/rootfs/bin/busybox
 $(BUSYBOX_BIN): $(BUSYBOX_SRC)
 	cp configs/busybox-config $(BUSYBOX_SRC)/.config
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "benchmark.h"
+#include "emu.h"
+
+// the instructions run at once between checking the progress
+#define BENCH_SLICE 100000
+
+typedef struct {
+    const char *name;
+    const char *binary;
+    const char *rfs_name;
+    // run by the user-mode emulation
+    bool user;
+    // the output of UART which completes the workload, or NULL if it exits
+    const char *until;
+} bench_workload;
+
+static const bench_workload workloads[] = {
+    {"xv6-boot", "xv6/kernel.img", "xv6/fs.img", false, "$ "},
+    {"integer", "bench/int.elf", NULL, false, NULL},
+    {"memcpy", "bench/memcpy.elf", NULL, false, NULL},
+    {"branch", "bench/branch.elf", NULL, false, NULL},
+    {"syscall", "bench/syscall.elf", NULL, true, NULL},
+};
+
+// match the output of UART against the expected one
+typedef struct {
+    const char *until;
+    size_t matched;
+    bool done;
+} bench_output;
+
+static void bench_uart_tx(void *opaque, char c)
+{
+    bench_output *out = opaque;
+    if (!out->until || out->done)
+        return;
+
+    if (c == out->until[out->matched])
+        out->matched++;
+    else
+        out->matched = c == out->until[0];
+    out->done = out->until[out->matched] == '\0';
+}
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool run_workload(const bench_workload *w,
+                         double *seconds,
+                         uint64_t *instret)
+{
+    bench_output out = {.until = w->until};
+    riscv_config config = {
+        .binary = w->binary,
+        .rfs_name = w->rfs_name,
+        .user = w->user,
+        .callbacks =
+            {
+                .opaque = &out,
+                .uart_tx = bench_uart_tx,
+            },
+    };
+
+    *seconds = 0;
+    *instret = 0;
+    riscv_emu *emu = create_emu(&config);
+    if (!emu)
+        return false;
+
+    double start = now_seconds();
+    riscv_emu_state state = EMU_RUNNING;
+    while (state == EMU_RUNNING && !out.done &&
+           get_instret_emu(emu) < BENCH_INSN_LIMIT)
+        state = run_emu_for(emu, BENCH_SLICE);
+    *seconds = now_seconds() - start;
+    *instret = get_instret_emu(emu);
+
+    bool ok = w->until ? out.done
+                       : state == EMU_SHUTDOWN && exit_code_emu(emu) == 0;
+    free_emu(emu);
+    return ok;
+}
+
+int run_benchmark(void)
+{
+    int failed = 0;
+
+    printf("%-12s %9s %16s %10s  %s\n", "workload", "seconds", "instructions",
+           "MIPS", "result");
+    for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+        double seconds;
+        uint64_t instret;
+        bool ok = run_workload(&workloads[i], &seconds, &instret);
+        double mips = seconds > 0 ? instret / seconds / 1e6 : 0;
+
+        printf("%-12s %9.3f %16lu %10.3f  %s\n", workloads[i].name, seconds,
+               instret, mips, ok ? "ok" : "FAIL");
+        fflush(stdout);
+        failed += !ok;
+    }
+    return failed;
+}
@@ -1,4 +1,5 @@
 #include "boot.h"
+#include "dtb.h"
 #include "macros.h"
 #include "memmap.h"
 
@@ -6,16 +7,14 @@
 #include <stdlib.h>
 #include <string.h>
 
-bool init_boot(riscv_boot *boot, uint64_t entry_addr)
+bool init_boot(riscv_boot *boot,
+               uint64_t entry_addr,
+               const riscv_config *config)
 {
-    FILE *fp = fopen(DTB_FILENAME, "rb");
-    if (!fp) {
-        ERROR("Invalid boot rom path.\n");
+    size_t sz;
+    uint8_t *dtb = make_dtb(config, &sz);
+    if (!dtb)
         return false;
-    }
-    fseek(fp, 0, SEEK_END);
-    size_t sz = ftell(fp) * sizeof(uint8_t);
-    rewind(fp);
 
     // reset vector with size 0x20
     uint32_t reset_vec[] = {
@@ -26,25 +25,22 @@ bool init_boot(riscv_boot *boot, uint64_t entry_addr)
         0x0182b283,  // ld     t0,24(t0): load ELF entry point address
         0x28067,     // jr     t0
         0, entry_addr & 0xFFFFFFFF, (entry_addr >> 32)};
+    _Static_assert(sizeof(reset_vec) == BOOT_FDT_OFFSET,
+                   "the device tree should follow the reset vector");
 
     size_t boot_mem_size = sz + sizeof(reset_vec);
     boot->boot_mem = malloc(boot_mem_size);
     if (!boot->boot_mem) {
         ERROR("Error when allocating space through malloc for BOOT_DRAM\n");
+        free(dtb);
         return false;
     }
     boot->boot_mem_size = boot_mem_size;
     // copy boot rom instruction to specific address
     memcpy(boot->boot_mem, reset_vec, sizeof(reset_vec));
     // copy dtb to specific address
-    size_t read_size =
-        fread(boot->boot_mem + sizeof(reset_vec), sizeof(uint8_t), sz, fp);
-    fclose(fp);
-    if (read_size != sz) {
-        ERROR("Error when reading binary through fread.\n");
-        free(boot->boot_mem);
-        return false;
-    }
+    memcpy(boot->boot_mem + sizeof(reset_vec), dtb, sz);
+    free(dtb);
 
     return true;
 }
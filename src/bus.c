@@ -2,51 +2,95 @@
 
 #include "bus.h"
 
-bool init_bus(riscv_bus *bus, const char *filename, const char *rfs_name)
+bool init_bus(riscv_bus *bus, const riscv_config *config)
 {
-    if (!init_mem(&bus->memory, filename))
+    if (!init_mem(&bus->memory, config))
         return false;
 
     /* since the initialize of CLINT / PLIC is simple, we don't put it to
      * another function */
     memset(&bus->clint, 0, sizeof(riscv_clint));
     memset(&bus->plic, 0, sizeof(riscv_plic));
-
-    if (!init_uart(&bus->uart))
+    memset(&bus->ctrl, 0, sizeof(riscv_ctrl));
+    memset(bus->mmio_reads, 0, sizeof(bus->mmio_reads));
+    memset(bus->mmio_writes, 0, sizeof(bus->mmio_writes));
+    init_htif(&bus->htif, bus->memory.tohost_addr, bus->memory.fromhost_addr);
+
+    bus->callbacks = config->callbacks;
+    // the input is received by the emulator when it is recorded
+    bool deferred = config->record && config->record[0] != '\0';
+    if (!init_uart(&bus->uart, config->console, deferred, &bus->callbacks))
         return false;
 
-    if (!init_virtio_blk(&bus->virtio_blk, rfs_name))
+    if (!init_virtio_blk(&bus->virtio_blk, config->rfs_name))
         return false;
 
-    if (!init_boot(&bus->boot, get_entry_addr()))
+    if (!init_boot(&bus->boot, bus->memory.entry_addr, config))
         return false;
 
     return true;
 }
 
+/* DRAM and the boot ROM accept access of any alignment, while the devices only
+ * handle the naturally aligned register access. */
+static bool misaligned_mmio(uint64_t addr, uint8_t size)
+{
+    if (!(addr & ((size >> 3) - 1)))
+        return false;
+    return addr < DRAM_BASE && addr >= CTRL_BASE;
+}
+
 uint64_t read_bus(riscv_bus *bus,
                   uint64_t addr,
                   uint8_t size,
                   riscv_exception *exc)
 {
-    if (addr >= CLINT_BASE && addr < CLINT_END)
+    if (misaligned_mmio(addr, size)) {
+        exc->exception = LoadAddressMisaligned;
+        exc->value = addr;
+        return -1;
+    }
+
+    if (addr >= CTRL_BASE && addr < CTRL_END) {
+        bus->mmio_reads[BUS_CTRL]++;
+        return read_ctrl(&bus->ctrl, addr, size, exc);
+    }
+
+    if (addr >= CLINT_BASE && addr < CLINT_END) {
+        bus->mmio_reads[BUS_CLINT]++;
         return read_clint(&bus->clint, addr, size, exc);
+    }
 
-    if (addr >= PLIC_BASE && addr < PLIC_END)
+    if (addr >= PLIC_BASE && addr < PLIC_END) {
+        bus->mmio_reads[BUS_PLIC]++;
         return read_plic(&bus->plic, addr, size, exc);
+    }
 
-    if (addr >= UART_BASE && addr < UART_END)
+    if (addr >= UART_BASE && addr < UART_END) {
+        bus->mmio_reads[BUS_UART]++;
         return read_uart(&bus->uart, addr, size, exc);
+    }
 
-    if (addr >= VIRTIO_BASE && addr < VIRTIO_END)
+    if (addr >= VIRTIO_BASE && addr < VIRTIO_END) {
+        bus->mmio_reads[BUS_VIRTIO]++;
         return read_virtio_blk(&bus->virtio_blk, addr, size, exc);
+    }
 
     if (addr >= DRAM_BASE && addr < DRAM_END)
         return read_mem(&bus->memory, addr, size, exc);
 
     if ((addr >= BOOT_ROM_BASE) &&
-        (addr < (BOOT_ROM_BASE + bus->boot.boot_mem_size)))
+        (addr < (BOOT_ROM_BASE + bus->boot.boot_mem_size))) {
+        bus->mmio_reads[BUS_BOOT]++;
         return read_boot(&bus->boot, addr, size, exc);
+    }
+
+    uint64_t value;
+    if (bus->callbacks.mmio_read &&
+        bus->callbacks.mmio_read(bus->callbacks.opaque, addr, size, &value)) {
+        bus->mmio_reads[BUS_HOST]++;
+        return value;
+    }
 
     ERROR("Invalid read memory address 0x%lx\n", addr);
     exc->exception = LoadAccessFault;
@@ -61,20 +105,49 @@ bool write_bus(riscv_bus *bus,
                uint64_t value,
                riscv_exception *exc)
 {
-    if (addr >= CLINT_BASE && addr < CLINT_END)
+    if (misaligned_mmio(addr, size)) {
+        exc->exception = StoreAMOAddressMisaligned;
+        exc->value = addr;
+        return false;
+    }
+
+    if (addr >= CTRL_BASE && addr < CTRL_END) {
+        bus->mmio_writes[BUS_CTRL]++;
+        return write_ctrl(&bus->ctrl, addr, size, value, exc);
+    }
+
+    if (addr >= CLINT_BASE && addr < CLINT_END) {
+        bus->mmio_writes[BUS_CLINT]++;
         return write_clint(&bus->clint, addr, size, value, exc);
+    }
 
-    if (addr >= PLIC_BASE && addr < PLIC_END)
+    if (addr >= PLIC_BASE && addr < PLIC_END) {
+        bus->mmio_writes[BUS_PLIC]++;
         return write_plic(&bus->plic, addr, size, value, exc);
+    }
 
-    if (addr >= UART_BASE && addr < UART_END)
+    if (addr >= UART_BASE && addr < UART_END) {
+        bus->mmio_writes[BUS_UART]++;
         return write_uart(&bus->uart, addr, size, value, exc);
+    }
 
-    if (addr >= VIRTIO_BASE && addr < VIRTIO_END)
+    if (addr >= VIRTIO_BASE && addr < VIRTIO_END) {
+        bus->mmio_writes[BUS_VIRTIO]++;
         return write_virtio_blk(&bus->virtio_blk, addr, size, value, exc);
+    }
 
-    if (addr >= DRAM_BASE && addr < DRAM_END)
-        return write_mem(&bus->memory, addr, size, value, exc);
+    if (addr >= DRAM_BASE && addr < DRAM_END) {
+        if (!write_mem(&bus->memory, addr, size, value, exc))
+            return false;
+        notify_dram_write(bus, addr, size >> 3);
+        return true;
+    }
+
+    if (bus->callbacks.mmio_write &&
+        bus->callbacks.mmio_write(bus->callbacks.opaque, addr, size, value)) {
+        bus->mmio_writes[BUS_HOST]++;
+        return true;
+    }
 
     ERROR("Invalid write memory address 0x%ld\n", addr);
     exc->exception = StoreAMOAccessFault;
@@ -82,9 +155,9 @@ bool write_bus(riscv_bus *bus,
     return false;
 }
 
-void tick_bus(riscv_bus *bus, riscv_csr *csr)
+void tick_bus(riscv_bus *bus, riscv_csr *csr, uint64_t ticks)
 {
-    tick_clint(&bus->clint, csr);
+    tick_clint(&bus->clint, csr, ticks);
     tick_plic(&bus->plic, csr, uart_is_interrupt(&bus->uart),
               virtio_is_interrupt(&bus->virtio_blk));
     tick_virtio_blk(&bus->virtio_blk);
@@ -91,9 +91,9 @@ write_clint_fail:
     return false;
 }
 
-void tick_clint(riscv_clint *clint, riscv_csr *csr)
+void tick_clint(riscv_clint *clint, riscv_csr *csr, uint64_t ticks)
 {
-    clint->mtime++;
+    clint->mtime += ticks;
 
     if (clint->msip & 1)
         set_csr_bits(csr, MIP, MIP_MSIP);
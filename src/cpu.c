@@ -5,12 +5,14 @@
 #include <string.h>
 
 #include "cpu.h"
+#include "macros.h"
 
 static uint64_t read_cpu(riscv_cpu *cpu, uint64_t addr, uint8_t size);
 static bool write_cpu(riscv_cpu *cpu,
                       uint64_t addr,
                       uint8_t size,
                       uint64_t value);
+static uint64_t addr_translate(riscv_cpu *cpu, uint64_t addr, Access access);
 
 /* Many type conversion are appied for expected result. To know the detail, you
  * should check out the International Standard of C:
@@ -148,6 +150,84 @@ static void instr_fencei(__attribute__((unused)) riscv_cpu *cpu)
 #endif
 }
 
+/* Cache-block management (Zicbom) and zero (Zicboz) instructions
+ *
+ * There is no cache to maintain in the emulator, so cbo.clean, cbo.flush and
+ * cbo.inval only check the permission. cbo.zero is executed by a single
+ * address translation for the whole block, which is then cleared by one
+ * memset if the block is in DRAM. */
+
+// check the enable bits of menvcfg / senvcfg by the current privilege mode
+static bool cbo_enabled(riscv_cpu *cpu, uint64_t mask)
+{
+    if (cpu->mode.mode != MACHINE && !(cpu->csr.reg[MENVCFG] & mask))
+        return false;
+    if (cpu->mode.mode == USER && !(cpu->csr.reg[SENVCFG] & mask))
+        return false;
+    return true;
+}
+
+static void cbo_manage(riscv_cpu *cpu, uint64_t mask)
+{
+    if (!cbo_enabled(cpu, mask)) {
+        cpu->exc.exception = IllegalInstruction;
+        cpu->exc.value = cpu->instr.instr;
+        return;
+    }
+
+    /* The block is accessed only if it could be read or written. Since there
+     * isn't any page with only write permission, the check of load is
+     * sufficient. Note that the fault is reported as store/AMO. */
+    uint64_t addr = cpu->xreg[cpu->instr.rs1] & ~(CBO_BLOCK_SIZE - 1UL);
+    addr_translate(cpu, addr, Access_Load);
+    if (cpu->exc.exception == LoadPageFault)
+        cpu->exc.exception = StoreAMOPageFault;
+}
+
+static void instr_cboinval(riscv_cpu *cpu)
+{
+    cbo_manage(cpu, MENVCFG_CBIE);
+}
+
+static void instr_cboclean(riscv_cpu *cpu)
+{
+    cbo_manage(cpu, MENVCFG_CBCFE);
+}
+
+static void instr_cboflush(riscv_cpu *cpu)
+{
+    cbo_manage(cpu, MENVCFG_CBCFE);
+}
+
+static void instr_cbozero(riscv_cpu *cpu)
+{
+    if (!cbo_enabled(cpu, MENVCFG_CBZE)) {
+        cpu->exc.exception = IllegalInstruction;
+        cpu->exc.value = cpu->instr.instr;
+        return;
+    }
+
+    // the block never crosses the page boundary
+    uint64_t addr = cpu->xreg[cpu->instr.rs1] & ~(CBO_BLOCK_SIZE - 1UL);
+    uint64_t paddr = addr_translate(cpu, addr, Access_Store);
+    if (cpu->exc.exception != NoException)
+        return;
+
+    if (paddr >= DRAM_BASE && paddr + CBO_BLOCK_SIZE <= DRAM_END) {
+        memset(cpu->bus.memory.mem + (paddr - DRAM_BASE), 0, CBO_BLOCK_SIZE);
+        mark_dirty(cpu->bus.memory.dirty, paddr - DRAM_BASE, CBO_BLOCK_SIZE);
+        notify_dram_write(&cpu->bus, paddr, CBO_BLOCK_SIZE);
+        return;
+    }
+
+    for (uint64_t i = 0; i < CBO_BLOCK_SIZE; i += 8) {
+        if (!write_bus(&cpu->bus, paddr + i, 64, 0, &cpu->exc)) {
+            cpu->exc.value = addr + i;
+            return;
+        }
+    }
+}
+
 static void instr_addi(riscv_cpu *cpu)
 {
     cpu->xreg[cpu->instr.rd] = cpu->xreg[cpu->instr.rs1] + cpu->instr.imm;
@@ -555,6 +635,275 @@ static void instr_remuw(riscv_cpu *cpu)
     }
 }
 
+/* Bit-manipulation extensions: Zba, Zbb and Zbs
+ *
+ * Each of these instructions is mapped to a single gcc builtin or an idiom
+ * which gcc recognizes (e.g. rotate), so it could be executed by one host
+ * instruction on most of the machines. */
+
+static inline uint64_t rotl64(uint64_t x, uint64_t shamt)
+{
+    return (x << (shamt & 63)) | (x >> (-shamt & 63));
+}
+
+static inline uint64_t rotr64(uint64_t x, uint64_t shamt)
+{
+    return (x >> (shamt & 63)) | (x << (-shamt & 63));
+}
+
+static inline uint32_t rotl32(uint32_t x, uint32_t shamt)
+{
+    return (x << (shamt & 31)) | (x >> (-shamt & 31));
+}
+
+static inline uint32_t rotr32(uint32_t x, uint32_t shamt)
+{
+    return (x >> (shamt & 31)) | (x << (-shamt & 31));
+}
+
+static void instr_sh1add(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        cpu->xreg[cpu->instr.rs2] + (cpu->xreg[cpu->instr.rs1] << 1);
+}
+
+static void instr_sh2add(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        cpu->xreg[cpu->instr.rs2] + (cpu->xreg[cpu->instr.rs1] << 2);
+}
+
+static void instr_sh3add(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        cpu->xreg[cpu->instr.rs2] + (cpu->xreg[cpu->instr.rs1] << 3);
+}
+
+static void instr_adduw(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] = cpu->xreg[cpu->instr.rs2] +
+                               (uint32_t) cpu->xreg[cpu->instr.rs1];
+}
+
+static void instr_sh1adduw(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        cpu->xreg[cpu->instr.rs2] +
+        ((uint64_t) (uint32_t) cpu->xreg[cpu->instr.rs1] << 1);
+}
+
+static void instr_sh2adduw(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        cpu->xreg[cpu->instr.rs2] +
+        ((uint64_t) (uint32_t) cpu->xreg[cpu->instr.rs1] << 2);
+}
+
+static void instr_sh3adduw(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        cpu->xreg[cpu->instr.rs2] +
+        ((uint64_t) (uint32_t) cpu->xreg[cpu->instr.rs1] << 3);
+}
+
+static void instr_slliuw(riscv_cpu *cpu)
+{
+    uint64_t shamt = (cpu->instr.imm & 0x3f);
+    cpu->xreg[cpu->instr.rd] = (uint64_t) (uint32_t) cpu->xreg[cpu->instr.rs1]
+                               << shamt;
+}
+
+static void instr_andn(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        cpu->xreg[cpu->instr.rs1] & ~cpu->xreg[cpu->instr.rs2];
+}
+
+static void instr_orn(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        cpu->xreg[cpu->instr.rs1] | ~cpu->xreg[cpu->instr.rs2];
+}
+
+static void instr_xnor(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        ~(cpu->xreg[cpu->instr.rs1] ^ cpu->xreg[cpu->instr.rs2]);
+}
+
+static void instr_clz(riscv_cpu *cpu)
+{
+    uint64_t value = cpu->xreg[cpu->instr.rs1];
+    cpu->xreg[cpu->instr.rd] = value ? __builtin_clzll(value) : 64;
+}
+
+static void instr_clzw(riscv_cpu *cpu)
+{
+    uint32_t value = cpu->xreg[cpu->instr.rs1];
+    cpu->xreg[cpu->instr.rd] = value ? __builtin_clz(value) : 32;
+}
+
+static void instr_ctz(riscv_cpu *cpu)
+{
+    uint64_t value = cpu->xreg[cpu->instr.rs1];
+    cpu->xreg[cpu->instr.rd] = value ? __builtin_ctzll(value) : 64;
+}
+
+static void instr_ctzw(riscv_cpu *cpu)
+{
+    uint32_t value = cpu->xreg[cpu->instr.rs1];
+    cpu->xreg[cpu->instr.rd] = value ? __builtin_ctz(value) : 32;
+}
+
+static void instr_cpop(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] = __builtin_popcountll(cpu->xreg[cpu->instr.rs1]);
+}
+
+static void instr_cpopw(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        __builtin_popcount((uint32_t) cpu->xreg[cpu->instr.rs1]);
+}
+
+static void instr_max(riscv_cpu *cpu)
+{
+    int64_t a = cpu->xreg[cpu->instr.rs1], b = cpu->xreg[cpu->instr.rs2];
+    cpu->xreg[cpu->instr.rd] = a > b ? a : b;
+}
+
+static void instr_maxu(riscv_cpu *cpu)
+{
+    uint64_t a = cpu->xreg[cpu->instr.rs1], b = cpu->xreg[cpu->instr.rs2];
+    cpu->xreg[cpu->instr.rd] = a > b ? a : b;
+}
+
+static void instr_min(riscv_cpu *cpu)
+{
+    int64_t a = cpu->xreg[cpu->instr.rs1], b = cpu->xreg[cpu->instr.rs2];
+    cpu->xreg[cpu->instr.rd] = a < b ? a : b;
+}
+
+static void instr_minu(riscv_cpu *cpu)
+{
+    uint64_t a = cpu->xreg[cpu->instr.rs1], b = cpu->xreg[cpu->instr.rs2];
+    cpu->xreg[cpu->instr.rd] = a < b ? a : b;
+}
+
+static void instr_sextb(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] = (int8_t) cpu->xreg[cpu->instr.rs1];
+}
+
+static void instr_sexth(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] = (int16_t) cpu->xreg[cpu->instr.rs1];
+}
+
+static void instr_zexth(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] = (uint16_t) cpu->xreg[cpu->instr.rs1];
+}
+
+static void instr_rol(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        rotl64(cpu->xreg[cpu->instr.rs1], cpu->xreg[cpu->instr.rs2]);
+}
+
+static void instr_rolw(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] = (int32_t) rotl32(cpu->xreg[cpu->instr.rs1],
+                                                cpu->xreg[cpu->instr.rs2]);
+}
+
+static void instr_ror(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        rotr64(cpu->xreg[cpu->instr.rs1], cpu->xreg[cpu->instr.rs2]);
+}
+
+static void instr_rori(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        rotr64(cpu->xreg[cpu->instr.rs1], cpu->instr.imm & 0x3f);
+}
+
+static void instr_rorw(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] = (int32_t) rotr32(cpu->xreg[cpu->instr.rs1],
+                                                cpu->xreg[cpu->instr.rs2]);
+}
+
+static void instr_roriw(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        (int32_t) rotr32(cpu->xreg[cpu->instr.rs1], cpu->instr.imm & 0x1f);
+}
+
+// set each byte of the result to all ones if the byte of rs1 is non-zero
+static void instr_orcb(riscv_cpu *cpu)
+{
+    uint64_t value = cpu->xreg[cpu->instr.rs1];
+    value |= (value >> 4) & 0x0f0f0f0f0f0f0f0fUL;
+    value |= (value >> 2) & 0x3333333333333333UL;
+    value |= (value >> 1) & 0x5555555555555555UL;
+    cpu->xreg[cpu->instr.rd] = (value & 0x0101010101010101UL) * 0xff;
+}
+
+static void instr_rev8(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] = __builtin_bswap64(cpu->xreg[cpu->instr.rs1]);
+}
+
+static void instr_bclr(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] = cpu->xreg[cpu->instr.rs1] &
+                               ~(1UL << (cpu->xreg[cpu->instr.rs2] & 0x3f));
+}
+
+static void instr_bclri(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        cpu->xreg[cpu->instr.rs1] & ~(1UL << (cpu->instr.imm & 0x3f));
+}
+
+static void instr_bext(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        (cpu->xreg[cpu->instr.rs1] >> (cpu->xreg[cpu->instr.rs2] & 0x3f)) & 1;
+}
+
+static void instr_bexti(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        (cpu->xreg[cpu->instr.rs1] >> (cpu->instr.imm & 0x3f)) & 1;
+}
+
+static void instr_binv(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] = cpu->xreg[cpu->instr.rs1] ^
+                               (1UL << (cpu->xreg[cpu->instr.rs2] & 0x3f));
+}
+
+static void instr_binvi(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        cpu->xreg[cpu->instr.rs1] ^ (1UL << (cpu->instr.imm & 0x3f));
+}
+
+static void instr_bset(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] = cpu->xreg[cpu->instr.rs1] |
+                               (1UL << (cpu->xreg[cpu->instr.rs2] & 0x3f));
+}
+
+static void instr_bseti(riscv_cpu *cpu)
+{
+    cpu->xreg[cpu->instr.rd] =
+        cpu->xreg[cpu->instr.rs1] | (1UL << (cpu->instr.imm & 0x3f));
+}
+
 static void instr_beq(riscv_cpu *cpu)
 {
     if (cpu->xreg[cpu->instr.rs1] == cpu->xreg[cpu->instr.rs2])
@@ -613,6 +962,19 @@ static void instr_ecall(riscv_cpu *cpu)
 {
     assert(cpu->instr.instr & 0x73);
 
+    /* the SBI call from the S-mode kernel is serviced by the emulator directly
+     * without taking a trap if the built-in SBI is enabled */
+    if (cpu->mode.mode == SUPERVISOR && cpu->sbi.enable) {
+        sbi_ecall(cpu);
+        return;
+    }
+
+    // so is the syscall from the program run by the user-mode emulation
+    if (cpu->mode.mode == USER && cpu->user.enable) {
+        user_ecall(cpu);
+        return;
+    }
+
     cpu->exc.value = cpu->pc - 4;
     switch (cpu->mode.mode) {
     case MACHINE:
@@ -678,10 +1040,49 @@ static void instr_mret(riscv_cpu *cpu)
 #endif
 }
 
-static void instr_wfi(__attribute__((unused)) riscv_cpu *cpu) {}
+/* The ticks until the next timer interrupt of CLINT or stimecmp which is
+ * enabled, or UINT64_MAX if there is none. */
+static uint64_t timer_deadline(riscv_cpu *cpu)
+{
+    riscv_clint *clint = &cpu->bus.clint;
+    riscv_csr *csr = &cpu->csr;
+
+    uint64_t ticks = UINT64_MAX;
+    if ((csr->reg[MIE] & MIP_MTIP) && clint->mtimecmp > clint->mtime)
+        ticks = clint->mtimecmp - clint->mtime;
+    if ((csr->reg[MIE] & MIP_STIP) && (csr->reg[MENVCFG] & MENVCFG_STCE) &&
+        csr->reg[STIMECMP] > csr->reg[TIME] &&
+        csr->reg[STIMECMP] - csr->reg[TIME] < ticks)
+        ticks = csr->reg[STIMECMP] - csr->reg[TIME];
+    return ticks;
+}
+
+/* WFI waits until an enabled interrupt is pending, instead of spinning in the
+ * idle loop of the guest. With the instruction-count timebase, nothing but the
+ * timer could change while no instruction is executed, so the time skips to
+ * the next deadline. With the host timebase, the host blocks until the
+ * deadline or the input of UART. virtio-blk completes the requests when they
+ * are notified and there is one hart, so nothing else wakes it up. */
+static void instr_wfi(riscv_cpu *cpu)
+{
+    riscv_csr *csr = &cpu->csr;
+    if (csr->reg[MIP] & csr->reg[MIE])
+        return;
+
+    uint64_t ticks = timer_deadline(cpu);
+    if (cpu->timebase.mode == TIMEBASE_INSTRET) {
+        if (ticks != UINT64_MAX) {
+            csr->reg[TIME] += ticks;
+            cpu->bus.clint.mtime += ticks;
+        }
+        return;
+    }
+    wait_uart(&cpu->bus.uart, wait_timebase(&cpu->timebase, ticks));
+}
 
-static void instr_sfencevma(__attribute__((unused)) riscv_cpu *cpu)
+static void instr_sfencevma(riscv_cpu *cpu)
 {
+    cpu->stats.tlb_flushes++;
 #ifdef ICACHE_CONFIG
     /* FIXME: What is ASID? How should we support this? */
 
@@ -702,8 +1103,44 @@ static void instr_hfencebvma(__attribute__((unused)) riscv_cpu *cpu) {}
 
 static void instr_hfencegvma(__attribute__((unused)) riscv_cpu *cpu) {}
 
+/* The counters could be read in the lower privilege modes only if they are
+ * enabled by mcounteren, and also by scounteren for U-mode. Otherwise, the
+ * access raises an illegal instruction exception. */
+static bool csr_accessible(riscv_cpu *cpu)
+{
+    uint16_t addr = cpu->instr.imm;
+    if (cpu->mode.mode == MACHINE)
+        return true;
+
+    /* stimecmp is accessible to S-mode only if Sstc is enabled by
+     * menvcfg.STCE and time is by mcounteren.TM */
+    if (addr == STIMECMP) {
+        if (cpu->mode.mode == SUPERVISOR &&
+            (read_csr(&cpu->csr, MENVCFG) & MENVCFG_STCE) &&
+            (read_csr(&cpu->csr, MCOUNTEREN) & (1UL << (TIME - CYCLE))))
+            return true;
+        goto illegal;
+    }
+
+    if (addr < CYCLE || addr > HPMCOUNTER31)
+        return true;
+
+    uint64_t bit = 1UL << (addr - CYCLE);
+    if ((read_csr(&cpu->csr, MCOUNTEREN) & bit) &&
+        (cpu->mode.mode != USER || (read_csr(&cpu->csr, SCOUNTEREN) & bit)))
+        return true;
+
+illegal:
+
+    cpu->exc.exception = IllegalInstruction;
+    cpu->exc.value = cpu->instr.instr;
+    return false;
+}
+
 static void instr_csrrw(riscv_cpu *cpu)
 {
+    if (!csr_accessible(cpu))
+        return;
     uint64_t tmp = read_csr(&cpu->csr, cpu->instr.imm);
     write_csr(&cpu->csr, cpu->instr.imm, cpu->xreg[cpu->instr.rs1]);
     cpu->xreg[cpu->instr.rd] = tmp;
@@ -711,6 +1148,8 @@ static void instr_csrrw(riscv_cpu *cpu)
 
 static void instr_csrrs(riscv_cpu *cpu)
 {
+    if (!csr_accessible(cpu))
+        return;
     uint64_t tmp = read_csr(&cpu->csr, cpu->instr.imm);
     write_csr(&cpu->csr, cpu->instr.imm, tmp | cpu->xreg[cpu->instr.rs1]);
     cpu->xreg[cpu->instr.rd] = tmp;
@@ -718,6 +1157,8 @@ static void instr_csrrs(riscv_cpu *cpu)
 
 static void instr_csrrc(riscv_cpu *cpu)
 {
+    if (!csr_accessible(cpu))
+        return;
     uint64_t tmp = read_csr(&cpu->csr, cpu->instr.imm);
     write_csr(&cpu->csr, cpu->instr.imm, tmp & (~cpu->xreg[cpu->instr.rs1]));
     cpu->xreg[cpu->instr.rd] = tmp;
@@ -725,6 +1166,8 @@ static void instr_csrrc(riscv_cpu *cpu)
 
 static void instr_csrrwi(riscv_cpu *cpu)
 {
+    if (!csr_accessible(cpu))
+        return;
     uint64_t zimm = cpu->instr.rs1;
     cpu->xreg[cpu->instr.rd] = read_csr(&cpu->csr, cpu->instr.imm);
     write_csr(&cpu->csr, cpu->instr.imm, zimm);
@@ -732,6 +1175,8 @@ static void instr_csrrwi(riscv_cpu *cpu)
 
 static void instr_csrrsi(riscv_cpu *cpu)
 {
+    if (!csr_accessible(cpu))
+        return;
     uint64_t zimm = cpu->instr.rs1;
     uint64_t tmp = read_csr(&cpu->csr, cpu->instr.imm);
     write_csr(&cpu->csr, cpu->instr.imm, tmp | zimm);
@@ -740,15 +1185,32 @@ static void instr_csrrsi(riscv_cpu *cpu)
 
 static void instr_csrrci(riscv_cpu *cpu)
 {
+    if (!csr_accessible(cpu))
+        return;
     uint64_t zimm = cpu->instr.rs1;
     uint64_t tmp = read_csr(&cpu->csr, cpu->instr.imm);
     write_csr(&cpu->csr, cpu->instr.imm, tmp & (~zimm));
     cpu->xreg[cpu->instr.rd] = tmp;
 }
 
+/* The atomics must be naturally aligned, otherwise they raise the misaligned
+ * exception before any access, which is for load by LR and store by others. */
+static bool amo_aligned(riscv_cpu *cpu, uint8_t size, bool is_load)
+{
+    uint64_t addr = cpu->xreg[cpu->instr.rs1];
+    if (!(addr & ((size >> 3) - 1)))
+        return true;
+    cpu->exc.exception =
+        is_load ? LoadAddressMisaligned : StoreAMOAddressMisaligned;
+    cpu->exc.value = addr;
+    return false;
+}
+
 /* TODO: the lock acquire and realease are not implemented now */
 static void instr_amoaddw(riscv_cpu *cpu)
 {
+    if (!amo_aligned(cpu, 32, false))
+        return;
     uint64_t tmp = read_cpu(cpu, cpu->xreg[cpu->instr.rs1], 32);
     if (cpu->exc.exception != NoException) {
         assert(tmp == (uint64_t) -1);
@@ -763,6 +1225,8 @@ static void instr_amoaddw(riscv_cpu *cpu)
 
 static void instr_amoswapw(riscv_cpu *cpu)
 {
+    if (!amo_aligned(cpu, 32, false))
+        return;
     uint64_t tmp = read_cpu(cpu, cpu->xreg[cpu->instr.rs1], 32);
     if (cpu->exc.exception != NoException) {
         assert(tmp == (uint64_t) -1);
@@ -776,6 +1240,8 @@ static void instr_amoswapw(riscv_cpu *cpu)
 
 static void instr_lrw(riscv_cpu *cpu)
 {
+    if (!amo_aligned(cpu, 32, true))
+        return;
     uint64_t addr = cpu->xreg[cpu->instr.rs1];
     uint64_t tmp = read_cpu(cpu, addr, 32);
     if (cpu->exc.exception != NoException) {
@@ -788,6 +1254,8 @@ static void instr_lrw(riscv_cpu *cpu)
 
 static void instr_scw(riscv_cpu *cpu)
 {
+    if (!amo_aligned(cpu, 32, false))
+        return;
     uint64_t addr = cpu->xreg[cpu->instr.rs1];
 
     if (cpu->reservation == addr) {
@@ -798,172 +1266,1361 @@ static void instr_scw(riscv_cpu *cpu)
         cpu->xreg[cpu->instr.rd] = 1;
     }
 
-    // invalidate the reservation
-    cpu->reservation = (uint64_t) -1;
+    // invalidate the reservation
+    cpu->reservation = (uint64_t) -1;
+}
+
+static void instr_amoxorw(riscv_cpu *cpu)
+{
+    if (!amo_aligned(cpu, 32, false))
+        return;
+    uint64_t addr = cpu->xreg[cpu->instr.rs1];
+    uint64_t tmp = read_cpu(cpu, addr, 32);
+    if (cpu->exc.exception != NoException) {
+        assert(tmp == (uint64_t) -1);
+        return;
+    }
+
+    uint64_t value = (int32_t) ((tmp ^ cpu->xreg[cpu->instr.rs2]) & 0xffffffff);
+    if (!write_cpu(cpu, addr, 32, value))
+        return;
+
+    cpu->xreg[cpu->instr.rd] = (int32_t) (tmp & 0xffffffff);
+}
+
+static void instr_amoorw(riscv_cpu *cpu)
+{
+    if (!amo_aligned(cpu, 32, false))
+        return;
+    uint64_t addr = cpu->xreg[cpu->instr.rs1];
+    uint64_t tmp = read_cpu(cpu, addr, 32);
+    if (cpu->exc.exception != NoException) {
+        assert(tmp == (uint64_t) -1);
+        return;
+    }
+
+    uint64_t value = (int32_t) ((tmp | cpu->xreg[cpu->instr.rs2]) & 0xffffffff);
+    if (!write_cpu(cpu, addr, 32, value))
+        return;
+
+    cpu->xreg[cpu->instr.rd] = (int32_t) (tmp & 0xffffffff);
+}
+
+static void instr_amoandw(riscv_cpu *cpu)
+{
+    if (!amo_aligned(cpu, 32, false))
+        return;
+    uint64_t addr = cpu->xreg[cpu->instr.rs1];
+    uint64_t tmp = read_cpu(cpu, addr, 32);
+    if (cpu->exc.exception != NoException) {
+        assert(tmp == (uint64_t) -1);
+        return;
+    }
+
+    uint64_t value = (int32_t) ((tmp & cpu->xreg[cpu->instr.rs2]) & 0xffffffff);
+    if (!write_cpu(cpu, addr, 32, value))
+        return;
+
+    cpu->xreg[cpu->instr.rd] = (int32_t) (tmp & 0xffffffff);
+}
+
+/*
+static void instr_amominw(riscv_cpu *cpu){}
+static void instr_amomaxw(riscv_cpu *cpu){}
+*/
+
+static void instr_amoaddd(riscv_cpu *cpu)
+{
+    if (!amo_aligned(cpu, 64, false))
+        return;
+    uint64_t tmp = read_cpu(cpu, cpu->xreg[cpu->instr.rs1], 64);
+    if (cpu->exc.exception != NoException) {
+        assert(tmp == (uint64_t) -1);
+        return;
+    }
+    if (!write_cpu(cpu, cpu->xreg[cpu->instr.rs1], 64,
+                   tmp + cpu->xreg[cpu->instr.rs2]))
+        return;
+    cpu->xreg[cpu->instr.rd] = tmp;
+}
+
+static void instr_amoswapd(riscv_cpu *cpu)
+{
+    if (!amo_aligned(cpu, 64, false))
+        return;
+    uint64_t tmp = read_cpu(cpu, cpu->xreg[cpu->instr.rs1], 64);
+    if (cpu->exc.exception != NoException) {
+        assert(tmp == (uint64_t) -1);
+        return;
+    }
+    if (!write_cpu(cpu, cpu->xreg[cpu->instr.rs1], 64,
+                   cpu->xreg[cpu->instr.rs2]))
+        return;
+    cpu->xreg[cpu->instr.rd] = tmp;
+}
+
+
+static void instr_lrd(riscv_cpu *cpu)
+{
+    if (!amo_aligned(cpu, 64, true))
+        return;
+    uint64_t addr = cpu->xreg[cpu->instr.rs1];
+    uint64_t tmp = read_cpu(cpu, addr, 64);
+    if (cpu->exc.exception != NoException) {
+        assert(tmp == (uint64_t) -1);
+        return;
+    }
+    cpu->xreg[cpu->instr.rd] = tmp;
+    cpu->reservation = addr;
+}
+
+
+static void instr_scd(riscv_cpu *cpu)
+{
+    if (!amo_aligned(cpu, 64, false))
+        return;
+    uint64_t addr = cpu->xreg[cpu->instr.rs1];
+
+    if (cpu->reservation == addr) {
+        if (!write_cpu(cpu, addr, 64, cpu->xreg[cpu->instr.rs2]))
+            return;
+        cpu->xreg[cpu->instr.rd] = 0;
+    } else {
+        cpu->xreg[cpu->instr.rd] = 1;
+    }
+
+    // invalidate the reservation
+    cpu->reservation = (uint64_t) -1;
+}
+
+
+static void instr_amoxord(riscv_cpu *cpu)
+{
+    if (!amo_aligned(cpu, 64, false))
+        return;
+    uint64_t addr = cpu->xreg[cpu->instr.rs1];
+    uint64_t tmp = read_cpu(cpu, addr, 64);
+    if (cpu->exc.exception != NoException) {
+        assert(tmp == (uint64_t) -1);
+        return;
+    }
+
+    uint64_t value = tmp ^ cpu->xreg[cpu->instr.rs2];
+    if (!write_cpu(cpu, addr, 64, value))
+        return;
+
+    cpu->xreg[cpu->instr.rd] = tmp;
+}
+
+static void instr_amoord(riscv_cpu *cpu)
+{
+    if (!amo_aligned(cpu, 64, false))
+        return;
+    uint64_t addr = cpu->xreg[cpu->instr.rs1];
+    uint64_t tmp = read_cpu(cpu, addr, 64);
+    if (cpu->exc.exception != NoException) {
+        assert(tmp == (uint64_t) -1);
+        return;
+    }
+
+    uint64_t value = tmp | cpu->xreg[cpu->instr.rs2];
+    if (!write_cpu(cpu, addr, 64, value))
+        return;
+
+    cpu->xreg[cpu->instr.rd] = tmp;
+}
+
+static void instr_amoandd(riscv_cpu *cpu)
+{
+    if (!amo_aligned(cpu, 64, false))
+        return;
+    uint64_t addr = cpu->xreg[cpu->instr.rs1];
+    uint64_t tmp = read_cpu(cpu, addr, 64);
+    if (cpu->exc.exception != NoException) {
+        assert(tmp == (uint64_t) -1);
+        return;
+    }
+
+    uint64_t value = tmp & cpu->xreg[cpu->instr.rs2];
+    if (!write_cpu(cpu, addr, 64, value))
+        return;
+
+    cpu->xreg[cpu->instr.rd] = tmp;
+}
+
+/*
+static void instr_amomind(riscv_cpu *cpu){}
+static void instr_amomaxd(riscv_cpu *cpu){}
+*/
+
+/* Vector extension
+ *
+ * The elements of a vector register group are stored as a plain array in
+ * cpu->vreg, so each instruction is executed by the element kernels in
+ * vector.c on the whole group at once. The general flow of the arithmetic
+ * instructions is:
+ *  1. check vtype and the register group alignment
+ *  2. prepare the operand vs1, which is splatted from the scalar operand for
+ *     .vx / .vi / .vf form
+ *  3. run the kernel on the destination directly if unmasked, otherwise run the
+ *     kernel on a temporary copy and merge the active elements back
+ *
+ * Note that vstart is always treated as 0, since all of the instructions
+ * are executed entirely or not at all, except the fault-only-first load. */
+
+#define VREG(cpu, n) (&(cpu)->vreg[(n) * VREG_SIZE])
+// the mask bit inst[25], which is 1 if the instruction is unmasked
+#define VM(cpu) (((cpu)->instr.instr >> 25) & 0x1)
+// the sign-extended 5-bit immediate in the field rs1
+#define SIMM5(cpu) ((uint64_t) ((int8_t) ((cpu)->instr.rs1 << 3) >> 3))
+
+// the source of operand vs1
+typedef enum {
+    VEC_VV,   // vector register
+    VEC_VX,   // integer register
+    VEC_VI,   // sign-extended immediate
+    VEC_VUI,  // zero-extended immediate
+    VEC_VF,   // floating-point register
+    VEC_V,    // none, for unary operations
+} vec_operand;
+
+// the field mop of vector load / store
+enum {
+    VEC_UNIT_STRIDE,
+    VEC_INDEXED_UNORDERED,
+    VEC_STRIDED,
+    VEC_INDEXED_ORDERED
+};
+
+static inline unsigned int vec_sew(riscv_cpu *cpu)
+{
+    return (cpu->csr.reg[VTYPE] & VTYPE_VSEW) >> 3;
+}
+
+// return log2(LMUL), which is negative for fractional LMUL
+static inline int vec_lmul(riscv_cpu *cpu)
+{
+    return ((int) (cpu->csr.reg[VTYPE] & VTYPE_VLMUL) ^ 4) - 4;
+}
+
+static inline uint64_t vec_get(const uint8_t *v, unsigned int sew, uint64_t i)
+{
+    uint64_t value = 0;
+    memcpy(&value, v + (i << sew), 1 << sew);
+    return value;
+}
+
+static inline void vec_set(uint8_t *v,
+                           unsigned int sew,
+                           uint64_t i,
+                           uint64_t value)
+{
+    memcpy(v + (i << sew), &value, 1 << sew);
+}
+
+static bool vec_illegal(riscv_cpu *cpu)
+{
+    cpu->exc.exception = IllegalInstruction;
+    cpu->exc.value = cpu->instr.instr;
+    return false;
+}
+
+/* The vector instructions are illegal if the vector unit is off by
+ * mstatus.VS. */
+static bool vec_enabled(riscv_cpu *cpu)
+{
+    if (!(cpu->csr.reg[MSTATUS] & SSTATUS_VS))
+        return vec_illegal(cpu);
+    return true;
+}
+
+// the instructions which depend on vtype are illegal if vtype.vill is set
+static bool vec_begin(riscv_cpu *cpu)
+{
+    if (!vec_enabled(cpu))
+        return false;
+    if (cpu->csr.reg[VTYPE] & VTYPE_VILL)
+        return vec_illegal(cpu);
+    return true;
+}
+
+// mark the vector state as dirty to let the OS save it on context switch
+static void vec_finish(riscv_cpu *cpu)
+{
+    cpu->csr.reg[VSTART] = 0;
+    cpu->csr.reg[MSTATUS] |= SSTATUS_VS;
+}
+
+/* the register number of a group should be aligned to EMUL, which also
+ * promises that the group won't exceed the last vector register */
+static bool vec_check_group(riscv_cpu *cpu, uint8_t reg, int emul)
+{
+    if (emul < -3 || emul > 3)
+        return vec_illegal(cpu);
+    if (emul > 0 && (reg & ((1 << emul) - 1)))
+        return vec_illegal(cpu);
+    return true;
+}
+
+static uint64_t vec_vlmax(unsigned int sew, int lmul)
+{
+    uint64_t elems = VLEN >> (3 + sew);
+    return lmul >= 0 ? elems << lmul : elems >> -lmul;
+}
+
+/* Return the pointer to the operand vs1. The scalar operand is splatted to
+ * the buffer, which should be able to hold a register group. NULL is returned
+ * if the operand is invalid under the current SEW. */
+static const void *vec_operand1(riscv_cpu *cpu,
+                                vec_operand form,
+                                unsigned int sew,
+                                uint64_t vl,
+                                uint8_t *buf)
+{
+    uint64_t value;
+
+    switch (form) {
+    case VEC_VV:
+        return VREG(cpu, cpu->instr.rs1);
+    case VEC_V:
+        return VREG(cpu, cpu->instr.rs2);
+    case VEC_VX:
+        value = cpu->xreg[cpu->instr.rs1];
+        break;
+    case VEC_VI:
+        value = SIMM5(cpu);
+        break;
+    case VEC_VUI:
+        value = cpu->instr.rs1;
+        break;
+    case VEC_VF:
+        value = cpu->freg[cpu->instr.rs1].u;
+        if (sew == 2) {
+            // a single-precision value is valid only if it is NaN-boxed
+            value = (value >> 32) == 0xffffffff ? value & 0xffffffff
+                                                : 0x7fc00000;
+        } else if (sew != 3) {
+            return NULL;
+        }
+        break;
+    default:
+        return NULL;
+    }
+
+    vec_splat(buf, value, sew, vl ? vl : 1);
+    return buf;
+}
+
+static void vec_arith(riscv_cpu *cpu,
+                      const vec_arith_fn *kernel,
+                      vec_operand form)
+{
+    if (!vec_begin(cpu))
+        return;
+
+    unsigned int sew = vec_sew(cpu);
+    int lmul = vec_lmul(cpu);
+    uint64_t vl = cpu->csr.reg[VL];
+
+    vec_arith_fn fn = kernel[sew];
+    if (fn == NULL) {
+        vec_illegal(cpu);
+        return;
+    }
+
+    if (!vec_check_group(cpu, cpu->instr.rd, lmul) ||
+        !vec_check_group(cpu, cpu->instr.rs2, lmul) ||
+        (form == VEC_VV && !vec_check_group(cpu, cpu->instr.rs1, lmul)))
+        return;
+
+    uint8_t buf[VGROUP_MAX] __attribute__((aligned(32)));
+    const void *vs1 = vec_operand1(cpu, form, sew, vl, buf);
+    if (vs1 == NULL) {
+        vec_illegal(cpu);
+        return;
+    }
+
+    uint8_t *vd = VREG(cpu, cpu->instr.rd);
+    uint8_t *vs2 = VREG(cpu, cpu->instr.rs2);
+
+    if (VM(cpu)) {
+        fn(vd, vs2, vs1, vl);
+    } else {
+        uint8_t tmp[VGROUP_MAX] __attribute__((aligned(32)));
+        uint8_t mask[VLEN];
+
+        memcpy(tmp, vd, vl << sew);
+        fn(tmp, vs2, vs1, vl);
+        vec_unpack_mask(mask, VREG(cpu, 0), vl);
+        vec_merge(vd, tmp, mask, sew, vl);
+    }
+
+    vec_finish(cpu);
+}
+
+// the comparison writes the result into the mask register vd
+static void vec_compare(riscv_cpu *cpu,
+                        const vec_cmp_fn *kernel,
+                        vec_operand form)
+{
+    if (!vec_begin(cpu))
+        return;
+
+    unsigned int sew = vec_sew(cpu);
+    int lmul = vec_lmul(cpu);
+    uint64_t vl = cpu->csr.reg[VL];
+
+    vec_cmp_fn fn = kernel[sew];
+    if (fn == NULL) {
+        vec_illegal(cpu);
+        return;
+    }
+
+    if (!vec_check_group(cpu, cpu->instr.rs2, lmul) ||
+        (form == VEC_VV && !vec_check_group(cpu, cpu->instr.rs1, lmul)))
+        return;
+
+    uint8_t buf[VGROUP_MAX] __attribute__((aligned(32)));
+    const void *vs1 = vec_operand1(cpu, form, sew, vl, buf);
+    if (vs1 == NULL) {
+        vec_illegal(cpu);
+        return;
+    }
+
+    uint8_t res[VLEN];
+    fn(res, VREG(cpu, cpu->instr.rs2), vs1, vl);
+
+    if (VM(cpu)) {
+        vec_pack_mask(VREG(cpu, cpu->instr.rd), res, NULL, vl);
+    } else {
+        uint8_t mask[VLEN];
+        vec_unpack_mask(mask, VREG(cpu, 0), vl);
+        vec_pack_mask(VREG(cpu, cpu->instr.rd), res, mask, vl);
+    }
+
+    vec_finish(cpu);
+}
+
+// vd[0] = reduce(vs1[0], active elements of vs2)
+static void vec_reduce(riscv_cpu *cpu, const vec_red_fn *kernel)
+{
+    if (!vec_begin(cpu))
+        return;
+
+    unsigned int sew = vec_sew(cpu);
+    uint64_t vl = cpu->csr.reg[VL];
+
+    vec_red_fn fn = kernel[sew];
+    if (fn == NULL) {
+        vec_illegal(cpu);
+        return;
+    }
+
+    if (!vec_check_group(cpu, cpu->instr.rs2, vec_lmul(cpu)))
+        return;
+
+    // nothing is written if vl is zero
+    if (vl != 0) {
+        uint64_t acc = vec_get(VREG(cpu, cpu->instr.rs1), sew, 0);
+        uint8_t mask[VLEN];
+
+        if (!VM(cpu))
+            vec_unpack_mask(mask, VREG(cpu, 0), vl);
+        fn(&acc, VREG(cpu, cpu->instr.rs2), VM(cpu) ? NULL : mask, vl);
+        vec_set(VREG(cpu, cpu->instr.rd), sew, 0, acc);
+    }
+
+    vec_finish(cpu);
+}
+
+/* vmerge / vfmerge if masked, otherwise vmv.v / vfmv.v
+ *  vd[i] = v0.mask[i] ? vs1[i] : vs2[i] */
+static void vec_merge_mv(riscv_cpu *cpu, vec_operand form)
+{
+    if (VM(cpu)) {
+        vec_arith(cpu, vec_mv, form);
+        return;
+    }
+
+    if (!vec_begin(cpu))
+        return;
+
+    unsigned int sew = vec_sew(cpu);
+    int lmul = vec_lmul(cpu);
+    uint64_t vl = cpu->csr.reg[VL];
+
+    if (!vec_check_group(cpu, cpu->instr.rd, lmul) ||
+        !vec_check_group(cpu, cpu->instr.rs2, lmul) ||
+        (form == VEC_VV && !vec_check_group(cpu, cpu->instr.rs1, lmul)))
+        return;
+
+    uint8_t buf[VGROUP_MAX] __attribute__((aligned(32)));
+    const void *vs1 = vec_operand1(cpu, form, sew, vl, buf);
+    if (vs1 == NULL) {
+        vec_illegal(cpu);
+        return;
+    }
+
+    uint8_t tmp[VGROUP_MAX] __attribute__((aligned(32)));
+    uint8_t mask[VLEN];
+
+    memcpy(tmp, VREG(cpu, cpu->instr.rs2), vl << sew);
+    vec_unpack_mask(mask, VREG(cpu, 0), vl);
+    vec_merge(tmp, vs1, mask, sew, vl);
+    memcpy(VREG(cpu, cpu->instr.rd), tmp, vl << sew);
+
+    vec_finish(cpu);
+}
+
+/* The slide instructions. The offset is given by the scalar operand, or one
+ * for vslide1up / vslide1down which also insert the scalar operand at the
+ * vacated element. */
+static void vec_slide(riscv_cpu *cpu, vec_operand form, bool up, bool one)
+{
+    if (!vec_begin(cpu))
+        return;
+
+    unsigned int sew = vec_sew(cpu);
+    int lmul = vec_lmul(cpu);
+    uint64_t vl = cpu->csr.reg[VL];
+    uint64_t vlmax = vec_vlmax(sew, lmul);
+
+    if (!vec_check_group(cpu, cpu->instr.rd, lmul) ||
+        !vec_check_group(cpu, cpu->instr.rs2, lmul))
+        return;
+
+    uint8_t buf[VGROUP_MAX] __attribute__((aligned(32)));
+    const uint8_t *scalar = vec_operand1(cpu, form, sew, 1, buf);
+    if (scalar == NULL) {
+        vec_illegal(cpu);
+        return;
+    }
+
+    uint64_t offset = one ? 1 : vec_get(scalar, sew, 0);
+    if (!one && form == VEC_VX)
+        offset = cpu->xreg[cpu->instr.rs1];
+
+    uint8_t *vd = VREG(cpu, cpu->instr.rd);
+    uint8_t *vs2 = VREG(cpu, cpu->instr.rs2);
+    uint8_t tmp[VGROUP_MAX] __attribute__((aligned(32)));
+
+    if (up) {
+        // the elements below offset are unchanged
+        memcpy(tmp, vd, vl << sew);
+        if (offset < vl)
+            memcpy(tmp + (offset << sew), vs2, (vl - offset) << sew);
+        if (one && vl > 0)
+            memcpy(tmp, scalar, 1 << sew);
+    } else {
+        // the source elements beyond VLMAX are read as zero
+        memset(tmp, 0, vl << sew);
+        if (offset < vlmax) {
+            uint64_t count = vlmax - offset < vl ? vlmax - offset : vl;
+            memcpy(tmp, vs2 + (offset << sew), count << sew);
+        }
+        if (one && vl > 0)
+            memcpy(tmp + ((vl - 1) << sew), scalar, 1 << sew);
+    }
+
+    if (VM(cpu)) {
+        memcpy(vd, tmp, vl << sew);
+    } else {
+        uint8_t mask[VLEN];
+        vec_unpack_mask(mask, VREG(cpu, 0), vl);
+        vec_merge(vd, tmp, mask, sew, vl);
+    }
+
+    vec_finish(cpu);
+}
+
+/* Transfer len bytes between the guest virtual memory and the host buffer.
+ * The access is split at the page boundary, and then each part in DRAM is
+ * transferred by a single memcpy. Return the number of bytes transferred
+ * before an exception happens. */
+static uint64_t vec_mem_copy(riscv_cpu *cpu,
+                             uint64_t addr,
+                             uint8_t *buf,
+                             uint64_t len,
+                             Access access)
+{
+    uint64_t done = 0;
+
+    while (done < len) {
+        uint64_t page_left = (1UL << PAGE_SHIFT) -
+                             ((addr + done) & ((1UL << PAGE_SHIFT) - 1));
+        uint64_t chunk = len - done < page_left ? len - done : page_left;
+
+        uint64_t paddr = addr_translate(cpu, addr + done, access);
+        if (cpu->exc.exception != NoException)
+            return done;
+
+        if (paddr >= DRAM_BASE && paddr + chunk <= DRAM_END) {
+            uint8_t *host = cpu->bus.memory.mem + (paddr - DRAM_BASE);
+            if (access == Access_Store) {
+                memcpy(host, buf + done, chunk);
+                mark_dirty(cpu->bus.memory.dirty, paddr - DRAM_BASE, chunk);
+                notify_dram_write(&cpu->bus, paddr, chunk);
+            } else {
+                memcpy(buf + done, host, chunk);
+            }
+        } else {
+            // the I/O region is accessed byte by byte
+            for (uint64_t i = 0; i < chunk; i++) {
+                if (access == Access_Store)
+                    write_bus(&cpu->bus, paddr + i, 8, buf[done + i],
+                              &cpu->exc);
+                else
+                    buf[done + i] =
+                        read_bus(&cpu->bus, paddr + i, 8, &cpu->exc);
+                if (cpu->exc.exception != NoException) {
+                    cpu->exc.value = addr + done + i;
+                    return done + i;
+                }
+            }
+        }
+        done += chunk;
+    }
+
+    return done;
+}
+
+// the encoding of width to log2(EEW / 8)
+static int vec_width_eew(uint8_t width)
+{
+    switch (width) {
+    case 0x0:
+        return 0;
+    case 0x5:
+        return 1;
+    case 0x6:
+        return 2;
+    case 0x7:
+        return 3;
+    default:
+        return -1;
+    }
+}
+
+/* The vector load / store of unit-stride, strided and indexed. The segment
+ * load / store (nf != 0) is not supported.
+ *
+ * The data is loaded into a temporary buffer before being committed to vd,
+ * so the vector register won't be changed if an exception happens. */
+static void vec_load_store(riscv_cpu *cpu,
+                           Access access,
+                           int mop,
+                           bool fault_only_first)
+{
+    if (!vec_begin(cpu))
+        return;
+
+    uint32_t nf = cpu->instr.instr >> 29;
+    int width_eew = vec_width_eew(cpu->instr.width);
+    if (nf != 0 || width_eew < 0) {
+        vec_illegal(cpu);
+        return;
+    }
+
+    unsigned int sew = vec_sew(cpu);
+    int lmul = vec_lmul(cpu);
+    uint64_t vl = cpu->csr.reg[VL];
+    bool indexed = (mop == VEC_INDEXED_UNORDERED || mop == VEC_INDEXED_ORDERED);
+
+    /* For indexed access, the width is the EEW of the index in vs2, and the
+     * data is accessed by SEW. Otherwise the data is accessed by the width. */
+    unsigned int eew = indexed ? sew : (unsigned int) width_eew;
+    int emul = (int) eew - (int) sew + lmul;
+    if (!vec_check_group(cpu, cpu->instr.rd, emul))
+        return;
+    if (indexed && !vec_check_group(cpu, cpu->instr.rs2,
+                                    width_eew - (int) sew + lmul))
+        return;
+
+    uint64_t base = cpu->xreg[cpu->instr.rs1];
+    uint64_t stride =
+        mop == VEC_STRIDED ? cpu->xreg[cpu->instr.rs2] : 1UL << eew;
+    uint8_t *vd = VREG(cpu, cpu->instr.rd);
+    uint8_t *buf = vd;
+    uint8_t tmp[VGROUP_MAX] __attribute__((aligned(32)));
+    uint8_t mask[VLEN];
+
+    if (access == Access_Load)
+        buf = tmp;
+    if (!VM(cpu))
+        vec_unpack_mask(mask, VREG(cpu, 0), vl);
+
+    if (mop == VEC_UNIT_STRIDE && VM(cpu)) {
+        // the whole unit-stride access is transferred at once
+        uint64_t done = vec_mem_copy(cpu, base, buf, vl << eew, access);
+        if (cpu->exc.exception != NoException) {
+            if (!fault_only_first || (done >> eew) == 0)
+                return;
+            // trim vl to the elements before the fault
+            vl = done >> eew;
+            cpu->csr.reg[VL] = vl;
+            cpu->exc.exception = NoException;
+        }
+    } else {
+        for (uint64_t i = 0; i < vl; i++) {
+            if (!VM(cpu) && !mask[i])
+                continue;
+
+            uint64_t addr = base + i * stride;
+            if (indexed)
+                addr = base + vec_get(VREG(cpu, cpu->instr.rs2), width_eew, i);
+
+            vec_mem_copy(cpu, addr, buf + (i << eew), 1 << eew, access);
+            if (cpu->exc.exception != NoException) {
+                if (!fault_only_first || i == 0)
+                    return;
+                vl = i;
+                cpu->csr.reg[VL] = vl;
+                cpu->exc.exception = NoException;
+                break;
+            }
+        }
+    }
+
+    if (access == Access_Load) {
+        if (VM(cpu))
+            memcpy(vd, tmp, vl << eew);
+        else
+            vec_merge(vd, tmp, mask, eew, vl);
+    }
+
+    vec_finish(cpu);
+}
+
+/* The load / store of whole registers (vl<nf>r / vs<nf>r) and mask
+ * (vlm / vsm), which is unit-stride of bytes without masking */
+static void vec_load_store_bytes(riscv_cpu *cpu, Access access, bool whole)
+{
+    uint64_t len;
+    uint32_t nf = (cpu->instr.instr >> 29) + 1;
+
+    if (whole) {
+        // the whole register access doesn't depend on vtype
+        if (!vec_enabled(cpu))
+            return;
+        if ((nf & (nf - 1)) || (cpu->instr.rd & (nf - 1)) || !VM(cpu)) {
+            vec_illegal(cpu);
+            return;
+        }
+        len = nf * VREG_SIZE;
+    } else {
+        if (!vec_begin(cpu))
+            return;
+        if (nf != 1 || cpu->instr.width != 0 || !VM(cpu)) {
+            vec_illegal(cpu);
+            return;
+        }
+        len = (cpu->csr.reg[VL] + 7) >> 3;
+    }
+
+    uint8_t *vd = VREG(cpu, cpu->instr.rd);
+    if (access == Access_Load) {
+        uint8_t tmp[VGROUP_MAX];
+        vec_mem_copy(cpu, cpu->xreg[cpu->instr.rs1], tmp, len, access);
+        if (cpu->exc.exception != NoException)
+            return;
+        memcpy(vd, tmp, len);
+    } else {
+        vec_mem_copy(cpu, cpu->xreg[cpu->instr.rs1], vd, len, access);
+        if (cpu->exc.exception != NoException)
+            return;
+    }
+
+    vec_finish(cpu);
+}
+
+static void instr_vle(riscv_cpu *cpu)
+{
+    vec_load_store(cpu, Access_Load, VEC_UNIT_STRIDE, false);
+}
+
+static void instr_vleff(riscv_cpu *cpu)
+{
+    vec_load_store(cpu, Access_Load, VEC_UNIT_STRIDE, true);
+}
+
+static void instr_vlse(riscv_cpu *cpu)
+{
+    vec_load_store(cpu, Access_Load, VEC_STRIDED, false);
+}
+
+static void instr_vluxei(riscv_cpu *cpu)
+{
+    vec_load_store(cpu, Access_Load, VEC_INDEXED_UNORDERED, false);
+}
+
+static void instr_vloxei(riscv_cpu *cpu)
+{
+    vec_load_store(cpu, Access_Load, VEC_INDEXED_ORDERED, false);
+}
+
+static void instr_vlm(riscv_cpu *cpu)
+{
+    vec_load_store_bytes(cpu, Access_Load, false);
+}
+
+static void instr_vlr(riscv_cpu *cpu)
+{
+    vec_load_store_bytes(cpu, Access_Load, true);
+}
+
+static void instr_vse(riscv_cpu *cpu)
+{
+    vec_load_store(cpu, Access_Store, VEC_UNIT_STRIDE, false);
+}
+
+static void instr_vsse(riscv_cpu *cpu)
+{
+    vec_load_store(cpu, Access_Store, VEC_STRIDED, false);
+}
+
+static void instr_vsuxei(riscv_cpu *cpu)
+{
+    vec_load_store(cpu, Access_Store, VEC_INDEXED_UNORDERED, false);
+}
+
+static void instr_vsoxei(riscv_cpu *cpu)
+{
+    vec_load_store(cpu, Access_Store, VEC_INDEXED_ORDERED, false);
+}
+
+static void instr_vsm(riscv_cpu *cpu)
+{
+    vec_load_store_bytes(cpu, Access_Store, false);
+}
+
+static void instr_vsr(riscv_cpu *cpu)
+{
+    vec_load_store_bytes(cpu, Access_Store, true);
+}
+
+/* vsetvli, vsetivli and vsetvl, which are distinguished by inst[31:30]:
+ *  - 0x: vsetvli rd, rs1, vtypei[10:0]
+ *  - 11: vsetivli rd, uimm, vtypei[9:0]
+ *  - 10: vsetvl rd, rs1, rs2 */
+static void instr_vsetvl(riscv_cpu *cpu)
+{
+    if (!vec_enabled(cpu))
+        return;
+
+    uint32_t instr = cpu->instr.instr;
+    uint8_t rd = cpu->instr.rd, rs1 = cpu->instr.rs1;
+    uint64_t vtype, avl;
+
+    if ((instr >> 31) == 0)
+        vtype = (instr >> 20) & 0x7ff;
+    else if ((instr >> 30) == 0x3)
+        vtype = (instr >> 20) & 0x3ff;
+    else
+        vtype = cpu->xreg[cpu->instr.rs2];
+
+    if ((instr >> 30) == 0x3)
+        avl = rs1;
+    else if (rs1 != 0)
+        avl = cpu->xreg[rs1];
+    else if (rd != 0)
+        avl = -1;  // set vl to VLMAX
+    else
+        avl = cpu->csr.reg[VL];  // keep the current vl
+
+    unsigned int sew = (vtype & VTYPE_VSEW) >> 3;
+    int lmul = ((int) (vtype & VTYPE_VLMUL) ^ 4) - 4;
+    uint64_t vlmax = vec_vlmax(sew, lmul);
+
+    /* the vtype is unsupported if:
+     * 1. any of the reserved bits is set
+     * 2. SEW > ELEN or LMUL is reserved
+     * 3. SEW > LMUL * ELEN for fractional LMUL */
+    if ((vtype >> 8) || sew > 3 || (vtype & VTYPE_VLMUL) == 0x4 ||
+        (int) sew > 3 + lmul || vlmax == 0) {
+        cpu->csr.reg[VTYPE] = VTYPE_VILL;
+        cpu->csr.reg[VL] = 0;
+    } else {
+        cpu->csr.reg[VTYPE] = vtype;
+        cpu->csr.reg[VL] = avl < vlmax ? avl : vlmax;
+    }
+
+    cpu->xreg[rd] = cpu->csr.reg[VL];
+    vec_finish(cpu);
+}
+
+/* clang-format off */
+#define VEC_ARITH_INSTR(name, kernel, form) \
+    static void instr_##name(riscv_cpu *cpu) { vec_arith(cpu, kernel, form); }
+#define VEC_COMPARE_INSTR(name, kernel, form) \
+    static void instr_##name(riscv_cpu *cpu) { vec_compare(cpu, kernel, form); }
+#define VEC_REDUCE_INSTR(name, kernel) \
+    static void instr_##name(riscv_cpu *cpu) { vec_reduce(cpu, kernel); }
+
+VEC_ARITH_INSTR(vadd_vv, vec_add, VEC_VV)
+VEC_ARITH_INSTR(vadd_vx, vec_add, VEC_VX)
+VEC_ARITH_INSTR(vadd_vi, vec_add, VEC_VI)
+VEC_ARITH_INSTR(vsub_vv, vec_sub, VEC_VV)
+VEC_ARITH_INSTR(vsub_vx, vec_sub, VEC_VX)
+VEC_ARITH_INSTR(vrsub_vx, vec_rsub, VEC_VX)
+VEC_ARITH_INSTR(vrsub_vi, vec_rsub, VEC_VI)
+VEC_ARITH_INSTR(vminu_vv, vec_minu, VEC_VV)
+VEC_ARITH_INSTR(vminu_vx, vec_minu, VEC_VX)
+VEC_ARITH_INSTR(vmin_vv, vec_min, VEC_VV)
+VEC_ARITH_INSTR(vmin_vx, vec_min, VEC_VX)
+VEC_ARITH_INSTR(vmaxu_vv, vec_maxu, VEC_VV)
+VEC_ARITH_INSTR(vmaxu_vx, vec_maxu, VEC_VX)
+VEC_ARITH_INSTR(vmax_vv, vec_max, VEC_VV)
+VEC_ARITH_INSTR(vmax_vx, vec_max, VEC_VX)
+VEC_ARITH_INSTR(vand_vv, vec_and, VEC_VV)
+VEC_ARITH_INSTR(vand_vx, vec_and, VEC_VX)
+VEC_ARITH_INSTR(vand_vi, vec_and, VEC_VI)
+VEC_ARITH_INSTR(vor_vv, vec_or, VEC_VV)
+VEC_ARITH_INSTR(vor_vx, vec_or, VEC_VX)
+VEC_ARITH_INSTR(vor_vi, vec_or, VEC_VI)
+VEC_ARITH_INSTR(vxor_vv, vec_xor, VEC_VV)
+VEC_ARITH_INSTR(vxor_vx, vec_xor, VEC_VX)
+VEC_ARITH_INSTR(vxor_vi, vec_xor, VEC_VI)
+VEC_ARITH_INSTR(vsll_vv, vec_sll, VEC_VV)
+VEC_ARITH_INSTR(vsll_vx, vec_sll, VEC_VX)
+VEC_ARITH_INSTR(vsll_vi, vec_sll, VEC_VUI)
+VEC_ARITH_INSTR(vsrl_vv, vec_srl, VEC_VV)
+VEC_ARITH_INSTR(vsrl_vx, vec_srl, VEC_VX)
+VEC_ARITH_INSTR(vsrl_vi, vec_srl, VEC_VUI)
+VEC_ARITH_INSTR(vsra_vv, vec_sra, VEC_VV)
+VEC_ARITH_INSTR(vsra_vx, vec_sra, VEC_VX)
+VEC_ARITH_INSTR(vsra_vi, vec_sra, VEC_VUI)
+VEC_ARITH_INSTR(vmul_vv, vec_mul, VEC_VV)
+VEC_ARITH_INSTR(vmul_vx, vec_mul, VEC_VX)
+VEC_ARITH_INSTR(vmulh_vv, vec_mulh, VEC_VV)
+VEC_ARITH_INSTR(vmulh_vx, vec_mulh, VEC_VX)
+VEC_ARITH_INSTR(vmulhu_vv, vec_mulhu, VEC_VV)
+VEC_ARITH_INSTR(vmulhu_vx, vec_mulhu, VEC_VX)
+VEC_ARITH_INSTR(vmulhsu_vv, vec_mulhsu, VEC_VV)
+VEC_ARITH_INSTR(vmulhsu_vx, vec_mulhsu, VEC_VX)
+VEC_ARITH_INSTR(vdivu_vv, vec_divu, VEC_VV)
+VEC_ARITH_INSTR(vdivu_vx, vec_divu, VEC_VX)
+VEC_ARITH_INSTR(vdiv_vv, vec_div, VEC_VV)
+VEC_ARITH_INSTR(vdiv_vx, vec_div, VEC_VX)
+VEC_ARITH_INSTR(vremu_vv, vec_remu, VEC_VV)
+VEC_ARITH_INSTR(vremu_vx, vec_remu, VEC_VX)
+VEC_ARITH_INSTR(vrem_vv, vec_rem, VEC_VV)
+VEC_ARITH_INSTR(vrem_vx, vec_rem, VEC_VX)
+VEC_ARITH_INSTR(vmacc_vv, vec_macc, VEC_VV)
+VEC_ARITH_INSTR(vmacc_vx, vec_macc, VEC_VX)
+VEC_ARITH_INSTR(vnmsac_vv, vec_nmsac, VEC_VV)
+VEC_ARITH_INSTR(vnmsac_vx, vec_nmsac, VEC_VX)
+VEC_ARITH_INSTR(vmadd_vv, vec_madd, VEC_VV)
+VEC_ARITH_INSTR(vmadd_vx, vec_madd, VEC_VX)
+VEC_ARITH_INSTR(vnmsub_vv, vec_nmsub, VEC_VV)
+VEC_ARITH_INSTR(vnmsub_vx, vec_nmsub, VEC_VX)
+
+VEC_COMPARE_INSTR(vmseq_vv, vec_seq, VEC_VV)
+VEC_COMPARE_INSTR(vmseq_vx, vec_seq, VEC_VX)
+VEC_COMPARE_INSTR(vmseq_vi, vec_seq, VEC_VI)
+VEC_COMPARE_INSTR(vmsne_vv, vec_sne, VEC_VV)
+VEC_COMPARE_INSTR(vmsne_vx, vec_sne, VEC_VX)
+VEC_COMPARE_INSTR(vmsne_vi, vec_sne, VEC_VI)
+VEC_COMPARE_INSTR(vmsltu_vv, vec_sltu, VEC_VV)
+VEC_COMPARE_INSTR(vmsltu_vx, vec_sltu, VEC_VX)
+VEC_COMPARE_INSTR(vmslt_vv, vec_slt, VEC_VV)
+VEC_COMPARE_INSTR(vmslt_vx, vec_slt, VEC_VX)
+VEC_COMPARE_INSTR(vmsleu_vv, vec_sleu, VEC_VV)
+VEC_COMPARE_INSTR(vmsleu_vx, vec_sleu, VEC_VX)
+VEC_COMPARE_INSTR(vmsleu_vi, vec_sleu, VEC_VI)
+VEC_COMPARE_INSTR(vmsle_vv, vec_sle, VEC_VV)
+VEC_COMPARE_INSTR(vmsle_vx, vec_sle, VEC_VX)
+VEC_COMPARE_INSTR(vmsle_vi, vec_sle, VEC_VI)
+VEC_COMPARE_INSTR(vmsgtu_vx, vec_sgtu, VEC_VX)
+VEC_COMPARE_INSTR(vmsgtu_vi, vec_sgtu, VEC_VI)
+VEC_COMPARE_INSTR(vmsgt_vx, vec_sgt, VEC_VX)
+VEC_COMPARE_INSTR(vmsgt_vi, vec_sgt, VEC_VI)
+
+VEC_REDUCE_INSTR(vredsum_vs, vec_redsum)
+VEC_REDUCE_INSTR(vredand_vs, vec_redand)
+VEC_REDUCE_INSTR(vredor_vs, vec_redor)
+VEC_REDUCE_INSTR(vredxor_vs, vec_redxor)
+VEC_REDUCE_INSTR(vredminu_vs, vec_redminu)
+VEC_REDUCE_INSTR(vredmin_vs, vec_redmin)
+VEC_REDUCE_INSTR(vredmaxu_vs, vec_redmaxu)
+VEC_REDUCE_INSTR(vredmax_vs, vec_redmax)
+
+VEC_ARITH_INSTR(vfadd_vv, vec_fadd, VEC_VV)
+VEC_ARITH_INSTR(vfadd_vf, vec_fadd, VEC_VF)
+VEC_ARITH_INSTR(vfsub_vv, vec_fsub, VEC_VV)
+VEC_ARITH_INSTR(vfsub_vf, vec_fsub, VEC_VF)
+VEC_ARITH_INSTR(vfrsub_vf, vec_frsub, VEC_VF)
+VEC_ARITH_INSTR(vfmul_vv, vec_fmul, VEC_VV)
+VEC_ARITH_INSTR(vfmul_vf, vec_fmul, VEC_VF)
+VEC_ARITH_INSTR(vfdiv_vv, vec_fdiv, VEC_VV)
+VEC_ARITH_INSTR(vfdiv_vf, vec_fdiv, VEC_VF)
+VEC_ARITH_INSTR(vfrdiv_vf, vec_frdiv, VEC_VF)
+VEC_ARITH_INSTR(vfmin_vv, vec_fmin, VEC_VV)
+VEC_ARITH_INSTR(vfmin_vf, vec_fmin, VEC_VF)
+VEC_ARITH_INSTR(vfmax_vv, vec_fmax, VEC_VV)
+VEC_ARITH_INSTR(vfmax_vf, vec_fmax, VEC_VF)
+VEC_ARITH_INSTR(vfsgnj_vv, vec_fsgnj, VEC_VV)
+VEC_ARITH_INSTR(vfsgnj_vf, vec_fsgnj, VEC_VF)
+VEC_ARITH_INSTR(vfsgnjn_vv, vec_fsgnjn, VEC_VV)
+VEC_ARITH_INSTR(vfsgnjn_vf, vec_fsgnjn, VEC_VF)
+VEC_ARITH_INSTR(vfsgnjx_vv, vec_fsgnjx, VEC_VV)
+VEC_ARITH_INSTR(vfsgnjx_vf, vec_fsgnjx, VEC_VF)
+VEC_ARITH_INSTR(vfmacc_vv, vec_fmacc, VEC_VV)
+VEC_ARITH_INSTR(vfmacc_vf, vec_fmacc, VEC_VF)
+VEC_ARITH_INSTR(vfnmacc_vv, vec_fnmacc, VEC_VV)
+VEC_ARITH_INSTR(vfnmacc_vf, vec_fnmacc, VEC_VF)
+VEC_ARITH_INSTR(vfmsac_vv, vec_fmsac, VEC_VV)
+VEC_ARITH_INSTR(vfmsac_vf, vec_fmsac, VEC_VF)
+VEC_ARITH_INSTR(vfnmsac_vv, vec_fnmsac, VEC_VV)
+VEC_ARITH_INSTR(vfnmsac_vf, vec_fnmsac, VEC_VF)
+VEC_ARITH_INSTR(vfmadd_vv, vec_fmadd, VEC_VV)
+VEC_ARITH_INSTR(vfmadd_vf, vec_fmadd, VEC_VF)
+VEC_ARITH_INSTR(vfnmadd_vv, vec_fnmadd, VEC_VV)
+VEC_ARITH_INSTR(vfnmadd_vf, vec_fnmadd, VEC_VF)
+VEC_ARITH_INSTR(vfmsub_vv, vec_fmsub, VEC_VV)
+VEC_ARITH_INSTR(vfmsub_vf, vec_fmsub, VEC_VF)
+VEC_ARITH_INSTR(vfnmsub_vv, vec_fnmsub, VEC_VV)
+VEC_ARITH_INSTR(vfnmsub_vf, vec_fnmsub, VEC_VF)
+VEC_ARITH_INSTR(vfsqrt_v, vec_fsqrt, VEC_V)
+VEC_ARITH_INSTR(vfcvt_xu_f_v, vec_fcvt_xu_f, VEC_V)
+VEC_ARITH_INSTR(vfcvt_x_f_v, vec_fcvt_x_f, VEC_V)
+VEC_ARITH_INSTR(vfcvt_f_xu_v, vec_fcvt_f_xu, VEC_V)
+VEC_ARITH_INSTR(vfcvt_f_x_v, vec_fcvt_f_x, VEC_V)
+VEC_ARITH_INSTR(vfcvt_rtz_xu_f_v, vec_fcvt_rtz_xu_f, VEC_V)
+VEC_ARITH_INSTR(vfcvt_rtz_x_f_v, vec_fcvt_rtz_x_f, VEC_V)
+
+VEC_COMPARE_INSTR(vmfeq_vv, vec_mfeq, VEC_VV)
+VEC_COMPARE_INSTR(vmfeq_vf, vec_mfeq, VEC_VF)
+VEC_COMPARE_INSTR(vmfne_vv, vec_mfne, VEC_VV)
+VEC_COMPARE_INSTR(vmfne_vf, vec_mfne, VEC_VF)
+VEC_COMPARE_INSTR(vmflt_vv, vec_mflt, VEC_VV)
+VEC_COMPARE_INSTR(vmflt_vf, vec_mflt, VEC_VF)
+VEC_COMPARE_INSTR(vmfle_vv, vec_mfle, VEC_VV)
+VEC_COMPARE_INSTR(vmfle_vf, vec_mfle, VEC_VF)
+VEC_COMPARE_INSTR(vmfgt_vf, vec_mfgt, VEC_VF)
+VEC_COMPARE_INSTR(vmfge_vf, vec_mfge, VEC_VF)
+
+VEC_REDUCE_INSTR(vfredusum_vs, vec_fredsum)
+VEC_REDUCE_INSTR(vfredosum_vs, vec_fredsum)
+VEC_REDUCE_INSTR(vfredmin_vs, vec_fredmin)
+VEC_REDUCE_INSTR(vfredmax_vs, vec_fredmax)
+/* clang-format on */
+
+static void instr_vmerge_vv(riscv_cpu *cpu)
+{
+    vec_merge_mv(cpu, VEC_VV);
+}
+
+static void instr_vmerge_vx(riscv_cpu *cpu)
+{
+    vec_merge_mv(cpu, VEC_VX);
+}
+
+static void instr_vmerge_vi(riscv_cpu *cpu)
+{
+    vec_merge_mv(cpu, VEC_VI);
+}
+
+static void instr_vfmerge_vf(riscv_cpu *cpu)
+{
+    vec_merge_mv(cpu, VEC_VF);
+}
+
+static void instr_vslideup_vx(riscv_cpu *cpu)
+{
+    vec_slide(cpu, VEC_VX, true, false);
+}
+
+static void instr_vslideup_vi(riscv_cpu *cpu)
+{
+    vec_slide(cpu, VEC_VUI, true, false);
+}
+
+static void instr_vslidedown_vx(riscv_cpu *cpu)
+{
+    vec_slide(cpu, VEC_VX, false, false);
+}
+
+static void instr_vslidedown_vi(riscv_cpu *cpu)
+{
+    vec_slide(cpu, VEC_VUI, false, false);
+}
+
+static void instr_vslide1up_vx(riscv_cpu *cpu)
+{
+    vec_slide(cpu, VEC_VX, true, true);
+}
+
+static void instr_vslide1down_vx(riscv_cpu *cpu)
+{
+    vec_slide(cpu, VEC_VX, false, true);
+}
+
+static void instr_vfslide1up_vf(riscv_cpu *cpu)
+{
+    vec_slide(cpu, VEC_VF, true, true);
+}
+
+static void instr_vfslide1down_vf(riscv_cpu *cpu)
+{
+    vec_slide(cpu, VEC_VF, false, true);
+}
+
+// vmv<nr>r.v, the whole register move which doesn't depend on vtype
+static void instr_vmvr(riscv_cpu *cpu)
+{
+    if (!vec_enabled(cpu))
+        return;
+
+    uint64_t nr = cpu->instr.rs1 + 1;
+    if ((nr & (nr - 1)) || nr > 8 || (cpu->instr.rd & (nr - 1)) ||
+        (cpu->instr.rs2 & (nr - 1))) {
+        vec_illegal(cpu);
+        return;
+    }
+
+    memmove(VREG(cpu, cpu->instr.rd), VREG(cpu, cpu->instr.rs2),
+            nr * VREG_SIZE);
+    vec_finish(cpu);
+}
+
+static void vec_mask_instr(riscv_cpu *cpu, vec_mask_op op)
+{
+    if (!vec_begin(cpu))
+        return;
+
+    vec_mask_logical(op, VREG(cpu, cpu->instr.rd), VREG(cpu, cpu->instr.rs2),
+                     VREG(cpu, cpu->instr.rs1), cpu->csr.reg[VL]);
+    vec_finish(cpu);
+}
+
+static void instr_vmandn_mm(riscv_cpu *cpu)
+{
+    vec_mask_instr(cpu, VMANDN);
+}
+
+static void instr_vmand_mm(riscv_cpu *cpu)
+{
+    vec_mask_instr(cpu, VMAND);
+}
+
+static void instr_vmor_mm(riscv_cpu *cpu)
+{
+    vec_mask_instr(cpu, VMOR);
+}
+
+static void instr_vmxor_mm(riscv_cpu *cpu)
+{
+    vec_mask_instr(cpu, VMXOR);
+}
+
+static void instr_vmorn_mm(riscv_cpu *cpu)
+{
+    vec_mask_instr(cpu, VMORN);
+}
+
+static void instr_vmnand_mm(riscv_cpu *cpu)
+{
+    vec_mask_instr(cpu, VMNAND);
+}
+
+static void instr_vmnor_mm(riscv_cpu *cpu)
+{
+    vec_mask_instr(cpu, VMNOR);
 }
 
-static void instr_amoxorw(riscv_cpu *cpu)
+static void instr_vmxnor_mm(riscv_cpu *cpu)
 {
-    uint64_t addr = cpu->xreg[cpu->instr.rs1];
-    uint64_t tmp = read_cpu(cpu, addr, 32);
-    if (cpu->exc.exception != NoException) {
-        assert(tmp == (uint64_t) -1);
-        return;
-    }
+    vec_mask_instr(cpu, VMXNOR);
+}
 
-    uint64_t value = (int32_t) ((tmp ^ cpu->xreg[cpu->instr.rs2]) & 0xffffffff);
-    if (!write_cpu(cpu, addr, 32, value))
+// x[rd] = sign-extended vs2[0]
+static void instr_vmv_x_s(riscv_cpu *cpu)
+{
+    if (!vec_begin(cpu))
         return;
 
-    cpu->xreg[cpu->instr.rd] = (int32_t) (tmp & 0xffffffff);
+    unsigned int sew = vec_sew(cpu);
+    uint64_t value = vec_get(VREG(cpu, cpu->instr.rs2), sew, 0);
+    unsigned int shift = 64 - (8 << sew);
+    cpu->xreg[cpu->instr.rd] = (int64_t) (value << shift) >> shift;
+    vec_finish(cpu);
 }
 
-static void instr_amoorw(riscv_cpu *cpu)
+static void instr_vmv_s_x(riscv_cpu *cpu)
 {
-    uint64_t addr = cpu->xreg[cpu->instr.rs1];
-    uint64_t tmp = read_cpu(cpu, addr, 32);
-    if (cpu->exc.exception != NoException) {
-        assert(tmp == (uint64_t) -1);
+    if (!vec_begin(cpu))
         return;
-    }
 
-    uint64_t value = (int32_t) ((tmp | cpu->xreg[cpu->instr.rs2]) & 0xffffffff);
-    if (!write_cpu(cpu, addr, 32, value))
+    if (cpu->csr.reg[VL] != 0)
+        vec_set(VREG(cpu, cpu->instr.rd), vec_sew(cpu), 0,
+                cpu->xreg[cpu->instr.rs1]);
+    vec_finish(cpu);
+}
+
+static void instr_vfmv_f_s(riscv_cpu *cpu)
+{
+    if (!vec_begin(cpu))
         return;
 
-    cpu->xreg[cpu->instr.rd] = (int32_t) (tmp & 0xffffffff);
+    unsigned int sew = vec_sew(cpu);
+    uint64_t value = vec_get(VREG(cpu, cpu->instr.rs2), sew, 0);
+    if (sew == 2) {
+        // NaN-boxing for single-precision value
+        cpu->freg[cpu->instr.rd].u = 0xffffffff00000000UL | value;
+    } else if (sew == 3) {
+        cpu->freg[cpu->instr.rd].u = value;
+    } else {
+        vec_illegal(cpu);
+        return;
+    }
+    vec_finish(cpu);
 }
 
-static void instr_amoandw(riscv_cpu *cpu)
+static void instr_vfmv_s_f(riscv_cpu *cpu)
 {
-    uint64_t addr = cpu->xreg[cpu->instr.rs1];
-    uint64_t tmp = read_cpu(cpu, addr, 32);
-    if (cpu->exc.exception != NoException) {
-        assert(tmp == (uint64_t) -1);
+    if (!vec_begin(cpu))
         return;
-    }
 
-    uint64_t value = (int32_t) ((tmp & cpu->xreg[cpu->instr.rs2]) & 0xffffffff);
-    if (!write_cpu(cpu, addr, 32, value))
+    unsigned int sew = vec_sew(cpu);
+    uint8_t buf[VGROUP_MAX];
+    const uint8_t *scalar = vec_operand1(cpu, VEC_VF, sew, 1, buf);
+    if (scalar == NULL) {
+        vec_illegal(cpu);
         return;
+    }
 
-    cpu->xreg[cpu->instr.rd] = (int32_t) (tmp & 0xffffffff);
+    if (cpu->csr.reg[VL] != 0)
+        memcpy(VREG(cpu, cpu->instr.rd), scalar, 1 << sew);
+    vec_finish(cpu);
 }
 
-/*
-static void instr_amominw(riscv_cpu *cpu){}
-static void instr_amomaxw(riscv_cpu *cpu){}
-*/
-
-static void instr_amoaddd(riscv_cpu *cpu)
+/* vcpop.m and vfirst.m, count the active set bits or find the first one in
+ * the mask register vs2 */
+static void vec_mask_scan(riscv_cpu *cpu, bool first)
 {
-    uint64_t tmp = read_cpu(cpu, cpu->xreg[cpu->instr.rs1], 64);
-    if (cpu->exc.exception != NoException) {
-        assert(tmp == (uint64_t) -1);
+    if (!vec_begin(cpu))
         return;
+
+    uint64_t vl = cpu->csr.reg[VL];
+    const uint8_t *vs2 = VREG(cpu, cpu->instr.rs2);
+    const uint8_t *v0 = VREG(cpu, 0);
+    uint64_t count = 0;
+    int64_t index = -1;
+
+    for (uint64_t i = 0; i < vl; i += 8) {
+        uint8_t bits = vs2[i >> 3];
+        if (!VM(cpu))
+            bits &= v0[i >> 3];
+        if (vl - i < 8)
+            bits &= (1 << (vl - i)) - 1;
+
+        if (first && bits) {
+            index = i + __builtin_ctz(bits);
+            break;
+        }
+        count += __builtin_popcount(bits);
     }
-    if (!write_cpu(cpu, cpu->xreg[cpu->instr.rs1], 64,
-                   tmp + cpu->xreg[cpu->instr.rs2]))
-        return;
-    cpu->xreg[cpu->instr.rd] = tmp;
+
+    cpu->xreg[cpu->instr.rd] = first ? (uint64_t) index : count;
+    vec_finish(cpu);
 }
 
-static void instr_amoswapd(riscv_cpu *cpu)
+static void instr_vcpop_m(riscv_cpu *cpu)
 {
-    uint64_t tmp = read_cpu(cpu, cpu->xreg[cpu->instr.rs1], 64);
-    if (cpu->exc.exception != NoException) {
-        assert(tmp == (uint64_t) -1);
-        return;
-    }
-    if (!write_cpu(cpu, cpu->xreg[cpu->instr.rs1], 64,
-                   cpu->xreg[cpu->instr.rs2]))
-        return;
-    cpu->xreg[cpu->instr.rd] = tmp;
+    vec_mask_scan(cpu, false);
 }
 
+static void instr_vfirst_m(riscv_cpu *cpu)
+{
+    vec_mask_scan(cpu, true);
+}
 
-static void instr_lrd(riscv_cpu *cpu)
+/* vmsbf.m, vmsif.m and vmsof.m, set the bits before, including or only at the
+ * first set bit of the mask register vs2 */
+static void vec_mask_set_first(riscv_cpu *cpu, bool before, bool at)
 {
-    uint64_t addr = cpu->xreg[cpu->instr.rs1];
-    uint64_t tmp = read_cpu(cpu, addr, 64);
-    if (cpu->exc.exception != NoException) {
-        assert(tmp == (uint64_t) -1);
+    if (!vec_begin(cpu))
         return;
-    }
-    cpu->xreg[cpu->instr.rd] = tmp;
-    cpu->reservation = addr;
-}
 
+    uint64_t vl = cpu->csr.reg[VL];
+    uint8_t res[VLEN], src[VLEN], mask[VLEN];
+    bool found = false;
 
-static void instr_scd(riscv_cpu *cpu)
-{
-    uint64_t addr = cpu->xreg[cpu->instr.rs1];
+    vec_unpack_mask(src, VREG(cpu, cpu->instr.rs2), vl);
+    if (!VM(cpu))
+        vec_unpack_mask(mask, VREG(cpu, 0), vl);
 
-    if (cpu->reservation == addr) {
-        if (!write_cpu(cpu, addr, 64, cpu->xreg[cpu->instr.rs2]))
-            return;
-        cpu->xreg[cpu->instr.rd] = 0;
-    } else {
-        cpu->xreg[cpu->instr.rd] = 1;
+    for (uint64_t i = 0; i < vl; i++) {
+        bool active = VM(cpu) || mask[i];
+        if (active && src[i] && !found) {
+            found = true;
+            res[i] = at;
+            continue;
+        }
+        res[i] = !found && before;
     }
 
-    // invalidate the reservation
-    cpu->reservation = (uint64_t) -1;
+    vec_pack_mask(VREG(cpu, cpu->instr.rd), res, VM(cpu) ? NULL : mask, vl);
+    vec_finish(cpu);
 }
 
-
-static void instr_amoxord(riscv_cpu *cpu)
+static void instr_vmsbf_m(riscv_cpu *cpu)
 {
-    uint64_t addr = cpu->xreg[cpu->instr.rs1];
-    uint64_t tmp = read_cpu(cpu, addr, 64);
-    if (cpu->exc.exception != NoException) {
-        assert(tmp == (uint64_t) -1);
-        return;
-    }
+    vec_mask_set_first(cpu, true, false);
+}
 
-    uint64_t value = tmp ^ cpu->xreg[cpu->instr.rs2];
-    if (!write_cpu(cpu, addr, 64, value))
-        return;
+static void instr_vmsif_m(riscv_cpu *cpu)
+{
+    vec_mask_set_first(cpu, true, true);
+}
 
-    cpu->xreg[cpu->instr.rd] = tmp;
+static void instr_vmsof_m(riscv_cpu *cpu)
+{
+    vec_mask_set_first(cpu, false, true);
 }
 
-static void instr_amoord(riscv_cpu *cpu)
+/* viota.m writes the number of active set bits before each element, and
+ * vid.v writes the index of each element */
+static void vec_index(riscv_cpu *cpu, bool iota)
 {
-    uint64_t addr = cpu->xreg[cpu->instr.rs1];
-    uint64_t tmp = read_cpu(cpu, addr, 64);
-    if (cpu->exc.exception != NoException) {
-        assert(tmp == (uint64_t) -1);
+    if (!vec_begin(cpu))
         return;
-    }
 
-    uint64_t value = tmp | cpu->xreg[cpu->instr.rs2];
-    if (!write_cpu(cpu, addr, 64, value))
+    unsigned int sew = vec_sew(cpu);
+    uint64_t vl = cpu->csr.reg[VL];
+    if (!vec_check_group(cpu, cpu->instr.rd, vec_lmul(cpu)))
         return;
 
-    cpu->xreg[cpu->instr.rd] = tmp;
-}
+    uint8_t tmp[VGROUP_MAX] __attribute__((aligned(32)));
+    uint8_t src[VLEN], mask[VLEN];
+    uint64_t count = 0;
 
-static void instr_amoandd(riscv_cpu *cpu)
-{
-    uint64_t addr = cpu->xreg[cpu->instr.rs1];
-    uint64_t tmp = read_cpu(cpu, addr, 64);
-    if (cpu->exc.exception != NoException) {
-        assert(tmp == (uint64_t) -1);
-        return;
+    vec_unpack_mask(src, VREG(cpu, cpu->instr.rs2), vl);
+    if (!VM(cpu))
+        vec_unpack_mask(mask, VREG(cpu, 0), vl);
+
+    for (uint64_t i = 0; i < vl; i++) {
+        vec_set(tmp, sew, i, iota ? count : i);
+        if ((VM(cpu) || mask[i]) && src[i])
+            count++;
     }
 
-    uint64_t value = tmp & cpu->xreg[cpu->instr.rs2];
-    if (!write_cpu(cpu, addr, 64, value))
-        return;
+    if (VM(cpu))
+        memcpy(VREG(cpu, cpu->instr.rd), tmp, vl << sew);
+    else
+        vec_merge(VREG(cpu, cpu->instr.rd), tmp, mask, sew, vl);
+    vec_finish(cpu);
+}
 
-    cpu->xreg[cpu->instr.rd] = tmp;
+static void instr_viota_m(riscv_cpu *cpu)
+{
+    vec_index(cpu, true);
 }
 
-/*
-static void instr_amomind(riscv_cpu *cpu){}
-static void instr_amomaxd(riscv_cpu *cpu){}
-*/
+static void instr_vid_v(riscv_cpu *cpu)
+{
+    vec_index(cpu, false);
+}
 
 static void instr_caddi4spn(riscv_cpu *cpu)
 {
@@ -1335,22 +2992,65 @@ static riscv_instr_entry instr_load_type[] = {
 };
 INIT_RISCV_INSTR_LIST(FUNC3, instr_load_type);
 
+static riscv_instr_entry instr_cbo_type[] = {
+    [0x0] = {NULL, instr_cboinval, NULL, "CBO.INVAL"},
+    [0x1] = {NULL, instr_cboclean, NULL, "CBO.CLEAN"},
+    [0x2] = {NULL, instr_cboflush, NULL, "CBO.FLUSH"},
+    [0x4] = {NULL, instr_cbozero, NULL, "CBO.ZERO"}
+};
+INIT_RISCV_INSTR_LIST(RS2, instr_cbo_type);
+
 static riscv_instr_entry instr_fence_type[] = {
     [0x0] = {NULL, instr_fence, NULL, "FENCE"},
-    [0x1] = {NULL, instr_fencei, NULL, "FENCEI"}
+    [0x1] = {NULL, instr_fencei, NULL, "FENCEI"},
+    [0x2] = {R_decode, NULL, &instr_cbo_type_list, NULL}
 };
 INIT_RISCV_INSTR_LIST(FUNC3, instr_fence_type);
 
 
+static riscv_instr_entry instr_clz_ctz_cpop_type[] = {
+    [0x0] = {NULL, instr_clz, NULL, "CLZ"},
+    [0x1] = {NULL, instr_ctz, NULL, "CTZ"},
+    [0x2] = {NULL, instr_cpop, NULL, "CPOP"},
+    [0x4] = {NULL, instr_sextb, NULL, "SEXT.B"},
+    [0x5] = {NULL, instr_sexth, NULL, "SEXT.H"}
+};
+INIT_RISCV_INSTR_LIST(RS2, instr_clz_ctz_cpop_type);
+
+/* The I-type decoding doesn't parse rs2, so R_decode is used for the
+ * instructions whose function code is placed in the field rs2 */
+static riscv_instr_entry instr_slli_type[] = {
+    [0x00] = {NULL, instr_slli, NULL, "SLLI"},
+    [0x0a] = {NULL, instr_bseti, NULL, "BSETI"},
+    [0x12] = {NULL, instr_bclri, NULL, "BCLRI"},
+    [0x18] = {R_decode, NULL, &instr_clz_ctz_cpop_type_list, NULL},
+    [0x1a] = {NULL, instr_binvi, NULL, "BINVI"}
+};
+INIT_RISCV_INSTR_LIST(FUNC7_S, instr_slli_type);
+
+static riscv_instr_entry instr_orcb_type[] = {
+    [0x07] = {NULL, instr_orcb, NULL, "ORC.B"}
+};
+INIT_RISCV_INSTR_LIST(RS2, instr_orcb_type);
+
+static riscv_instr_entry instr_rev8_type[] = {
+    [0x18] = {NULL, instr_rev8, NULL, "REV8"}
+};
+INIT_RISCV_INSTR_LIST(RS2, instr_rev8_type);
+
 static riscv_instr_entry instr_srli_srai_type[] = {
     [0x0] =  {NULL, instr_srli, NULL, "SRLI"},
-    [0x10] = {NULL, instr_srai, NULL, "SRAI"}
+    [0x0a] = {R_decode, NULL, &instr_orcb_type_list, NULL},
+    [0x10] = {NULL, instr_srai, NULL, "SRAI"},
+    [0x12] = {NULL, instr_bexti, NULL, "BEXTI"},
+    [0x18] = {NULL, instr_rori, NULL, "RORI"},
+    [0x1a] = {R_decode, NULL, &instr_rev8_type_list, NULL}
 };
 INIT_RISCV_INSTR_LIST(FUNC7_S, instr_srli_srai_type);
 
 static riscv_instr_entry instr_imm_type[] = {
     [0x0] = {NULL, instr_addi, NULL, "ADDI"},
-    [0x1] = {NULL, instr_slli, NULL, "SLLI"},
+    [0x1] = {NULL, NULL, &instr_slli_type_list, NULL},
     [0x2] = {NULL, instr_slti, NULL, "SLTI"},
     [0x3] = {NULL, instr_sltiu, NULL, "SLTIU"},
     [0x4] = {NULL, instr_xori, NULL, "XORI"},
@@ -1369,13 +3069,18 @@ INIT_RISCV_INSTR_LIST(FUNC7, instr_add_mul_sub_type);
 
 static riscv_instr_entry instr_sll_mulh_type[] = {
     [0x00] = {NULL, instr_sll, NULL, "SLL"},
-    [0x01] = {NULL, instr_mulh, NULL, "MULH"}
+    [0x01] = {NULL, instr_mulh, NULL, "MULH"},
+    [0x14] = {NULL, instr_bset, NULL, "BSET"},
+    [0x24] = {NULL, instr_bclr, NULL, "BCLR"},
+    [0x30] = {NULL, instr_rol, NULL, "ROL"},
+    [0x34] = {NULL, instr_binv, NULL, "BINV"}
 };
 INIT_RISCV_INSTR_LIST(FUNC7, instr_sll_mulh_type);
 
 static riscv_instr_entry instr_slt_mulhsu_type[] = {
     [0x00] = {NULL, instr_slt, NULL, "SLT"},
-    [0x01] = {NULL, instr_mulhsu, NULL, "MULHSU"}
+    [0x01] = {NULL, instr_mulhsu, NULL, "MULHSU"},
+    [0x10] = {NULL, instr_sh1add, NULL, "SH1ADD"}
 };
 INIT_RISCV_INSTR_LIST(FUNC7, instr_slt_mulhsu_type);
 
@@ -1387,26 +3092,37 @@ INIT_RISCV_INSTR_LIST(FUNC7, instr_sltu_mulhu_type);
 
 static riscv_instr_entry instr_xor_div_type[] = {
     [0x00] = {NULL, instr_xor, NULL, "XOR"},
-    [0x01] = {NULL, instr_div, NULL, "DIV"}
+    [0x01] = {NULL, instr_div, NULL, "DIV"},
+    [0x05] = {NULL, instr_min, NULL, "MIN"},
+    [0x10] = {NULL, instr_sh2add, NULL, "SH2ADD"},
+    [0x20] = {NULL, instr_xnor, NULL, "XNOR"}
 };
 INIT_RISCV_INSTR_LIST(FUNC7, instr_xor_div_type);
 
 static riscv_instr_entry instr_srl_divu_sra_type[] = {
     [0x00] = {NULL, instr_srl, NULL, "SRL"},
     [0x01] = {NULL, instr_divu, NULL, "DIVU"},
-    [0x20] = {NULL, instr_sra, NULL, "SRA"}
+    [0x05] = {NULL, instr_minu, NULL, "MINU"},
+    [0x20] = {NULL, instr_sra, NULL, "SRA"},
+    [0x24] = {NULL, instr_bext, NULL, "BEXT"},
+    [0x30] = {NULL, instr_ror, NULL, "ROR"}
 };
 INIT_RISCV_INSTR_LIST(FUNC7, instr_srl_divu_sra_type);
 
 static riscv_instr_entry instr_or_rem_type[] = {
     [0x00] = {NULL, instr_or, NULL, "OR"},
-    [0x01] = {NULL, instr_rem, NULL, "REM"}
+    [0x01] = {NULL, instr_rem, NULL, "REM"},
+    [0x05] = {NULL, instr_max, NULL, "MAX"},
+    [0x10] = {NULL, instr_sh3add, NULL, "SH3ADD"},
+    [0x20] = {NULL, instr_orn, NULL, "ORN"}
 };
 INIT_RISCV_INSTR_LIST(FUNC7, instr_or_rem_type);
 
 static riscv_instr_entry instr_and_remu_type[] = {
     [0x00] = {NULL, instr_and, NULL, "AND"},
-    [0x01] = {NULL, instr_remu, NULL, "REMU"}
+    [0x01] = {NULL, instr_remu, NULL, "REMU"},
+    [0x05] = {NULL, instr_maxu, NULL, "MAXU"},
+    [0x20] = {NULL, instr_andn, NULL, "ANDN"}
 };
 INIT_RISCV_INSTR_LIST(FUNC7, instr_and_remu_type);
 
@@ -1424,13 +3140,28 @@ INIT_RISCV_INSTR_LIST(FUNC3, instr_reg_type);
 
 static riscv_instr_entry instr_srliw_sraiw_type[] = {
     [0x00] = {NULL, instr_srliw, NULL, "SRLIW"},
-    [0x20] = {NULL, instr_sraiw, NULL, "SRAIW"}
+    [0x20] = {NULL, instr_sraiw, NULL, "SRAIW"},
+    [0x30] = {NULL, instr_roriw, NULL, "RORIW"}
 };
 INIT_RISCV_INSTR_LIST(FUNC7, instr_srliw_sraiw_type);
 
+static riscv_instr_entry instr_clzw_ctzw_cpopw_type[] = {
+    [0x0] = {NULL, instr_clzw, NULL, "CLZW"},
+    [0x1] = {NULL, instr_ctzw, NULL, "CTZW"},
+    [0x2] = {NULL, instr_cpopw, NULL, "CPOPW"}
+};
+INIT_RISCV_INSTR_LIST(RS2, instr_clzw_ctzw_cpopw_type);
+
+static riscv_instr_entry instr_slliw_type[] = {
+    [0x00] = {NULL, instr_slliw, NULL, "SLLIW"},
+    [0x02] = {NULL, instr_slliuw, NULL, "SLLI.UW"},
+    [0x18] = {R_decode, NULL, &instr_clzw_ctzw_cpopw_type_list, NULL}
+};
+INIT_RISCV_INSTR_LIST(FUNC7_S, instr_slliw_type);
+
 static riscv_instr_entry instr_immw_type[] = {
     [0x0] = {NULL, instr_addiw, NULL, "ADDIW"},
-    [0x1] = {NULL, instr_slliw, NULL, "SLLIW"},
+    [0x1] = {NULL, NULL, &instr_slliw_type_list, NULL},
     [0x5] = {NULL, NULL, &instr_srliw_sraiw_type_list, NULL}
 };
 INIT_RISCV_INSTR_LIST(FUNC3, instr_immw_type);
@@ -1443,38 +3174,68 @@ static riscv_instr_entry instr_store_type[] = {
 };
 INIT_RISCV_INSTR_LIST(FUNC3, instr_store_type);
 
+static riscv_instr_entry instr_vstore_unit_type[] = {
+    [0x00] = {NULL, instr_vse, NULL, "VSE"},
+    [0x08] = {NULL, instr_vsr, NULL, "VSR"},
+    [0x0b] = {NULL, instr_vsm, NULL, "VSM"},
+};
+INIT_RISCV_INSTR_LIST(RS2, instr_vstore_unit_type);
+
+static riscv_instr_entry instr_vstore_type[] = {
+    [0x0] = {NULL, NULL, &instr_vstore_unit_type_list, NULL},
+    [0x1] = {NULL, instr_vsuxei, NULL, "VSUXEI"},
+    [0x2] = {NULL, instr_vsse, NULL, "VSSE"},
+    [0x3] = {NULL, instr_vsoxei, NULL, "VSOXEI"},
+};
+INIT_RISCV_INSTR_LIST(FUNC6_S, instr_vstore_type);
+
 static riscv_instr_entry instr_store_fp_type[] = {
+    [0x0] = {V_decode, NULL, &instr_vstore_type_list, NULL},
     [0x2] = {NULL, instr_fsw, NULL, "FSW"},
     [0x3] = {NULL, instr_fsd, NULL, "FSD"},
+    [0x5] = {V_decode, NULL, &instr_vstore_type_list, NULL},
+    [0x6] = {V_decode, NULL, &instr_vstore_type_list, NULL},
+    [0x7] = {V_decode, NULL, &instr_vstore_type_list, NULL},
 };
 INIT_RISCV_INSTR_LIST(WIDTH, instr_store_fp_type);
 
 static riscv_instr_entry instr_addw_mulw_subw_type[] = {
     [0x00] = {NULL, instr_addw, NULL, "ADDW"},
     [0x01] = {NULL, instr_mulw, NULL, "MULW"},
+    [0x04] = {NULL, instr_adduw, NULL, "ADD.UW"},
     [0x20] = {NULL, instr_subw, NULL, "SUBW"}
 };
 INIT_RISCV_INSTR_LIST(FUNC7, instr_addw_mulw_subw_type);
 
 static riscv_instr_entry instr_sllw_type[] = {
     [0x00] = {NULL, instr_sllw, NULL, "SLLW"},
+    [0x30] = {NULL, instr_rolw, NULL, "ROLW"}
 };
 INIT_RISCV_INSTR_LIST(FUNC7, instr_sllw_type);
 
+static riscv_instr_entry instr_sh1adduw_type[] = {
+    [0x10] = {NULL, instr_sh1adduw, NULL, "SH1ADD.UW"}
+};
+INIT_RISCV_INSTR_LIST(FUNC7, instr_sh1adduw_type);
+
 static riscv_instr_entry instr_divw_type[] = {
-    [0x01] = {NULL, instr_divw, NULL, "DIVW"}
+    [0x01] = {NULL, instr_divw, NULL, "DIVW"},
+    [0x04] = {NULL, instr_zexth, NULL, "ZEXT.H"},
+    [0x10] = {NULL, instr_sh2adduw, NULL, "SH2ADD.UW"}
 };
 INIT_RISCV_INSTR_LIST(FUNC7, instr_divw_type);
 
 static riscv_instr_entry instr_srlw_divuw_sraw_type[] = {
     [0x00] = {NULL, instr_srlw, NULL, "SRLW"},
     [0x01] = {NULL, instr_divuw, NULL, "DIVUW"},
-    [0x20] = {NULL, instr_sraw, NULL, "SRAW"}
+    [0x20] = {NULL, instr_sraw, NULL, "SRAW"},
+    [0x30] = {NULL, instr_rorw, NULL, "RORW"}
 };
 INIT_RISCV_INSTR_LIST(FUNC7, instr_srlw_divuw_sraw_type);
 
 static riscv_instr_entry instr_remw_type[] = {
-    [0x01] = {NULL, instr_remw, NULL, "REMW"}
+    [0x01] = {NULL, instr_remw, NULL, "REMW"},
+    [0x10] = {NULL, instr_sh3adduw, NULL, "SH3ADD.UW"}
 };
 INIT_RISCV_INSTR_LIST(FUNC7, instr_remw_type);
 
@@ -1486,6 +3247,7 @@ INIT_RISCV_INSTR_LIST(FUNC7, instr_remuw_type);
 static riscv_instr_entry instr_regw_type[] = {
     [0x0] = {NULL, NULL, &instr_addw_mulw_subw_type_list, NULL},
     [0x1] = {NULL, NULL, &instr_sllw_type_list, NULL},
+    [0x2] = {NULL, NULL, &instr_sh1adduw_type_list, NULL},
     [0x4] = {NULL, NULL, &instr_divw_type_list, NULL},
     [0x5] = {NULL, NULL, &instr_srlw_divuw_sraw_type_list, NULL},
     [0x6] = {NULL, NULL, &instr_remw_type_list, NULL},
@@ -1624,11 +3386,285 @@ static riscv_instr_entry instr_c2_type[] = {
 };
 INIT_RISCV_INSTR_LIST(FUNC3, instr_c2_type);
 
+static riscv_instr_entry instr_vload_unit_type[] = {
+    [0x00] = {NULL, instr_vle, NULL, "VLE"},
+    [0x08] = {NULL, instr_vlr, NULL, "VLR"},
+    [0x0b] = {NULL, instr_vlm, NULL, "VLM"},
+    [0x10] = {NULL, instr_vleff, NULL, "VLEFF"},
+};
+INIT_RISCV_INSTR_LIST(RS2, instr_vload_unit_type);
+
+static riscv_instr_entry instr_vload_type[] = {
+    [0x0] = {NULL, NULL, &instr_vload_unit_type_list, NULL},
+    [0x1] = {NULL, instr_vluxei, NULL, "VLUXEI"},
+    [0x2] = {NULL, instr_vlse, NULL, "VLSE"},
+    [0x3] = {NULL, instr_vloxei, NULL, "VLOXEI"},
+};
+INIT_RISCV_INSTR_LIST(FUNC6_S, instr_vload_type);
+
+static riscv_instr_entry instr_load_fp_type[] = {
+    [0x0] = {NULL, NULL, &instr_vload_type_list, NULL},
+    [0x5] = {NULL, NULL, &instr_vload_type_list, NULL},
+    [0x6] = {NULL, NULL, &instr_vload_type_list, NULL},
+    [0x7] = {NULL, NULL, &instr_vload_type_list, NULL},
+};
+INIT_RISCV_INSTR_LIST(WIDTH, instr_load_fp_type);
+
+static riscv_instr_entry instr_opivv_type[] = {
+    [0x00] = {NULL, instr_vadd_vv, NULL, "VADD.VV"},
+    [0x02] = {NULL, instr_vsub_vv, NULL, "VSUB.VV"},
+    [0x04] = {NULL, instr_vminu_vv, NULL, "VMINU.VV"},
+    [0x05] = {NULL, instr_vmin_vv, NULL, "VMIN.VV"},
+    [0x06] = {NULL, instr_vmaxu_vv, NULL, "VMAXU.VV"},
+    [0x07] = {NULL, instr_vmax_vv, NULL, "VMAX.VV"},
+    [0x09] = {NULL, instr_vand_vv, NULL, "VAND.VV"},
+    [0x0a] = {NULL, instr_vor_vv, NULL, "VOR.VV"},
+    [0x0b] = {NULL, instr_vxor_vv, NULL, "VXOR.VV"},
+    [0x17] = {NULL, instr_vmerge_vv, NULL, "VMERGE.VVM/VMV.V.V"},
+    [0x18] = {NULL, instr_vmseq_vv, NULL, "VMSEQ.VV"},
+    [0x19] = {NULL, instr_vmsne_vv, NULL, "VMSNE.VV"},
+    [0x1a] = {NULL, instr_vmsltu_vv, NULL, "VMSLTU.VV"},
+    [0x1b] = {NULL, instr_vmslt_vv, NULL, "VMSLT.VV"},
+    [0x1c] = {NULL, instr_vmsleu_vv, NULL, "VMSLEU.VV"},
+    [0x1d] = {NULL, instr_vmsle_vv, NULL, "VMSLE.VV"},
+    [0x25] = {NULL, instr_vsll_vv, NULL, "VSLL.VV"},
+    [0x28] = {NULL, instr_vsrl_vv, NULL, "VSRL.VV"},
+    [0x29] = {NULL, instr_vsra_vv, NULL, "VSRA.VV"},
+};
+INIT_RISCV_INSTR_LIST(FUNC6, instr_opivv_type);
+
+static riscv_instr_entry instr_opivx_type[] = {
+    [0x00] = {NULL, instr_vadd_vx, NULL, "VADD.VX"},
+    [0x02] = {NULL, instr_vsub_vx, NULL, "VSUB.VX"},
+    [0x03] = {NULL, instr_vrsub_vx, NULL, "VRSUB.VX"},
+    [0x04] = {NULL, instr_vminu_vx, NULL, "VMINU.VX"},
+    [0x05] = {NULL, instr_vmin_vx, NULL, "VMIN.VX"},
+    [0x06] = {NULL, instr_vmaxu_vx, NULL, "VMAXU.VX"},
+    [0x07] = {NULL, instr_vmax_vx, NULL, "VMAX.VX"},
+    [0x09] = {NULL, instr_vand_vx, NULL, "VAND.VX"},
+    [0x0a] = {NULL, instr_vor_vx, NULL, "VOR.VX"},
+    [0x0b] = {NULL, instr_vxor_vx, NULL, "VXOR.VX"},
+    [0x0e] = {NULL, instr_vslideup_vx, NULL, "VSLIDEUP.VX"},
+    [0x0f] = {NULL, instr_vslidedown_vx, NULL, "VSLIDEDOWN.VX"},
+    [0x17] = {NULL, instr_vmerge_vx, NULL, "VMERGE.VXM/VMV.V.X"},
+    [0x18] = {NULL, instr_vmseq_vx, NULL, "VMSEQ.VX"},
+    [0x19] = {NULL, instr_vmsne_vx, NULL, "VMSNE.VX"},
+    [0x1a] = {NULL, instr_vmsltu_vx, NULL, "VMSLTU.VX"},
+    [0x1b] = {NULL, instr_vmslt_vx, NULL, "VMSLT.VX"},
+    [0x1c] = {NULL, instr_vmsleu_vx, NULL, "VMSLEU.VX"},
+    [0x1d] = {NULL, instr_vmsle_vx, NULL, "VMSLE.VX"},
+    [0x1e] = {NULL, instr_vmsgtu_vx, NULL, "VMSGTU.VX"},
+    [0x1f] = {NULL, instr_vmsgt_vx, NULL, "VMSGT.VX"},
+    [0x25] = {NULL, instr_vsll_vx, NULL, "VSLL.VX"},
+    [0x28] = {NULL, instr_vsrl_vx, NULL, "VSRL.VX"},
+    [0x29] = {NULL, instr_vsra_vx, NULL, "VSRA.VX"},
+};
+INIT_RISCV_INSTR_LIST(FUNC6, instr_opivx_type);
+
+static riscv_instr_entry instr_opivi_type[] = {
+    [0x00] = {NULL, instr_vadd_vi, NULL, "VADD.VI"},
+    [0x03] = {NULL, instr_vrsub_vi, NULL, "VRSUB.VI"},
+    [0x09] = {NULL, instr_vand_vi, NULL, "VAND.VI"},
+    [0x0a] = {NULL, instr_vor_vi, NULL, "VOR.VI"},
+    [0x0b] = {NULL, instr_vxor_vi, NULL, "VXOR.VI"},
+    [0x0e] = {NULL, instr_vslideup_vi, NULL, "VSLIDEUP.VI"},
+    [0x0f] = {NULL, instr_vslidedown_vi, NULL, "VSLIDEDOWN.VI"},
+    [0x17] = {NULL, instr_vmerge_vi, NULL, "VMERGE.VIM/VMV.V.I"},
+    [0x18] = {NULL, instr_vmseq_vi, NULL, "VMSEQ.VI"},
+    [0x19] = {NULL, instr_vmsne_vi, NULL, "VMSNE.VI"},
+    [0x1c] = {NULL, instr_vmsleu_vi, NULL, "VMSLEU.VI"},
+    [0x1d] = {NULL, instr_vmsle_vi, NULL, "VMSLE.VI"},
+    [0x1e] = {NULL, instr_vmsgtu_vi, NULL, "VMSGTU.VI"},
+    [0x1f] = {NULL, instr_vmsgt_vi, NULL, "VMSGT.VI"},
+    [0x25] = {NULL, instr_vsll_vi, NULL, "VSLL.VI"},
+    [0x27] = {NULL, instr_vmvr, NULL, "VMV<NR>R.V"},
+    [0x28] = {NULL, instr_vsrl_vi, NULL, "VSRL.VI"},
+    [0x29] = {NULL, instr_vsra_vi, NULL, "VSRA.VI"},
+};
+INIT_RISCV_INSTR_LIST(FUNC6, instr_opivi_type);
+
+static riscv_instr_entry instr_vwxunary0_type[] = {
+    [0x00] = {NULL, instr_vmv_x_s, NULL, "VMV.X.S"},
+    [0x10] = {NULL, instr_vcpop_m, NULL, "VCPOP.M"},
+    [0x11] = {NULL, instr_vfirst_m, NULL, "VFIRST.M"},
+};
+INIT_RISCV_INSTR_LIST(RS1, instr_vwxunary0_type);
+
+static riscv_instr_entry instr_vmunary0_type[] = {
+    [0x01] = {NULL, instr_vmsbf_m, NULL, "VMSBF.M"},
+    [0x02] = {NULL, instr_vmsof_m, NULL, "VMSOF.M"},
+    [0x03] = {NULL, instr_vmsif_m, NULL, "VMSIF.M"},
+    [0x10] = {NULL, instr_viota_m, NULL, "VIOTA.M"},
+    [0x11] = {NULL, instr_vid_v, NULL, "VID.V"},
+};
+INIT_RISCV_INSTR_LIST(RS1, instr_vmunary0_type);
+
+static riscv_instr_entry instr_opmvv_type[] = {
+    [0x00] = {NULL, instr_vredsum_vs, NULL, "VREDSUM.VS"},
+    [0x01] = {NULL, instr_vredand_vs, NULL, "VREDAND.VS"},
+    [0x02] = {NULL, instr_vredor_vs, NULL, "VREDOR.VS"},
+    [0x03] = {NULL, instr_vredxor_vs, NULL, "VREDXOR.VS"},
+    [0x04] = {NULL, instr_vredminu_vs, NULL, "VREDMINU.VS"},
+    [0x05] = {NULL, instr_vredmin_vs, NULL, "VREDMIN.VS"},
+    [0x06] = {NULL, instr_vredmaxu_vs, NULL, "VREDMAXU.VS"},
+    [0x07] = {NULL, instr_vredmax_vs, NULL, "VREDMAX.VS"},
+    [0x10] = {NULL, NULL, &instr_vwxunary0_type_list, NULL},
+    [0x14] = {NULL, NULL, &instr_vmunary0_type_list, NULL},
+    [0x18] = {NULL, instr_vmandn_mm, NULL, "VMANDN.MM"},
+    [0x19] = {NULL, instr_vmand_mm, NULL, "VMAND.MM"},
+    [0x1a] = {NULL, instr_vmor_mm, NULL, "VMOR.MM"},
+    [0x1b] = {NULL, instr_vmxor_mm, NULL, "VMXOR.MM"},
+    [0x1c] = {NULL, instr_vmorn_mm, NULL, "VMORN.MM"},
+    [0x1d] = {NULL, instr_vmnand_mm, NULL, "VMNAND.MM"},
+    [0x1e] = {NULL, instr_vmnor_mm, NULL, "VMNOR.MM"},
+    [0x1f] = {NULL, instr_vmxnor_mm, NULL, "VMXNOR.MM"},
+    [0x20] = {NULL, instr_vdivu_vv, NULL, "VDIVU.VV"},
+    [0x21] = {NULL, instr_vdiv_vv, NULL, "VDIV.VV"},
+    [0x22] = {NULL, instr_vremu_vv, NULL, "VREMU.VV"},
+    [0x23] = {NULL, instr_vrem_vv, NULL, "VREM.VV"},
+    [0x24] = {NULL, instr_vmulhu_vv, NULL, "VMULHU.VV"},
+    [0x25] = {NULL, instr_vmul_vv, NULL, "VMUL.VV"},
+    [0x26] = {NULL, instr_vmulhsu_vv, NULL, "VMULHSU.VV"},
+    [0x27] = {NULL, instr_vmulh_vv, NULL, "VMULH.VV"},
+    [0x29] = {NULL, instr_vmadd_vv, NULL, "VMADD.VV"},
+    [0x2b] = {NULL, instr_vnmsub_vv, NULL, "VNMSUB.VV"},
+    [0x2d] = {NULL, instr_vmacc_vv, NULL, "VMACC.VV"},
+    [0x2f] = {NULL, instr_vnmsac_vv, NULL, "VNMSAC.VV"},
+};
+INIT_RISCV_INSTR_LIST(FUNC6, instr_opmvv_type);
+
+static riscv_instr_entry instr_vrxunary0_type[] = {
+    [0x00] = {NULL, instr_vmv_s_x, NULL, "VMV.S.X"},
+};
+INIT_RISCV_INSTR_LIST(RS2, instr_vrxunary0_type);
+
+static riscv_instr_entry instr_opmvx_type[] = {
+    [0x0e] = {NULL, instr_vslide1up_vx, NULL, "VSLIDE1UP.VX"},
+    [0x0f] = {NULL, instr_vslide1down_vx, NULL, "VSLIDE1DOWN.VX"},
+    [0x10] = {NULL, NULL, &instr_vrxunary0_type_list, NULL},
+    [0x20] = {NULL, instr_vdivu_vx, NULL, "VDIVU.VX"},
+    [0x21] = {NULL, instr_vdiv_vx, NULL, "VDIV.VX"},
+    [0x22] = {NULL, instr_vremu_vx, NULL, "VREMU.VX"},
+    [0x23] = {NULL, instr_vrem_vx, NULL, "VREM.VX"},
+    [0x24] = {NULL, instr_vmulhu_vx, NULL, "VMULHU.VX"},
+    [0x25] = {NULL, instr_vmul_vx, NULL, "VMUL.VX"},
+    [0x26] = {NULL, instr_vmulhsu_vx, NULL, "VMULHSU.VX"},
+    [0x27] = {NULL, instr_vmulh_vx, NULL, "VMULH.VX"},
+    [0x29] = {NULL, instr_vmadd_vx, NULL, "VMADD.VX"},
+    [0x2b] = {NULL, instr_vnmsub_vx, NULL, "VNMSUB.VX"},
+    [0x2d] = {NULL, instr_vmacc_vx, NULL, "VMACC.VX"},
+    [0x2f] = {NULL, instr_vnmsac_vx, NULL, "VNMSAC.VX"},
+};
+INIT_RISCV_INSTR_LIST(FUNC6, instr_opmvx_type);
+
+static riscv_instr_entry instr_vwfunary0_type[] = {
+    [0x00] = {NULL, instr_vfmv_f_s, NULL, "VFMV.F.S"},
+};
+INIT_RISCV_INSTR_LIST(RS1, instr_vwfunary0_type);
+
+static riscv_instr_entry instr_vfunary0_type[] = {
+    [0x00] = {NULL, instr_vfcvt_xu_f_v, NULL, "VFCVT.XU.F.V"},
+    [0x01] = {NULL, instr_vfcvt_x_f_v, NULL, "VFCVT.X.F.V"},
+    [0x02] = {NULL, instr_vfcvt_f_xu_v, NULL, "VFCVT.F.XU.V"},
+    [0x03] = {NULL, instr_vfcvt_f_x_v, NULL, "VFCVT.F.X.V"},
+    [0x06] = {NULL, instr_vfcvt_rtz_xu_f_v, NULL, "VFCVT.RTZ.XU.F.V"},
+    [0x07] = {NULL, instr_vfcvt_rtz_x_f_v, NULL, "VFCVT.RTZ.X.F.V"},
+};
+INIT_RISCV_INSTR_LIST(RS1, instr_vfunary0_type);
+
+static riscv_instr_entry instr_vfunary1_type[] = {
+    [0x00] = {NULL, instr_vfsqrt_v, NULL, "VFSQRT.V"},
+};
+INIT_RISCV_INSTR_LIST(RS1, instr_vfunary1_type);
+
+static riscv_instr_entry instr_opfvv_type[] = {
+    [0x00] = {NULL, instr_vfadd_vv, NULL, "VFADD.VV"},
+    [0x01] = {NULL, instr_vfredusum_vs, NULL, "VFREDUSUM.VS"},
+    [0x02] = {NULL, instr_vfsub_vv, NULL, "VFSUB.VV"},
+    [0x03] = {NULL, instr_vfredosum_vs, NULL, "VFREDOSUM.VS"},
+    [0x04] = {NULL, instr_vfmin_vv, NULL, "VFMIN.VV"},
+    [0x05] = {NULL, instr_vfredmin_vs, NULL, "VFREDMIN.VS"},
+    [0x06] = {NULL, instr_vfmax_vv, NULL, "VFMAX.VV"},
+    [0x07] = {NULL, instr_vfredmax_vs, NULL, "VFREDMAX.VS"},
+    [0x08] = {NULL, instr_vfsgnj_vv, NULL, "VFSGNJ.VV"},
+    [0x09] = {NULL, instr_vfsgnjn_vv, NULL, "VFSGNJN.VV"},
+    [0x0a] = {NULL, instr_vfsgnjx_vv, NULL, "VFSGNJX.VV"},
+    [0x10] = {NULL, NULL, &instr_vwfunary0_type_list, NULL},
+    [0x12] = {NULL, NULL, &instr_vfunary0_type_list, NULL},
+    [0x13] = {NULL, NULL, &instr_vfunary1_type_list, NULL},
+    [0x18] = {NULL, instr_vmfeq_vv, NULL, "VMFEQ.VV"},
+    [0x19] = {NULL, instr_vmfle_vv, NULL, "VMFLE.VV"},
+    [0x1b] = {NULL, instr_vmflt_vv, NULL, "VMFLT.VV"},
+    [0x1c] = {NULL, instr_vmfne_vv, NULL, "VMFNE.VV"},
+    [0x20] = {NULL, instr_vfdiv_vv, NULL, "VFDIV.VV"},
+    [0x24] = {NULL, instr_vfmul_vv, NULL, "VFMUL.VV"},
+    [0x28] = {NULL, instr_vfmadd_vv, NULL, "VFMADD.VV"},
+    [0x29] = {NULL, instr_vfnmadd_vv, NULL, "VFNMADD.VV"},
+    [0x2a] = {NULL, instr_vfmsub_vv, NULL, "VFMSUB.VV"},
+    [0x2b] = {NULL, instr_vfnmsub_vv, NULL, "VFNMSUB.VV"},
+    [0x2c] = {NULL, instr_vfmacc_vv, NULL, "VFMACC.VV"},
+    [0x2d] = {NULL, instr_vfnmacc_vv, NULL, "VFNMACC.VV"},
+    [0x2e] = {NULL, instr_vfmsac_vv, NULL, "VFMSAC.VV"},
+    [0x2f] = {NULL, instr_vfnmsac_vv, NULL, "VFNMSAC.VV"},
+};
+INIT_RISCV_INSTR_LIST(FUNC6, instr_opfvv_type);
+
+static riscv_instr_entry instr_vrfunary0_type[] = {
+    [0x00] = {NULL, instr_vfmv_s_f, NULL, "VFMV.S.F"},
+};
+INIT_RISCV_INSTR_LIST(RS2, instr_vrfunary0_type);
+
+static riscv_instr_entry instr_opfvf_type[] = {
+    [0x00] = {NULL, instr_vfadd_vf, NULL, "VFADD.VF"},
+    [0x02] = {NULL, instr_vfsub_vf, NULL, "VFSUB.VF"},
+    [0x04] = {NULL, instr_vfmin_vf, NULL, "VFMIN.VF"},
+    [0x06] = {NULL, instr_vfmax_vf, NULL, "VFMAX.VF"},
+    [0x08] = {NULL, instr_vfsgnj_vf, NULL, "VFSGNJ.VF"},
+    [0x09] = {NULL, instr_vfsgnjn_vf, NULL, "VFSGNJN.VF"},
+    [0x0a] = {NULL, instr_vfsgnjx_vf, NULL, "VFSGNJX.VF"},
+    [0x0e] = {NULL, instr_vfslide1up_vf, NULL, "VFSLIDE1UP.VF"},
+    [0x0f] = {NULL, instr_vfslide1down_vf, NULL, "VFSLIDE1DOWN.VF"},
+    [0x10] = {NULL, NULL, &instr_vrfunary0_type_list, NULL},
+    [0x17] = {NULL, instr_vfmerge_vf, NULL, "VFMERGE.VFM/VFMV.V.F"},
+    [0x18] = {NULL, instr_vmfeq_vf, NULL, "VMFEQ.VF"},
+    [0x19] = {NULL, instr_vmfle_vf, NULL, "VMFLE.VF"},
+    [0x1b] = {NULL, instr_vmflt_vf, NULL, "VMFLT.VF"},
+    [0x1c] = {NULL, instr_vmfne_vf, NULL, "VMFNE.VF"},
+    [0x1d] = {NULL, instr_vmfgt_vf, NULL, "VMFGT.VF"},
+    [0x1f] = {NULL, instr_vmfge_vf, NULL, "VMFGE.VF"},
+    [0x20] = {NULL, instr_vfdiv_vf, NULL, "VFDIV.VF"},
+    [0x21] = {NULL, instr_vfrdiv_vf, NULL, "VFRDIV.VF"},
+    [0x24] = {NULL, instr_vfmul_vf, NULL, "VFMUL.VF"},
+    [0x27] = {NULL, instr_vfrsub_vf, NULL, "VFRSUB.VF"},
+    [0x28] = {NULL, instr_vfmadd_vf, NULL, "VFMADD.VF"},
+    [0x29] = {NULL, instr_vfnmadd_vf, NULL, "VFNMADD.VF"},
+    [0x2a] = {NULL, instr_vfmsub_vf, NULL, "VFMSUB.VF"},
+    [0x2b] = {NULL, instr_vfnmsub_vf, NULL, "VFNMSUB.VF"},
+    [0x2c] = {NULL, instr_vfmacc_vf, NULL, "VFMACC.VF"},
+    [0x2d] = {NULL, instr_vfnmacc_vf, NULL, "VFNMACC.VF"},
+    [0x2e] = {NULL, instr_vfmsac_vf, NULL, "VFMSAC.VF"},
+    [0x2f] = {NULL, instr_vfnmsac_vf, NULL, "VFNMSAC.VF"},
+};
+INIT_RISCV_INSTR_LIST(FUNC6, instr_opfvf_type);
+
+static riscv_instr_entry instr_vector_type[] = {
+    [0x0] = {NULL, NULL, &instr_opivv_type_list, NULL},
+    [0x1] = {NULL, NULL, &instr_opfvv_type_list, NULL},
+    [0x2] = {NULL, NULL, &instr_opmvv_type_list, NULL},
+    [0x3] = {NULL, NULL, &instr_opivi_type_list, NULL},
+    [0x4] = {NULL, NULL, &instr_opivx_type_list, NULL},
+    [0x5] = {NULL, NULL, &instr_opfvf_type_list, NULL},
+    [0x6] = {NULL, NULL, &instr_opmvx_type_list, NULL},
+    [0x7] = {NULL, instr_vsetvl, NULL, "VSETVLI/VSETIVLI/VSETVL"},
+};
+INIT_RISCV_INSTR_LIST(FUNC3, instr_vector_type);
+
 static riscv_instr_entry opcode_type[] = {
     [0x00] = {Cx_decode, NULL, &instr_c0_type_list, NULL},
     [0x01] = {Cx_decode, NULL, &instr_c1_type_list, NULL},
     [0x02] = {Cx_decode, NULL, &instr_c2_type_list, NULL},
     [0x03] = {I_decode, NULL, &instr_load_type_list, NULL},
+    [0x07] = {V_decode, NULL, &instr_load_fp_type_list, NULL},
     [0x0f] = {I_decode, NULL, &instr_fence_type_list, NULL},
     [0x13] = {I_decode, NULL, &instr_imm_type_list, NULL},
     [0x17] = {U_decode, instr_auipc, NULL, "AUIPC"},
@@ -1639,6 +3675,7 @@ static riscv_instr_entry opcode_type[] = {
     [0x33] = {R_decode, NULL, &instr_reg_type_list, NULL},
     [0x37] = {U_decode, instr_lui, NULL, "LUI"},
     [0x3b] = {R_decode, NULL, &instr_regw_type_list, NULL},
+    [0x57] = {V_decode, NULL, &instr_vector_type_list, NULL},
     [0x63] = {B_decode, NULL, &instr_branch_type_list, NULL},
     [0x67] = {I_decode, instr_jalr, NULL, "JALR"},
     [0x6f] = {J_decode, instr_jal, NULL, "JAL"},
@@ -1667,6 +3704,9 @@ static bool __decode(riscv_cpu *cpu, riscv_instr_desc *instr_desc)
     case FUNC5:
         index = (cpu->instr.funct7 & 0b1111100) >> 2;
         break;
+    case FUNC6:
+        index = cpu->instr.funct6;
+        break;
     case FUNC6_S:
         index = cpu->instr.funct6 & 0x3;
         break;
@@ -1676,6 +3716,9 @@ static bool __decode(riscv_cpu *cpu, riscv_instr_desc *instr_desc)
     case FUNC7:
         index = cpu->instr.funct7;
         break;
+    case RS1:
+        index = cpu->instr.rs1;
+        break;
     case RS2:
         index = cpu->instr.rs2;
         break;
@@ -1719,9 +3762,11 @@ static bool __decode(riscv_cpu *cpu, riscv_instr_desc *instr_desc)
         return __decode(cpu, entry.next);
     else
         cpu->instr.exec_func = entry.exec_func;
+    cpu->instr.name = entry.entry_name;
 
     if (entry.entry_name) {
-        LOG_DEBUG("[DEBUG] next INSTR: %s\n", entry.entry_name);
+        LOG_DEBUG(cpu->logger, "[DEBUG] next INSTR: %s\n",
+                  entry.entry_name);
     }
 
     return true;
@@ -1729,6 +3774,13 @@ static bool __decode(riscv_cpu *cpu, riscv_instr_desc *instr_desc)
 
 static uint64_t addr_translate(riscv_cpu *cpu, uint64_t addr, Access access)
 {
+    // the user-mode emulation maps the whole address space to DRAM linearly
+    if (cpu->user.enable) {
+        if (addr < USER_SIZE)
+            return addr + DRAM_BASE;
+        goto translate_fail;
+    }
+
     uint64_t satp = read_csr(&cpu->csr, SATP);
     // if not enable page table translation
     if (satp >> 60 != 8)
@@ -1743,6 +3795,9 @@ static uint64_t addr_translate(riscv_cpu *cpu, uint64_t addr, Access access)
             ((read_csr(&cpu->csr, MSTATUS) >> 11) == MACHINE))
             return addr;
 
+    count_hpm(&cpu->csr, HPM_PAGE_WALK);
+    cpu->stats.page_walks++;
+
     /* Reference to:
      * - 4.3.2 Virtual Address Translation Process
      * - 4.4 Sv39: Page-Based 39-bit Virtual-Memory System */
@@ -1930,15 +3985,22 @@ static Trap handle_exception(riscv_cpu *cpu, uint64_t exc_pc)
     case InstructionAddressMisaligned:
     case InstructionAccessFault:
         return Trap_Fatal;
+    /* The instruction which can't be decoded stops the emulator in tick_cpu,
+     * so this is an illegal one found on execution, e.g. a vector instruction
+     * while mstatus.VS is Off. */
     case IllegalInstruction:
-        return Trap_Fatal;  // stop the emulator if overcome illegal instruction
+        return Trap_Contained;
     case Breakpoint:
         return Trap_Requested;
-    case LoadAddressMisaligned:
     case LoadAccessFault:
-    case StoreAMOAddressMisaligned:
     case StoreAMOAccessFault:
         return Trap_Fatal;
+    /* misaligned access to DRAM is handled by the emulator, so only the one
+     * to device or by the atomics is reported, which could be emulated by the
+     * guest */
+    case LoadAddressMisaligned:
+    case StoreAMOAddressMisaligned:
+        return Trap_Invisible;
     case EnvironmentCallFromUMode:
     case EnvironmentCallFromSMode:
     case EnvironmentCallFromMMode:
@@ -2040,6 +4102,11 @@ static bool irq_enable(riscv_cpu *cpu, uint8_t cause)
 
     cpu->irq.irq = cause;
     cpu->irq.value = cpu->pc;
+    count_hpm(&cpu->csr, HPM_INTERRUPT);
+    count_trap(cpu->stats.interrupts, cause, cpu->mode.mode);
+    if (cpu->tracer)
+        trace_event(cpu->tracer, TRACE_INTERRUPT, cpu->pc, cpu->mode.mode,
+                    cause, 0);
     interrput_take_trap(cpu, new_mode);
 #ifdef ICACHE_CONFIG
     // flush cache when jumping in trap handler
@@ -2109,14 +4176,70 @@ static void handle_interrupt(riscv_cpu *cpu)
 #endif
 }
 
+/* An access that crosses the page boundary is split into two halves, and each
+ * of them is translated separately since the two pages could be mapped to
+ * unrelated frames. Both pages are translated before touching the memory, so a
+ * fault on the second page leaves the first one intact. Return the number of
+ * bytes in the first page, or 0 if the access should be taken as a whole.
+ *
+ * Both halves must be in DRAM, where each of them is accessed at once. Such an
+ * access is misaligned, so the one to a device raises the misaligned exception
+ * as the whole access does on the bus. */
+static uint8_t split_translate(riscv_cpu *cpu,
+                               uint64_t addr,
+                               uint8_t size,
+                               Access access,
+                               uint64_t paddr[2])
+{
+    uint64_t page_size = 1UL << PAGE_SHIFT;
+    uint64_t offset = addr & (page_size - 1);
+
+    paddr[0] = addr_translate(cpu, addr, access);
+    if (cpu->exc.exception != NoException || offset + (size >> 3) <= page_size)
+        return 0;
+
+    paddr[1] = addr_translate(cpu, addr - offset + page_size, access);
+    if (cpu->exc.exception != NoException)
+        return 0;
+
+    uint8_t split = page_size - offset, len = size >> 3;
+    if (paddr[0] < DRAM_BASE || paddr[0] + split > DRAM_END ||
+        paddr[1] < DRAM_BASE || paddr[1] + len - split > DRAM_END) {
+        cpu->exc.exception = access == Access_Store ? StoreAMOAddressMisaligned
+                                                    : LoadAddressMisaligned;
+        cpu->exc.value = addr;
+        return 0;
+    }
+    return split;
+}
+
 /* these two functions are the indirect layer of read / write bus from cpu,
  * which will do address translation before actually read / write the bus */
 static uint64_t read_cpu(riscv_cpu *cpu, uint64_t addr, uint8_t size)
 {
-    addr = addr_translate(cpu, addr, Access_Load);
+    uint64_t paddr[2];
+    uint8_t split = split_translate(cpu, addr, size, Access_Load, paddr);
     if (cpu->exc.exception != NoException)
         return -1;
-    return read_bus(&cpu->bus, addr, size, &cpu->exc);
+    if (paddr[0] < DRAM_BASE || paddr[0] >= DRAM_END)
+        count_hpm(&cpu->csr, HPM_MMIO);
+    if (!split) {
+        uint64_t value = read_bus(&cpu->bus, paddr[0], size, &cpu->exc);
+        if (cpu->tracer)
+            trace_mem(cpu->tracer, addr, value, false);
+        return value;
+    }
+
+    // the bytes beyond the access are zero
+    uint8_t buf[8] = {0};
+    uint8_t *mem = cpu->bus.memory.mem;
+    memcpy(buf, mem + (paddr[0] - DRAM_BASE), split);
+    memcpy(buf + split, mem + (paddr[1] - DRAM_BASE), (size >> 3) - split);
+    uint64_t value;
+    read_len(64, buf, value);
+    if (cpu->tracer)
+        trace_mem(cpu->tracer, addr, value, false);
+    return value;
 }
 
 static bool write_cpu(riscv_cpu *cpu,
@@ -2124,15 +4247,37 @@ static bool write_cpu(riscv_cpu *cpu,
                       uint8_t size,
                       uint64_t value)
 {
-    addr = addr_translate(cpu, addr, Access_Store);
+    uint64_t paddr[2];
+    uint8_t split = split_translate(cpu, addr, size, Access_Store, paddr);
     if (cpu->exc.exception != NoException)
         return false;
-    return write_bus(&cpu->bus, addr, size, value, &cpu->exc);
+    if (paddr[0] < DRAM_BASE || paddr[0] >= DRAM_END)
+        count_hpm(&cpu->csr, HPM_MMIO);
+    if (cpu->tracer)
+        trace_mem(cpu->tracer, addr, value, true);
+    if (!split)
+        return write_bus(&cpu->bus, paddr[0], size, value, &cpu->exc);
+
+    uint8_t buf[8];
+    write_len(64, buf, value);
+    uint64_t len[2] = {split, (size >> 3) - split};
+    for (int i = 0; i < 2; i++) {
+        memcpy(cpu->bus.memory.mem + (paddr[i] - DRAM_BASE), buf + i * split,
+               len[i]);
+        mark_dirty(cpu->bus.memory.dirty, paddr[i] - DRAM_BASE, len[i]);
+        notify_dram_write(&cpu->bus, paddr[i], len[i]);
+    }
+    return true;
 }
 
-bool init_cpu(riscv_cpu *cpu, const char *filename, const char *rfs_name)
+bool init_cpu(riscv_cpu *cpu, const riscv_config *config)
 {
-    if (!init_bus(&cpu->bus, filename, rfs_name))
+    if (!log_begin(&cpu->logger)) {
+        ERROR("Fail to initialize the debug logger\n");
+        return false;
+    }
+
+    if (!init_bus(&cpu->bus, config))
         return false;
 
     if (!init_csr(&cpu->csr))
@@ -2153,10 +4298,23 @@ bool init_cpu(riscv_cpu *cpu, const char *filename, const char *rfs_name)
         cpu->freg[i].u = 0;
         cpu->freg[i].f = 0;
     }
+    memset(cpu->vreg, 0, sizeof(cpu->vreg));
 
     cpu->pc = BOOT_ROM_BASE;
     cpu->xreg[2] = DRAM_BASE + DRAM_SIZE;
     cpu->instr.exec_func = NULL;
+    cpu->instr_stats = NULL;
+    memset(&cpu->stats, 0, sizeof(riscv_stats));
+    cpu->tracer = NULL;
+    init_timebase(&cpu->timebase, config->timebase);
+
+    memset(&cpu->sbi, 0, sizeof(riscv_sbi));
+    if (config->sbi && !init_sbi(cpu))
+        return false;
+
+    memset(&cpu->user, 0, sizeof(riscv_user));
+    if (config->user && !init_user(cpu, config))
+        return false;
     return true;
 }
 
@@ -2169,9 +4327,10 @@ static bool fetch_icache(riscv_cpu *cpu)
         memcpy(&cpu->instr, icache_instr, sizeof(riscv_instr));
         cpu->pc += (cpu->instr.instr & 0x3) == 0x3 ? 4 : 2;
 
-        LOG_DEBUG("[DEBUG] cache hit \n");
+        LOG_DEBUG(cpu->logger, "[DEBUG] cache hit \n");
 
         LOG_DEBUG(
+            cpu->logger,
             "[DEBUG] instr: 0x%x\n"
             "opcode = 0x%x funct3 = 0x%x funct7 = 0x%x rs2 = 0x%x\n",
             cpu->instr.instr, cpu->instr.opcode, cpu->instr.funct3,
@@ -2190,9 +4349,29 @@ static bool fetch(riscv_cpu *cpu)
     if (cpu->exc.exception != NoException)
         return false;
 
-    uint32_t instr = read_bus(&cpu->bus, pc, 32, &cpu->exc);
-    if (cpu->exc.exception != NoException)
-        return false;
+    /* The 4 bytes after pc could cross the page boundary when the last
+     * instruction of a page is compressed, or a 32-bit instruction is only
+     * 2-byte aligned. Fetch the first half alone in this case, and translate
+     * the second page only if it is actually required. */
+    uint32_t instr;
+    if ((cpu->pc & ((1UL << PAGE_SHIFT) - 1)) == (1UL << PAGE_SHIFT) - 2) {
+        instr = read_bus(&cpu->bus, pc, 16, &cpu->exc);
+        if (cpu->exc.exception != NoException)
+            return false;
+
+        if ((instr & 0x3) == 0x3) {
+            uint64_t hi = addr_translate(cpu, cpu->pc + 2, Access_Instr);
+            if (cpu->exc.exception != NoException)
+                return false;
+            instr |= read_bus(&cpu->bus, hi, 16, &cpu->exc) << 16;
+            if (cpu->exc.exception != NoException)
+                return false;
+        }
+    } else {
+        instr = read_bus(&cpu->bus, pc, 32, &cpu->exc);
+        if (cpu->exc.exception != NoException)
+            return false;
+    }
 
     int pc_shift = 0;
 
@@ -2215,7 +4394,8 @@ static bool fetch(riscv_cpu *cpu)
         cpu->instr.opcode = instr & 0x7f;
     }
 
-    LOG_DEBUG("[DEBUG] pc: %lx instr: 0x%x\n", pc, cpu->instr.instr);
+    LOG_DEBUG(cpu->logger, "[DEBUG] pc: %lx instr: 0x%x\n", pc,
+              cpu->instr.instr);
 
     cpu->pc += pc_shift;
     return true;
@@ -2226,6 +4406,7 @@ static bool decode(riscv_cpu *cpu)
     bool ret = __decode(cpu, &opcode_type_list);
 
     LOG_DEBUG(
+        cpu->logger,
         "[DEBUG] instr: 0x%x opcode = 0x%x funct3 = 0x%x funct7 = 0x%x\n"
         "        rs1 = 0x%x rs2 = 0x%x rd = 0x%x\n",
         cpu->instr.instr, cpu->instr.opcode, cpu->instr.funct3,
@@ -2264,6 +4445,23 @@ static bool exec(riscv_cpu *cpu)
     return true;
 }
 
+// exec and record the instruction, which is kept out of the usual path
+static __attribute__((noinline, cold)) bool exec_traced(riscv_cpu *cpu,
+                                                      uint64_t pc)
+{
+    uint8_t mode = cpu->mode.mode;
+    uint8_t rd = cpu->instr.rd;
+    uint32_t instr = cpu->instr.instr;
+    uint64_t old = cpu->xreg[rd];
+
+    if (!exec(cpu))
+        return false;
+
+    trace_instr(cpu->tracer, pc, instr, mode, rd, cpu->xreg[rd] != old,
+                cpu->xreg[rd]);
+    return true;
+}
+
 static void dump_reg(riscv_cpu *cpu)
 {
     static char *abi_name[] = {
@@ -2295,20 +4493,27 @@ static void dump_csr(riscv_cpu *cpu)
 
 bool tick_cpu(riscv_cpu *cpu)
 {
-    // TODO: sync mtime in Clint and TIME in CSR
-    // Increment the value for Time in CSR
-    tick_csr(&cpu->csr);
-    // Increment the value for mtime in Clint
-    tick_bus(&cpu->bus, &cpu->csr);
+    // the guest has asked to shut down the system through SBI, HTIF or exit
+    if (cpu->sbi.shutdown || cpu->bus.htif.exited || cpu->user.exited)
+        return false;
+
+    // mtime in CLINT and time in CSR advance together, see timebase.h
+    uint64_t ticks = tick_timebase(&cpu->timebase);
+    tick_csr(&cpu->csr, ticks);
+    tick_bus(&cpu->bus, &cpu->csr, ticks);
     handle_interrupt(cpu);
 
     uint64_t instr_addr = cpu->pc;
     bool ret = true;
+    bool decoded = false;
 
 #ifdef ICACHE_CONFIG
     if (!fetch_icache(cpu))
 #endif
     {
+#ifdef ICACHE_CONFIG
+        count_hpm(&cpu->csr, HPM_ICACHE_MISS);
+#endif
         ret = fetch(cpu);
         if (!ret)
             goto get_trap;
@@ -2318,12 +4523,34 @@ bool tick_cpu(riscv_cpu *cpu)
             goto get_trap;
     }
 
-    ret = exec(cpu);
+    decoded = true;
+    if (cpu->instr_stats)
+        count_instr(cpu->instr_stats, cpu->instr.name, cpu->mode.mode);
+    ret = cpu->tracer ? exec_traced(cpu, instr_addr) : exec(cpu);
+    if (ret && !(cpu->csr.reg[MCOUNTINHIBIT] & COUNTER_IR))
+        cpu->csr.reg[MINSTRET]++;
 get_trap:
     if (!ret) {
         uint64_t next_pc = cpu->pc;
+        if (cpu->tracer)
+            trace_event(cpu->tracer, TRACE_EXCEPTION, instr_addr,
+                        cpu->mode.mode, cpu->exc.exception, cpu->exc.value);
+        /* There is no kernel to take the trap of the program run by the
+         * user-mode emulation, which is killed as if by a signal. */
+        if (cpu->user.enable) {
+            ERROR("The program is killed by exception %x at pc 0x%lx, "
+                  "tval 0x%lx\n",
+                  cpu->exc.exception, instr_addr, cpu->exc.value);
+            return false;
+        }
+        count_hpm(&cpu->csr, HPM_EXCEPTION);
+        count_trap(cpu->stats.exceptions, cpu->exc.exception, cpu->mode.mode);
+        /* The instruction which can't be fetched or decoded as a valid one is
+         * likely not implemented by the emulator, so it stops here instead of
+         * leaving it to the guest. */
+        bool unknown = !decoded && cpu->exc.exception == IllegalInstruction;
         Trap trap = handle_exception(cpu, instr_addr);
-        if (trap == Trap_Fatal) {
+        if (trap == Trap_Fatal || unknown) {
             dump_reg(cpu);
             dump_csr(cpu);
             ERROR("CPU mode: %d, exception %x happen before pc %lx\n",
@@ -2341,9 +4568,52 @@ get_trap:
     return true;
 }
 
+bool decode_cpu(riscv_cpu *cpu, uint32_t instr)
+{
+    if ((instr & 0x3) != 0x3) {
+        cpu->instr.instr = instr & 0xffff;
+        cpu->instr.opcode = instr & 0x3;
+    } else {
+        cpu->instr.instr = instr;
+        cpu->instr.opcode = instr & 0x7f;
+    }
+    return __decode(cpu, &opcode_type_list);
+}
+
+uint64_t translate_cpu(riscv_cpu *cpu, uint64_t addr, Access access)
+{
+    return addr_translate(cpu, addr, access);
+}
+
+bool peek_cpu(riscv_cpu *cpu, uint64_t addr, uint64_t *value)
+{
+    if (addr & 0x7)
+        return false;
+
+    riscv_exception exc = cpu->exc;
+    uint64_t page_walks = cpu->stats.page_walks;
+    uint32_t walk_counters = cpu->csr.hpm_counters[HPM_PAGE_WALK];
+    cpu->csr.hpm_counters[HPM_PAGE_WALK] = 0;
+    cpu->exc.exception = NoException;
+
+    uint64_t paddr = addr_translate(cpu, addr, Access_Load);
+    bool ok = cpu->exc.exception == NoException && paddr >= DRAM_BASE &&
+              paddr < DRAM_END;
+    if (ok)
+        *value = read_mem(&cpu->bus.memory, paddr, 64, &cpu->exc);
+
+    cpu->csr.hpm_counters[HPM_PAGE_WALK] = walk_counters;
+    cpu->stats.page_walks = page_walks;
+    cpu->exc = exc;
+    return ok;
+}
+
 void free_cpu(riscv_cpu *cpu)
 {
+    log_end(cpu->logger);
     free_bus(&cpu->bus);
+    free_user(cpu);
+    free_instr_stats(cpu->instr_stats);
 #ifdef ICACHE_CONFIG
     free_icache(&cpu->icache);
 #endif
@@ -2,6 +2,7 @@
 #include <string.h>
 
 #include "csr.h"
+#include "vector.h"
 
 /* 1.The supervisor should only view CSR state that should be visible to a
  * supervisor-level operating system. In particular, there is no information
@@ -29,16 +30,24 @@
 
 bool init_csr(riscv_csr *csr)
 {
-    memset(&csr->reg, 0, sizeof(uint64_t) * CSR_CAPACITY);
+    memset(csr, 0, sizeof(riscv_csr));
 
     uint64_t misa_val = (2UL << 62) |  // XLEN = 64
+                        (1 << 21) |    // Vector extension
                         (1 << 20) |    // User mode implemented
                         (1 << 18) |    // Supervisor mode implemented
                         (1 << 12) |    // Integer Multiply/Divide extension
                         (1 << 8) |     // RV32I/64I/128I base ISA
                         (1 << 2) |     // Compressed extension)
+                        (1 << 1) |     // Bit-manipulation extension
                         1;             // Atomic extension
     write_csr(csr, MISA, misa_val);
+
+    // the vector unit is reset with an illegal vtype
+    csr->reg[VTYPE] = VTYPE_VILL;
+    csr->reg[VLENB] = VREG_SIZE;
+    // no timer interrupt before stimecmp is written
+    csr->reg[STIMECMP] = -1;
     return true;
 }
 
@@ -52,15 +61,34 @@ uint64_t read_csr(riscv_csr *csr, uint16_t addr)
     switch (addr) {
     case SSTATUS:
         return (csr->reg[MSTATUS] | SSTATUS_UXL_64BIT) & SSTATUS_VISIBLE;
+    // the unprivileged counters are the read-only shadows of the machine ones
+    case CYCLE:
+        return csr->reg[MCYCLE];
+    case INSTRET:
+        return csr->reg[MINSTRET];
+    case HPMCOUNTER3 ... HPMCOUNTER31:
+        return csr->reg[MHPMCOUNTER3 + (addr - HPMCOUNTER3)];
     case SIE:
         return (csr->reg[MIE] & csr->reg[MIDELEG]);
     case SIP:
         return (csr->reg[MIP] & csr->reg[MIDELEG]);
+    case VCSR:
+        return (csr->reg[VXRM] << 1) | csr->reg[VXSAT];
     default:
         return csr->reg[addr];
     }
 }
 
+// select the event counted by mhpmcounter<n>
+static void write_hpm_event(riscv_csr *csr, int n, uint64_t event)
+{
+    csr->reg[MHPMEVENT3 + n - 3] = event;
+    for (int i = 0; i < HPM_EVENT_COUNT; i++)
+        csr->hpm_counters[i] &= ~(1U << n);
+    if (event != HPM_NONE && event < HPM_EVENT_COUNT)
+        csr->hpm_counters[event] |= 1U << n;
+}
+
 void write_csr(riscv_csr *csr, uint16_t addr, uint64_t value)
 {
     if (addr >= CSR_CAPACITY) {
@@ -96,16 +124,65 @@ void write_csr(riscv_csr *csr, uint16_t addr, uint64_t value)
         *mstatus = (*mstatus & ~MSTATUS_WRITABLE) | (value & MSTATUS_WRITABLE);
         break;
     }
+    case MENVCFG:
+        csr->reg[MENVCFG] = value & (MENVCFG_CBIE | MENVCFG_CBCFE |
+                                     MENVCFG_CBZE | MENVCFG_STCE);
+        break;
+    case SENVCFG:
+        csr->reg[SENVCFG] =
+            value & (MENVCFG_CBIE | MENVCFG_CBCFE | MENVCFG_CBZE);
+        break;
+    case VXSAT:
+        csr->reg[VXSAT] = value & 0x1;
+        break;
+    case VXRM:
+        csr->reg[VXRM] = value & 0x3;
+        break;
+    case VCSR:
+        csr->reg[VXSAT] = value & 0x1;
+        csr->reg[VXRM] = (value >> 1) & 0x3;
+        break;
+    case MCOUNTEREN:
+    case SCOUNTEREN:
+        csr->reg[addr] = value & 0xffffffff;
+        break;
+    case MCOUNTINHIBIT:
+        // time is always counting
+        csr->reg[MCOUNTINHIBIT] = value & 0xffffffff & ~COUNTER_TM;
+        break;
+    case MHPMEVENT3 ... MHPMEVENT31:
+        write_hpm_event(csr, addr - MHPMEVENT3 + 3, value);
+        break;
     // read only CSR
     case MHARTID:
+    case CYCLE:
     case TIME:
+    case INSTRET:
+    case HPMCOUNTER3 ... HPMCOUNTER31:
+    case VL:
+    case VTYPE:
+    case VLENB:
         break;
     default:
         csr->reg[addr] = value;
     }
 }
 
-void tick_csr(riscv_csr *csr)
+void tick_csr(riscv_csr *csr, uint64_t ticks)
 {
-    csr->reg[TIME]++;
+    csr->reg[TIME] += ticks;
+    // each instruction takes a cycle
+    if (!(csr->reg[MCOUNTINHIBIT] & COUNTER_CY))
+        csr->reg[MCYCLE]++;
+
+    /* When menvcfg.STCE is set, the supervisor timer interrupt is raised by
+     * comparing time with stimecmp directly, so the S-mode kernel could program
+     * its next tick without the round trip through the M-mode firmware. STIP
+     * stays pending as long as time >= stimecmp. */
+    if (csr->reg[MENVCFG] & MENVCFG_STCE) {
+        if (csr->reg[TIME] >= csr->reg[STIMECMP])
+            csr->reg[MIP] |= MIP_STIP;
+        else
+            csr->reg[MIP] &= ~MIP_STIP;
+    }
 }
@@ -0,0 +1,30 @@
+#include "ctrl.h"
+
+uint64_t read_ctrl(__attribute__((unused)) riscv_ctrl *ctrl,
+                   uint64_t addr,
+                   uint8_t size,
+                   riscv_exception *exc)
+{
+    if ((size != 32 && size != 64) || addr != CTRL_CHECKPOINT) {
+        exc->exception = LoadAccessFault;
+        exc->value = addr;
+        return -1;
+    }
+    return 0;
+}
+
+bool write_ctrl(riscv_ctrl *ctrl,
+                uint64_t addr,
+                uint8_t size,
+                __attribute__((unused)) uint64_t value,
+                riscv_exception *exc)
+{
+    if ((size != 32 && size != 64) || addr != CTRL_CHECKPOINT) {
+        exc->exception = StoreAMOAccessFault;
+        exc->value = addr;
+        return false;
+    }
+
+    ctrl->checkpoint = true;
+    return true;
+}
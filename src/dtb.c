@@ -1,7 +1,10 @@
-#include "dtb.h"
+#include <stdio.h>
 #include <stdlib.h>
-#include <sys/wait.h>
-#include <unistd.h>
+
+#include "cpu.h"
+#include "dtb.h"
+#include "fdt.h"
+#include "timebase.h"
 
 /*  The emulator should be compatible to QEMU RISC-V VirtIO Board:
  *  - https://github.com/qemu/qemu/blob/master/hw/riscv/virt.c
@@ -10,145 +13,162 @@
  *  - https://github.com/riscv/riscv-isa-sim/blob/master/riscv/dts.cc
  */
 
-// TODO: don't mash all codes together for flexibility
-bool make_dtb(const char *dtb_filename)
+// the phandles referred by the interrupt-parent of devices
+#define PHANDLE_CPU0_INTC 1
+#define PHANDLE_PLIC 2
+
+#define RISCV_ISA "rv64imacv_zicbom_zicboz_zba_zbb_zbs_sstc"
+#define UART_CLOCK_FREQ 0x384000
+#define UART_IRQ 0xa
+#define VIRTIO_IRQ 0x1
+#define PLIC_NDEV 0x35
+#define PLIC_SIZE 0x4000000
+
+// the reg property of a device with #address-cells = #size-cells = 2
+static void fdt_prop_reg(fdt_writer *fdt, uint64_t base, uint64_t size)
 {
-    char dts_str[] =
-        "/dts-v1/; \n"
-        "\n"
-        "/ {\n"
-        "    #address-cells = <0x02>;\n"
-        "    #size-cells = <0x02>;\n"
-        "    model = \"riscv-virtio,qemu\";\n"
-        "    compatible = \"riscv-virtio\";\n"
-        "\n"
-        "    chosen {\n"
-        "        bootargs = \"root=/dev/vda rw console=ttyS0\";"
-        "        stdout-path = \"/uart@10000000\";\n"
-        "    };\n"
-        "\n"
-        "    cpus {\n"
-        "      #address-cells = <0x01>;\n"
-        "      #size-cells = <0x00>;\n"
-        "      timebase-frequency = <0x989680>;\n"
-        "\n"
-        "      CPU0: cpu@0 {\n"
-        "        device_type = \"cpu\";\n"
-        "        reg = <0x00>;\n"
-        "        status = \"okay\";\n"
-        "        compatible = \"riscv\";\n"
-        "        riscv,isa = \"rv64imac\";\n"
-        "        mmu-type = \"riscv,sv39\";\n"
-        "        CPU0_intc: interrupt-controller {\n"
-        "            #interrupt-cells = <0x01>;\n"
-        "            interrupt-controller;\n"
-        "            compatible = \"riscv,cpu-intc\";\n"
-        "        };\n"
-        "      };\n"
-        "    };\n"
-        "\n"
-        "    memory@80000000 {\n"
-        "      device_type = \"memory\";\n"
-        "      reg = <0x0 0x80000000 0x0 0x8000000>;\n"
-        "    };\n"
-        "\n"
-        "    soc {\n"
-        "      #address-cells = <0x02>;\n"
-        "      #size-cells = <0x02>;\n"
-        "      compatible = \"simple-bus\";\n"
-        "      ranges;\n"
-        "\n"
-        "      uart@10000000 {\n"
-        "          interrupts = <0xa>;\n"
-        "          interrupt-parent = <&PLIC>;\n"
-        "          clock-frequency = <0x384000>;\n"
-        "          reg = <0x0 0x10000000 0x0 0x100>;\n"
-        "          compatible = \"ns16550a\";\n"
-        "      };\n"
-        "\n"
-        "      virtio_mmio@10001000 {\n"
-        "          interrupts = <0x01>;\n"
-        "          interrupt-parent = <&PLIC>;\n"
-        "          reg = <0x0 0x10001000 0x0 0x1000>;\n"
-        "          compatible = \"virtio,mmio\";\n"
-        "      };\n"
-        "\n"
-        "       PLIC: plic@c000000 {\n"
-        "          compatible = \"riscv,plic0\";\n"
-        "          interrupts-extended = <&CPU0_intc 0x0b &CPU0_intc 0x09>;\n"
-        "          reg = <0x00 0xc000000 0x00 0x4000000>;\n"
-        "          riscv,ndev = <0x35>;\n"
-        "          interrupt-controller;\n"
-        "          #interrupt-cells = <0x01>;\n"
-        "          #address-cells = <0x00>;\n"
-        "       };\n"
-        "\n"
-        "       clint@2000000 {\n"
-        "          compatible = \"riscv,clint0\";\n"
-        "          interrupts-extended = <&CPU0_intc 0x03 &CPU0_intc 0x07>;\n"
-        "          reg = <0x00 0x2000000 0x00 0x10000>;\n"
-        "       };\n"
-        "    };"
-        "\n"
-        "};\n";
-
-    size_t dts_len = sizeof(dts_str);
-
-    // Convert the DTS to DTB
-    int dts_pipe[2];
-    pid_t dts_pid;
-
-    fflush(NULL);  // flush stdout/stderr before forking
-
-    if (pipe(dts_pipe) != 0 || (dts_pid = fork()) < 0) {
-        ERROR("Failed to fork dts child\n");
-        exit(1);
-    }
+    uint32_t reg[] = {base >> 32, base, size >> 32, size};
+    fdt_prop_cells(fdt, "reg", reg, 4);
+}
 
-    // Child process to output dts
-    if (dts_pid == 0) {
-        close(dts_pipe[0]);
-        if (write(dts_pipe[1], dts_str, dts_len) == -1) {
-            ERROR("Failed to write dts\n");
-            exit(1);
-        }
-        close(dts_pipe[1]);
+static void fdt_begin_node_at(fdt_writer *fdt, const char *name, uint64_t addr)
+{
+    char node_name[64];
+    snprintf(node_name, sizeof(node_name), "%s@%lx", name, addr);
+    fdt_begin_node(fdt, node_name);
+}
 
-        exit(0);
-    }
+static void make_chosen(fdt_writer *fdt, const riscv_config *config)
+{
+    fdt_begin_node(fdt, "chosen");
+    if (config->rfs_name[0] != '\0')
+        fdt_prop_string(fdt, "bootargs", "root=/dev/vda rw console=ttyS0");
+    else
+        fdt_prop_string(fdt, "bootargs", "console=ttyS0");
 
-    pid_t dtb_pid;
+    char stdout_path[64];
+    snprintf(stdout_path, sizeof(stdout_path), "/soc/uart@%x", UART_BASE);
+    fdt_prop_string(fdt, "stdout-path", stdout_path);
 
-    if ((dtb_pid = fork()) < 0) {
-        ERROR("Failed to fork dtb child\n");
-        exit(1);
-    }
+    // tell the kernel where the initrd is loaded
+    if (config->sbi && config->initrd[0] != '\0') {
+        FILE *fp = fopen(config->initrd, "rb");
+        if (fp) {
+            fseek(fp, 0, SEEK_END);
+            uint64_t size = ftell(fp);
+            fclose(fp);
 
-    // Child process to output dtb
-    if (dtb_pid == 0) {
-        dup2(dts_pipe[0], STDIN_FILENO);  // redirect to stdin
-        close(dts_pipe[0]);
-        close(dts_pipe[1]);
-        execlp("dtc", "dtc", "-O", "dtb", "-o", dtb_filename, (char *) 0);
-        ERROR("Failed to run dtc\n");
-        exit(1);
+            uint64_t start = INITRD_START(size);
+            uint64_t end = start + size;
+            uint32_t start_cells[] = {start >> 32, start};
+            uint32_t end_cells[] = {end >> 32, end};
+            fdt_prop_cells(fdt, "linux,initrd-start", start_cells, 2);
+            fdt_prop_cells(fdt, "linux,initrd-end", end_cells, 2);
+        }
     }
+    fdt_end_node(fdt);
+}
 
-    close(dts_pipe[1]);
-    close(dts_pipe[0]);
+static void make_cpu(fdt_writer *fdt, uint32_t hartid, uint32_t phandle)
+{
+    fdt_begin_node_at(fdt, "cpu", hartid);
+    fdt_prop_string(fdt, "device_type", "cpu");
+    fdt_prop_u32(fdt, "reg", hartid);
+    fdt_prop_string(fdt, "status", "okay");
+    fdt_prop_string(fdt, "compatible", "riscv");
+    fdt_prop_string(fdt, "riscv,isa", RISCV_ISA);
+    fdt_prop_u32(fdt, "riscv,cbom-block-size", CBO_BLOCK_SIZE);
+    fdt_prop_u32(fdt, "riscv,cboz-block-size", CBO_BLOCK_SIZE);
+    fdt_prop_string(fdt, "mmu-type", "riscv,sv39");
 
-    // Reap children
-    int status;
-    waitpid(dts_pid, &status, 0);
-    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
-        printf("Child dts process failed\n");
-        exit(1);
-    }
-    waitpid(dtb_pid, &status, 0);
-    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
-        printf("Child dtb process failed\n");
-        exit(1);
-    }
+    fdt_begin_node(fdt, "interrupt-controller");
+    fdt_prop_u32(fdt, "#interrupt-cells", 1);
+    fdt_prop_empty(fdt, "interrupt-controller");
+    fdt_prop_string(fdt, "compatible", "riscv,cpu-intc");
+    fdt_prop_u32(fdt, "phandle", phandle);
+    fdt_end_node(fdt);
+
+    fdt_end_node(fdt);
+}
+
+static void make_soc(fdt_writer *fdt)
+{
+    fdt_begin_node(fdt, "soc");
+    fdt_prop_u32(fdt, "#address-cells", 2);
+    fdt_prop_u32(fdt, "#size-cells", 2);
+    fdt_prop_string(fdt, "compatible", "simple-bus");
+    fdt_prop_empty(fdt, "ranges");
+
+    fdt_begin_node_at(fdt, "uart", UART_BASE);
+    fdt_prop_u32(fdt, "interrupts", UART_IRQ);
+    fdt_prop_u32(fdt, "interrupt-parent", PHANDLE_PLIC);
+    fdt_prop_u32(fdt, "clock-frequency", UART_CLOCK_FREQ);
+    fdt_prop_reg(fdt, UART_BASE, UART_SIZE);
+    fdt_prop_string(fdt, "compatible", "ns16550a");
+    fdt_end_node(fdt);
+
+    fdt_begin_node_at(fdt, "virtio_mmio", VIRTIO_BASE);
+    fdt_prop_u32(fdt, "interrupts", VIRTIO_IRQ);
+    fdt_prop_u32(fdt, "interrupt-parent", PHANDLE_PLIC);
+    fdt_prop_reg(fdt, VIRTIO_BASE, VIRTIO_SIZE);
+    fdt_prop_string(fdt, "compatible", "virtio,mmio");
+    fdt_end_node(fdt);
+
+    // M-mode and S-mode external interrupt of hart 0
+    uint32_t plic_irqs[] = {PHANDLE_CPU0_INTC, 0xb, PHANDLE_CPU0_INTC, 0x9};
+    fdt_begin_node_at(fdt, "plic", PLIC_BASE);
+    fdt_prop_string(fdt, "compatible", "riscv,plic0");
+    fdt_prop_cells(fdt, "interrupts-extended", plic_irqs, 4);
+    fdt_prop_reg(fdt, PLIC_BASE, PLIC_SIZE);
+    fdt_prop_u32(fdt, "riscv,ndev", PLIC_NDEV);
+    fdt_prop_empty(fdt, "interrupt-controller");
+    fdt_prop_u32(fdt, "#interrupt-cells", 1);
+    fdt_prop_u32(fdt, "#address-cells", 0);
+    fdt_prop_u32(fdt, "phandle", PHANDLE_PLIC);
+    fdt_end_node(fdt);
+
+    // M-mode software and timer interrupt of hart 0
+    uint32_t clint_irqs[] = {PHANDLE_CPU0_INTC, 0x3, PHANDLE_CPU0_INTC, 0x7};
+    fdt_begin_node_at(fdt, "clint", CLINT_BASE);
+    fdt_prop_string(fdt, "compatible", "riscv,clint0");
+    fdt_prop_cells(fdt, "interrupts-extended", clint_irqs, 4);
+    fdt_prop_reg(fdt, CLINT_BASE, CLINT_END - CLINT_BASE);
+    fdt_end_node(fdt);
+
+    fdt_end_node(fdt);
+}
+
+uint8_t *make_dtb(const riscv_config *config, size_t *size)
+{
+    fdt_writer fdt;
+    fdt_init(&fdt);
+
+    fdt_begin_node(&fdt, "");
+    fdt_prop_u32(&fdt, "#address-cells", 2);
+    fdt_prop_u32(&fdt, "#size-cells", 2);
+    fdt_prop_string(&fdt, "model", "riscv-virtio,qemu");
+    fdt_prop_string(&fdt, "compatible", "riscv-virtio");
+
+    make_chosen(&fdt, config);
+
+    fdt_begin_node(&fdt, "cpus");
+    fdt_prop_u32(&fdt, "#address-cells", 1);
+    fdt_prop_u32(&fdt, "#size-cells", 0);
+    fdt_prop_u32(&fdt, "timebase-frequency", TIMEBASE_FREQ);
+    make_cpu(&fdt, 0, PHANDLE_CPU0_INTC);
+    fdt_end_node(&fdt);
+
+    fdt_begin_node_at(&fdt, "memory", DRAM_BASE);
+    fdt_prop_string(&fdt, "device_type", "memory");
+    fdt_prop_reg(&fdt, DRAM_BASE, DRAM_SIZE);
+    fdt_end_node(&fdt);
+
+    make_soc(&fdt);
+
+    fdt_end_node(&fdt);
 
-    return true;
+    uint8_t *blob = fdt_finish(&fdt, size);
+    if (!blob)
+        ERROR("Failed to generate the device tree\n");
+    return blob;
 }
@@ -101,6 +101,117 @@ int elf_lookup_symbol(elf_t *elf, char *symbol, Elf64_Sym **sym)
     return -1;
 }
 
+static int elf_symbol_cmp(const void *a, const void *b)
+{
+    const elf_symbol_t *x = a, *y = b;
+    if (x->addr != y->addr)
+        return x->addr < y->addr ? -1 : 1;
+    // prefer the symbol with the size among the aliases
+    return (x->size < y->size) - (x->size > y->size);
+}
+
+// whether the symbol names the code, except the labels and mapping symbols
+static int elf_is_code_symbol(elf_t *elf, Elf64_Sym *sym, const char *name)
+{
+    uint8_t type = ELF64_ST_TYPE(sym->st_info);
+    if (type != STT_FUNC && type != STT_NOTYPE)
+        return 0;
+    if (sym->st_shndx == SHN_UNDEF || sym->st_shndx >= SHN_LORESERVE)
+        return 0;
+    if (name[0] == '\0' || name[0] == '$' || !strncmp(name, ".L", 2))
+        return 0;
+
+    Elf64_Shdr *sec_header = get_section_header(
+        elf->inner->data, elf->inner->header, sym->st_shndx);
+    return (sec_header->sh_flags & SHF_EXECINSTR) != 0;
+}
+
+int elf_symtab_add(elf_symtab_t *symtab, elf_t *elf, uint64_t bias)
+{
+    Elf64_Shdr *symtab_sec_header;
+    uint8_t *elf_data = elf->inner->data;
+    Elf64_Ehdr *elf_header = elf->inner->header;
+    int ret = elf_lookup_shdr(elf, ".symtab", &symtab_sec_header);
+    if (ret)
+        return ret;
+
+    Elf64_Sym *syms = (Elf64_Sym *) (elf_data + symtab_sec_header->sh_offset);
+
+    Elf64_Shdr *strtab_sec_header =
+        get_section_header(elf_data, elf_header, symtab_sec_header->sh_link);
+    char *strtab = (char *) elf_data + strtab_sec_header->sh_offset;
+
+    unsigned int symbol_cnt = symtab_sec_header->sh_size / sizeof(Elf64_Sym);
+    for (unsigned int i = 0; i < symbol_cnt; i++) {
+        const char *name = strtab + syms[i].st_name;
+        if (!elf_is_code_symbol(elf, &syms[i], name))
+            continue;
+
+        if (symtab->count == symtab->capacity) {
+            size_t capacity = symtab->capacity ? symtab->capacity * 2 : 256;
+            elf_symbol_t *symbols =
+                realloc(symtab->symbols, capacity * sizeof(elf_symbol_t));
+            if (symbols == NULL)
+                return -1;
+            symtab->symbols = symbols;
+            symtab->capacity = capacity;
+        }
+
+        char *copy = strdup(name);
+        if (copy == NULL)
+            return -1;
+        symtab->symbols[symtab->count++] = (elf_symbol_t){
+            .addr = syms[i].st_value + bias,
+            .size = syms[i].st_size,
+            .name = copy,
+        };
+    }
+
+    qsort(symtab->symbols, symtab->count, sizeof(elf_symbol_t),
+          elf_symbol_cmp);
+
+    // only keep the first one of the aliases
+    size_t n = 0;
+    for (size_t i = 0; i < symtab->count; i++) {
+        if (n && symtab->symbols[n - 1].addr == symtab->symbols[i].addr) {
+            free(symtab->symbols[i].name);
+            continue;
+        }
+        symtab->symbols[n++] = symtab->symbols[i];
+    }
+    symtab->count = n;
+    return 0;
+}
+
+const elf_symbol_t *elf_lookup_address(const elf_symtab_t *symtab,
+                                       uint64_t addr)
+{
+    // find the last symbol which starts at or before the address
+    size_t lo = 0, hi = symtab->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (symtab->symbols[mid].addr <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0)
+        return NULL;
+
+    const elf_symbol_t *sym = &symtab->symbols[lo - 1];
+    if (sym->size && addr - sym->addr >= sym->size)
+        return NULL;
+    return sym;
+}
+
+void elf_symtab_free(elf_symtab_t *symtab)
+{
+    for (size_t i = 0; i < symtab->count; i++)
+        free(symtab->symbols[i].name);
+    free(symtab->symbols);
+    memset(symtab, 0, sizeof(elf_symtab_t));
+}
+
 uint64_t elf_e_entry(elf_t *elf)
 {
     Elf64_Ehdr *elf_header = elf->inner->header;
@@ -1,48 +1,449 @@
-#include <assert.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "cpu.h"
 #include "elf.h"
 #include "emu.h"
+#include "fork_server.h"
+#include "profiler.h"
+#include "replay.h"
+#include "stats.h"
+#include "snapshot.h"
 
 struct Emu {
     riscv_cpu cpu;
+    riscv_emu_state state;
+    const char *snapshot_file;
+    const char *fork_server;
+    volatile sig_atomic_t snapshot_pending;
+    volatile sig_atomic_t stop_pending;
+    volatile sig_atomic_t stats_pending;
+    const char *instr_stats_file;
+    const char *stats_file;
+    uint64_t stats_interval;
+    // the instructions executed since the last periodic statistics
+    uint64_t stats_steps;
+
+    riscv_tracer *tracer;
+    // the tracer is enabled after the instructions are executed
+    uint64_t trace_start;
+
+    riscv_replay *replay;
+
+    const char *checkpoint_prefix;
+    uint64_t checkpoint_interval;
+    // the sequence number of the next checkpoint
+    uint64_t checkpoint_seq;
+    // the instructions executed since the last checkpoint
+    uint64_t checkpoint_steps;
+    // the instructions executed by the emulator in total
+    uint64_t instret;
+
+    riscv_profiler *profiler;
+    const char *profile_file;
+    uint64_t profile_interval;
+    // the instructions executed since the last sample
+    uint64_t profile_steps;
 };
 
-riscv_emu *create_emu(const char *filename, const char *rfs_name)
+static const char *path_or_empty(const char *path)
+{
+    return path ? path : "";
+}
+
+riscv_emu *create_emu(const riscv_config *user_config)
 {
     riscv_emu *emu = calloc(1, sizeof(riscv_emu));
     if (!emu)
         return NULL;
 
-    if (!init_cpu(&emu->cpu, filename, rfs_name)) {
+    // the files which aren't provided are empty strings in the emulator
+    riscv_config cfg = *user_config;
+    const riscv_config *config = &cfg;
+    cfg.binary = path_or_empty(cfg.binary);
+    cfg.rfs_name = path_or_empty(cfg.rfs_name);
+    cfg.initrd = path_or_empty(cfg.initrd);
+    cfg.snapshot = path_or_empty(cfg.snapshot);
+    cfg.restore = path_or_empty(cfg.restore);
+    cfg.checkpoint = path_or_empty(cfg.checkpoint);
+    cfg.fork_server = path_or_empty(cfg.fork_server);
+    cfg.profile = path_or_empty(cfg.profile);
+    cfg.instr_stats = path_or_empty(cfg.instr_stats);
+    cfg.stats = path_or_empty(cfg.stats);
+    cfg.trace = path_or_empty(cfg.trace);
+    cfg.record = path_or_empty(cfg.record);
+    cfg.replay = path_or_empty(cfg.replay);
+
+    if (cfg.record[0] != '\0' || cfg.replay[0] != '\0') {
+        if (cfg.record[0] != '\0' && cfg.replay[0] != '\0') {
+            ERROR("The input can't be recorded and replayed at once\n");
+            free(emu);
+            return NULL;
+        }
+        /* The programs run by the user-mode emulation take the input by the
+         * system calls, the children of the fork server take it from their
+         * own connections, and the host timebase reads the host clock, none of
+         * which are recorded. */
+        if (cfg.user || cfg.fork_server[0] != '\0' ||
+            cfg.timebase != TIMEBASE_INSTRET) {
+            ERROR("The input can't be recorded or replayed with --user, the "
+                  "fork server or the host timebase\n");
+            free(emu);
+            return NULL;
+        }
+        emu->replay = create_replay(
+            cfg.record[0] != '\0' ? cfg.record : cfg.replay,
+            cfg.record[0] != '\0');
+        if (!emu->replay) {
+            free(emu);
+            return NULL;
+        }
+        // stdin is ignored, since the input comes from the log
+        if (cfg.replay[0] != '\0')
+            cfg.console = false;
+    }
+
+    if (!init_cpu(&emu->cpu, config)) {
         free_emu(emu);
         return NULL;
     }
 
+    if (config->restore[0] != '\0' &&
+        !restore_snapshot(&emu->cpu, config->restore)) {
+        free_emu(emu);
+        return NULL;
+    }
+
+    emu->snapshot_file = config->snapshot;
+    emu->fork_server = config->fork_server;
+    emu->checkpoint_prefix = config->checkpoint;
+    emu->checkpoint_interval =
+        config->checkpoint[0] != '\0' ? config->checkpoint_interval : 0;
+
+    if (config->profile[0] != '\0' && config->profile_interval) {
+        emu->profiler = create_profiler(config);
+        if (!emu->profiler) {
+            free_emu(emu);
+            return NULL;
+        }
+        emu->profile_file = config->profile;
+        emu->profile_interval = config->profile_interval;
+    }
+
+    if (config->instr_stats[0] != '\0') {
+        emu->cpu.instr_stats = create_instr_stats();
+        if (!emu->cpu.instr_stats) {
+            free_emu(emu);
+            return NULL;
+        }
+        emu->instr_stats_file = config->instr_stats;
+    }
+
+    emu->stats_file = config->stats;
+    emu->stats_interval = config->stats[0] != '\0' ? config->stats_interval : 0;
+
+    if (config->trace[0] != '\0') {
+        emu->tracer = create_tracer(config->trace);
+        if (!emu->tracer) {
+            free_emu(emu);
+            return NULL;
+        }
+        emu->trace_start = config->trace_start;
+        if (!emu->trace_start)
+            trace_emu(emu, true);
+    }
     return emu;
 }
 
-void run_emu(riscv_emu *emu)
+/* Each checkpoint only saves the pages written since the previous one, so it
+ * can be restored by following the chain back to the first one. */
+static void checkpoint_emu(riscv_emu *emu)
+{
+    char filename[PATH_MAX], parent[PATH_MAX];
+    uint64_t seq = emu->checkpoint_seq++;
+    snprintf(filename, sizeof(filename), "%s.%lu", emu->checkpoint_prefix,
+             seq);
+    snprintf(parent, sizeof(parent), "%s.%lu", emu->checkpoint_prefix,
+             seq - 1);
+
+    save_checkpoint(&emu->cpu, filename, seq ? parent : NULL);
+}
+
+static inline void profile_emu(riscv_emu *emu)
 {
-    while (tick_cpu(&emu->cpu))
-        ;
+    if (emu->profiler && ++emu->profile_steps == emu->profile_interval) {
+        emu->profile_steps = 0;
+        sample_profiler(emu->profiler, &emu->cpu);
+    }
 }
 
-int test_emu(riscv_emu *emu)
+/* Move the input from the host to the guest between the instructions, where
+ * it is recorded with the instructions executed, or is replayed at the same
+ * instructions. */
+static void replay_input(riscv_emu *emu)
 {
+    riscv_replay *replay = emu->replay;
+    riscv_uart *uart = &emu->cpu.bus.uart;
+
+    if (replay->record) {
+        int c = uart_take_input(uart);
+        if (c >= 0) {
+            riscv_replay_event event = {emu->instret, REPLAY_UART, c};
+            record_replay(replay, &event);
+        }
+        return;
+    }
+
+    while (replay_due(replay, emu->instret)) {
+        if (!uart_receive(uart, replay->next.value)) {
+            ERROR("The replay diverges at instruction %lu\n", emu->instret);
+            replay->pending = false;
+            return;
+        }
+        next_replay(replay);
+    }
+}
+
+static inline void replay_emu(riscv_emu *emu)
+{
+    if (emu->replay)
+        replay_input(emu);
+}
+
+// the machine can't run anymore, so tell the host why
+static riscv_emu_state stop_emu(riscv_emu *emu)
+{
+    riscv_cpu *cpu = &emu->cpu;
+    emu->state = cpu->sbi.shutdown || cpu->bus.htif.exited || cpu->user.exited
+                     ? EMU_SHUTDOWN
+                     : EMU_TRAP;
+
+    const riscv_callbacks *callbacks = &emu->cpu.bus.callbacks;
+    if (callbacks->exit)
+        callbacks->exit(callbacks->opaque, emu->state);
+    return emu->state;
+}
+
+riscv_emu_state run_emu_for(riscv_emu *emu, uint64_t budget)
+{
+    if (emu->state != EMU_RUNNING)
+        return emu->state;
+
+    for (uint64_t i = 0; i < budget; i++) {
+        if (!tick_cpu(&emu->cpu))
+            return stop_emu(emu);
+        emu->instret++;
+        profile_emu(emu);
+        replay_emu(emu);
+    }
+    return EMU_RUNNING;
+}
+
+riscv_emu_state step_emu(riscv_emu *emu)
+{
+    return run_emu_for(emu, 1);
+}
+
+riscv_emu_state run_emu(riscv_emu *emu)
+{
+    if (emu->state != EMU_RUNNING)
+        return emu->state;
+
     while (tick_cpu(&emu->cpu)) {
-        /* If a riscv-tests program is done, it will write non-zero value to
-         * a certain address. We can poll it in every tick to terminate the
-         * emulator. */
-        riscv_mem *mem = &emu->cpu.bus.memory;
-        uint64_t tohost_addr = mem->tohost_addr;
-        assert(tohost_addr > DRAM_BASE);
-        if (read_mem(mem, tohost_addr, 8, &emu->cpu.exc) != 0)
-            break;
+        emu->instret++;
+        profile_emu(emu);
+        replay_emu(emu);
+        if (emu->instret == emu->trace_start && emu->tracer)
+            trace_emu(emu, true);
+        if (emu->checkpoint_interval &&
+            ++emu->checkpoint_steps == emu->checkpoint_interval) {
+            emu->checkpoint_steps = 0;
+            checkpoint_emu(emu);
+        }
+
+        if (emu->snapshot_pending) {
+            emu->snapshot_pending = 0;
+            snapshot_emu(emu, emu->snapshot_file);
+        }
+
+        if (emu->stats_interval &&
+            ++emu->stats_steps == emu->stats_interval) {
+            emu->stats_steps = 0;
+            write_stats(&emu->cpu, emu->instret, emu->stats_file);
+        }
+
+        if (emu->stats_pending) {
+            emu->stats_pending = 0;
+            write_stats_emu(emu);
+        }
+
+        if (emu->stop_pending) {
+            emu->stop_pending = 0;
+            return EMU_RUNNING;
+        }
+
+        riscv_ctrl *ctrl = &emu->cpu.bus.ctrl;
+        if (ctrl->checkpoint) {
+            ctrl->checkpoint = false;
+            if (emu->fork_server[0] == '\0')
+                continue;
+            /* The trace is written out before forking, so the children inherit
+             * neither the records nor a FILE locked by the writer. */
+            if (emu->tracer)
+                flush_tracer(emu->tracer);
+            // the machine is still runnable if the server fails
+            if (!serve_fork(&emu->cpu, emu->fork_server))
+                return EMU_RUNNING;
+            // now it is a child running the job
+            emu->fork_server = "";
+            /* The writer of the tracer isn't forked, so the child leaves the
+             * trace to the server. */
+            drop_tracer(emu->tracer);
+            emu->cpu.tracer = NULL;
+            emu->tracer = NULL;
+        }
+    }
+
+    return stop_emu(emu);
+}
+
+void request_snapshot_emu(riscv_emu *emu)
+{
+    emu->snapshot_pending = 1;
+}
+
+bool trace_emu(riscv_emu *emu, bool enable)
+{
+    if (!emu->tracer)
+        return false;
+
+    riscv_cpu *cpu = &emu->cpu;
+    if (enable && !cpu->tracer)
+        trace_event(emu->tracer, TRACE_START, cpu->pc, cpu->mode.mode, 0,
+                    emu->instret);
+    cpu->tracer = enable ? emu->tracer : NULL;
+    return true;
+}
+
+void request_stats_emu(riscv_emu *emu)
+{
+    emu->stats_pending = 1;
+}
+
+void write_stats_emu(riscv_emu *emu)
+{
+    if (emu->cpu.instr_stats)
+        write_instr_stats(emu->cpu.instr_stats, emu->instr_stats_file);
+    if (emu->stats_file[0] != '\0')
+        write_stats(&emu->cpu, emu->instret, emu->stats_file);
+}
+
+void request_stop_emu(riscv_emu *emu)
+{
+    emu->stop_pending = 1;
+}
+
+bool snapshot_emu(riscv_emu *emu, const char *filename)
+{
+    return save_snapshot(&emu->cpu, filename);
+}
+
+bool restore_emu(riscv_emu *emu, const char *filename)
+{
+    return restore_snapshot(&emu->cpu, filename);
+}
+
+uint64_t get_instret_emu(riscv_emu *emu)
+{
+    return emu->instret;
+}
+
+uint64_t get_reg_emu(riscv_emu *emu, int reg)
+{
+    return emu->cpu.xreg[reg & 0x1f];
+}
+
+void set_reg_emu(riscv_emu *emu, int reg, uint64_t value)
+{
+    // x0 is hardwired to zero
+    if (reg & 0x1f)
+        emu->cpu.xreg[reg & 0x1f] = value;
+}
+
+uint64_t get_pc_emu(riscv_emu *emu)
+{
+    return emu->cpu.pc;
+}
+
+void set_pc_emu(riscv_emu *emu, uint64_t pc)
+{
+    emu->cpu.pc = pc;
+}
+
+static bool dram_range(uint64_t addr, uint64_t len)
+{
+    return addr >= DRAM_BASE && len <= DRAM_SIZE &&
+           addr - DRAM_BASE <= DRAM_SIZE - len;
+}
+
+bool read_mem_emu(riscv_emu *emu, uint64_t addr, void *buf, uint64_t len)
+{
+    if (!dram_range(addr, len))
+        return false;
+
+    memcpy(buf, emu->cpu.bus.memory.mem + (addr - DRAM_BASE), len);
+    return true;
+}
+
+bool write_mem_emu(riscv_emu *emu,
+                   uint64_t addr,
+                   const void *buf,
+                   uint64_t len)
+{
+    if (!dram_range(addr, len))
+        return false;
+
+    riscv_mem *mem = &emu->cpu.bus.memory;
+    memcpy(mem->mem + (addr - DRAM_BASE), buf, len);
+    mark_dirty(mem->dirty, addr - DRAM_BASE, len);
+#ifdef ICACHE_CONFIG
+    // the instructions could be replaced
+    invalid_icache(&emu->cpu.icache);
+#endif
+    return true;
+}
+
+int exit_code_emu(riscv_emu *emu)
+{
+    riscv_cpu *cpu = &emu->cpu;
+    if (cpu->user.exited)
+        return cpu->user.exit_code;
+    if (cpu->bus.htif.exited)
+        return cpu->bus.htif.exit_code;
+    return emu->state == EMU_TRAP ? -1 : 0;
+}
+
+int test_emu(riscv_emu *emu, uint64_t limit, uint64_t *steps)
+{
+    riscv_htif *htif = &emu->cpu.bus.htif;
+    if (!htif->tohost) {
+        ERROR("The test has no .tohost section\n");
+        return -1;
     }
 
-    return emu->cpu.xreg[10];
+    /* A riscv-tests program exits through HTIF when it is done, which stops
+     * the CPU. */
+    uint64_t n = 0;
+    while ((!limit || n < limit) && tick_cpu(&emu->cpu))
+        n++;
+    emu->instret += n;
+
+    if (steps)
+        *steps = n;
+    return htif->exited ? (int) htif->exit_code : -1;
 }
 
 int take_signature_emu(riscv_emu *emu, char *signature_out_file)
@@ -72,6 +473,14 @@ void free_emu(riscv_emu *emu)
     if (emu == NULL)
         return;
 
+    if (emu->profiler) {
+        write_profiler(emu->profiler, emu->profile_file);
+        free_profiler(emu->profiler);
+    }
+    write_stats_emu(emu);
+    emu->cpu.tracer = NULL;
+    free_tracer(emu->tracer);
     free_cpu(&emu->cpu);
+    free_replay(emu->replay);
     free(emu);
 }
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "fdt.h"
+
+// the header of the blob, all fields are stored in big-endian
+struct fdt_header {
+    uint32_t magic;
+    uint32_t totalsize;
+    uint32_t off_dt_struct;
+    uint32_t off_dt_strings;
+    uint32_t off_mem_rsvmap;
+    uint32_t version;
+    uint32_t last_comp_version;
+    uint32_t boot_cpuid_phys;
+    uint32_t size_dt_strings;
+    uint32_t size_dt_struct;
+};
+
+static uint32_t cpu_to_fdt32(uint32_t value)
+{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    return __builtin_bswap32(value);
+#else
+    return value;
+#endif
+}
+
+static bool fdt_grow(fdt_writer *fdt, void **buf, size_t *cap, size_t size)
+{
+    if (fdt->error)
+        return false;
+    if (size <= *cap)
+        return true;
+
+    size_t new_cap = *cap ? *cap : 1024;
+    while (new_cap < size)
+        new_cap <<= 1;
+
+    void *new_buf = realloc(*buf, new_cap);
+    if (!new_buf) {
+        fdt->error = true;
+        return false;
+    }
+    *buf = new_buf;
+    *cap = new_cap;
+    return true;
+}
+
+// append data to the structure block with the padding to 4 bytes
+static void fdt_append(fdt_writer *fdt, const void *data, size_t len)
+{
+    size_t padded = (len + 3) & ~3UL;
+    if (!fdt_grow(fdt, (void **) &fdt->dt_struct, &fdt->struct_cap,
+                  fdt->struct_size + padded))
+        return;
+
+    memcpy(fdt->dt_struct + fdt->struct_size, data, len);
+    memset(fdt->dt_struct + fdt->struct_size + len, 0, padded - len);
+    fdt->struct_size += padded;
+}
+
+static void fdt_append_u32(fdt_writer *fdt, uint32_t value)
+{
+    value = cpu_to_fdt32(value);
+    fdt_append(fdt, &value, sizeof(value));
+}
+
+// return the offset of the name in strings block, which is shared if possible
+static uint32_t fdt_string_offset(fdt_writer *fdt, const char *name)
+{
+    size_t len = strlen(name) + 1;
+    for (size_t off = 0; off < fdt->strings_size;
+         off += strlen(fdt->strings + off) + 1) {
+        if (!strcmp(fdt->strings + off, name))
+            return off;
+    }
+
+    if (!fdt_grow(fdt, (void **) &fdt->strings, &fdt->strings_cap,
+                  fdt->strings_size + len))
+        return 0;
+
+    uint32_t off = fdt->strings_size;
+    memcpy(fdt->strings + off, name, len);
+    fdt->strings_size += len;
+    return off;
+}
+
+void fdt_init(fdt_writer *fdt)
+{
+    memset(fdt, 0, sizeof(fdt_writer));
+}
+
+void fdt_begin_node(fdt_writer *fdt, const char *name)
+{
+    fdt_append_u32(fdt, FDT_BEGIN_NODE);
+    fdt_append(fdt, name, strlen(name) + 1);
+}
+
+void fdt_end_node(fdt_writer *fdt)
+{
+    fdt_append_u32(fdt, FDT_END_NODE);
+}
+
+void fdt_prop(fdt_writer *fdt, const char *name, const void *data, size_t len)
+{
+    uint32_t nameoff = fdt_string_offset(fdt, name);
+    fdt_append_u32(fdt, FDT_PROP);
+    fdt_append_u32(fdt, len);
+    fdt_append_u32(fdt, nameoff);
+    if (len)
+        fdt_append(fdt, data, len);
+}
+
+void fdt_prop_empty(fdt_writer *fdt, const char *name)
+{
+    fdt_prop(fdt, name, NULL, 0);
+}
+
+void fdt_prop_string(fdt_writer *fdt, const char *name, const char *str)
+{
+    fdt_prop(fdt, name, str, strlen(str) + 1);
+}
+
+void fdt_prop_u32(fdt_writer *fdt, const char *name, uint32_t value)
+{
+    fdt_prop_cells(fdt, name, &value, 1);
+}
+
+void fdt_prop_cells(fdt_writer *fdt,
+                    const char *name,
+                    const uint32_t *cells,
+                    size_t n)
+{
+    uint32_t buf[n];
+    for (size_t i = 0; i < n; i++)
+        buf[i] = cpu_to_fdt32(cells[i]);
+    fdt_prop(fdt, name, buf, sizeof(buf));
+}
+
+uint8_t *fdt_finish(fdt_writer *fdt, size_t *size)
+{
+    fdt_append_u32(fdt, FDT_END);
+
+    /* The memory reservation block only has the terminating entry, which
+     * should be aligned to 8 bytes. */
+    size_t off_mem_rsvmap = (sizeof(struct fdt_header) + 7) & ~7UL;
+    size_t off_dt_struct = off_mem_rsvmap + 16;
+    size_t off_dt_strings = off_dt_struct + fdt->struct_size;
+    size_t totalsize = off_dt_strings + fdt->strings_size;
+
+    uint8_t *blob = NULL;
+    if (!fdt->error)
+        blob = calloc(1, totalsize);
+
+    if (blob) {
+        struct fdt_header header = {
+            .magic = cpu_to_fdt32(FDT_MAGIC),
+            .totalsize = cpu_to_fdt32(totalsize),
+            .off_dt_struct = cpu_to_fdt32(off_dt_struct),
+            .off_dt_strings = cpu_to_fdt32(off_dt_strings),
+            .off_mem_rsvmap = cpu_to_fdt32(off_mem_rsvmap),
+            .version = cpu_to_fdt32(FDT_VERSION),
+            .last_comp_version = cpu_to_fdt32(FDT_LAST_COMP_VERSION),
+            .boot_cpuid_phys = 0,
+            .size_dt_strings = cpu_to_fdt32(fdt->strings_size),
+            .size_dt_struct = cpu_to_fdt32(fdt->struct_size),
+        };
+        memcpy(blob, &header, sizeof(header));
+        memcpy(blob + off_dt_struct, fdt->dt_struct, fdt->struct_size);
+        memcpy(blob + off_dt_strings, fdt->strings, fdt->strings_size);
+        *size = totalsize;
+    }
+
+    free(fdt->dt_struct);
+    free(fdt->strings);
+    fdt_init(fdt);
+    return blob;
+}
@@ -0,0 +1,96 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "fork_server.h"
+#include "pager.h"
+
+static int listen_socket(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        ERROR("The path of socket %s is too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        ERROR("Failed to create the socket\n");
+        return -1;
+    }
+
+    // remove the socket left by the previous server
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        listen(fd, SOMAXCONN) < 0) {
+        ERROR("Failed to listen on %s\n", path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// the child takes the connection as the input and output of UART
+static bool start_job(riscv_cpu *cpu, int conn)
+{
+    if (dup2(conn, STDIN_FILENO) < 0 || dup2(conn, STDOUT_FILENO) < 0)
+        return false;
+    close(conn);
+    return start_uart(&cpu->bus.uart);
+}
+
+bool serve_fork(riscv_cpu *cpu, const char *path)
+{
+    riscv_mem *mem = &cpu->bus.memory;
+    if (mem->pager) {
+        settle_dram(mem->pager);
+        mem->pager = NULL;
+    }
+
+    int fd = listen_socket(path);
+    if (fd < 0)
+        return false;
+
+    /* No thread survives fork, so the UART thread is stopped here and each
+     * child starts its own one. The devices and DRAM are plain memory, which
+     * are copied on write. */
+    stop_uart(&cpu->bus.uart);
+    fflush(stdout);
+    // the children are reaped automatically
+    signal(SIGCHLD, SIG_IGN);
+
+    while (true) {
+        int conn = accept(fd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fd);
+            signal(SIGCHLD, SIG_DFL);
+            if (!start_job(cpu, conn)) {
+                ERROR("Failed to start the job\n");
+                _exit(-1);
+            }
+            return true;
+        }
+
+        if (pid < 0)
+            ERROR("Failed to fork the job\n");
+        close(conn);
+    }
+
+    ERROR("Failed to accept the job on %s\n", path);
+    close(fd);
+    // the UART thread is expected by free_uart
+    start_uart(&cpu->bus.uart);
+    return false;
+}
@@ -0,0 +1,140 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "htif.h"
+#include "macros.h"
+#include "memmap.h"
+
+#define HTIF_DEV_SYSCALL 0
+#define HTIF_DEV_CONSOLE 1
+#define HTIF_CMD_PUTCHAR 1
+
+// the syscalls of the proxy kernel, which are numbered as Linux
+#define HTIF_SYS_WRITE 64
+#define HTIF_SYS_EXIT 93
+#define HTIF_SYS_EXIT_GROUP 94
+
+void init_htif(riscv_htif *htif, uint64_t tohost, uint64_t fromhost)
+{
+    memset(htif, 0, sizeof(riscv_htif));
+    // the commands are only watched in DRAM
+    if (tohost < DRAM_BASE || tohost + HTIF_SIZE > DRAM_END)
+        return;
+    htif->tohost = tohost;
+    htif->fromhost = fromhost;
+}
+
+// return the host address of the physical range, or NULL if it isn't in DRAM
+static uint8_t *dram_ptr(riscv_mem *mem, uint64_t addr, uint64_t len)
+{
+    if (addr < DRAM_BASE || len > DRAM_SIZE ||
+        addr - DRAM_BASE > DRAM_SIZE - len)
+        return NULL;
+    return mem->mem + (addr - DRAM_BASE);
+}
+
+static void store_word(riscv_mem *mem, uint64_t addr, uint64_t value)
+{
+    uint8_t *p = dram_ptr(mem, addr, 8);
+    if (!p)
+        return;
+    write_len(64, p, value);
+    mark_dirty(mem->dirty, addr - DRAM_BASE, 8);
+}
+
+static void put_char(FILE *fp, const riscv_callbacks *callbacks, char c)
+{
+    if (fp == stdout && callbacks->uart_tx) {
+        callbacks->uart_tx(callbacks->opaque, c);
+        return;
+    }
+    fputc(c, fp);
+}
+
+static uint64_t htif_write(riscv_mem *mem,
+                           const riscv_callbacks *callbacks,
+                           uint64_t fd,
+                           uint64_t buf,
+                           uint64_t len)
+{
+    FILE *fp = fd == 1 ? stdout : fd == 2 ? stderr : NULL;
+    if (!fp)
+        return -EBADF;
+
+    const uint8_t *p = dram_ptr(mem, buf, len);
+    if (!p)
+        return -EFAULT;
+
+    for (uint64_t i = 0; i < len; i++)
+        put_char(fp, callbacks, p[i]);
+    fflush(fp);
+    return len;
+}
+
+static void htif_syscall(riscv_htif *htif,
+                         riscv_mem *mem,
+                         const riscv_callbacks *callbacks,
+                         uint64_t magic)
+{
+    uint8_t *p = dram_ptr(mem, magic, 8 * sizeof(uint64_t));
+    if (!p) {
+        ERROR("Invalid HTIF syscall arguments at 0x%lx\n", magic);
+        return;
+    }
+
+    uint64_t args[8];
+    memcpy(args, p, sizeof(args));
+
+    uint64_t ret;
+    switch (args[0]) {
+    case HTIF_SYS_WRITE:
+        ret = htif_write(mem, callbacks, args[1], args[2], args[3]);
+        break;
+    case HTIF_SYS_EXIT:
+    case HTIF_SYS_EXIT_GROUP:
+        htif->exited = true;
+        htif->exit_code = args[1];
+        return;
+    default:
+        ERROR("Unsupported HTIF syscall %lu\n", args[0]);
+        ret = -ENOSYS;
+        break;
+    }
+    store_word(mem, magic, ret);
+}
+
+void handle_htif(riscv_htif *htif,
+                 riscv_mem *mem,
+                 const riscv_callbacks *callbacks)
+{
+    uint64_t value;
+    read_len(64, dram_ptr(mem, htif->tohost, 8), value);
+    // the guest clears it by itself
+    if (!value)
+        return;
+
+    uint8_t device = value >> 56;
+    uint8_t cmd = value >> 48;
+    uint64_t payload = value & ((1UL << 48) - 1);
+
+    if (device == HTIF_DEV_SYSCALL && cmd == 0) {
+        if (payload & 1) {
+            htif->exited = true;
+            htif->exit_code = payload >> 1;
+            return;
+        }
+        htif_syscall(htif, mem, callbacks, payload);
+    } else if (device == HTIF_DEV_CONSOLE && cmd == HTIF_CMD_PUTCHAR) {
+        put_char(stdout, callbacks, payload & 0xff);
+        fflush(stdout);
+    } else {
+        ERROR("Unsupported HTIF command 0x%lx\n", value);
+    }
+
+    // acknowledge the command
+    store_word(mem, htif->tohost, 0);
+    if (htif->fromhost)
+        store_word(mem, htif->fromhost, ((uint64_t) device << 56) |
+                                            ((uint64_t) cmd << 48) | 1);
+}
@@ -7,6 +7,10 @@
 
 bool init_icache(riscv_icache *icache)
 {
+    icache->hits = 0;
+    icache->misses = 0;
+    icache->flushes = 0;
+
     for (int set = 0; set < CACHE_SET_CNT; set++) {
         riscv_icache_entry *prev = NULL;
 
@@ -47,6 +51,7 @@ riscv_instr *read_icache(riscv_icache *icache, uint64_t addr)
                 entry->next = icache->set[index].head;
                 icache->set[index].head = entry;
             }
+            icache->hits++;
             return &entry->instr;
         }
 
@@ -54,6 +59,7 @@ riscv_instr *read_icache(riscv_icache *icache, uint64_t addr)
         entry = entry->next;
     }
 
+    icache->misses++;
     return NULL;
 }
 
@@ -99,6 +105,7 @@ update_cache:
 
 void invalid_icache(riscv_icache *icache)
 {
+    icache->flushes++;
     for (int set = 0; set < CACHE_SET_CNT; set++) {
         riscv_icache_entry *entry = icache->set[set].head;
 
@@ -111,6 +118,7 @@ void invalid_icache(riscv_icache *icache)
 
 void invalid_icache_by_vaddr(riscv_icache *icache, uint64_t vaddr)
 {
+    icache->flushes++;
     uint64_t vpn = vaddr >> 12;
 
     for (int set = 0; set < CACHE_SET_CNT; set++) {
@@ -168,3 +168,18 @@ void FS_decode(riscv_instr *instr)
     instr->imm = (((int32_t) (instr->instr & 0xfe000000) >> 20) |
                   (int32_t) ((instr->instr >> 7) & 0x1f));
 }
+
+/* This function is used for the vector instructions, including the vector
+ * load / store under the opcode LOAD-FP and STORE-FP. The field rd is vd (or
+ * vs3 for store), and funct6 is inst[31:26]. Note that the field width of
+ * load / store is the same as funct3. */
+void V_decode(riscv_instr *instr)
+{
+    instr->rd = (instr->instr >> 7) & 0x1f;
+    instr->rs1 = (instr->instr >> 15) & 0x1f;
+    instr->rs2 = (instr->instr >> 20) & 0x1f;
+    instr->funct3 = (instr->instr >> 12) & 0x7;
+    instr->width = instr->funct3;
+    instr->funct6 = (instr->instr >> 26) & 0x3f;
+    instr->funct7 = (instr->instr >> 25) & 0x7f;
+}
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "instr_stats.h"
+
+static uint64_t total_count(const riscv_instr_count *entry)
+{
+    return entry->count[0] + entry->count[1] + entry->count[2] +
+           entry->count[3];
+}
+
+static int count_cmp(const void *a, const void *b)
+{
+    uint64_t x = total_count(*(const riscv_instr_count **) a);
+    uint64_t y = total_count(*(const riscv_instr_count **) b);
+    return (x < y) - (x > y);
+}
+
+riscv_instr_stats *create_instr_stats(void)
+{
+    return calloc(1, sizeof(riscv_instr_stats));
+}
+
+bool write_instr_stats(const riscv_instr_stats *stats, const char *filename)
+{
+    const riscv_instr_count *entries[INSTR_STATS_SIZE + 1];
+    size_t n = 0;
+    uint64_t mode_total[4] = {0};
+    for (size_t i = 0; i <= INSTR_STATS_SIZE; i++) {
+        // the overflow is listed as "(other)" if there is any
+        const riscv_instr_count *entry =
+            i < INSTR_STATS_SIZE ? &stats->table[i] : &stats->overflow;
+        if (i < INSTR_STATS_SIZE ? !entry->name : !total_count(entry))
+            continue;
+        entries[n++] = entry;
+        for (int mode = 0; mode < 4; mode++)
+            mode_total[mode] += entry->count[mode];
+    }
+    qsort(entries, n, sizeof(entries[0]), count_cmp);
+
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        ERROR("Failed to open %s\n", filename);
+        return false;
+    }
+
+    uint64_t total =
+        mode_total[0] + mode_total[1] + mode_total[2] + mode_total[3];
+    fprintf(fp, "%-16s %14s %7s %7s %14s %14s %14s\n", "instruction", "count",
+            "%", "cum %", "M-mode", "S-mode", "U-mode");
+    fprintf(fp, "%-16s %14lu %7.2f %7s %14lu %14lu %14lu\n", "total", total,
+            100.0, "", mode_total[3], mode_total[1], mode_total[0]);
+
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < n; i++) {
+        const riscv_instr_count *entry = entries[i];
+        uint64_t count = total_count(entry);
+        cumulative += count;
+        fprintf(fp, "%-16s %14lu %7.2f %7.2f %14lu %14lu %14lu\n",
+                entry->name ? entry->name : "(other)", count,
+                100.0 * count / total, 100.0 * cumulative / total,
+                entry->count[3], entry->count[1], entry->count[0]);
+    }
+
+    bool ok = !ferror(fp);
+    if (fclose(fp) != 0 || !ok) {
+        ERROR("Failed to write the instruction mix to %s\n", filename);
+        return false;
+    }
+    return true;
+}
+
+void free_instr_stats(riscv_instr_stats *stats)
+{
+    free(stats);
+}
@@ -1,5 +1,4 @@
 #ifdef DEBUG
-#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -14,50 +13,49 @@ struct logger {
     char line_buf[MAX_RECORD_LINE][MAX_LINE_LEN + 1];
     size_t line_cnt;
 };
-static struct logger *gLogger = NULL;
 
-bool log_begin(void)
+bool log_begin(riscv_logger **logger)
 {
-    assert(!gLogger);
-    gLogger = calloc(1, sizeof(struct logger));
-    return gLogger != NULL;
+    *logger = calloc(1, sizeof(struct logger));
+    return *logger != NULL;
 }
 
-void log_end(void)
+void log_end(riscv_logger *logger)
 {
-    assert(gLogger);
+    if (!logger)
+        return;
 
     FILE *trace_file = fopen("trace.out", "w");
     if (trace_file != NULL) {
         for (size_t i = 0; i < MAX_RECORD_LINE; i++) {
-            size_t idx = (gLogger->line_cnt - i) & MAX_RECORD_LINE_MASK;
-            if (gLogger->line_buf[idx][0] == '\0')
+            size_t idx = (logger->line_cnt - i) & MAX_RECORD_LINE_MASK;
+            if (logger->line_buf[idx][0] == '\0')
                 break;
-            fprintf(trace_file, "%s\n", gLogger->line_buf[idx]);
+            fprintf(trace_file, "%s\n", logger->line_buf[idx]);
         }
         fclose(trace_file);
     }
-    free(gLogger);
-    gLogger = NULL;
+    free(logger);
 }
 
-void log_debug(const char *format, ...)
+void log_debug(riscv_logger *logger, const char *format, ...)
 {
-    if (gLogger == NULL)
+    if (logger == NULL)
         return;
 
     va_list vargs;
-    char *buf = gLogger->line_buf[gLogger->line_cnt & MAX_RECORD_LINE_MASK];
+    char *buf = logger->line_buf[logger->line_cnt & MAX_RECORD_LINE_MASK];
     va_start(vargs, format);
     vsnprintf(buf, MAX_LINE_LEN, format, vargs);
     va_end(vargs);
 
-    gLogger->line_cnt++;
+    logger->line_cnt++;
 }
 #else
-bool log_begin(void)
+bool log_begin(riscv_logger **logger)
 {
+    *logger = NULL;
     return true;
 }
-void log_end(void) {}
+void log_end(__attribute__((unused)) riscv_logger *logger) {}
 #endif /* DEBUG */
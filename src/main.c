@@ -1,46 +1,117 @@
 #include <assert.h>
 #include <getopt.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include "dtb.h"
+#include "benchmark.h"
 #include "emu.h"
+#include "test_runner.h"
 
 #define MAX_FILE_LEN 256
+#define MAX_SYMBOL_FILES 8
 
 static char input_file[MAX_FILE_LEN];
 static char rfsimg_file[MAX_FILE_LEN];
 static char signature_out_file[MAX_FILE_LEN];
+static char initrd_file[MAX_FILE_LEN];
+static char snapshot_file[MAX_FILE_LEN];
+static char restore_file[MAX_FILE_LEN];
+static char fork_server_file[MAX_FILE_LEN];
+static char checkpoint_prefix[MAX_FILE_LEN];
+// the default interval of checkpoints in instructions
+static uint64_t checkpoint_interval = 100000000;
+static char profile_file[MAX_FILE_LEN];
+static char instr_stats_file[MAX_FILE_LEN];
+static char stats_file[MAX_FILE_LEN];
+static char trace_file[MAX_FILE_LEN];
+static char record_file[MAX_FILE_LEN];
+static char replay_file[MAX_FILE_LEN];
+static riscv_timebase_mode timebase = TIMEBASE_INSTRET;
+// the instructions executed before the trace is recorded
+static uint64_t trace_start = 0;
+// the interval of periodic statistics in instructions, 0 to disable
+static uint64_t stats_interval = 0;
+// the default interval of profiling samples in instructions
+static uint64_t profile_interval = 10000;
+// the extra ELF files of symbols, which is NULL-terminated
+static char *profile_symbols[MAX_SYMBOL_FILES + 1];
+static int profile_symbols_count = 0;
+// the threads to run a batch of tests, 0 for the number of processors
+static int test_jobs = 0;
 
 static char opt_input = false;
 static char opt_rfsimg = false;
 static bool opt_compliance = false;
 static bool opt_riscv_test = false;
+static bool opt_sbi = false;
+static bool opt_user = false;
 
-int main(int argc, char *argv[])
+extern char **environ;
+
+// the emulator which takes the snapshot on SIGUSR2
+static riscv_emu *snapshot_target;
+
+static void snapshot_handler(__attribute__((unused)) int sig)
 {
-    if (!make_dtb(DTB_FILENAME)) {
-        ERROR("Fail to create dtb file!\n");
-        return -1;
-    }
+    request_snapshot_emu(snapshot_target);
+}
 
-    if (!log_begin()) {
-        ERROR("Fail to initialize the debug logger\n");
-        return -1;
-    }
+// the emulator which writes the statistics on SIGUSR1
+static riscv_emu *stats_target;
+
+static void stats_handler(__attribute__((unused)) int sig)
+{
+    request_stats_emu(stats_target);
+}
 
+// the emulator which stops on SIGINT to write its profile and statistics
+static riscv_emu *stop_target;
+
+static void stop_handler(__attribute__((unused)) int sig)
+{
+    request_stop_emu(stop_target);
+}
+
+int main(int argc, char *argv[])
+{
     int option_index = 0;
     struct option opts[] = {
         {"binary", 1, NULL, 'B'},
         {"rfsimg", 1, NULL, 'R'},
         {"compliance", 1, NULL, 'C'},
         {"riscv-test", 0, NULL, 'T'},
+        {"sbi", 0, NULL, 'S'},
+        {"initrd", 1, NULL, 'I'},
+        {"snapshot", 1, NULL, 'P'},
+        {"restore", 1, NULL, 'E'},
+        {"fork-server", 1, NULL, 'F'},
+        {"checkpoint", 1, NULL, 'K'},
+        {"checkpoint-interval", 1, NULL, 'N'},
+        {"jobs", 1, NULL, 'j'},
+        {"user", 0, NULL, 'U'},
+        {"bench", 0, NULL, 'M'},
+        {"profile", 1, NULL, 'O'},
+        {"profile-interval", 1, NULL, 'Q'},
+        {"profile-symbols", 1, NULL, 'Y'},
+        {"instr-stats", 1, NULL, 'X'},
+        {"stats", 1, NULL, 'J'},
+        {"stats-interval", 1, NULL, 'W'},
+        {"trace", 1, NULL, 'G'},
+        {"trace-start", 1, NULL, 'A'},
+        {"record", 1, NULL, 'L'},
+        {"replay", 1, NULL, 'V'},
+        {"timebase", 1, NULL, 'H'},
+        {0, 0, 0, 0},
     };
 
     int c;
-    while ((c = getopt_long(argc, argv, "B:R:C:T", opts, &option_index)) !=
-           -1) {
+    /* Stop at the first non-option argument, since the arguments after the
+     * program of --user are passed to it. */
+    while ((c = getopt_long(argc, argv,
+                            "+B:R:C:TSI:P:E:F:K:N:j:UMO:Q:Y:X:J:W:G:A:L:V:H:",
+                            opts, &option_index)) != -1) {
         switch (c) {
         case 'B':
             opt_input = true;
@@ -60,12 +131,114 @@ int main(int argc, char *argv[])
         case 'T':
             opt_riscv_test = true;
             break;
+        case 'S':
+            opt_sbi = true;
+            break;
+        case 'I':
+            strncpy(initrd_file, optarg, MAX_FILE_LEN - 1);
+            initrd_file[MAX_FILE_LEN - 1] = '\0';
+            break;
+        case 'P':
+            strncpy(snapshot_file, optarg, MAX_FILE_LEN - 1);
+            snapshot_file[MAX_FILE_LEN - 1] = '\0';
+            break;
+        case 'E':
+            strncpy(restore_file, optarg, MAX_FILE_LEN - 1);
+            restore_file[MAX_FILE_LEN - 1] = '\0';
+            break;
+        case 'F':
+            strncpy(fork_server_file, optarg, MAX_FILE_LEN - 1);
+            fork_server_file[MAX_FILE_LEN - 1] = '\0';
+            break;
+        case 'K':
+            strncpy(checkpoint_prefix, optarg, MAX_FILE_LEN - 1);
+            checkpoint_prefix[MAX_FILE_LEN - 1] = '\0';
+            break;
+        case 'N':
+            checkpoint_interval = strtoull(optarg, NULL, 0);
+            break;
+        case 'j':
+            test_jobs = atoi(optarg);
+            break;
+        case 'U':
+            opt_user = true;
+            break;
+        case 'M':
+            return run_benchmark() ? -1 : 0;
+        case 'O':
+            strncpy(profile_file, optarg, MAX_FILE_LEN - 1);
+            profile_file[MAX_FILE_LEN - 1] = '\0';
+            break;
+        case 'Q':
+            profile_interval = strtoull(optarg, NULL, 0);
+            break;
+        case 'Y':
+            if (profile_symbols_count == MAX_SYMBOL_FILES) {
+                ERROR("At most %d files of symbols are supported\n",
+                      MAX_SYMBOL_FILES);
+                return -1;
+            }
+            profile_symbols[profile_symbols_count++] = optarg;
+            break;
+        case 'X':
+            strncpy(instr_stats_file, optarg, MAX_FILE_LEN - 1);
+            instr_stats_file[MAX_FILE_LEN - 1] = '\0';
+            break;
+        case 'J':
+            strncpy(stats_file, optarg, MAX_FILE_LEN - 1);
+            stats_file[MAX_FILE_LEN - 1] = '\0';
+            break;
+        case 'W':
+            stats_interval = strtoull(optarg, NULL, 0);
+            break;
+        case 'G':
+            strncpy(trace_file, optarg, MAX_FILE_LEN - 1);
+            trace_file[MAX_FILE_LEN - 1] = '\0';
+            break;
+        case 'A':
+            trace_start = strtoull(optarg, NULL, 0);
+            break;
+        case 'L':
+            strncpy(record_file, optarg, MAX_FILE_LEN - 1);
+            record_file[MAX_FILE_LEN - 1] = '\0';
+            break;
+        case 'V':
+            strncpy(replay_file, optarg, MAX_FILE_LEN - 1);
+            replay_file[MAX_FILE_LEN - 1] = '\0';
+            break;
+        case 'H':
+            if (!strcmp(optarg, "instret")) {
+                timebase = TIMEBASE_INSTRET;
+            } else if (!strcmp(optarg, "host")) {
+                timebase = TIMEBASE_HOST;
+            } else {
+                ERROR("The timebase should be instret or host\n");
+                return -1;
+            }
+            break;
         default:
             ERROR("Unknown option\n");
         }
     }
 
-    if (!opt_input) {
+    // the tests given after the options are run as a batch
+    if (opt_riscv_test && optind < argc) {
+        int failed = run_tests(&argv[optind], argc - optind, test_jobs);
+        return failed ? -1 : 0;
+    }
+
+    // the program and its arguments follow the options
+    if (opt_user) {
+        if (optind >= argc) {
+            ERROR("A program is needed for --user!\n");
+            return -1;
+        }
+        opt_input = true;
+        strncpy(input_file, argv[optind], MAX_FILE_LEN - 1);
+        input_file[MAX_FILE_LEN - 1] = '\0';
+    }
+
+    if (!opt_input && restore_file[0] == '\0') {
         ERROR("An input image is needed!\n");
         return -1;
     }
@@ -74,18 +247,72 @@ int main(int argc, char *argv[])
     if (!opt_rfsimg)
         rfsimg_file[0] = '\0';
 
+    riscv_config config = {
+        .binary = input_file,
+        .rfs_name = rfsimg_file,
+        .initrd = initrd_file,
+        .sbi = opt_sbi,
+        .user = opt_user,
+        .user_argv = opt_user ? &argv[optind] : NULL,
+        .user_envp = environ,
+        // the program of --user reads stdin by itself
+        .console = !opt_user,
+        .snapshot = snapshot_file,
+        .restore = restore_file,
+        .fork_server = fork_server_file,
+        .checkpoint = checkpoint_prefix,
+        .checkpoint_interval = checkpoint_interval,
+        .profile = profile_file,
+        .profile_interval = profile_interval,
+        .profile_symbols = profile_symbols,
+        .instr_stats = instr_stats_file,
+        .stats = stats_file,
+        .stats_interval = stats_interval,
+        .trace = trace_file,
+        .trace_start = trace_start,
+        .record = record_file,
+        .replay = replay_file,
+        .timebase = timebase,
+    };
+
+    if (initrd_file[0] != '\0' && !opt_sbi) {
+        ERROR("The initrd is only supported with --sbi!\n");
+        return -1;
+    }
+
     int ret = 0;
-    riscv_emu *emu = create_emu(input_file, rfsimg_file);
+    riscv_emu *emu = create_emu(&config);
     if (!emu) {
         ERROR("Fail to create the emulator\n");
         ret = -1;
         goto clean_up;
     }
 
+    // the snapshot is taken when receiving SIGUSR2
+    if (snapshot_file[0] != '\0') {
+        snapshot_target = emu;
+        signal(SIGUSR2, snapshot_handler);
+    }
+
+    // the statistics are written when receiving SIGUSR1
+    bool stats = instr_stats_file[0] != '\0' || stats_file[0] != '\0';
+    if (stats) {
+        stats_target = emu;
+        signal(SIGUSR1, stats_handler);
+    }
+
+    // stop on SIGINT instead of being killed, so the reports are written
+    if (profile_file[0] != '\0' || stats || trace_file[0] != '\0') {
+        stop_target = emu;
+        signal(SIGINT, stop_handler);
+    }
+
     if (opt_riscv_test) {
-        ret = test_emu(emu);
+        ret = test_emu(emu, 0, NULL);
     } else {
         run_emu(emu);
+        if (opt_user)
+            ret = exit_code_emu(emu);
     }
 
     if (opt_compliance) {
@@ -93,7 +320,6 @@ int main(int argc, char *argv[])
     }
 
 clean_up:
-    log_end();
     free_emu(emu);
     return ret;
 }
@@ -6,15 +6,18 @@
 #include "macros.h"
 #include "memmap.h"
 #include "memory.h"
+#include "pager.h"
 
-static uint64_t entry_addr = DRAM_BASE;
-
-static void load_elf(riscv_mem *mem, uint8_t *elf_file)
+static bool load_elf(riscv_mem *mem, uint8_t *elf_file, size_t sz)
 {
     Elf64_Shdr *tohost_shdr;
     if (elf_lookup_shdr(&mem->elf, ".tohost", &tohost_shdr) == 0) {
         mem->tohost_addr = tohost_shdr->sh_addr;
     }
+    Elf64_Shdr *fromhost_shdr;
+    if (elf_lookup_shdr(&mem->elf, ".fromhost", &fromhost_shdr) == 0) {
+        mem->fromhost_addr = fromhost_shdr->sh_addr;
+    }
 
     Elf64_Sym *sym;
     if (elf_lookup_symbol(&mem->elf, "begin_signature", &sym) == 0) {
@@ -24,32 +27,88 @@ static void load_elf(riscv_mem *mem, uint8_t *elf_file)
         mem->sig_end = sym->st_value;
     }
 
-    entry_addr = elf_e_entry(&mem->elf);
+    mem->entry_addr = elf_e_entry(&mem->elf);
 
     Elf64_Phdr *phdr;
     phdr_iter_t it;
     elf_phdr_iter_start(&it, PT_LOAD);
     while (elf_phdr_iter_next(&mem->elf, &it, &phdr) == 0) {
-        uint64_t start = phdr->p_paddr - entry_addr;
+        uint64_t start = phdr->p_paddr - mem->entry_addr;
         uint64_t size = phdr->p_filesz;
         uint64_t offset = phdr->p_offset;
+        if (start > DRAM_SIZE || size > DRAM_SIZE - start || offset > sz ||
+            size > sz - offset) {
+            ERROR("The segment at 0x%lx is out of DRAM\n", phdr->p_paddr);
+            return false;
+        }
         memcpy(mem->mem + start, elf_file + offset, size);
     }
+    return true;
 }
 
-uint64_t get_entry_addr()
+/* Read the whole file into DRAM at the physical address, which should not
+ * exceed the end address. */
+static bool load_raw(riscv_mem *mem,
+                     const char *filename,
+                     uint64_t addr,
+                     uint64_t end)
 {
-    return entry_addr;
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        ERROR("Invalid path %s.\n", filename);
+        return false;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size_t sz = ftell(fp) * sizeof(uint8_t);
+    rewind(fp);
+
+    if (addr + sz > end) {
+        ERROR("%s is too large to be loaded at 0x%lx\n", filename, addr);
+        fclose(fp);
+        return false;
+    }
+
+    size_t read_size =
+        fread(mem->mem + (addr - DRAM_BASE), sizeof(uint8_t), sz, fp);
+    fclose(fp);
+    if (read_size != sz) {
+        ERROR("Error when reading %s through fread.\n", filename);
+        return false;
+    }
+
+    return true;
 }
 
-bool init_mem(riscv_mem *mem, const char *filename)
+/* The kernel Image is loaded as a raw binary, and the initrd is placed right
+ * below the device tree at the end of DRAM. */
+static bool load_kernel(riscv_mem *mem, const riscv_config *config)
 {
-    // load binary file to memory
-    if (!filename) {
-        ERROR("Binary is required for memory!\n");
-        return false;
+    uint64_t kernel_end = DRAM_END;
+    if (config->initrd[0] != '\0') {
+        FILE *fp = fopen(config->initrd, "rb");
+        if (!fp) {
+            ERROR("Invalid initrd path.\n");
+            return false;
+        }
+        fseek(fp, 0, SEEK_END);
+        kernel_end = INITRD_START(ftell(fp));
+        fclose(fp);
+
+        if (!load_raw(mem, config->initrd, kernel_end, FDT_ADDR))
+            return false;
     }
 
+    mem->entry_addr = DRAM_BASE + KERNEL_OFFSET;
+    return load_raw(mem, config->binary, mem->entry_addr, kernel_end);
+}
+
+bool init_mem(riscv_mem *mem, const riscv_config *config)
+{
+    // load binary file to memory
+    const char *filename = config->binary;
+    mem->entry_addr = DRAM_BASE;
+
     // create memory with default size
     mem->mem = calloc(DRAM_SIZE, sizeof(uint8_t));
     if (!mem->mem) {
@@ -57,10 +116,27 @@ bool init_mem(riscv_mem *mem, const char *filename)
         return false;
     }
 
+    /* The whole DRAM will be replaced by the snapshot, or written by the host
+     * which embeds the emulator. */
+    if (config->restore[0] != '\0' || filename[0] == '\0')
+        return true;
+
+    // the program of the user-mode emulation is loaded by init_user
+    if (config->user)
+        return true;
+
+    if (config->sbi) {
+        if (!load_kernel(mem, config)) {
+            free_memory(mem);
+            return false;
+        }
+        return true;
+    }
+
     FILE *fp = fopen(filename, "rb");
     if (!fp) {
         ERROR("Invalid binary path.\n");
-        free(mem->mem);
+        free_memory(mem);
         return false;
     }
 
@@ -73,7 +149,7 @@ bool init_mem(riscv_mem *mem, const char *filename)
         ERROR(
             "Error when allocating space through malloc for ELF file buffer\n");
         fclose(fp);
-        free(mem->mem);
+        free_memory(mem);
         return false;
     }
 
@@ -82,15 +158,20 @@ bool init_mem(riscv_mem *mem, const char *filename)
     if (read_size != sz) {
         ERROR("Error when reading binary through fread.\n");
         free(buf);
-        free(mem->mem);
+        free_memory(mem);
         return false;
     }
 
     if (elf_init(&mem->elf, buf, sz) == -1) {
         memcpy(mem->mem, buf, sz);
     } else {
-        load_elf(mem, buf);
+        bool loaded = load_elf(mem, buf, sz);
         elf_close(&mem->elf);
+        if (!loaded) {
+            free(buf);
+            free_memory(mem);
+            return false;
+        }
     }
 
     free(buf);
@@ -133,6 +214,7 @@ bool write_mem(riscv_mem *mem,
                riscv_exception *exc)
 {
     uint64_t index = (addr - DRAM_BASE);
+    mark_dirty(mem->dirty, index, size >> 3);
 
     switch (size) {
     case 8:
@@ -158,5 +240,15 @@ bool write_mem(riscv_mem *mem,
 
 void free_memory(riscv_mem *mem)
 {
-    free(mem->mem);
+    if (mem->mapped)
+        unmap_dram(mem->mem, DRAM_SIZE, mem->pager);
+    else
+        free(mem->mem);
+
+    free(mem->dirty);
+
+    mem->mem = NULL;
+    mem->mapped = false;
+    mem->pager = NULL;
+    mem->dirty = NULL;
 }
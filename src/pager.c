@@ -0,0 +1,276 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/userfaultfd.h>
+#endif
+
+#include "pager.h"
+
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+
+struct Pager {
+    int uffd;
+    // the duplicated descriptor of the snapshot
+    int fd;
+    // the thread is stopped when the pipe is written
+    int stop_pipe[2];
+    uint8_t *mem;
+    snapshot_page *pages;
+    uint64_t count;
+    pthread_t thread;
+};
+
+#ifdef __linux__
+static int compare_page(const void *key, const void *elem)
+{
+    uint64_t page = *(const uint64_t *) key;
+    const snapshot_page *entry = elem;
+    return page < entry->page ? -1 : page > entry->page;
+}
+
+// resolve the fault by the page in snapshot, or a zero page if it isn't there
+static void serve_fault(riscv_pager *pager, uint64_t addr, uint8_t *buf)
+{
+    addr &= ~(uint64_t) (SNAPSHOT_PAGE_SIZE - 1);
+    uint64_t page = (addr - (uint64_t) pager->mem) / SNAPSHOT_PAGE_SIZE;
+    const snapshot_page *entry = bsearch(&page, pager->pages, pager->count,
+                                         sizeof(snapshot_page), compare_page);
+
+    if (entry) {
+        // the faulting access must be resolved anyway
+        if (!load_snapshot_page(pager->fd, entry, buf)) {
+            ERROR("Failed to load page 0x%lx of the snapshot\n", page);
+            memset(buf, 0, SNAPSHOT_PAGE_SIZE);
+        }
+
+        struct uffdio_copy copy = {
+            .dst = addr,
+            .src = (uint64_t) buf,
+            .len = SNAPSHOT_PAGE_SIZE,
+        };
+        ioctl(pager->uffd, UFFDIO_COPY, &copy);
+        return;
+    }
+
+    struct uffdio_zeropage zero = {
+        .range = {.start = addr, .len = SNAPSHOT_PAGE_SIZE},
+    };
+    ioctl(pager->uffd, UFFDIO_ZEROPAGE, &zero);
+}
+
+static void *pager_thread(void *arg)
+{
+    riscv_pager *pager = arg;
+    uint8_t buf[SNAPSHOT_PAGE_SIZE];
+    struct pollfd fds[2] = {
+        {.fd = pager->uffd, .events = POLLIN},
+        {.fd = pager->stop_pipe[0], .events = POLLIN},
+    };
+
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents)
+            break;
+
+        struct uffd_msg msg;
+        if (read(pager->uffd, &msg, sizeof(msg)) != sizeof(msg))
+            continue;
+        if (msg.event == UFFD_EVENT_PAGEFAULT)
+            serve_fault(pager, msg.arg.pagefault.address, buf);
+    }
+    return NULL;
+}
+
+static int open_userfaultfd()
+{
+    /* The faults from kernel are allowed only for privileged users, which are
+     * never expected since the pages are always touched by the emulator
+     * first. */
+    int uffd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    if (uffd < 0)
+        uffd = syscall(SYS_userfaultfd,
+                       O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+    if (uffd < 0)
+        return -1;
+
+    struct uffdio_api api = {.api = UFFD_API};
+    if (ioctl(uffd, UFFDIO_API, &api) < 0) {
+        close(uffd);
+        return -1;
+    }
+    return uffd;
+}
+
+static riscv_pager *start_pager(int fd,
+                                const snapshot_page *pages,
+                                uint64_t count,
+                                uint8_t *mem,
+                                uint64_t size)
+{
+    int uffd = open_userfaultfd();
+    if (uffd < 0)
+        return NULL;
+
+    struct uffdio_register reg = {
+        .range = {.start = (uint64_t) mem, .len = size},
+        .mode = UFFDIO_REGISTER_MODE_MISSING,
+    };
+    if (ioctl(uffd, UFFDIO_REGISTER, &reg) < 0) {
+        close(uffd);
+        return NULL;
+    }
+
+    riscv_pager *pager = calloc(1, sizeof(riscv_pager));
+    if (!pager) {
+        close(uffd);
+        return NULL;
+    }
+    pager->uffd = uffd;
+    pager->mem = mem;
+    pager->count = count;
+    // allocate one more entry in case the snapshot has no page
+    pager->pages = malloc((count + 1) * sizeof(snapshot_page));
+    pager->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    pager->stop_pipe[0] = pager->stop_pipe[1] = -1;
+    if (pager->pages)
+        memcpy(pager->pages, pages, count * sizeof(snapshot_page));
+
+    if (!pager->pages || pager->fd < 0 || pipe(pager->stop_pipe) < 0 ||
+        pthread_create(&pager->thread, NULL, pager_thread, pager) != 0) {
+        // closing uffd also unregisters DRAM
+        close(uffd);
+        if (pager->fd >= 0)
+            close(pager->fd);
+        if (pager->stop_pipe[0] >= 0) {
+            close(pager->stop_pipe[0]);
+            close(pager->stop_pipe[1]);
+        }
+        free(pager->pages);
+        free(pager);
+        return NULL;
+    }
+
+    return pager;
+}
+
+/* Map the runs of uncompressed pages which are contiguous in both DRAM and the
+ * file, and read the compressed pages. */
+static bool map_file_pages(int fd,
+                           const snapshot_page *pages,
+                           uint64_t count,
+                           uint8_t *mem)
+{
+    for (uint64_t i = 0; i < count;) {
+        uint8_t *dst = mem + pages[i].page * SNAPSHOT_PAGE_SIZE;
+        if (pages[i].len != SNAPSHOT_PAGE_SIZE) {
+            if (!load_snapshot_page(fd, &pages[i], dst))
+                return false;
+            i++;
+            continue;
+        }
+
+        uint64_t n = 1;
+        while (i + n < count && pages[i + n].len == SNAPSHOT_PAGE_SIZE &&
+               pages[i + n].page == pages[i].page + n &&
+               pages[i + n].offset == pages[i].offset + n * SNAPSHOT_PAGE_SIZE)
+            n++;
+
+        if (mmap(dst, n * SNAPSHOT_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_FIXED, fd, pages[i].offset) == MAP_FAILED)
+            return false;
+        i += n;
+    }
+    return true;
+}
+#endif
+
+uint8_t *map_dram(int fd,
+                  const snapshot_page *pages,
+                  uint64_t count,
+                  uint64_t size,
+                  riscv_pager **pager)
+{
+    *pager = NULL;
+#ifdef __linux__
+    if (sysconf(_SC_PAGESIZE) != SNAPSHOT_PAGE_SIZE)
+        return NULL;
+
+    uint8_t *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED)
+        return NULL;
+
+    *pager = start_pager(fd, pages, count, mem, size);
+    if (*pager || map_file_pages(fd, pages, count, mem))
+        return mem;
+
+    munmap(mem, size);
+    return NULL;
+#else
+    (void) fd;
+    (void) pages;
+    (void) count;
+    (void) size;
+    return NULL;
+#endif
+}
+
+static void free_pager(riscv_pager *pager)
+{
+    if (write(pager->stop_pipe[1], "", 1) == 1)
+        pthread_join(pager->thread, NULL);
+    close(pager->stop_pipe[0]);
+    close(pager->stop_pipe[1]);
+    close(pager->uffd);
+    close(pager->fd);
+    free(pager->pages);
+    free(pager);
+}
+
+void unmap_dram(uint8_t *mem, uint64_t size, riscv_pager *pager)
+{
+    if (pager)
+        free_pager(pager);
+    munmap(mem, size);
+}
+
+void settle_dram(riscv_pager *pager)
+{
+#ifdef __linux__
+    uint8_t buf[SNAPSHOT_PAGE_SIZE];
+    for (uint64_t i = 0; i < pager->count; i++) {
+        uint64_t addr =
+            (uint64_t) pager->mem + pager->pages[i].page * SNAPSHOT_PAGE_SIZE;
+        // the pages which have been touched are skipped by EEXIST
+        if (!load_snapshot_page(pager->fd, &pager->pages[i], buf)) {
+            ERROR("Failed to load page 0x%lx of the snapshot\n",
+                  pager->pages[i].page);
+            memset(buf, 0, SNAPSHOT_PAGE_SIZE);
+        }
+
+        struct uffdio_copy copy = {
+            .dst = addr,
+            .src = (uint64_t) buf,
+            .len = SNAPSHOT_PAGE_SIZE,
+        };
+        ioctl(pager->uffd, UFFDIO_COPY, &copy);
+    }
+#endif
+    // the rest of DRAM becomes the zero pages after closing uffd
+    free_pager(pager);
+}
@@ -1,6 +1,13 @@
 #include "plic.h"
 #include "irq.h"
 
+static void count_claim(riscv_plic *plic, uint32_t irq)
+{
+    // 0 means there is no interrupt to claim
+    if (irq && irq < 32)
+        plic->claimed[irq]++;
+}
+
 uint64_t read_plic(riscv_plic *plic,
                    uint64_t addr,
                    uint8_t size,
@@ -25,10 +32,12 @@ uint64_t read_plic(riscv_plic *plic,
         case PLIC_THRESHOLD_0:
             return plic->threshold[0];
         case PLIC_CLAIM_0:
+            count_claim(plic, plic->claim[0]);
             return plic->claim[0];
         case PLIC_THRESHOLD_1:
             return plic->threshold[1];
         case PLIC_CLAIM_1:
+            count_claim(plic, plic->claim[1]);
             return plic->claim[1];
         default:
             goto read_plic_fail;
@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf_parser.h"
+#include "profiler.h"
+#include "user.h"
+
+typedef struct {
+    uint64_t samples;
+    uint64_t hash;
+    uint8_t mode;
+    uint8_t depth;
+    // the innermost frame first
+    uint64_t *frames;
+} profile_stack;
+
+struct Profiler {
+    elf_symtab_t symtab;
+    // the distinct stacks in the open addressing table
+    profile_stack *stacks;
+    size_t capacity;
+    size_t count;
+};
+
+/* Add the symbols of the ELF file. The binary which can't be read or isn't an
+ * ELF is ignored unless the file is required. */
+static bool load_symbols(riscv_profiler *prof,
+                         const char *filename,
+                         bool user,
+                         bool required)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        if (required)
+            ERROR("Failed to open %s\n", filename);
+        return !required;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size_t sz = ftell(fp);
+    rewind(fp);
+
+    uint8_t *buf = malloc(sz);
+    if (!buf || fread(buf, 1, sz, fp) != sz) {
+        if (required)
+            ERROR("Failed to read %s\n", filename);
+        free(buf);
+        fclose(fp);
+        return !required;
+    }
+    fclose(fp);
+
+    elf_t elf = {0};
+    bool ok = !required;
+    if (elf_init(&elf, buf, sz) == 0) {
+        // the static PIE of the user-mode emulation is moved
+        Elf64_Ehdr *ehdr = elf.inner->header;
+        uint64_t bias = user && ehdr->e_type == ET_DYN ? USER_PIE_BASE : 0;
+        ok = elf_symtab_add(&prof->symtab, &elf, bias) == 0 || !required;
+    }
+    elf_close(&elf);
+    free(buf);
+
+    if (!ok)
+        ERROR("Failed to load the symbols of %s\n", filename);
+    return ok;
+}
+
+riscv_profiler *create_profiler(const riscv_config *config)
+{
+    riscv_profiler *prof = calloc(1, sizeof(riscv_profiler));
+    if (!prof)
+        return NULL;
+
+    if (config->binary[0] != '\0' &&
+        !load_symbols(prof, config->binary, config->user, false)) {
+        free_profiler(prof);
+        return NULL;
+    }
+
+    for (char *const *file = config->profile_symbols; file && *file; file++) {
+        if (!load_symbols(prof, *file, false, true)) {
+            free_profiler(prof);
+            return NULL;
+        }
+    }
+
+    prof->capacity = 1024;
+    prof->stacks = calloc(prof->capacity, sizeof(profile_stack));
+    if (!prof->stacks) {
+        free_profiler(prof);
+        return NULL;
+    }
+    return prof;
+}
+
+/* The address is replaced by the function which it belongs to, so the samples
+ * at different pcs of a function are merged. */
+static uint64_t resolve(riscv_profiler *prof, uint64_t addr)
+{
+    const elf_symbol_t *sym = elf_lookup_address(&prof->symtab, addr);
+    return sym ? sym->addr : addr;
+}
+
+/* A leaf function doesn't save ra, so only the previous fp is saved at fp - 8,
+ * which is told from a return address by pointing to the stack slightly above
+ * sp, like the unwinder of Linux. */
+#define LEAF_FRAME_RANGE 0x10000UL
+
+static int unwind(riscv_profiler *prof, riscv_cpu *cpu, uint64_t *frames)
+{
+    int depth = 0;
+    frames[depth++] = resolve(prof, cpu->pc);
+
+    uint64_t sp = cpu->xreg[2], fp = cpu->xreg[8];
+    while (depth < PROFILE_MAX_DEPTH) {
+        uint64_t ra, prev;
+        if (fp < 16 || !peek_cpu(cpu, fp - 8, &ra))
+            break;
+
+        if (depth == 1 && !(ra & 0x7) && ra > sp &&
+            ra - sp < LEAF_FRAME_RANGE) {
+            prev = ra;
+            ra = cpu->xreg[1];
+        } else if (!peek_cpu(cpu, fp - 16, &prev)) {
+            break;
+        }
+        if (!ra)
+            break;
+        // the call could be the last instruction of a noreturn caller
+        frames[depth++] = resolve(prof, ra - 1);
+
+        // the stack grows down, so the frame of the caller is above
+        if (prev <= fp)
+            break;
+        fp = prev;
+    }
+    return depth;
+}
+
+static uint64_t hash_stack(uint8_t mode, const uint64_t *frames, int depth)
+{
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325UL ^ mode;
+    for (int i = 0; i < depth; i++)
+        hash = (hash ^ frames[i]) * 0x100000001b3UL;
+    return hash;
+}
+
+static profile_stack *find_stack(profile_stack *stacks,
+                                 size_t capacity,
+                                 uint64_t hash,
+                                 uint8_t mode,
+                                 const uint64_t *frames,
+                                 int depth)
+{
+    for (size_t i = hash & (capacity - 1);; i = (i + 1) & (capacity - 1)) {
+        profile_stack *stack = &stacks[i];
+        if (!stack->frames)
+            return stack;
+        if (stack->hash == hash && stack->mode == mode &&
+            stack->depth == depth &&
+            !memcmp(stack->frames, frames, depth * sizeof(uint64_t)))
+            return stack;
+    }
+}
+
+static bool grow_stacks(riscv_profiler *prof)
+{
+    size_t capacity = prof->capacity * 2;
+    profile_stack *stacks = calloc(capacity, sizeof(profile_stack));
+    if (!stacks)
+        return false;
+
+    for (size_t i = 0; i < prof->capacity; i++) {
+        profile_stack *old = &prof->stacks[i];
+        if (old->frames)
+            *find_stack(stacks, capacity, old->hash, old->mode, old->frames,
+                        old->depth) = *old;
+    }
+    free(prof->stacks);
+    prof->stacks = stacks;
+    prof->capacity = capacity;
+    return true;
+}
+
+void sample_profiler(riscv_profiler *prof, riscv_cpu *cpu)
+{
+    uint64_t frames[PROFILE_MAX_DEPTH];
+    int depth = unwind(prof, cpu, frames);
+    uint8_t mode = cpu->mode.mode;
+    uint64_t hash = hash_stack(mode, frames, depth);
+
+    profile_stack *stack =
+        find_stack(prof->stacks, prof->capacity, hash, mode, frames, depth);
+    if (!stack->frames) {
+        // keep the table at most half full, or drop the sample
+        if (prof->count * 2 >= prof->capacity) {
+            if (!grow_stacks(prof))
+                return;
+            stack = find_stack(prof->stacks, prof->capacity, hash, mode,
+                               frames, depth);
+        }
+
+        stack->frames = malloc(depth * sizeof(uint64_t));
+        if (!stack->frames)
+            return;
+        memcpy(stack->frames, frames, depth * sizeof(uint64_t));
+        stack->hash = hash;
+        stack->mode = mode;
+        stack->depth = depth;
+        prof->count++;
+    }
+    stack->samples++;
+}
+
+static void write_frame(riscv_profiler *prof, FILE *fp, uint64_t addr)
+{
+    const elf_symbol_t *sym = elf_lookup_address(&prof->symtab, addr);
+    if (sym)
+        fprintf(fp, ";%s", sym->name);
+    else
+        fprintf(fp, ";0x%lx", addr);
+}
+
+bool write_profiler(riscv_profiler *prof, const char *filename)
+{
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        ERROR("Failed to open %s\n", filename);
+        return false;
+    }
+
+    static const char *const mode_names[] = {
+        [USER] = "U-mode",
+        [SUPERVISOR] = "S-mode",
+        [MACHINE] = "M-mode",
+    };
+    for (size_t i = 0; i < prof->capacity; i++) {
+        profile_stack *stack = &prof->stacks[i];
+        if (!stack->frames)
+            continue;
+
+        fputs(mode_names[stack->mode], fp);
+        for (int j = stack->depth - 1; j >= 0; j--)
+            write_frame(prof, fp, stack->frames[j]);
+        fprintf(fp, " %lu\n", stack->samples);
+    }
+
+    bool ok = !ferror(fp);
+    if (fclose(fp) != 0 || !ok) {
+        ERROR("Failed to write the profile to %s\n", filename);
+        return false;
+    }
+    return true;
+}
+
+void free_profiler(riscv_profiler *prof)
+{
+    if (!prof)
+        return;
+
+    for (size_t i = 0; prof->stacks && i < prof->capacity; i++)
+        free(prof->stacks[i].frames);
+    free(prof->stacks);
+    elf_symtab_free(&prof->symtab);
+    free(prof);
+}
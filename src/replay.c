@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+
+static const char *const type_names[] = {
+    [REPLAY_UART] = "uart",
+};
+
+#define REPLAY_TYPES (sizeof(type_names) / sizeof(type_names[0]))
+
+riscv_replay *create_replay(const char *filename, bool record)
+{
+    riscv_replay *replay = calloc(1, sizeof(riscv_replay));
+    if (!replay)
+        return NULL;
+
+    replay->record = record;
+    replay->fp = fopen(filename, record ? "w" : "r");
+    if (!replay->fp) {
+        ERROR("Failed to open %s\n", filename);
+        free(replay);
+        return NULL;
+    }
+
+    if (record) {
+        fprintf(replay->fp, "%s\n", REPLAY_HEADER);
+        return replay;
+    }
+
+    char line[64];
+    if (!fgets(line, sizeof(line), replay->fp) ||
+        strncmp(line, REPLAY_HEADER, strlen(REPLAY_HEADER))) {
+        ERROR("%s isn't a replay log\n", filename);
+        free_replay(replay);
+        return NULL;
+    }
+    // a log without any event is fine
+    next_replay(replay);
+    return replay;
+}
+
+bool record_replay(riscv_replay *replay, const riscv_replay_event *event)
+{
+    replay->events++;
+    /* Flush each event, so the log is complete even if the emulator is killed
+     * or crashes, which is when it is needed the most. The input is rare. */
+    if (fprintf(replay->fp, "%lu %s 0x%lx\n", event->instret,
+                type_names[event->type], event->value) < 0 ||
+        fflush(replay->fp)) {
+        ERROR("Failed to record the event\n");
+        return false;
+    }
+    return true;
+}
+
+bool next_replay(riscv_replay *replay)
+{
+    uint64_t last = replay->next.instret;
+    replay->pending = false;
+
+    char line[64], name[16];
+    riscv_replay_event event;
+    while (fgets(line, sizeof(line), replay->fp)) {
+        if (line[0] == '\n')
+            continue;
+
+        if (sscanf(line, "%lu %15s %li", &event.instret, name,
+                   (long *) &event.value) != 3) {
+            ERROR("Malformed event after %lu events of the replay\n",
+                  replay->events);
+            return false;
+        }
+
+        size_t type = 0;
+        while (type < REPLAY_TYPES && strcmp(name, type_names[type]))
+            type++;
+        if (type == REPLAY_TYPES || event.instret < last) {
+            ERROR("Invalid event after %lu events of the replay\n",
+                  replay->events);
+            return false;
+        }
+
+        event.type = type;
+        replay->next = event;
+        replay->pending = true;
+        replay->events++;
+        return true;
+    }
+    return false;
+}
+
+void free_replay(riscv_replay *replay)
+{
+    if (!replay)
+        return;
+    fclose(replay->fp);
+    free(replay);
+}
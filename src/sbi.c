@@ -0,0 +1,380 @@
+#include <string.h>
+
+#include "cpu.h"
+#include "sbi.h"
+
+/* The built-in SBI lets the emulator boot a Linux kernel Image in S-mode
+ * directly. Instead of trapping into the M-mode firmware, which is interpreted
+ * as well, each SBI call from the kernel becomes a function call in the
+ * emulator. Only one hart is emulated, so the hart mask of IPI and remote
+ * fence is checked against hart 0 only. */
+
+// the hart mask includes hart 0 if hart_mask_base is -1 or bit 0 is set
+static bool sbi_mask_hart0(uint64_t hart_mask, uint64_t hart_mask_base)
+{
+    if (hart_mask_base == (uint64_t) -1)
+        return true;
+    return hart_mask_base == 0 && (hart_mask & 1);
+}
+
+static void sbi_set_timer(riscv_cpu *cpu, uint64_t stime_value)
+{
+    /* The timer is implemented by Sstc, which is always enabled under the
+     * built-in SBI. STIP is then updated by the comparison on each tick. */
+    write_csr(&cpu->csr, STIMECMP, stime_value);
+}
+
+static void sbi_send_ipi(riscv_cpu *cpu, uint64_t mask, uint64_t base)
+{
+    if (sbi_mask_hart0(mask, base))
+        set_csr_bits(&cpu->csr, MIP, MIP_SSIP);
+}
+
+static void sbi_remote_fence(__attribute__((unused)) riscv_cpu *cpu,
+                             uint64_t mask,
+                             uint64_t base)
+{
+    if (!sbi_mask_hart0(mask, base))
+        return;
+#ifdef ICACHE_CONFIG
+    invalid_icache(&cpu->icache);
+#endif
+}
+
+static void sbi_putchar(riscv_cpu *cpu, uint64_t ch)
+{
+    riscv_exception exc;
+    write_bus(&cpu->bus, UART_THR, 8, ch, &exc);
+}
+
+static int64_t sbi_getchar(riscv_cpu *cpu)
+{
+    riscv_exception exc;
+    if (!(read_bus(&cpu->bus, UART_LSR, 8, &exc) & UART_LSR_RX))
+        return -1;
+    return read_bus(&cpu->bus, UART_RHR, 8, &exc) & 0xff;
+}
+
+static bool sbi_probe(uint64_t ext)
+{
+    switch (ext) {
+    case SBI_EXT_0_1_SET_TIMER ... SBI_EXT_0_1_SHUTDOWN:
+    case SBI_EXT_BASE:
+    case SBI_EXT_TIME:
+    case SBI_EXT_IPI:
+    case SBI_EXT_RFENCE:
+    case SBI_EXT_HSM:
+    case SBI_EXT_SRST:
+    case SBI_EXT_PMU:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static int64_t sbi_base(uint64_t fid, uint64_t arg0, uint64_t *value)
+{
+    switch (fid) {
+    case SBI_BASE_GET_SPEC_VERSION:
+        *value = SBI_SPEC_VERSION;
+        break;
+    case SBI_BASE_GET_IMP_ID:
+        *value = SBI_IMPL_ID;
+        break;
+    case SBI_BASE_GET_IMP_VERSION:
+        *value = SBI_IMPL_VERSION;
+        break;
+    case SBI_BASE_PROBE_EXT:
+        *value = sbi_probe(arg0);
+        break;
+    case SBI_BASE_GET_MVENDORID:
+    case SBI_BASE_GET_MARCHID:
+    case SBI_BASE_GET_MIMPID:
+        *value = 0;
+        break;
+    default:
+        return SBI_ERR_NOT_SUPPORTED;
+    }
+    return SBI_SUCCESS;
+}
+
+static int64_t sbi_hsm(uint64_t fid, uint64_t arg0, uint64_t *value)
+{
+    // arg0 is the hart ID except hart_suspend, which takes the suspend type
+    uint64_t hartid = arg0;
+
+    switch (fid) {
+    case SBI_HSM_HART_START:
+        // the only hart is always running
+        return hartid == 0 ? SBI_ERR_ALREADY_AVAILABLE : SBI_ERR_INVALID_PARAM;
+    case SBI_HSM_HART_STOP:
+        return SBI_ERR_FAILED;
+    case SBI_HSM_HART_GET_STATUS:
+        if (hartid != 0)
+            return SBI_ERR_INVALID_PARAM;
+        *value = SBI_HSM_STATE_STARTED;
+        return SBI_SUCCESS;
+    case SBI_HSM_HART_SUSPEND:
+        /* a default retentive suspend is the same as WFI, which returns when
+         * the hart is resumed */
+        if (arg0 == SBI_HSM_SUSPEND_RET_DEFAULT)
+            return SBI_SUCCESS;
+        return SBI_ERR_NOT_SUPPORTED;
+    default:
+        return SBI_ERR_NOT_SUPPORTED;
+    }
+}
+
+/* The counters of the PMU extension are the ones of the hart, i.e. cycle,
+ * time, instret and hpmcounter3 - 31, so the kernel reads them by the CSRs
+ * directly. cycle and instret count their own events only, and the raw events,
+ * whose event_data is the value of mhpmevent, are counted by the hpmcounters.
+ * A counter is started and stopped by mcountinhibit. There is no firmware
+ * counter. */
+#define SBI_PMU_COUNTERS 32
+
+// the counters in the mask starting from base
+static uint32_t sbi_pmu_mask(uint64_t base, uint64_t mask)
+{
+    return base < SBI_PMU_COUNTERS ? (mask << base) & 0xffffffff : 0;
+}
+
+// the counters which could count the event
+static uint32_t sbi_pmu_event_counters(uint64_t event_idx)
+{
+    uint64_t type = (event_idx >> 16) & 0xf;
+    uint64_t code = event_idx & 0xffff;
+
+    if (type == SBI_PMU_EVENT_HW && code == SBI_PMU_HW_CPU_CYCLES)
+        return COUNTER_CY;
+    if (type == SBI_PMU_EVENT_HW && code == SBI_PMU_HW_INSTRUCTIONS)
+        return COUNTER_IR;
+    if (type == SBI_PMU_EVENT_RAW)
+        return COUNTER_HPM;
+    return 0;
+}
+
+static int64_t sbi_pmu_cfg_match(riscv_cpu *cpu,
+                                 const uint64_t *a,
+                                 uint64_t *value)
+{
+    uint64_t flags = a[2];
+    uint32_t candidates =
+        sbi_pmu_mask(a[0], a[1]) & sbi_pmu_event_counters(a[3]);
+    // the counter is taken as it is, which has been configured before
+    if (!(flags & SBI_PMU_CFG_SKIP_MATCH))
+        candidates &= ~cpu->sbi.pmu_counters;
+    if (!candidates)
+        return SBI_ERR_NOT_SUPPORTED;
+
+    int i = __builtin_ctz(candidates);
+    uint32_t bit = 1U << i;
+    cpu->sbi.pmu_counters |= bit;
+    if (bit & COUNTER_HPM)
+        write_csr(&cpu->csr, MHPMEVENT3 + i - 3, a[4]);
+    if (flags & SBI_PMU_CFG_CLEAR_VALUE)
+        write_csr(&cpu->csr, MCYCLE + i, 0);
+    if (flags & SBI_PMU_CFG_AUTO_START)
+        clear_csr_bits(&cpu->csr, MCOUNTINHIBIT, bit);
+    else
+        set_csr_bits(&cpu->csr, MCOUNTINHIBIT, bit);
+
+    *value = i;
+    return SBI_SUCCESS;
+}
+
+static int64_t sbi_pmu_start(riscv_cpu *cpu, const uint64_t *a)
+{
+    uint32_t counters = sbi_pmu_mask(a[0], a[1]);
+    if (!counters || (counters & ~cpu->sbi.pmu_counters))
+        return SBI_ERR_INVALID_PARAM;
+
+    int64_t error = SBI_SUCCESS;
+    for (int i = 0; i < SBI_PMU_COUNTERS; i++) {
+        uint32_t bit = 1U << i;
+        if (!(counters & bit))
+            continue;
+        if (!(read_csr(&cpu->csr, MCOUNTINHIBIT) & bit))
+            error = SBI_ERR_ALREADY_STARTED;
+        if (a[2] & SBI_PMU_START_SET_INIT_VALUE)
+            write_csr(&cpu->csr, MCYCLE + i, a[3]);
+        clear_csr_bits(&cpu->csr, MCOUNTINHIBIT, bit);
+    }
+    return error;
+}
+
+static int64_t sbi_pmu_stop(riscv_cpu *cpu, const uint64_t *a)
+{
+    uint32_t counters = sbi_pmu_mask(a[0], a[1]);
+    if (!counters || (counters & ~cpu->sbi.pmu_counters))
+        return SBI_ERR_INVALID_PARAM;
+
+    int64_t error = SBI_SUCCESS;
+    for (int i = 0; i < SBI_PMU_COUNTERS; i++) {
+        uint32_t bit = 1U << i;
+        if (!(counters & bit))
+            continue;
+        if (read_csr(&cpu->csr, MCOUNTINHIBIT) & bit)
+            error = SBI_ERR_ALREADY_STOPPED;
+        set_csr_bits(&cpu->csr, MCOUNTINHIBIT, bit);
+        // the counter is released, and could be configured again
+        if (a[2] & SBI_PMU_STOP_RESET) {
+            cpu->sbi.pmu_counters &= ~bit;
+            if (bit & COUNTER_HPM)
+                write_csr(&cpu->csr, MHPMEVENT3 + i - 3, HPM_NONE);
+        }
+    }
+    return error;
+}
+
+static int64_t sbi_pmu(riscv_cpu *cpu,
+                       uint64_t fid,
+                       const uint64_t *a,
+                       uint64_t *value)
+{
+    switch (fid) {
+    case SBI_PMU_NUM_COUNTERS:
+        *value = SBI_PMU_COUNTERS;
+        return SBI_SUCCESS;
+    case SBI_PMU_COUNTER_GET_INFO:
+        if (a[0] >= SBI_PMU_COUNTERS)
+            return SBI_ERR_INVALID_PARAM;
+        // a hardware counter of 64 bits, which is read by the CSR
+        *value = (CYCLE + a[0]) | (63UL << 12);
+        return SBI_SUCCESS;
+    case SBI_PMU_COUNTER_CFG_MATCH:
+        return sbi_pmu_cfg_match(cpu, a, value);
+    case SBI_PMU_COUNTER_START:
+        return sbi_pmu_start(cpu, a);
+    case SBI_PMU_COUNTER_STOP:
+        return sbi_pmu_stop(cpu, a);
+    default:
+        return SBI_ERR_NOT_SUPPORTED;
+    }
+}
+
+void sbi_ecall(riscv_cpu *cpu)
+{
+    uint64_t *a = &cpu->xreg[10];
+    uint64_t ext = cpu->xreg[17];
+    uint64_t fid = cpu->xreg[16];
+    uint64_t value = 0;
+    int64_t error = SBI_SUCCESS;
+
+    switch (ext) {
+    // the legacy extensions return the value in a0 only
+    case SBI_EXT_0_1_SET_TIMER:
+        sbi_set_timer(cpu, a[0]);
+        a[0] = 0;
+        return;
+    case SBI_EXT_0_1_CONSOLE_PUTCHAR:
+        sbi_putchar(cpu, a[0]);
+        a[0] = 0;
+        return;
+    case SBI_EXT_0_1_CONSOLE_GETCHAR:
+        a[0] = sbi_getchar(cpu);
+        return;
+    case SBI_EXT_0_1_CLEAR_IPI:
+        clear_csr_bits(&cpu->csr, MIP, MIP_SSIP);
+        a[0] = 0;
+        return;
+    case SBI_EXT_0_1_SEND_IPI:
+    case SBI_EXT_0_1_REMOTE_FENCE_I:
+    case SBI_EXT_0_1_REMOTE_SFENCE_VMA:
+    case SBI_EXT_0_1_REMOTE_SFENCE_VMA_ASID:
+        /* The hart mask of legacy extensions is passed by its virtual
+         * address. Since the caller could only target itself on a single hart
+         * system, it is taken as hart 0 directly. */
+        if (ext == SBI_EXT_0_1_SEND_IPI)
+            sbi_send_ipi(cpu, 1, 0);
+        else
+            sbi_remote_fence(cpu, 1, 0);
+        a[0] = 0;
+        return;
+    case SBI_EXT_0_1_SHUTDOWN:
+        cpu->sbi.shutdown = true;
+        return;
+
+    case SBI_EXT_BASE:
+        error = sbi_base(fid, a[0], &value);
+        break;
+    case SBI_EXT_TIME:
+        if (fid == 0)
+            sbi_set_timer(cpu, a[0]);
+        else
+            error = SBI_ERR_NOT_SUPPORTED;
+        break;
+    case SBI_EXT_IPI:
+        if (fid == 0)
+            sbi_send_ipi(cpu, a[0], a[1]);
+        else
+            error = SBI_ERR_NOT_SUPPORTED;
+        break;
+    case SBI_EXT_RFENCE:
+        if (fid <= 6)
+            sbi_remote_fence(cpu, a[0], a[1]);
+        else
+            error = SBI_ERR_NOT_SUPPORTED;
+        break;
+    case SBI_EXT_HSM:
+        error = sbi_hsm(fid, a[0], &value);
+        break;
+    case SBI_EXT_PMU:
+        error = sbi_pmu(cpu, fid, a, &value);
+        break;
+    case SBI_EXT_SRST:
+        // any type of reset or shutdown stops the emulator
+        if (fid == 0)
+            cpu->sbi.shutdown = true;
+        else
+            error = SBI_ERR_NOT_SUPPORTED;
+        break;
+    default:
+        error = SBI_ERR_NOT_SUPPORTED;
+    }
+
+    a[0] = error;
+    a[1] = value;
+}
+
+bool init_sbi(riscv_cpu *cpu)
+{
+    /* Linux expects the device tree to be in DRAM, so copy it from the boot
+     * ROM. */
+    riscv_boot *boot = &cpu->bus.boot;
+    uint64_t fdt_size = boot->boot_mem_size - BOOT_FDT_OFFSET;
+    if (fdt_size > FDT_MAX_SIZE) {
+        ERROR("The device tree is too large for the built-in SBI\n");
+        return false;
+    }
+    memcpy(cpu->bus.memory.mem + (FDT_ADDR - DRAM_BASE),
+           boot->boot_mem + BOOT_FDT_OFFSET, fdt_size);
+
+    /* Everything the firmware would do before jumping to the kernel: delegate
+     * the traps which are handled by the kernel, enable the counters, Sstc and
+     * the cache-block operations for the lower privilege mode. There is no
+     * M-mode trap handler, so every trap which the kernel could take, e.g. the
+     * illegal instruction of the lazy enable of V, is delegated. */
+    write_csr(&cpu->csr, MEDELEG,
+              (1 << InstructionAddressMisaligned) |
+                  (1 << InstructionAccessFault) | (1 << IllegalInstruction) |
+                  (1 << Breakpoint) | (1 << LoadAddressMisaligned) |
+                  (1 << LoadAccessFault) | (1 << StoreAMOAddressMisaligned) |
+                  (1 << StoreAMOAccessFault) |
+                  (1 << EnvironmentCallFromUMode) |
+                  (1 << InstructionPageFault) | (1 << LoadPageFault) |
+                  (1 << StoreAMOPageFault));
+    write_csr(&cpu->csr, MIDELEG, MIDELEG_WRITABLE);
+    write_csr(&cpu->csr, MCOUNTEREN, -1);
+    write_csr(&cpu->csr, MENVCFG,
+              MENVCFG_CBIE | MENVCFG_CBCFE | MENVCFG_CBZE | MENVCFG_STCE);
+
+    // a0 is the hart ID and a1 is the address of the device tree
+    cpu->mode.mode = SUPERVISOR;
+    cpu->pc = cpu->bus.memory.entry_addr;
+    cpu->xreg[10] = 0;
+    cpu->xreg[11] = FDT_ADDR;
+
+    cpu->sbi.enable = true;
+    return true;
+}
@@ -0,0 +1,665 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef SNAPSHOT_ZLIB
+#include <zlib.h>
+#endif
+
+#include "pager.h"
+#include "snapshot.h"
+
+_Static_assert(SNAPSHOT_PAGE_SIZE == DIRTY_PAGE_SIZE,
+               "the dirty pages should be the pages of snapshot");
+
+// the architectural state of the CPU
+typedef struct {
+    uint64_t pc;
+    uint64_t mode;
+    uint64_t reservation;
+    uint64_t xreg[32];
+    uint64_t freg[32];
+    uint8_t vreg[32 * VREG_SIZE];
+} snapshot_cpu;
+
+// the part of UART which is not related to the host thread
+typedef struct {
+    uint8_t reg[UART_SIZE];
+    bool is_interrupt;
+} snapshot_uart;
+
+/* All the counters of the statistics, which are gathered from the CPU and the
+ * devices, so they continue from the snapshot after it is restored */
+typedef struct {
+    riscv_stats cpu;
+    uint64_t mmio_reads[BUS_DEVICE_COUNT];
+    uint64_t mmio_writes[BUS_DEVICE_COUNT];
+    uint64_t plic_claimed[32];
+    uint64_t uart_tx_bytes;
+    uint64_t uart_rx_bytes;
+    uint64_t virtio_requests;
+    uint64_t virtio_read_bytes;
+    uint64_t virtio_write_bytes;
+    // zero unless the emulator is built with I-cache
+    uint64_t icache_hits;
+    uint64_t icache_misses;
+    uint64_t icache_flushes;
+} snapshot_stats;
+
+static bool snap_write(FILE *fp, const void *buf, size_t len)
+{
+    return fwrite(buf, 1, len, fp) == len;
+}
+
+static bool snap_read(FILE *fp, void *buf, size_t len)
+{
+    return fread(buf, 1, len, fp) == len;
+}
+
+static bool snap_write_section(FILE *fp,
+                               snapshot_tag tag,
+                               const void *buf,
+                               uint64_t len)
+{
+    snapshot_section section = {.tag = tag, .len = len};
+    return snap_write(fp, &section, sizeof(section)) &&
+           (!buf || snap_write(fp, buf, len));
+}
+
+/* Read the header of the next section, which should be the expected one. The
+ * payload is also read if buf isn't NULL, whose length should be exactly len.
+ * Return the length of the payload, or -1 on failure. */
+static int64_t snap_read_section(FILE *fp,
+                                 snapshot_tag tag,
+                                 void *buf,
+                                 uint64_t len)
+{
+    snapshot_section section;
+    if (!snap_read(fp, &section, sizeof(section)) || section.tag != tag) {
+        ERROR("Invalid snapshot section %d\n", tag);
+        return -1;
+    }
+
+    if (!buf)
+        return section.len;
+
+    if (section.len != len) {
+        ERROR("The snapshot is taken by an incompatible build (section %d)\n",
+              tag);
+        return -1;
+    }
+    return snap_read(fp, buf, len) ? (int64_t) len : -1;
+}
+
+// the counters of UART are taken by the caller under the lock of UART
+static void save_stats(riscv_cpu *cpu, snapshot_stats *stats)
+{
+    riscv_bus *bus = &cpu->bus;
+    memset(stats, 0, sizeof(snapshot_stats));
+    stats->cpu = cpu->stats;
+    memcpy(stats->mmio_reads, bus->mmio_reads, sizeof(stats->mmio_reads));
+    memcpy(stats->mmio_writes, bus->mmio_writes, sizeof(stats->mmio_writes));
+    memcpy(stats->plic_claimed, bus->plic.claimed,
+           sizeof(stats->plic_claimed));
+    stats->virtio_requests = bus->virtio_blk.requests;
+    stats->virtio_read_bytes = bus->virtio_blk.read_bytes;
+    stats->virtio_write_bytes = bus->virtio_blk.write_bytes;
+#ifdef ICACHE_CONFIG
+    stats->icache_hits = cpu->icache.hits;
+    stats->icache_misses = cpu->icache.misses;
+    stats->icache_flushes = cpu->icache.flushes;
+#endif
+}
+
+static void restore_stats(riscv_cpu *cpu, const snapshot_stats *stats)
+{
+    riscv_bus *bus = &cpu->bus;
+    cpu->stats = stats->cpu;
+    memcpy(bus->mmio_reads, stats->mmio_reads, sizeof(bus->mmio_reads));
+    memcpy(bus->mmio_writes, stats->mmio_writes, sizeof(bus->mmio_writes));
+    memcpy(bus->plic.claimed, stats->plic_claimed, sizeof(bus->plic.claimed));
+    bus->virtio_blk.requests = stats->virtio_requests;
+    bus->virtio_blk.read_bytes = stats->virtio_read_bytes;
+    bus->virtio_blk.write_bytes = stats->virtio_write_bytes;
+#ifdef ICACHE_CONFIG
+    cpu->icache.hits = stats->icache_hits;
+    cpu->icache.misses = stats->icache_misses;
+    cpu->icache.flushes = stats->icache_flushes;
+#endif
+}
+
+static const uint8_t zero_page[SNAPSHOT_PAGE_SIZE];
+
+/* Return the i-th page of the region. The last page of disk could be partial,
+ * which is copied to the buffer and padded by zero. */
+static const uint8_t *region_page(const uint8_t *mem,
+                                  uint64_t size,
+                                  uint64_t i,
+                                  uint8_t *buf)
+{
+    uint64_t off = i * SNAPSHOT_PAGE_SIZE;
+    if (size - off >= SNAPSHOT_PAGE_SIZE)
+        return mem + off;
+
+    memset(buf, 0, SNAPSHOT_PAGE_SIZE);
+    memcpy(buf, mem + off, size - off);
+    return buf;
+}
+
+static bool page_is_zero(const uint8_t *page)
+{
+    return !memcmp(page, zero_page, SNAPSHOT_PAGE_SIZE);
+}
+
+/* A full snapshot saves the non-zero pages, while an incremental one saves the
+ * dirty pages, including the ones which become zero. */
+static bool page_is_saved(const uint64_t *dirty,
+                          const uint8_t *page,
+                          uint64_t i)
+{
+    return dirty ? test_dirty(dirty, i) : !page_is_zero(page);
+}
+
+/* Write the data of the saved pages in the region, and then go back to fill
+ * the index in front of them, since the length of each compressed page is
+ * unknown before. */
+static bool snap_write_pages(FILE *fp,
+                             snapshot_tag tag,
+                             const uint8_t *mem,
+                             uint64_t size,
+                             const uint64_t *dirty)
+{
+    uint8_t last[SNAPSHOT_PAGE_SIZE];
+    uint64_t npages = (size + SNAPSHOT_PAGE_SIZE - 1) / SNAPSHOT_PAGE_SIZE;
+    snapshot_index index = {.count = 0};
+    for (uint64_t i = 0; i < npages; i++) {
+        if (page_is_saved(dirty, region_page(mem, size, i, last), i))
+            index.count++;
+    }
+
+    snapshot_page *pages = calloc(index.count + 1, sizeof(snapshot_page));
+    if (!pages)
+        return false;
+
+    long index_off;
+    bool ret = snap_write_section(fp, tag, NULL, size) &&
+               (index_off = ftell(fp)) >= 0 &&
+               fseek(fp,
+                     sizeof(snapshot_index) +
+                         index.count * sizeof(snapshot_page),
+                     SEEK_CUR) == 0;
+
+#ifdef SNAPSHOT_ZLIB
+    uint8_t zbuf[SNAPSHOT_PAGE_SIZE * 2];
+#endif
+
+    uint64_t n = 0;
+    for (uint64_t i = 0; ret && i < npages; i++) {
+        const uint8_t *page = region_page(mem, size, i, last);
+        if (!page_is_saved(dirty, page, i))
+            continue;
+        if (page_is_zero(page)) {
+            pages[n++] = (snapshot_page){.page = i, .len = 0};
+            continue;
+        }
+
+        uint32_t len = SNAPSHOT_PAGE_SIZE;
+#ifdef SNAPSHOT_ZLIB
+        uLongf zlen = sizeof(zbuf);
+        if (compress2(zbuf, &zlen, page, SNAPSHOT_PAGE_SIZE, Z_BEST_SPEED) ==
+                Z_OK &&
+            zlen < SNAPSHOT_PAGE_SIZE) {
+            page = zbuf;
+            len = zlen;
+        }
+#endif
+
+        // align the uncompressed page so it can be mapped from the file
+        long off = ftell(fp);
+        if (len == SNAPSHOT_PAGE_SIZE && off % SNAPSHOT_PAGE_SIZE) {
+            long pad = SNAPSHOT_PAGE_SIZE - off % SNAPSHOT_PAGE_SIZE;
+            ret = snap_write(fp, zero_page, pad);
+            off += pad;
+        }
+
+        pages[n++] = (snapshot_page){.page = i, .offset = off, .len = len};
+        ret = ret && off >= 0 && snap_write(fp, page, len);
+    }
+
+    index.end = ftell(fp);
+    ret = ret && fseek(fp, index_off, SEEK_SET) == 0 &&
+          snap_write(fp, &index, sizeof(index)) &&
+          snap_write(fp, pages, index.count * sizeof(snapshot_page)) &&
+          fseek(fp, index.end, SEEK_SET) == 0;
+    free(pages);
+    return ret;
+}
+
+/* Read the index of the region, and the pages should be freed by the caller.
+ * The file is left at the end of the section. */
+static bool snap_read_index(FILE *fp,
+                            uint64_t size,
+                            snapshot_index *index,
+                            snapshot_page **pages)
+{
+    uint64_t npages = (size + SNAPSHOT_PAGE_SIZE - 1) / SNAPSHOT_PAGE_SIZE;
+    if (!snap_read(fp, index, sizeof(snapshot_index)) || index->count > npages)
+        return false;
+
+    *pages = malloc((index->count + 1) * sizeof(snapshot_page));
+    if (!*pages)
+        return false;
+
+    bool ret = snap_read(fp, *pages, index->count * sizeof(snapshot_page));
+    for (uint64_t i = 0; ret && i < index->count; i++) {
+        if ((*pages)[i].page >= npages ||
+            (i > 0 && (*pages)[i].page <= (*pages)[i - 1].page))
+            ret = false;
+    }
+
+    if (!ret || fseek(fp, index->end, SEEK_SET) != 0) {
+        free(*pages);
+        return false;
+    }
+    return true;
+}
+
+// read the pages into the region, which has been cleared by the caller
+static bool snap_load_pages(int fd,
+                            const snapshot_page *pages,
+                            uint64_t count,
+                            uint8_t *mem,
+                            uint64_t size)
+{
+    uint8_t buf[SNAPSHOT_PAGE_SIZE];
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t off = pages[i].page * SNAPSHOT_PAGE_SIZE;
+        uint64_t len = size - off;
+        if (len > SNAPSHOT_PAGE_SIZE)
+            len = SNAPSHOT_PAGE_SIZE;
+
+        if (!load_snapshot_page(fd, &pages[i], buf))
+            return false;
+        memcpy(mem + off, buf, len);
+    }
+    return true;
+}
+
+bool load_snapshot_page(int fd, const snapshot_page *page, uint8_t *buf)
+{
+    if (page->len > SNAPSHOT_PAGE_SIZE)
+        return false;
+
+    if (page->len == 0) {
+        memset(buf, 0, SNAPSHOT_PAGE_SIZE);
+        return true;
+    }
+
+    if (page->len == SNAPSHOT_PAGE_SIZE)
+        return pread(fd, buf, SNAPSHOT_PAGE_SIZE, page->offset) ==
+               SNAPSHOT_PAGE_SIZE;
+
+#ifdef SNAPSHOT_ZLIB
+    uint8_t zbuf[SNAPSHOT_PAGE_SIZE];
+    uLongf len = SNAPSHOT_PAGE_SIZE;
+    return pread(fd, zbuf, page->len, page->offset) == page->len &&
+           uncompress(buf, &len, zbuf, page->len) == Z_OK &&
+           len == SNAPSHOT_PAGE_SIZE;
+#else
+    ERROR("The snapshot is compressed, please build with ZLIB=1\n");
+    return false;
+#endif
+}
+
+/* Map DRAM to the snapshot so the pages are loaded when they are touched, or
+ * read them all if it is impossible. */
+static bool restore_dram(FILE *fp, riscv_mem *memory)
+{
+    snapshot_index index;
+    snapshot_page *pages;
+    if (snap_read_section(fp, SNAPSHOT_DRAM, NULL, 0) != DRAM_SIZE ||
+        !snap_read_index(fp, DRAM_SIZE, &index, &pages))
+        return false;
+
+    free_memory(memory);
+
+    bool ret = true;
+    memory->mem =
+        map_dram(fileno(fp), pages, index.count, DRAM_SIZE, &memory->pager);
+    if (memory->mem) {
+        memory->mapped = true;
+    } else {
+        memory->mem = calloc(DRAM_SIZE, sizeof(uint8_t));
+        if (!memory->mem)
+            ERROR("Error when allocating space through malloc for DRAM\n");
+        ret = memory->mem && snap_load_pages(fileno(fp), pages, index.count,
+                                             memory->mem, DRAM_SIZE);
+    }
+
+    free(pages);
+    return ret;
+}
+
+static bool restore_disk(FILE *fp, riscv_virtio_blk *virtio_blk)
+{
+    int64_t size = snap_read_section(fp, SNAPSHOT_DISK, NULL, 0);
+    snapshot_index index;
+    snapshot_page *pages;
+    if (size < 0 || !snap_read_index(fp, size, &index, &pages))
+        return false;
+
+    // the disk content is restored from the snapshot instead of the image
+    uint8_t *rfsimg = NULL;
+    bool ret = true;
+    if (size > 0) {
+        rfsimg = calloc(size, sizeof(uint8_t));
+        if (!rfsimg)
+            ERROR("Error when allocating space through malloc for disk\n");
+        ret = rfsimg &&
+              snap_load_pages(fileno(fp), pages, index.count, rfsimg, size);
+    }
+    free(pages);
+
+    free(virtio_blk->rfsimg);
+    virtio_blk->rfsimg = rfsimg;
+    virtio_blk->rfsimg_size = ret ? size : 0;
+    return ret;
+}
+
+/* Apply the dirty pages of an incremental snapshot on top of the restored
+ * region, whose size should not be changed. */
+static bool apply_pages(FILE *fp, snapshot_tag tag, uint8_t *mem, uint64_t size)
+{
+    snapshot_index index;
+    snapshot_page *pages;
+    if (snap_read_section(fp, tag, NULL, 0) != (int64_t) size ||
+        !snap_read_index(fp, size, &index, &pages))
+        return false;
+
+    bool ret = snap_load_pages(fileno(fp), pages, index.count, mem, size);
+    free(pages);
+    return ret;
+}
+
+static bool snap_save(riscv_cpu *cpu,
+                      const char *filename,
+                      const char *parent,
+                      bool incremental)
+{
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        ERROR("Failed to open snapshot %s\n", filename);
+        return false;
+    }
+
+    snapshot_header header = {.version = SNAPSHOT_VERSION, .vlen = VLEN};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+
+    snapshot_cpu state = {
+        .pc = cpu->pc,
+        .mode = cpu->mode.mode,
+        .reservation = cpu->reservation,
+    };
+    memcpy(state.xreg, cpu->xreg, sizeof(state.xreg));
+    for (int i = 0; i < 32; i++)
+        state.freg[i] = cpu->freg[i].u;
+    memcpy(state.vreg, cpu->vreg, sizeof(state.vreg));
+
+    riscv_bus *bus = &cpu->bus;
+    snapshot_uart uart;
+    snapshot_stats stats;
+    save_stats(cpu, &stats);
+    pthread_mutex_lock(&bus->uart.lock);
+    memcpy(uart.reg, bus->uart.reg, sizeof(uart.reg));
+    uart.is_interrupt = bus->uart.is_interrupt;
+    stats.uart_tx_bytes = bus->uart.tx_bytes;
+    stats.uart_rx_bytes = bus->uart.rx_bytes;
+    pthread_mutex_unlock(&bus->uart.lock);
+
+    bool ret =
+        snap_write(fp, &header, sizeof(header)) &&
+        snap_write_section(fp, SNAPSHOT_PARENT, parent, strlen(parent)) &&
+        snap_write_section(fp, SNAPSHOT_CPU, &state, sizeof(state)) &&
+        snap_write_section(fp, SNAPSHOT_CSR, &cpu->csr, sizeof(riscv_csr)) &&
+        snap_write_section(fp, SNAPSHOT_SBI, &cpu->sbi, sizeof(riscv_sbi)) &&
+        snap_write_section(fp, SNAPSHOT_CLINT, &bus->clint,
+                           sizeof(riscv_clint)) &&
+        snap_write_section(fp, SNAPSHOT_PLIC, &bus->plic, sizeof(riscv_plic)) &&
+        snap_write_section(fp, SNAPSHOT_UART, &uart, sizeof(uart)) &&
+        snap_write_section(fp, SNAPSHOT_VIRTIO_BLK, &bus->virtio_blk,
+                           sizeof(riscv_virtio_blk)) &&
+        snap_write_section(fp, SNAPSHOT_STATS, &stats, sizeof(stats)) &&
+        snap_write_pages(fp, SNAPSHOT_DRAM, bus->memory.mem, DRAM_SIZE,
+                         incremental ? bus->memory.dirty : NULL) &&
+        snap_write_pages(fp, SNAPSHOT_DISK, bus->virtio_blk.rfsimg,
+                         bus->virtio_blk.rfsimg_size,
+                         incremental ? bus->virtio_blk.dirty : NULL);
+
+    if (fclose(fp) != 0)
+        ret = false;
+    if (!ret)
+        ERROR("Failed to write snapshot %s\n", filename);
+    return ret;
+}
+
+bool save_snapshot(riscv_cpu *cpu, const char *filename)
+{
+    return snap_save(cpu, filename, "", false);
+}
+
+static void untrack_dirty(riscv_bus *bus)
+{
+    free(bus->memory.dirty);
+    free(bus->virtio_blk.dirty);
+    bus->memory.dirty = NULL;
+    bus->virtio_blk.dirty = NULL;
+}
+
+// start to track the pages written from now on
+static bool track_dirty(riscv_bus *bus)
+{
+    untrack_dirty(bus);
+    bus->memory.dirty = calloc(DIRTY_WORDS(DRAM_SIZE), sizeof(uint64_t));
+    bus->virtio_blk.dirty =
+        calloc(DIRTY_WORDS(bus->virtio_blk.rfsimg_size), sizeof(uint64_t));
+    if (!bus->memory.dirty || !bus->virtio_blk.dirty) {
+        ERROR("Error when allocating space through malloc for dirty pages\n");
+        untrack_dirty(bus);
+        return false;
+    }
+    return true;
+}
+
+bool save_checkpoint(riscv_cpu *cpu, const char *filename, const char *parent)
+{
+    riscv_bus *bus = &cpu->bus;
+
+    // the pages should have been tracked since the parent is taken
+    const char *name = "";
+    bool incremental = parent && bus->memory.dirty;
+    if (incremental) {
+        name = strrchr(parent, '/');
+        name = name ? name + 1 : parent;
+    }
+
+    bool ret = snap_save(cpu, filename, name, incremental);
+    // the next checkpoint is full if this one fails
+    if (!ret || !track_dirty(bus)) {
+        untrack_dirty(bus);
+        return false;
+    }
+    return true;
+}
+
+/* Open the snapshot and check its header. If it is an incremental one, the
+ * path of the parent, which is in the same directory, is returned in parent,
+ * otherwise parent is an empty string. */
+static FILE *snap_open(const char *filename, char *parent, size_t parent_size)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        ERROR("Failed to open snapshot %s\n", filename);
+        return NULL;
+    }
+
+    snapshot_header header;
+    if (!snap_read(fp, &header, sizeof(header)) ||
+        memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) ||
+        header.version != SNAPSHOT_VERSION) {
+        ERROR("%s is not a valid snapshot\n", filename);
+        fclose(fp);
+        return NULL;
+    }
+    if (header.vlen != VLEN) {
+        ERROR("The snapshot is taken with VLEN=%u\n", header.vlen);
+        fclose(fp);
+        return NULL;
+    }
+
+    char name[SNAPSHOT_NAME_MAX];
+    int64_t len = snap_read_section(fp, SNAPSHOT_PARENT, NULL, 0);
+    if (len < 0 || len >= SNAPSHOT_NAME_MAX || !snap_read(fp, name, len)) {
+        ERROR("%s is not a valid snapshot\n", filename);
+        fclose(fp);
+        return NULL;
+    }
+    name[len] = '\0';
+
+    parent[0] = '\0';
+    if (len > 0) {
+        const char *slash = strrchr(filename, '/');
+        int dir_len = slash ? slash - filename + 1 : 0;
+        snprintf(parent, parent_size, "%.*s%s", dir_len, filename, name);
+    }
+    return fp;
+}
+
+/* Restore a snapshot of the chain, which is applied on top of the previous one
+ * if it is incremental. The architectural state is returned to the caller,
+ * since only the one of the last snapshot matters. */
+static bool restore_file(riscv_cpu *cpu,
+                         const char *filename,
+                         bool incremental,
+                         snapshot_cpu *state,
+                         snapshot_uart *uart,
+                         snapshot_stats *stats)
+{
+    char parent[PATH_MAX];
+    FILE *fp = snap_open(filename, parent, sizeof(parent));
+    if (!fp)
+        return false;
+
+    riscv_bus *bus = &cpu->bus;
+    // the pointers of disk are owned by the emulator instead of the snapshot
+    uint8_t *rfsimg = bus->virtio_blk.rfsimg;
+    uint64_t rfsimg_size = bus->virtio_blk.rfsimg_size;
+    uint64_t *dirty = bus->virtio_blk.dirty;
+
+    bool ret =
+        snap_read_section(fp, SNAPSHOT_CPU, state, sizeof(snapshot_cpu)) >=
+            0 &&
+        snap_read_section(fp, SNAPSHOT_CSR, &cpu->csr, sizeof(riscv_csr)) >=
+            0 &&
+        snap_read_section(fp, SNAPSHOT_SBI, &cpu->sbi, sizeof(riscv_sbi)) >=
+            0 &&
+        snap_read_section(fp, SNAPSHOT_CLINT, &bus->clint,
+                          sizeof(riscv_clint)) >= 0 &&
+        snap_read_section(fp, SNAPSHOT_PLIC, &bus->plic, sizeof(riscv_plic)) >=
+            0 &&
+        snap_read_section(fp, SNAPSHOT_UART, uart, sizeof(snapshot_uart)) >=
+            0 &&
+        snap_read_section(fp, SNAPSHOT_VIRTIO_BLK, &bus->virtio_blk,
+                          sizeof(riscv_virtio_blk)) >= 0 &&
+        snap_read_section(fp, SNAPSHOT_STATS, stats, sizeof(snapshot_stats)) >=
+            0;
+    bus->virtio_blk.rfsimg = rfsimg;
+    bus->virtio_blk.rfsimg_size = rfsimg_size;
+    bus->virtio_blk.dirty = dirty;
+
+    if (incremental) {
+        ret = ret &&
+              apply_pages(fp, SNAPSHOT_DRAM, bus->memory.mem, DRAM_SIZE) &&
+              apply_pages(fp, SNAPSHOT_DISK, rfsimg, rfsimg_size);
+    } else {
+        ret = ret && restore_dram(fp, &bus->memory) &&
+              restore_disk(fp, &bus->virtio_blk);
+    }
+    fclose(fp);
+    return ret;
+}
+
+bool restore_snapshot(riscv_cpu *cpu, const char *filename)
+{
+    // collect the chain from the given snapshot back to the full one
+    char **chain = NULL;
+    int n = 0;
+    bool ret = true;
+    char parent[PATH_MAX];
+    snprintf(parent, sizeof(parent), "%s", filename);
+
+    while (ret && parent[0] != '\0') {
+        if (n == SNAPSHOT_MAX_CHAIN) {
+            ERROR("The chain of snapshot %s is too long\n", filename);
+            ret = false;
+            break;
+        }
+
+        char **new_chain = realloc(chain, (n + 1) * sizeof(char *));
+        if (!new_chain || !(new_chain[n] = strdup(parent))) {
+            chain = new_chain ? new_chain : chain;
+            ret = false;
+            break;
+        }
+        chain = new_chain;
+
+        FILE *fp = snap_open(chain[n++], parent, sizeof(parent));
+        if (!fp)
+            ret = false;
+        else
+            fclose(fp);
+    }
+
+    // the dirty pages are tracked again by the next checkpoint
+    untrack_dirty(&cpu->bus);
+
+    snapshot_cpu state;
+    snapshot_uart uart;
+    snapshot_stats stats;
+    for (int i = n - 1; ret && i >= 0; i--)
+        ret = restore_file(cpu, chain[i], i != n - 1, &state, &uart, &stats);
+
+    for (int i = 0; i < n; i++)
+        free(chain[i]);
+    free(chain);
+
+    if (!ret) {
+        ERROR("Failed to restore snapshot %s\n", filename);
+        return false;
+    }
+
+    cpu->pc = state.pc;
+    cpu->mode.mode = state.mode;
+    cpu->reservation = state.reservation;
+    memcpy(cpu->xreg, state.xreg, sizeof(state.xreg));
+    for (int i = 0; i < 32; i++)
+        cpu->freg[i].u = state.freg[i];
+    memcpy(cpu->vreg, state.vreg, sizeof(state.vreg));
+    cpu->exc.exception = NoException;
+    cpu->irq.irq = NoInterrupt;
+
+    riscv_bus *bus = &cpu->bus;
+    pthread_mutex_lock(&bus->uart.lock);
+    memcpy(bus->uart.reg, uart.reg, sizeof(uart.reg));
+    bus->uart.is_interrupt = uart.is_interrupt;
+    bus->uart.tx_bytes = stats.uart_tx_bytes;
+    bus->uart.rx_bytes = stats.uart_rx_bytes;
+    pthread_mutex_unlock(&bus->uart.lock);
+
+    restore_stats(cpu, &stats);
+#ifdef ICACHE_CONFIG
+    invalid_icache(&cpu->icache);
+#endif
+    return true;
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+
+#include "cpu.h"
+#include "stats.h"
+
+static const char *const mode_names[4] = {"user", "supervisor", NULL,
+                                          "machine"};
+
+static const char *const exception_names[STATS_CAUSES] = {
+    [InstructionAddressMisaligned] = "instruction_address_misaligned",
+    [InstructionAccessFault] = "instruction_access_fault",
+    [IllegalInstruction] = "illegal_instruction",
+    [Breakpoint] = "breakpoint",
+    [LoadAddressMisaligned] = "load_address_misaligned",
+    [LoadAccessFault] = "load_access_fault",
+    [StoreAMOAddressMisaligned] = "store_address_misaligned",
+    [StoreAMOAccessFault] = "store_access_fault",
+    [EnvironmentCallFromUMode] = "ecall_from_user",
+    [EnvironmentCallFromSMode] = "ecall_from_supervisor",
+    [EnvironmentCallFromMMode] = "ecall_from_machine",
+    [InstructionPageFault] = "instruction_page_fault",
+    [LoadPageFault] = "load_page_fault",
+    [StoreAMOPageFault] = "store_page_fault",
+};
+
+static const char *const interrupt_names[STATS_CAUSES] = {
+    [UserSoftwareInterrupt] = "user_software",
+    [SupervisorSoftwareInterrupt] = "supervisor_software",
+    [MachineSoftwareInterrupt] = "machine_software",
+    [UserTimerInterrupt] = "user_timer",
+    [SupervisorTimerInterrupt] = "supervisor_timer",
+    [MachineTimerInterrupt] = "machine_timer",
+    [UserExternalInterrupt] = "user_external",
+    [SupervisorExternalInterrupt] = "supervisor_external",
+    [MachineExternalInterrupt] = "machine_external",
+};
+
+static const char *const device_names[BUS_DEVICE_COUNT] = {
+    [BUS_CTRL] = "ctrl",     [BUS_CLINT] = "clint",   [BUS_PLIC] = "plic",
+    [BUS_UART] = "uart",     [BUS_VIRTIO] = "virtio", [BUS_BOOT] = "boot",
+    [BUS_HOST] = "host",
+};
+
+/* The traps are grouped by the mode where they happen, and only the causes
+ * which occur are written, e.g. {"user":{"load_page_fault":3}} */
+static void write_traps(FILE *fp,
+                        const uint64_t traps[STATS_CAUSES][4],
+                        const char *const *names)
+{
+    fputc('{', fp);
+    bool first_mode = true;
+    for (int mode = 0; mode < 4; mode++) {
+        if (!mode_names[mode])
+            continue;
+        fprintf(fp, "%s\"%s\":{", first_mode ? "" : ",", mode_names[mode]);
+        first_mode = false;
+
+        bool first = true;
+        for (int cause = 0; cause < STATS_CAUSES; cause++) {
+            if (!traps[cause][mode])
+                continue;
+            if (names[cause])
+                fprintf(fp, "%s\"%s\":%lu", first ? "" : ",", names[cause],
+                        traps[cause][mode]);
+            else
+                fprintf(fp, "%s\"%d\":%lu", first ? "" : ",", cause,
+                        traps[cause][mode]);
+            first = false;
+        }
+        fputc('}', fp);
+    }
+    fputc('}', fp);
+}
+
+static void write_mmio(FILE *fp, const riscv_bus *bus)
+{
+    fputc('{', fp);
+    for (int dev = 0; dev < BUS_DEVICE_COUNT; dev++)
+        fprintf(fp, "%s\"%s\":{\"reads\":%lu,\"writes\":%lu}", dev ? "," : "",
+                device_names[dev], bus->mmio_reads[dev], bus->mmio_writes[dev]);
+    fputc('}', fp);
+}
+
+bool write_stats(const riscv_cpu *cpu, uint64_t instret, const char *filename)
+{
+    FILE *fp = fopen(filename, "a");
+    if (!fp) {
+        ERROR("Failed to open %s\n", filename);
+        return false;
+    }
+
+    const riscv_stats *stats = &cpu->stats;
+    const riscv_bus *bus = &cpu->bus;
+    fprintf(fp, "{\"instret\":%lu,\"pc\":%lu,\"mode\":\"%s\"", instret, cpu->pc,
+            mode_names[cpu->mode.mode & 0x3]);
+
+#ifdef ICACHE_CONFIG
+    const riscv_icache *icache = &cpu->icache;
+    fprintf(fp, ",\"icache\":{\"hits\":%lu,\"misses\":%lu,\"flushes\":%lu}",
+            icache->hits, icache->misses, icache->flushes);
+#endif
+    fprintf(fp, ",\"mmu\":{\"page_walks\":%lu,\"tlb_flushes\":%lu}",
+            stats->page_walks, stats->tlb_flushes);
+
+    fputs(",\"exceptions\":", fp);
+    write_traps(fp, stats->exceptions, exception_names);
+    fputs(",\"interrupts\":", fp);
+    write_traps(fp, stats->interrupts, interrupt_names);
+    fprintf(fp, ",\"plic_claims\":{\"uart\":%lu,\"virtio\":%lu}",
+            bus->plic.claimed[UART0_IRQ], bus->plic.claimed[VIRTIO_IRQ]);
+
+    fputs(",\"mmio\":", fp);
+    write_mmio(fp, bus);
+    fprintf(fp,
+            ",\"virtio_blk\":{\"requests\":%lu,\"read_bytes\":%lu,"
+            "\"write_bytes\":%lu}",
+            bus->virtio_blk.requests, bus->virtio_blk.read_bytes,
+            bus->virtio_blk.write_bytes);
+    fprintf(fp, ",\"uart\":{\"tx_bytes\":%lu,\"rx_bytes\":%lu}}\n",
+            bus->uart.tx_bytes, bus->uart.rx_bytes);
+
+    bool ok = !ferror(fp);
+    if (fclose(fp) != 0 || !ok) {
+        ERROR("Failed to write the statistics to %s\n", filename);
+        return false;
+    }
+    return true;
+}
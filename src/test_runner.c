@@ -0,0 +1,168 @@
+#include <glob.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "emu.h"
+#include "test_runner.h"
+
+typedef struct {
+    const char *file;
+    bool passed;
+    uint64_t instructions;
+    double seconds;
+} test_result;
+
+typedef struct {
+    test_result *results;
+    size_t count;
+    // the index of the next test to be taken by the workers
+    size_t next;
+    pthread_mutex_t lock;
+} test_queue;
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run_test(test_result *result)
+{
+    riscv_config config = {
+        .binary = result->file,
+    };
+
+    double start = now_seconds();
+    riscv_emu *emu = create_emu(&config);
+    if (emu) {
+        result->passed =
+            test_emu(emu, TEST_INSN_LIMIT, &result->instructions) == 0;
+        free_emu(emu);
+    }
+    result->seconds = now_seconds() - start;
+}
+
+static void *test_worker(void *arg)
+{
+    test_queue *queue = arg;
+
+    while (true) {
+        pthread_mutex_lock(&queue->lock);
+        size_t i = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if (i >= queue->count)
+            break;
+
+        test_result *result = &queue->results[i];
+        run_test(result);
+        ERROR("Run test: %s... %s\n", result->file,
+              result->passed ? "PASS" : "FAIL");
+    }
+    return NULL;
+}
+
+static void print_json_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            printf("\\%c", *s);
+        else if ((unsigned char) *s < 0x20)
+            printf("\\u%04x", *s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
+static int print_summary(const test_result *results,
+                         size_t count,
+                         double seconds)
+{
+    int failed = 0;
+    for (size_t i = 0; i < count; i++)
+        failed += !results[i].passed;
+
+    printf("{\"passed\": %lu, \"failed\": %d, \"seconds\": %.6f, \"tests\": [",
+           count - failed, failed, seconds);
+    for (size_t i = 0; i < count; i++) {
+        const test_result *r = &results[i];
+        double mips = r->seconds > 0 ? r->instructions / r->seconds / 1e6 : 0;
+
+        printf(i ? ",\n  {\"file\": " : "\n  {\"file\": ");
+        print_json_string(r->file);
+        printf(", \"result\": \"%s\", \"instructions\": %lu"
+               ", \"seconds\": %.6f, \"mips\": %.3f}",
+               r->passed ? "pass" : "fail", r->instructions, r->seconds, mips);
+    }
+    printf("\n]}\n");
+    return failed;
+}
+
+int run_tests(char *const patterns[], int count, int jobs)
+{
+    glob_t files;
+    for (int i = 0; i < count; i++) {
+        // a pattern which matches nothing is kept to be reported as failed
+        int flags = GLOB_NOCHECK | (i ? GLOB_APPEND : 0);
+        if (glob(patterns[i], flags, NULL, &files) != 0) {
+            ERROR("Failed to expand %s\n", patterns[i]);
+            if (i)
+                globfree(&files);
+            return -1;
+        }
+    }
+
+    test_queue queue = {
+        .results = calloc(files.gl_pathc, sizeof(test_result)),
+        .count = files.gl_pathc,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+    };
+    if (!queue.results) {
+        ERROR("Failed to allocate the results of tests\n");
+        globfree(&files);
+        return -1;
+    }
+    for (size_t i = 0; i < queue.count; i++)
+        queue.results[i].file = files.gl_pathv[i];
+
+    if (jobs <= 0)
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs <= 0)
+        jobs = 1;
+    if ((size_t) jobs > queue.count)
+        jobs = queue.count ? queue.count : 1;
+
+    pthread_t *threads = calloc(jobs, sizeof(pthread_t));
+    if (!threads) {
+        ERROR("Failed to allocate the threads of tests\n");
+        free(queue.results);
+        globfree(&files);
+        return -1;
+    }
+
+    double start = now_seconds();
+    int started = 0;
+    for (; started < jobs; started++) {
+        if (pthread_create(&threads[started], NULL, test_worker, &queue) != 0)
+            break;
+    }
+    // run in this thread if none of the workers is started
+    if (!started)
+        test_worker(&queue);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    int failed =
+        print_summary(queue.results, queue.count, now_seconds() - start);
+
+    free(threads);
+    free(queue.results);
+    globfree(&files);
+    return failed;
+}
@@ -0,0 +1,34 @@
+#include <time.h>
+
+#include "timebase.h"
+
+static uint64_t host_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+void init_timebase(riscv_timebase *tb, riscv_timebase_mode mode)
+{
+    tb->mode = mode;
+    tb->countdown = TIMEBASE_POLL;
+    tb->host_ns = host_ns();
+}
+
+uint64_t poll_timebase(riscv_timebase *tb)
+{
+    tb->countdown = TIMEBASE_POLL;
+    // the remainder less than a tick is counted by the next reading
+    uint64_t ticks = (host_ns() - tb->host_ns) / TIMEBASE_NSEC;
+    tb->host_ns += ticks * TIMEBASE_NSEC;
+    return ticks;
+}
+
+uint64_t wait_timebase(riscv_timebase *tb, uint64_t ticks)
+{
+    tb->countdown = 1;
+    if (ticks < TIMEBASE_MAX_WAIT / TIMEBASE_NSEC)
+        return ticks * TIMEBASE_NSEC;
+    return TIMEBASE_MAX_WAIT;
+}
@@ -0,0 +1,137 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tracer.h"
+
+static void *writer_thread(void *arg)
+{
+    riscv_tracer *tracer = arg;
+
+    pthread_mutex_lock(&tracer->lock);
+    while (true) {
+        trace_buffer *buf = &tracer->buffers[tracer->write];
+        while (!buf->full && !tracer->stop)
+            pthread_cond_wait(&tracer->cond, &tracer->lock);
+        // the full buffers are drained before it stops
+        if (!buf->full)
+            break;
+
+        pthread_mutex_unlock(&tracer->lock);
+        if (fwrite(buf->data, 1, buf->len, tracer->fp) != buf->len)
+            ERROR("Failed to write the trace\n");
+        pthread_mutex_lock(&tracer->lock);
+
+        buf->len = 0;
+        buf->full = false;
+        tracer->write = (tracer->write + 1) % TRACE_BUFFERS;
+        pthread_cond_broadcast(&tracer->cond);
+    }
+    pthread_mutex_unlock(&tracer->lock);
+    return NULL;
+}
+
+riscv_tracer *create_tracer(const char *filename)
+{
+    riscv_tracer *tracer = calloc(1, sizeof(riscv_tracer));
+    if (!tracer)
+        return NULL;
+
+    tracer->fp = fopen(filename, "wb");
+    if (!tracer->fp) {
+        ERROR("Failed to open %s\n", filename);
+        free(tracer);
+        return NULL;
+    }
+    fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), tracer->fp);
+
+    for (int i = 0; i < TRACE_BUFFERS; i++) {
+        tracer->buffers[i].data = malloc(TRACE_BUFFER_SIZE);
+        if (!tracer->buffers[i].data)
+            goto fail;
+    }
+
+    pthread_mutex_init(&tracer->lock, NULL);
+    pthread_cond_init(&tracer->cond, NULL);
+    if (pthread_create(&tracer->writer, NULL, writer_thread, tracer)) {
+        ERROR("Failed to create the writer of trace\n");
+        pthread_mutex_destroy(&tracer->lock);
+        pthread_cond_destroy(&tracer->cond);
+        goto fail;
+    }
+    return tracer;
+
+fail:
+    for (int i = 0; i < TRACE_BUFFERS; i++)
+        free(tracer->buffers[i].data);
+    fclose(tracer->fp);
+    free(tracer);
+    return NULL;
+}
+
+void trace_switch(riscv_tracer *tracer)
+{
+    pthread_mutex_lock(&tracer->lock);
+    tracer->buffers[tracer->fill].full = true;
+    pthread_cond_broadcast(&tracer->cond);
+
+    tracer->fill = (tracer->fill + 1) % TRACE_BUFFERS;
+    // wait for the writer when all of the buffers are full
+    while (tracer->buffers[tracer->fill].full)
+        pthread_cond_wait(&tracer->cond, &tracer->lock);
+    pthread_mutex_unlock(&tracer->lock);
+}
+
+void free_tracer(riscv_tracer *tracer)
+{
+    if (!tracer)
+        return;
+
+    pthread_mutex_lock(&tracer->lock);
+    if (tracer->buffers[tracer->fill].len)
+        tracer->buffers[tracer->fill].full = true;
+    tracer->stop = true;
+    pthread_cond_broadcast(&tracer->cond);
+    pthread_mutex_unlock(&tracer->lock);
+    pthread_join(tracer->writer, NULL);
+
+    pthread_mutex_destroy(&tracer->lock);
+    pthread_cond_destroy(&tracer->cond);
+    for (int i = 0; i < TRACE_BUFFERS; i++)
+        free(tracer->buffers[i].data);
+    fclose(tracer->fp);
+    free(tracer);
+}
+
+void flush_tracer(riscv_tracer *tracer)
+{
+    pthread_mutex_lock(&tracer->lock);
+    if (tracer->buffers[tracer->fill].len) {
+        tracer->buffers[tracer->fill].full = true;
+        tracer->fill = (tracer->fill + 1) % TRACE_BUFFERS;
+        pthread_cond_broadcast(&tracer->cond);
+    }
+    for (int i = 0; i < TRACE_BUFFERS; i++) {
+        while (tracer->buffers[i].full)
+            pthread_cond_wait(&tracer->cond, &tracer->lock);
+    }
+    // the writer is waiting for the next buffer, so it doesn't use the file
+    fflush(tracer->fp);
+    pthread_mutex_unlock(&tracer->lock);
+}
+
+void drop_tracer(riscv_tracer *tracer)
+{
+    if (!tracer)
+        return;
+
+    /* The FILE and the buffers are the copies of the parent, which are left
+     * as they are. Its fd is pointed to /dev/null instead of being closed, so
+     * whatever is flushed at exit goes nowhere even if the fd is reused. */
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) {
+        dup2(null, fileno(tracer->fp));
+        close(null);
+    }
+}
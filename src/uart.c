@@ -5,6 +5,7 @@
 #include <signal.h>
 #include <string.h>
 #include <sys/select.h>
+#include <time.h>
 #include <unistd.h>
 
 #define uart_reg(uart, addr) uart->reg[addr - UART_BASE]
@@ -20,21 +21,35 @@
 /* FIXME: Several pthread_* function is not completely doing
  * the error handling, we should take care of this. */
 
-/* global variable to stop the infinite loop of thread, has data race */
-volatile int thread_stop = 0;
+// put the character into the receive register, with the lock held
+static void receive(riscv_uart *uart, uint8_t c)
+{
+    uart_reg(uart, UART_RHR) = c;
+
+    __atomic_store_n(&uart->is_interrupt, true, __ATOMIC_SEQ_CST);
+
+    uart_reg(uart, UART_LSR) |= UART_LSR_RX;
+}
+
+// the thread waits until the guest, or the emulator if deferred, takes input
+static bool input_full(riscv_uart *uart)
+{
+    if (uart->deferred)
+        return uart->has_input;
+    return uart_reg(uart, UART_LSR) & UART_LSR_RX;
+}
 
 static void thread(riscv_uart *uart)
 {
     int infd = STDIN_FILENO;
     fd_set readfds;
 
-    struct timeval timeout;
-    timeout.tv_sec = 1;
-    timeout.tv_usec = 0;
-
-    while (!__atomic_load_n(&thread_stop, __ATOMIC_SEQ_CST)) {
+    while (!__atomic_load_n(&uart->thread_stop, __ATOMIC_SEQ_CST)) {
         FD_ZERO(&readfds);
         FD_SET(infd, &readfds);
+        /* select updates the timeout with the time left on Linux, so it is
+         * reset each time, otherwise the thread spins after it expires */
+        struct timeval timeout = {.tv_sec = 1, .tv_usec = 0};
 
         int result = select(infd + 1, &readfds, NULL, NULL, &timeout);
 
@@ -48,37 +63,73 @@ static void thread(riscv_uart *uart)
         int ret = read(infd, &c, 1);
         if (ret == -1)
             continue;
+        /* No more input after EOF. Stop here, otherwise the thread would wait
+         * for the guest to take a character that doesn't exist and never see
+         * uart->thread_stop. */
+        if (ret == 0)
+            break;
 
         pthread_mutex_lock(&uart->lock);
 
-        while ((uart_reg(uart, UART_LSR) & UART_LSR_RX) == 1) {
+        while (input_full(uart) &&
+               !__atomic_load_n(&uart->thread_stop, __ATOMIC_SEQ_CST)) {
             pthread_cond_wait(&uart->cond, &uart->lock);
         }
-        uart_reg(uart, UART_RHR) = c;
-
-        __atomic_store_n(&uart->is_interrupt, true, __ATOMIC_SEQ_CST);
-
-        uart_reg(uart, UART_LSR) |= UART_LSR_RX;
+        if (__atomic_load_n(&uart->thread_stop, __ATOMIC_SEQ_CST)) {
+            pthread_mutex_unlock(&uart->lock);
+            break;
+        }
+        if (uart->deferred) {
+            uart->input = c;
+            __atomic_store_n(&uart->has_input, true, __ATOMIC_RELEASE);
+        } else {
+            receive(uart, c);
+        }
+        // wake up the emulator waiting in WFI
+        pthread_cond_broadcast(&uart->cond);
 
         pthread_mutex_unlock(&uart->lock);
     }
 }
 
-bool init_uart(riscv_uart *uart)
+bool init_uart(riscv_uart *uart,
+               bool console,
+               bool deferred,
+               const riscv_callbacks *callbacks)
 {
     memset(&uart->reg[0], 0, UART_SIZE * sizeof(uint8_t));
     uart->is_interrupt = false;
+    uart->deferred = deferred;
+    uart->has_input = false;
+    uart->tx_bytes = 0;
+    uart->rx_bytes = 0;
     // transmitter hold register is empty at first
     uart_reg(uart, UART_LSR) |= UART_LSR_TX;
 
-    thread_stop = 0;
-
     if (pthread_mutex_init(&uart->lock, NULL))
         return false;
 
-    if (pthread_cond_init(&uart->cond, NULL))
+    // the timeout of wait_uart is given by the monotonic clock
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int err = pthread_cond_init(&uart->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (err)
         return false;
 
+    uart->callbacks = callbacks;
+    uart->console = console;
+    return start_uart(uart);
+}
+
+bool start_uart(riscv_uart *uart)
+{
+    if (!uart->console)
+        return true;
+
+    uart->thread_stop = 0;
+
     // create a thread for waiting input
     pthread_t tid;
     if (pthread_create(&tid, NULL, (void *) thread, (void *) uart)) {
@@ -90,6 +141,19 @@ bool init_uart(riscv_uart *uart)
     return true;
 }
 
+void stop_uart(riscv_uart *uart)
+{
+    if (!uart->console)
+        return;
+
+    __atomic_store_n(&uart->thread_stop, 1, __ATOMIC_SEQ_CST);
+    // wake up the thread if it is waiting for the guest to take the input
+    pthread_mutex_lock(&uart->lock);
+    pthread_cond_broadcast(&uart->cond);
+    pthread_mutex_unlock(&uart->lock);
+    pthread_join(uart->child_tid, NULL);
+}
+
 uint64_t read_uart(riscv_uart *uart,
                    uint64_t addr,
                    uint8_t size,
@@ -106,6 +170,8 @@ uint64_t read_uart(riscv_uart *uart,
     switch (addr) {
     case UART_RHR:
         ret_value = uart_reg(uart, addr);
+        if (uart_reg(uart, UART_LSR) & UART_LSR_RX)
+            uart->rx_bytes++;
         // no data in receive holding register after reading
         uart_reg(uart, UART_LSR) &= ~UART_LSR_RX;
         // thus the next input can come in
@@ -137,8 +203,14 @@ bool write_uart(riscv_uart *uart,
         /* Note: The case UART_LSR_TX == 0 isn't emulated. It means that our
          * emulated UART doesn't drop the character.
          */
-        printf("%c", (char) (value & 0xff));
-        fflush(stdout);
+        uart->tx_bytes++;
+        if (uart->callbacks->uart_tx) {
+            uart->callbacks->uart_tx(uart->callbacks->opaque,
+                                     (char) (value & 0xff));
+        } else {
+            printf("%c", (char) (value & 0xff));
+            fflush(stdout);
+        }
         break;
     case UART_IER:
         if ((value & UART_IER_THR_EMPTY_INT) != 0) {
@@ -161,6 +233,51 @@ bool write_uart(riscv_uart *uart,
     return true;
 }
 
+int uart_take_input(riscv_uart *uart)
+{
+    if (!__atomic_load_n(&uart->has_input, __ATOMIC_ACQUIRE))
+        return -1;
+
+    int c = -1;
+    pthread_mutex_lock(&uart->lock);
+    if (!(uart_reg(uart, UART_LSR) & UART_LSR_RX)) {
+        c = uart->input;
+        receive(uart, c);
+        uart->has_input = false;
+        pthread_cond_broadcast(&uart->cond);
+    }
+    pthread_mutex_unlock(&uart->lock);
+    return c;
+}
+
+bool uart_receive(riscv_uart *uart, uint8_t c)
+{
+    pthread_mutex_lock(&uart->lock);
+    bool empty = !(uart_reg(uart, UART_LSR) & UART_LSR_RX);
+    if (empty)
+        receive(uart, c);
+    pthread_mutex_unlock(&uart->lock);
+    return empty;
+}
+
+void wait_uart(riscv_uart *uart, uint64_t ns)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += (ts.tv_nsec + ns) / 1000000000;
+    ts.tv_nsec = (ts.tv_nsec + ns) % 1000000000;
+
+    pthread_mutex_lock(&uart->lock);
+    // the input which isn't seen by the emulator yet
+    while (!__atomic_load_n(&uart->is_interrupt, __ATOMIC_SEQ_CST) &&
+           !uart->has_input) {
+        if (pthread_cond_timedwait(&uart->cond, &uart->lock, &ts) ==
+            ETIMEDOUT)
+            break;
+    }
+    pthread_mutex_unlock(&uart->lock);
+}
+
 bool uart_is_interrupt(riscv_uart *uart)
 {
     return __atomic_exchange_n(&uart->is_interrupt, false, __ATOMIC_SEQ_CST);
@@ -168,8 +285,7 @@ bool uart_is_interrupt(riscv_uart *uart)
 
 void free_uart(riscv_uart *uart)
 {
-    __atomic_store_n(&thread_stop, 1, __ATOMIC_SEQ_CST);
-    pthread_join(uart->child_tid, NULL);
+    stop_uart(uart);
     pthread_mutex_destroy(&uart->lock);
     pthread_cond_destroy(&uart->cond);
 }
@@ -0,0 +1,837 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "user.h"
+
+/* The syscalls are numbered by the generic table of Linux, which is shared by
+ * RV64. The structures passed to the syscalls are the same as the ones of the
+ * 64-bit host, except struct stat which is converted. */
+#define SYS_GETCWD 17
+#define SYS_IOCTL 29
+#define SYS_MKDIRAT 34
+#define SYS_UNLINKAT 35
+#define SYS_FACCESSAT 48
+#define SYS_OPENAT 56
+#define SYS_CLOSE 57
+#define SYS_LSEEK 62
+#define SYS_READ 63
+#define SYS_WRITE 64
+#define SYS_READV 65
+#define SYS_WRITEV 66
+#define SYS_PREAD64 67
+#define SYS_PWRITE64 68
+#define SYS_READLINKAT 78
+#define SYS_NEWFSTATAT 79
+#define SYS_FSTAT 80
+#define SYS_EXIT 93
+#define SYS_EXIT_GROUP 94
+#define SYS_SET_TID_ADDRESS 96
+#define SYS_FUTEX 98
+#define SYS_SET_ROBUST_LIST 99
+#define SYS_NANOSLEEP 101
+#define SYS_CLOCK_GETTIME 113
+#define SYS_CLOCK_GETRES 114
+#define SYS_SCHED_YIELD 124
+#define SYS_SIGALTSTACK 132
+#define SYS_RT_SIGACTION 134
+#define SYS_RT_SIGPROCMASK 135
+#define SYS_UNAME 160
+#define SYS_GETRLIMIT 163
+#define SYS_GETTIMEOFDAY 169
+#define SYS_GETPID 172
+#define SYS_GETPPID 173
+#define SYS_GETUID 174
+#define SYS_GETEUID 175
+#define SYS_GETGID 176
+#define SYS_GETEGID 177
+#define SYS_GETTID 178
+#define SYS_BRK 214
+#define SYS_MUNMAP 215
+#define SYS_MMAP 222
+#define SYS_MPROTECT 226
+#define SYS_MADVISE 233
+#define SYS_PRLIMIT64 261
+#define SYS_GETRANDOM 278
+
+// the flags of openat and mmap in the generic ABI
+#define USER_O_ACCMODE 03
+#define USER_O_CREAT 0100
+#define USER_O_EXCL 0200
+#define USER_O_NOCTTY 0400
+#define USER_O_TRUNC 01000
+#define USER_O_APPEND 02000
+#define USER_O_NONBLOCK 04000
+#define USER_O_DIRECTORY 0200000
+#define USER_O_NOFOLLOW 0400000
+#define USER_O_CLOEXEC 02000000
+#define USER_RLIMIT_STACK 3
+#define USER_MAP_FIXED 0x10
+#define USER_MAP_ANONYMOUS 0x20
+
+// the initial state of vector in mstatus
+#define MSTATUS_VS_INITIAL 0x200UL
+
+#define USER_PAGE_SIZE 4096UL
+#define PAGE_ROUND_UP(x) (((x) + USER_PAGE_SIZE - 1) & ~(USER_PAGE_SIZE - 1))
+
+// the auxiliary vector passed on the stack
+#define AT_NULL 0
+#define AT_PHDR 3
+#define AT_PHENT 4
+#define AT_PHNUM 5
+#define AT_PAGESZ 6
+#define AT_BASE 7
+#define AT_ENTRY 9
+#define AT_UID 11
+#define AT_EUID 12
+#define AT_GID 13
+#define AT_EGID 14
+#define AT_HWCAP 16
+#define AT_CLKTCK 17
+#define AT_SECURE 23
+#define AT_RANDOM 25
+#define AT_EXECFN 31
+
+// the extensions in AT_HWCAP, one bit for each letter, which are rv64imacv
+#define HWCAP(c) (1UL << ((c) - 'A'))
+#define USER_HWCAP \
+    (HWCAP('I') | HWCAP('M') | HWCAP('A') | HWCAP('C') | HWCAP('V'))
+
+// struct stat of the generic ABI
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    uint32_t mode;
+    uint32_t nlink;
+    uint32_t uid;
+    uint32_t gid;
+    uint64_t rdev;
+    uint64_t pad1;
+    int64_t size;
+    int32_t blksize;
+    int32_t pad2;
+    int64_t blocks;
+    int64_t atime;
+    uint64_t atime_nsec;
+    int64_t mtime;
+    uint64_t mtime_nsec;
+    int64_t ctime;
+    uint64_t ctime_nsec;
+    uint32_t unused[2];
+} user_stat;
+
+// the utsname reported to the program
+#define UTS_LEN 65
+static const char *const uts_fields[] = {
+    "Linux", "riscv-emulator", "6.1.0", "#1", "riscv64", "(none)",
+};
+
+/* Return the host address of the range in the address space of the program, or
+ * NULL if it is out of the address space. */
+static uint8_t *user_ptr(riscv_cpu *cpu, uint64_t addr, uint64_t len)
+{
+    if (addr > USER_SIZE || len > USER_SIZE - addr)
+        return NULL;
+    return cpu->bus.memory.mem + addr;
+}
+
+// the range is written by the host
+static void user_wrote(riscv_cpu *cpu, uint64_t addr, uint64_t len)
+{
+    mark_dirty(cpu->bus.memory.dirty, addr, len);
+#ifdef ICACHE_CONFIG
+    invalid_icache(&cpu->icache);
+#endif
+}
+
+static const char *user_str(riscv_cpu *cpu, uint64_t addr)
+{
+    const char *s = (const char *) user_ptr(cpu, addr, 1);
+    if (!s || !memchr(s, '\0', USER_SIZE - addr))
+        return NULL;
+    return s;
+}
+
+static uint64_t host_ret(long ret)
+{
+    return ret < 0 ? (uint64_t) -errno : (uint64_t) ret;
+}
+
+// the host fd of the fd of the program, or -1 if it isn't open
+static int host_fd(riscv_cpu *cpu, uint64_t fd)
+{
+    return fd < USER_FD_MAX ? cpu->user.fds[fd] : -1;
+}
+
+/* The host fd of the directory given to the *at syscalls. A closed one is -1,
+ * which fails with EBADF for a relative path as Linux does. */
+static int host_dirfd(riscv_cpu *cpu, uint64_t dirfd)
+{
+    return (int) dirfd == AT_FDCWD ? AT_FDCWD : host_fd(cpu, dirfd);
+}
+
+static int host_open_flags(uint64_t flags)
+{
+    static const struct {
+        uint64_t user;
+        int host;
+    } map[] = {
+        {USER_O_CREAT, O_CREAT},         {USER_O_EXCL, O_EXCL},
+        {USER_O_NOCTTY, O_NOCTTY},       {USER_O_TRUNC, O_TRUNC},
+        {USER_O_APPEND, O_APPEND},       {USER_O_NONBLOCK, O_NONBLOCK},
+        {USER_O_DIRECTORY, O_DIRECTORY}, {USER_O_NOFOLLOW, O_NOFOLLOW},
+        {USER_O_CLOEXEC, O_CLOEXEC},
+    };
+
+    int host = flags & USER_O_ACCMODE;
+    for (size_t i = 0; i < sizeof(map) / sizeof(map[0]); i++) {
+        if (flags & map[i].user)
+            host |= map[i].host;
+    }
+    return host;
+}
+
+static uint64_t user_openat(riscv_cpu *cpu,
+                            uint64_t dirfd,
+                            uint64_t path,
+                            uint64_t flags,
+                            uint64_t mode)
+{
+    const char *p = user_str(cpu, path);
+    if (!p)
+        return -EFAULT;
+
+    // the lowest fd which isn't open, as Linux gives
+    uint64_t fd = 0;
+    while (fd < USER_FD_MAX && cpu->user.fds[fd] >= 0)
+        fd++;
+    if (fd == USER_FD_MAX)
+        return -EMFILE;
+
+    int ret = openat(host_dirfd(cpu, dirfd), p, host_open_flags(flags), mode);
+    if (ret < 0)
+        return -errno;
+    cpu->user.fds[fd] = ret;
+    return fd;
+}
+
+static uint64_t user_close(riscv_cpu *cpu, uint64_t fd)
+{
+    int hfd = host_fd(cpu, fd);
+    if (hfd < 0)
+        return -EBADF;
+
+    cpu->user.fds[fd] = -1;
+    // the standard streams are shared with the emulator
+    return hfd <= STDERR_FILENO ? 0 : host_ret(close(hfd));
+}
+
+static uint64_t user_copy_stat(riscv_cpu *cpu, uint64_t addr, struct stat *st)
+{
+    user_stat *out = (user_stat *) user_ptr(cpu, addr, sizeof(user_stat));
+    if (!out)
+        return -EFAULT;
+
+    memset(out, 0, sizeof(user_stat));
+    out->dev = st->st_dev;
+    out->ino = st->st_ino;
+    out->mode = st->st_mode;
+    out->nlink = st->st_nlink;
+    out->uid = st->st_uid;
+    out->gid = st->st_gid;
+    out->rdev = st->st_rdev;
+    out->size = st->st_size;
+    out->blksize = st->st_blksize;
+    out->blocks = st->st_blocks;
+    out->atime = st->st_atim.tv_sec;
+    out->atime_nsec = st->st_atim.tv_nsec;
+    out->mtime = st->st_mtim.tv_sec;
+    out->mtime_nsec = st->st_mtim.tv_nsec;
+    out->ctime = st->st_ctim.tv_sec;
+    out->ctime_nsec = st->st_ctim.tv_nsec;
+    user_wrote(cpu, addr, sizeof(user_stat));
+    return 0;
+}
+
+static uint64_t user_rw(riscv_cpu *cpu,
+                        bool is_write,
+                        uint64_t fd,
+                        uint64_t buf,
+                        uint64_t len,
+                        int64_t offset)
+{
+    int hfd = host_fd(cpu, fd);
+    if (hfd < 0)
+        return -EBADF;
+    uint8_t *p = user_ptr(cpu, buf, len);
+    if (!p)
+        return -EFAULT;
+
+    long ret;
+    if (is_write)
+        ret = offset < 0 ? write(hfd, p, len) : pwrite(hfd, p, len, offset);
+    else
+        ret = offset < 0 ? read(hfd, p, len) : pread(hfd, p, len, offset);
+    if (!is_write && ret > 0)
+        user_wrote(cpu, buf, ret);
+    return host_ret(ret);
+}
+
+#define USER_IOV_MAX 1024
+
+static uint64_t user_rwv(riscv_cpu *cpu,
+                         bool is_write,
+                         uint64_t fd,
+                         uint64_t iov,
+                         uint64_t count)
+{
+    int hfd = host_fd(cpu, fd);
+    if (hfd < 0)
+        return -EBADF;
+    if (count > USER_IOV_MAX)
+        return -EINVAL;
+
+    const uint64_t *user_iov = (uint64_t *) user_ptr(cpu, iov, count * 16);
+    if (!user_iov)
+        return -EFAULT;
+
+    struct iovec host_iov[USER_IOV_MAX];
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t base = user_iov[i * 2], len = user_iov[i * 2 + 1];
+        host_iov[i].iov_base = user_ptr(cpu, base, len);
+        host_iov[i].iov_len = len;
+        if (!host_iov[i].iov_base)
+            return -EFAULT;
+    }
+
+    long ret =
+        is_write ? writev(hfd, host_iov, count) : readv(hfd, host_iov, count);
+    for (uint64_t i = 0; !is_write && i < count; i++)
+        user_wrote(cpu, user_iov[i * 2], user_iov[i * 2 + 1]);
+    return host_ret(ret);
+}
+
+static uint64_t user_brk(riscv_cpu *cpu, uint64_t addr)
+{
+    riscv_user *user = &cpu->user;
+    if (addr < user->brk_start || addr > user->mmap_top)
+        return user->brk;
+
+    // the released space should be zero when it is used again
+    if (addr < user->brk) {
+        memset(cpu->bus.memory.mem + addr, 0, user->brk - addr);
+        user_wrote(cpu, addr, user->brk - addr);
+    }
+    user->brk = addr;
+    return addr;
+}
+
+static uint64_t user_mmap(riscv_cpu *cpu,
+                          uint64_t addr,
+                          uint64_t len,
+                          uint64_t flags,
+                          uint64_t fd,
+                          uint64_t offset)
+{
+    riscv_user *user = &cpu->user;
+    if (!len)
+        return -EINVAL;
+    int hfd = -1;
+    if (!(flags & USER_MAP_ANONYMOUS) && (hfd = host_fd(cpu, fd)) < 0)
+        return -EBADF;
+    // the length which is rounded up past UINT64_MAX
+    if (len > UINT64_MAX - (USER_PAGE_SIZE - 1))
+        return -ENOMEM;
+    len = PAGE_ROUND_UP(len);
+
+    if (flags & USER_MAP_FIXED) {
+        if ((addr & (USER_PAGE_SIZE - 1)) || !user_ptr(cpu, addr, len))
+            return -EINVAL;
+        memset(cpu->bus.memory.mem + addr, 0, len);
+        // keep the space below mmap_top unused
+        if (addr < user->mmap_top && addr >= user->brk)
+            user->mmap_top = addr;
+    } else {
+        if (len > user->mmap_top - user->brk)
+            return -ENOMEM;
+        user->mmap_top -= len;
+        addr = user->mmap_top;
+    }
+    user_wrote(cpu, addr, len);
+
+    // the file is mapped privately by copying its contents
+    if (!(flags & USER_MAP_ANONYMOUS)) {
+        long ret = pread(hfd, cpu->bus.memory.mem + addr, len, offset);
+        if (ret < 0)
+            return -errno;
+    }
+    return addr;
+}
+
+static uint64_t user_readlinkat(riscv_cpu *cpu,
+                                uint64_t dirfd,
+                                uint64_t path,
+                                uint64_t buf,
+                                uint64_t len)
+{
+    const char *p = user_str(cpu, path);
+    char *out = (char *) user_ptr(cpu, buf, len);
+    if (!p || !out)
+        return -EFAULT;
+
+    // the program itself instead of the emulator
+    if (!strcmp(p, "/proc/self/exe")) {
+        char resolved[PATH_MAX];
+        const char *exe = realpath(cpu->user.exe, resolved) ? resolved
+                                                            : cpu->user.exe;
+        size_t n = strlen(exe) < len ? strlen(exe) : len;
+        memcpy(out, exe, n);
+        user_wrote(cpu, buf, n);
+        return n;
+    }
+
+    long ret = readlinkat(host_dirfd(cpu, dirfd), p, out, len);
+    if (ret > 0)
+        user_wrote(cpu, buf, ret);
+    return host_ret(ret);
+}
+
+static uint64_t user_rlimit(riscv_cpu *cpu, uint64_t resource, uint64_t addr)
+{
+    uint64_t *limit = (uint64_t *) user_ptr(cpu, addr, 16);
+    if (!limit)
+        return -EFAULT;
+
+    // only the stack is limited by the address space
+    limit[0] = limit[1] =
+        resource == USER_RLIMIT_STACK ? USER_STACK_SIZE : (uint64_t) -1;
+    user_wrote(cpu, addr, 16);
+    return 0;
+}
+
+static uint64_t user_write_struct(riscv_cpu *cpu,
+                                  uint64_t addr,
+                                  const void *data,
+                                  uint64_t len)
+{
+    uint8_t *p = user_ptr(cpu, addr, len);
+    if (!p)
+        return -EFAULT;
+    memcpy(p, data, len);
+    user_wrote(cpu, addr, len);
+    return 0;
+}
+
+void user_ecall(riscv_cpu *cpu)
+{
+    uint64_t *a = &cpu->xreg[10];
+    uint64_t nr = cpu->xreg[17];
+    uint64_t ret = 0;
+
+    switch (nr) {
+    case SYS_READ:
+        ret = user_rw(cpu, false, a[0], a[1], a[2], -1);
+        break;
+    case SYS_WRITE:
+        ret = user_rw(cpu, true, a[0], a[1], a[2], -1);
+        break;
+    case SYS_PREAD64:
+        ret = user_rw(cpu, false, a[0], a[1], a[2], a[3]);
+        break;
+    case SYS_PWRITE64:
+        ret = user_rw(cpu, true, a[0], a[1], a[2], a[3]);
+        break;
+    case SYS_READV:
+        ret = user_rwv(cpu, false, a[0], a[1], a[2]);
+        break;
+    case SYS_WRITEV:
+        ret = user_rwv(cpu, true, a[0], a[1], a[2]);
+        break;
+    case SYS_OPENAT:
+        ret = user_openat(cpu, a[0], a[1], a[2], a[3]);
+        break;
+    case SYS_CLOSE:
+        ret = user_close(cpu, a[0]);
+        break;
+    case SYS_LSEEK:
+        ret = host_ret(lseek(host_fd(cpu, a[0]), a[1], a[2]));
+        break;
+    case SYS_FSTAT: {
+        struct stat st;
+        ret = fstat(host_fd(cpu, a[0]), &st) < 0
+                  ? (uint64_t) -errno
+                  : user_copy_stat(cpu, a[1], &st);
+        break;
+    }
+    case SYS_NEWFSTATAT: {
+        const char *path = user_str(cpu, a[1]);
+        struct stat st;
+        if (!path)
+            ret = -EFAULT;
+        else if (fstatat(host_dirfd(cpu, a[0]), path, &st, a[3]) < 0)
+            ret = -errno;
+        else
+            ret = user_copy_stat(cpu, a[2], &st);
+        break;
+    }
+    case SYS_READLINKAT:
+        ret = user_readlinkat(cpu, a[0], a[1], a[2], a[3]);
+        break;
+    case SYS_FACCESSAT: {
+        const char *path = user_str(cpu, a[1]);
+        ret = path ? host_ret(faccessat(host_dirfd(cpu, a[0]), path, a[2], 0))
+                   : (uint64_t) -EFAULT;
+        break;
+    }
+    case SYS_MKDIRAT: {
+        const char *path = user_str(cpu, a[1]);
+        ret = path ? host_ret(mkdirat(host_dirfd(cpu, a[0]), path, a[2]))
+                   : (uint64_t) -EFAULT;
+        break;
+    }
+    case SYS_UNLINKAT: {
+        const char *path = user_str(cpu, a[1]);
+        ret = path ? host_ret(unlinkat(host_dirfd(cpu, a[0]), path, a[2]))
+                   : (uint64_t) -EFAULT;
+        break;
+    }
+    case SYS_GETCWD: {
+        char *buf = (char *) user_ptr(cpu, a[0], a[1]);
+        if (!buf)
+            ret = -EFAULT;
+        else if (!getcwd(buf, a[1]))
+            ret = -errno;
+        else {
+            ret = strlen(buf) + 1;
+            user_wrote(cpu, a[0], ret);
+        }
+        break;
+    }
+    case SYS_IOCTL:
+        // none of the files is a terminal to the program
+        ret = host_fd(cpu, a[0]) < 0 ? (uint64_t) -EBADF : (uint64_t) -ENOTTY;
+        break;
+    case SYS_EXIT:
+    case SYS_EXIT_GROUP:
+        cpu->user.exited = true;
+        cpu->user.exit_code = a[0] & 0xff;
+        return;
+    case SYS_BRK:
+        ret = user_brk(cpu, a[0]);
+        break;
+    case SYS_MMAP:
+        ret = user_mmap(cpu, a[0], a[1], a[3], a[4], a[5]);
+        break;
+    case SYS_MUNMAP:
+    case SYS_MPROTECT:
+    case SYS_MADVISE:
+        // the space is never reused, and everything is accessible
+        ret = 0;
+        break;
+    case SYS_CLOCK_GETTIME:
+    case SYS_CLOCK_GETRES: {
+        struct timespec ts;
+        int r = nr == SYS_CLOCK_GETTIME ? clock_gettime(a[0], &ts)
+                                        : clock_getres(a[0], &ts);
+        if (r < 0)
+            ret = -errno;
+        else if (a[1])
+            ret = user_write_struct(cpu, a[1], &ts, sizeof(ts));
+        break;
+    }
+    case SYS_GETTIMEOFDAY: {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        if (a[0])
+            ret = user_write_struct(cpu, a[0], &tv, sizeof(tv));
+        break;
+    }
+    case SYS_NANOSLEEP: {
+        const struct timespec *ts =
+            (struct timespec *) user_ptr(cpu, a[0], sizeof(struct timespec));
+        ret = ts ? host_ret(nanosleep(ts, NULL)) : (uint64_t) -EFAULT;
+        break;
+    }
+    case SYS_UNAME: {
+        char *buf = (char *) user_ptr(cpu, a[0], UTS_LEN * 6);
+        if (!buf) {
+            ret = -EFAULT;
+            break;
+        }
+        memset(buf, 0, UTS_LEN * 6);
+        for (int i = 0; i < 6; i++)
+            strcpy(buf + i * UTS_LEN, uts_fields[i]);
+        user_wrote(cpu, a[0], UTS_LEN * 6);
+        break;
+    }
+    case SYS_GETRLIMIT:
+        ret = user_rlimit(cpu, a[0], a[1]);
+        break;
+    case SYS_PRLIMIT64:
+        if (a[3])
+            ret = user_rlimit(cpu, a[1], a[3]);
+        break;
+    case SYS_GETRANDOM: {
+        uint8_t *buf = user_ptr(cpu, a[0], a[1]);
+        ret = buf ? host_ret(getrandom(buf, a[1], a[2])) : (uint64_t) -EFAULT;
+        if (buf)
+            user_wrote(cpu, a[0], a[1]);
+        break;
+    }
+    case SYS_GETPID:
+    case SYS_GETTID:
+    case SYS_SET_TID_ADDRESS:
+        ret = getpid();
+        break;
+    case SYS_GETPPID:
+        ret = getppid();
+        break;
+    case SYS_GETUID:
+        ret = getuid();
+        break;
+    case SYS_GETEUID:
+        ret = geteuid();
+        break;
+    case SYS_GETGID:
+        ret = getgid();
+        break;
+    case SYS_GETEGID:
+        ret = getegid();
+        break;
+    case SYS_FUTEX:
+    case SYS_SET_ROBUST_LIST:
+    case SYS_SCHED_YIELD:
+    case SYS_SIGALTSTACK:
+    case SYS_RT_SIGACTION:
+    case SYS_RT_SIGPROCMASK:
+        // there is only one thread, and no signal is delivered
+        ret = 0;
+        break;
+    default:
+        LOG_DEBUG(cpu->logger, "[DEBUG] unsupported syscall %lu\n", nr);
+        ret = -ENOSYS;
+        break;
+    }
+
+    a[0] = ret;
+}
+
+static bool load_program(riscv_cpu *cpu,
+                         const char *filename,
+                         uint64_t *entry,
+                         uint64_t *phdr,
+                         uint64_t *phnum)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        ERROR("Invalid binary path.\n");
+        return false;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size_t sz = ftell(fp);
+    rewind(fp);
+
+    uint8_t *buf = malloc(sz);
+    if (!buf || fread(buf, 1, sz, fp) != sz) {
+        ERROR("Error when reading %s\n", filename);
+        free(buf);
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+
+    elf_t elf;
+    Elf64_Ehdr *ehdr = (Elf64_Ehdr *) buf;
+    if (sz < sizeof(Elf64_Ehdr) || elf_init(&elf, buf, sz) != 0 ||
+        ehdr->e_machine != EM_RISCV || ehdr->e_ident[EI_CLASS] != ELFCLASS64) {
+        ERROR("%s is not a RV64 ELF\n", filename);
+        free(buf);
+        return false;
+    }
+
+    Elf64_Phdr *ph;
+    phdr_iter_t it;
+    elf_phdr_iter_start(&it, PT_INTERP);
+    if (elf_phdr_iter_next(&elf, &it, &ph) == 0) {
+        ERROR("%s is dynamically linked, which isn't supported\n", filename);
+        goto fail;
+    }
+
+    uint64_t bias = ehdr->e_type == ET_DYN ? USER_PIE_BASE : 0;
+    uint64_t end = 0;
+    *phdr = 0;
+    elf_phdr_iter_start(&it, PT_LOAD);
+    while (elf_phdr_iter_next(&elf, &it, &ph) == 0) {
+        uint64_t vaddr = ph->p_vaddr + bias;
+        if (ph->p_filesz > ph->p_memsz || ph->p_offset + ph->p_filesz > sz ||
+            !user_ptr(cpu, vaddr, ph->p_memsz) ||
+            vaddr + ph->p_memsz > USER_SIZE - USER_STACK_SIZE) {
+            ERROR("The segment at 0x%lx doesn't fit the address space\n",
+                  vaddr);
+            goto fail;
+        }
+        memcpy(cpu->bus.memory.mem + vaddr, buf + ph->p_offset, ph->p_filesz);
+
+        // the program headers are loaded with the first segment
+        if (ehdr->e_phoff >= ph->p_offset &&
+            ehdr->e_phoff < ph->p_offset + ph->p_filesz)
+            *phdr = vaddr + ehdr->e_phoff - ph->p_offset;
+        if (vaddr + ph->p_memsz > end)
+            end = vaddr + ph->p_memsz;
+    }
+
+    *entry = ehdr->e_entry + bias;
+    *phnum = ehdr->e_phnum;
+    cpu->user.brk_start = cpu->user.brk = PAGE_ROUND_UP(end);
+    elf_close(&elf);
+    free(buf);
+    return true;
+
+fail:
+    elf_close(&elf);
+    free(buf);
+    return false;
+}
+
+// push the data onto the stack, which returns 0 if it overflows
+static uint64_t push_stack(riscv_cpu *cpu,
+                           uint64_t *sp,
+                           const void *data,
+                           uint64_t len)
+{
+    if (*sp - len < USER_SIZE - USER_STACK_SIZE)
+        return 0;
+    *sp -= len;
+    memcpy(cpu->bus.memory.mem + *sp, data, len);
+    return *sp;
+}
+
+static uint64_t count_strings(char *const *strs)
+{
+    uint64_t n = 0;
+    while (strs && strs[n])
+        n++;
+    return n;
+}
+
+/* The initial stack of Linux: argc, argv, envp and the auxiliary vector, and
+ * the strings and random bytes they point to are above them. */
+static bool init_stack(riscv_cpu *cpu,
+                       char *const *argv,
+                       char *const *envp,
+                       uint64_t entry,
+                       uint64_t phdr,
+                       uint64_t phnum)
+{
+    uint64_t argc = count_strings(argv), envc = count_strings(envp);
+    uint64_t sp = USER_SIZE;
+    uint64_t *ptrs = calloc(argc + envc, sizeof(uint64_t));
+    if (!ptrs)
+        return false;
+
+    bool ok = true;
+    for (uint64_t i = 0; i < argc + envc && ok; i++) {
+        const char *s = i < argc ? argv[i] : envp[i - argc];
+        ptrs[i] = push_stack(cpu, &sp, s, strlen(s) + 1);
+        ok = ptrs[i] != 0;
+    }
+
+    uint8_t random[16];
+    for (int i = 0; i < 16; i++)
+        random[i] = rand();
+    uint64_t random_addr = push_stack(cpu, &sp, random, sizeof(random));
+
+    uint64_t auxv[][2] = {
+        {AT_PHDR, phdr},
+        {AT_PHENT, sizeof(Elf64_Phdr)},
+        {AT_PHNUM, phnum},
+        {AT_PAGESZ, USER_PAGE_SIZE},
+        {AT_BASE, 0},
+        {AT_ENTRY, entry},
+        {AT_UID, getuid()},
+        {AT_EUID, geteuid()},
+        {AT_GID, getgid()},
+        {AT_EGID, getegid()},
+        {AT_HWCAP, USER_HWCAP},
+        {AT_CLKTCK, sysconf(_SC_CLK_TCK)},
+        {AT_SECURE, 0},
+        {AT_RANDOM, random_addr},
+        {AT_EXECFN, argc ? ptrs[0] : 0},
+        {AT_NULL, 0},
+    };
+
+    // argc, argv with NULL, envp with NULL and auxv, aligned to 16 bytes
+    uint64_t words = 1 + argc + 1 + envc + 1 + sizeof(auxv) / 8;
+    sp = (sp - words * 8) & ~15UL;
+    if (!ok || !random_addr || sp < USER_SIZE - USER_STACK_SIZE) {
+        ERROR("The arguments are too large for the stack\n");
+        free(ptrs);
+        return false;
+    }
+
+    uint64_t *p = (uint64_t *) (cpu->bus.memory.mem + sp);
+    *p++ = argc;
+    for (uint64_t i = 0; i < argc; i++)
+        *p++ = ptrs[i];
+    *p++ = 0;
+    for (uint64_t i = 0; i < envc; i++)
+        *p++ = ptrs[argc + i];
+    *p++ = 0;
+    memcpy(p, auxv, sizeof(auxv));
+
+    cpu->xreg[2] = sp;
+    free(ptrs);
+    return true;
+}
+
+bool init_user(riscv_cpu *cpu, const riscv_config *config)
+{
+    riscv_user *user = &cpu->user;
+    user->exe = config->binary;
+    user->mmap_top = USER_SIZE - USER_STACK_SIZE;
+    for (int fd = 0; fd < USER_FD_MAX; fd++)
+        user->fds[fd] = fd <= STDERR_FILENO ? fd : -1;
+
+    uint64_t entry, phdr, phnum;
+    if (!load_program(cpu, config->binary, &entry, &phdr, &phnum))
+        return false;
+
+    char *const default_argv[] = {(char *) config->binary, NULL};
+    char *const *argv = config->user_argv ? config->user_argv : default_argv;
+    if (!init_stack(cpu, argv, config->user_envp, entry, phdr, phnum))
+        return false;
+
+    // the program uses vector and the cache-block operations freely
+    cpu->csr.reg[MSTATUS] |= MSTATUS_VS_INITIAL;
+    write_csr(&cpu->csr, MCOUNTEREN, -1);
+    write_csr(&cpu->csr, SCOUNTEREN, -1);
+    write_csr(&cpu->csr, MENVCFG, MENVCFG_CBIE | MENVCFG_CBCFE | MENVCFG_CBZE);
+    write_csr(&cpu->csr, SENVCFG, MENVCFG_CBIE | MENVCFG_CBCFE | MENVCFG_CBZE);
+
+    cpu->mode.mode = USER;
+    cpu->pc = entry;
+    user->enable = true;
+    return true;
+}
+
+void free_user(riscv_cpu *cpu)
+{
+    if (!cpu->user.enable)
+        return;
+    for (int fd = 0; fd < USER_FD_MAX; fd++) {
+        if (cpu->user.fds[fd] > STDERR_FILENO)
+            close(cpu->user.fds[fd]);
+    }
+}
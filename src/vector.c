@@ -0,0 +1,376 @@
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "vector.h"
+
+/* The kernels below are generated for each element type by macros. For all of
+ * the generated loops, the expression `expr` computes the new value of one
+ * element from:
+ *  - a: the element of vs2
+ *  - b: the element of vs1 (or the scalar operand which is splatted by caller)
+ *  - c: the original element of vd
+ *
+ * Note that the integer operations which may overflow are defined on unsigned
+ * types to avoid undefined behavior, since the result is the same in two's
+ * complement representation. */
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define VEC_KERNEL \
+    static __attribute__((target_clones("arch=haswell", "default")))
+#else
+#define VEC_KERNEL static
+#endif
+
+#define WIDTH(x) (sizeof(x) * 8)
+#define SIGN_BIT(x) ((__typeof__(x)) 1 << (WIDTH(x) - 1))
+#define ZEXT128(x) ((__int128) (x) & ((((__int128) 1) << WIDTH(x)) - 1))
+
+#define FMA(x, y, z) (sizeof(x) == 4 ? fmaf(x, y, z) : fma(x, y, z))
+#define FMIN(x, y) (sizeof(x) == 4 ? fminf(x, y) : fmin(x, y))
+#define FMAX(x, y) (sizeof(x) == 4 ? fmaxf(x, y) : fmax(x, y))
+#define FSQRT(x) (sizeof(x) == 4 ? sqrtf(x) : sqrt(x))
+
+#define ARITH_KERNEL(name, type, expr)                                   \
+    VEC_KERNEL void name##_##type(void *vd, const void *vs2,             \
+                                  const void *vs1, uint64_t vl)          \
+    {                                                                    \
+        type *d = vd;                                                    \
+        const type *x = vs2, *y = vs1;                                   \
+        for (uint64_t i = 0; i < vl; i++) {                              \
+            __attribute__((unused)) type a = x[i], b = y[i], c = d[i];   \
+            d[i] = (expr);                                               \
+        }                                                                \
+    }
+
+#define CMP_KERNEL(name, type, expr)                                     \
+    VEC_KERNEL void name##_##type(uint8_t *res, const void *vs2,         \
+                                  const void *vs1, uint64_t vl)          \
+    {                                                                    \
+        const type *x = vs2, *y = vs1;                                   \
+        for (uint64_t i = 0; i < vl; i++) {                              \
+            type a = x[i], b = y[i];                                     \
+            res[i] = (expr);                                             \
+        }                                                                \
+    }
+
+#define RED_KERNEL(name, type, expr)                                     \
+    VEC_KERNEL void name##_##type(void *acc, const void *vs2,            \
+                                  const uint8_t *mask, uint64_t vl)      \
+    {                                                                    \
+        const type *x = vs2;                                             \
+        type r;                                                          \
+        memcpy(&r, acc, sizeof(r));                                      \
+        if (mask == NULL) {                                              \
+            for (uint64_t i = 0; i < vl; i++) {                          \
+                type a = x[i];                                           \
+                r = (expr);                                              \
+            }                                                            \
+        } else {                                                         \
+            for (uint64_t i = 0; i < vl; i++) {                          \
+                type a = x[i];                                           \
+                if (mask[i])                                             \
+                    r = (expr);                                          \
+            }                                                            \
+        }                                                                \
+        memcpy(acc, &r, sizeof(r));                                      \
+    }
+
+/* `sign` is empty for signed element or `u` for unsigned element */
+#define INT_KERNELS(kernel, fn_type, name, sign, expr)                  \
+    kernel(name, sign##int8_t, expr) kernel(name, sign##int16_t, expr)  \
+        kernel(name, sign##int32_t, expr)                               \
+            kernel(name, sign##int64_t, expr) const fn_type name[4] = { \
+                name##_##sign##int8_t, name##_##sign##int16_t,          \
+                name##_##sign##int32_t, name##_##sign##int64_t};
+
+#define FP_KERNELS(kernel, fn_type, name, expr)                      \
+    kernel(name, float, expr) kernel(name, double, expr)             \
+        const fn_type name[4] = {NULL, NULL, name##_float, name##_double};
+
+/* the sign-injection operates on the bit pattern of the floating-point value */
+#define FP_BITS_KERNELS(kernel, fn_type, name, expr)                     \
+    kernel(name, uint32_t, expr) kernel(name, uint64_t, expr)            \
+        const fn_type name[4] = {NULL, NULL, name##_uint32_t,            \
+                                 name##_uint64_t};
+
+#define INT_ARITH(name, sign, expr) \
+    INT_KERNELS(ARITH_KERNEL, vec_arith_fn, name, sign, expr)
+#define INT_CMP(name, sign, expr) \
+    INT_KERNELS(CMP_KERNEL, vec_cmp_fn, name, sign, expr)
+#define INT_RED(name, sign, expr) \
+    INT_KERNELS(RED_KERNEL, vec_red_fn, name, sign, expr)
+#define FP_ARITH(name, expr) FP_KERNELS(ARITH_KERNEL, vec_arith_fn, name, expr)
+#define FP_CMP(name, expr) FP_KERNELS(CMP_KERNEL, vec_cmp_fn, name, expr)
+#define FP_RED(name, expr) FP_KERNELS(RED_KERNEL, vec_red_fn, name, expr)
+#define FP_BITS_ARITH(name, expr) \
+    FP_BITS_KERNELS(ARITH_KERNEL, vec_arith_fn, name, expr)
+
+/* clang-format off */
+INT_ARITH(vec_add, u, a + b)
+INT_ARITH(vec_sub, u, a - b)
+INT_ARITH(vec_rsub, u, b - a)
+INT_ARITH(vec_minu, u, a < b ? a : b)
+INT_ARITH(vec_min, , a < b ? a : b)
+INT_ARITH(vec_maxu, u, a > b ? a : b)
+INT_ARITH(vec_max, , a > b ? a : b)
+INT_ARITH(vec_and, u, a & b)
+INT_ARITH(vec_or, u, a | b)
+INT_ARITH(vec_xor, u, a ^ b)
+INT_ARITH(vec_sll, u, a << (b & (WIDTH(a) - 1)))
+INT_ARITH(vec_srl, u, a >> (b & (WIDTH(a) - 1)))
+INT_ARITH(vec_sra, , a >> (b & (WIDTH(a) - 1)))
+INT_ARITH(vec_mul, u, a * b)
+INT_ARITH(vec_mulh, , ((__int128) a * b) >> WIDTH(a))
+INT_ARITH(vec_mulhu, u, ((unsigned __int128) a * b) >> WIDTH(a))
+INT_ARITH(vec_mulhsu, , ((__int128) a * ZEXT128(b)) >> WIDTH(a))
+/* The division by zero and the overflow of signed division don't raise
+ * exception but have the defined result. The signed overflow happens only for
+ * the division by -1, which is negation. */
+INT_ARITH(vec_divu, u, b == 0 ? (uint64_t) -1 : a / b)
+INT_ARITH(vec_div,
+          ,
+          b == 0 ? -1 : b == -1 ? (int64_t) (0 - (uint64_t) a) : a / b)
+INT_ARITH(vec_remu, u, b == 0 ? a : a % b)
+INT_ARITH(vec_rem, , b == 0 ? a : b == -1 ? 0 : a % b)
+INT_ARITH(vec_macc, u, b * a + c)
+INT_ARITH(vec_nmsac, u, c - b * a)
+INT_ARITH(vec_madd, u, b * c + a)
+INT_ARITH(vec_nmsub, u, a - b * c)
+INT_ARITH(vec_mv, u, b)
+
+INT_CMP(vec_seq, u, a == b)
+INT_CMP(vec_sne, u, a != b)
+INT_CMP(vec_sltu, u, a < b)
+INT_CMP(vec_slt, , a < b)
+INT_CMP(vec_sleu, u, a <= b)
+INT_CMP(vec_sle, , a <= b)
+INT_CMP(vec_sgtu, u, a > b)
+INT_CMP(vec_sgt, , a > b)
+
+INT_RED(vec_redsum, u, r + a)
+INT_RED(vec_redand, u, r & a)
+INT_RED(vec_redor, u, r | a)
+INT_RED(vec_redxor, u, r ^ a)
+INT_RED(vec_redminu, u, a < r ? a : r)
+INT_RED(vec_redmin, , a < r ? a : r)
+INT_RED(vec_redmaxu, u, a > r ? a : r)
+INT_RED(vec_redmax, , a > r ? a : r)
+
+/* The emulator has only the loads and stores of F and D but no fcsr, so the
+ * floating-point kernels round by the host, i.e. to nearest, instead of frm,
+ * don't accrue fflags, and aren't gated by mstatus.FS, which is always Off. */
+FP_ARITH(vec_fadd, a + b)
+FP_ARITH(vec_fsub, a - b)
+FP_ARITH(vec_frsub, b - a)
+FP_ARITH(vec_fmul, a * b)
+FP_ARITH(vec_fdiv, a / b)
+FP_ARITH(vec_frdiv, b / a)
+FP_ARITH(vec_fmin, FMIN(a, b))
+FP_ARITH(vec_fmax, FMAX(a, b))
+FP_ARITH(vec_fmacc, FMA(b, a, c))
+FP_ARITH(vec_fnmacc, -FMA(b, a, c))
+FP_ARITH(vec_fmsac, FMA(b, a, -c))
+FP_ARITH(vec_fnmsac, FMA(-b, a, c))
+FP_ARITH(vec_fmadd, FMA(b, c, a))
+FP_ARITH(vec_fnmadd, -FMA(b, c, a))
+FP_ARITH(vec_fmsub, FMA(b, c, -a))
+FP_ARITH(vec_fnmsub, FMA(-b, c, a))
+FP_ARITH(vec_fsqrt, FSQRT(a))
+
+FP_BITS_ARITH(vec_fsgnj, (a & ~SIGN_BIT(a)) | (b & SIGN_BIT(a)))
+FP_BITS_ARITH(vec_fsgnjn, (a & ~SIGN_BIT(a)) | (~b & SIGN_BIT(a)))
+FP_BITS_ARITH(vec_fsgnjx, a ^ (b & SIGN_BIT(a)))
+
+FP_CMP(vec_mfeq, a == b)
+FP_CMP(vec_mfne, a != b)
+FP_CMP(vec_mflt, a < b)
+FP_CMP(vec_mfle, a <= b)
+FP_CMP(vec_mfgt, a > b)
+FP_CMP(vec_mfge, a >= b)
+
+FP_RED(vec_fredsum, r + a)
+FP_RED(vec_fredmin, FMIN(r, a))
+FP_RED(vec_fredmax, FMAX(r, a))
+/* clang-format on */
+
+/* The conversion from floating-point to integer saturates on overflow, and
+ * NaN is converted to the largest integer. The rounding is done by the host's
+ * default rounding mode (round to nearest, ties to even) unless `rtz`. */
+static inline int64_t cvt_f2i(double f, bool rtz, double limit, int64_t max)
+{
+    if (isnan(f))
+        return max;
+    f = rtz ? trunc(f) : nearbyint(f);
+    if (f < -limit)
+        return -max - 1;
+    if (f >= limit)
+        return max;
+    return (int64_t) f;
+}
+
+static inline uint64_t cvt_f2u(double f, bool rtz, double limit, uint64_t max)
+{
+    if (isnan(f))
+        return max;
+    f = rtz ? trunc(f) : nearbyint(f);
+    if (f < 0)
+        return 0;
+    if (f >= limit)
+        return max;
+    return (uint64_t) f;
+}
+
+#define CVT_KERNEL(name, to, from, expr)                                  \
+    VEC_KERNEL void name##_##from(void *vd, const void *vs2,              \
+                                  __attribute__((unused)) const void *vs1, \
+                                  uint64_t vl)                            \
+    {                                                                     \
+        to *d = vd;                                                       \
+        const from *x = vs2;                                              \
+        for (uint64_t i = 0; i < vl; i++) {                               \
+            from a = x[i];                                                \
+            d[i] = (expr);                                                \
+        }                                                                 \
+    }
+
+/* clang-format off */
+#define CVT_F2I(name, rtz)                                                   \
+    CVT_KERNEL(name, int32_t, float, cvt_f2i(a, rtz, 0x1p31, INT32_MAX))     \
+    CVT_KERNEL(name, int64_t, double, cvt_f2i(a, rtz, 0x1p63, INT64_MAX))    \
+    const vec_arith_fn name[4] = {NULL, NULL, name##_float, name##_double};
+
+#define CVT_F2U(name, rtz)                                                   \
+    CVT_KERNEL(name, uint32_t, float, cvt_f2u(a, rtz, 0x1p32, UINT32_MAX))   \
+    CVT_KERNEL(name, uint64_t, double, cvt_f2u(a, rtz, 0x1p64, UINT64_MAX))  \
+    const vec_arith_fn name[4] = {NULL, NULL, name##_float, name##_double};
+
+#define CVT_I2F(name, sign)                                                  \
+    CVT_KERNEL(name, float, sign##int32_t, a)                                \
+    CVT_KERNEL(name, double, sign##int64_t, a)                               \
+    const vec_arith_fn name[4] = {NULL, NULL, name##_##sign##int32_t,        \
+                                  name##_##sign##int64_t};
+
+CVT_F2U(vec_fcvt_xu_f, false)
+CVT_F2I(vec_fcvt_x_f, false)
+CVT_F2U(vec_fcvt_rtz_xu_f, true)
+CVT_F2I(vec_fcvt_rtz_x_f, true)
+CVT_I2F(vec_fcvt_f_xu, u)
+CVT_I2F(vec_fcvt_f_x, )
+/* clang-format on */
+
+#define SPLAT_KERNEL(type)                                    \
+    static void splat_##type(void *vd, uint64_t value, uint64_t vl) \
+    {                                                         \
+        type *d = vd;                                         \
+        for (uint64_t i = 0; i < vl; i++)                     \
+            d[i] = value;                                     \
+    }
+
+#define MERGE_KERNEL(type)                                                  \
+    VEC_KERNEL void merge_##type(void *vd, const void *vs,                  \
+                                 const uint8_t *mask, uint64_t vl)          \
+    {                                                                       \
+        type *d = vd;                                                       \
+        const type *s = vs;                                                 \
+        for (uint64_t i = 0; i < vl; i++)                                   \
+            d[i] = mask[i] ? s[i] : d[i];                                   \
+    }
+
+SPLAT_KERNEL(uint8_t)
+SPLAT_KERNEL(uint16_t)
+SPLAT_KERNEL(uint32_t)
+SPLAT_KERNEL(uint64_t)
+MERGE_KERNEL(uint8_t)
+MERGE_KERNEL(uint16_t)
+MERGE_KERNEL(uint32_t)
+MERGE_KERNEL(uint64_t)
+
+// fill the first vl elements of vd with the value
+void vec_splat(void *vd, uint64_t value, unsigned int sew, uint64_t vl)
+{
+    static void (*const splat[4])(void *, uint64_t, uint64_t) = {
+        splat_uint8_t, splat_uint16_t, splat_uint32_t, splat_uint64_t};
+    splat[sew](vd, value, vl);
+}
+
+// copy the element of vs to vd if the corresponding mask byte is set
+void vec_merge(void *vd,
+               const void *vs,
+               const uint8_t *mask,
+               unsigned int sew,
+               uint64_t vl)
+{
+    static void (*const merge[4])(void *, const void *, const uint8_t *,
+                                  uint64_t) = {
+        merge_uint8_t, merge_uint16_t, merge_uint32_t, merge_uint64_t};
+    merge[sew](vd, vs, mask, vl);
+}
+
+// expand the mask register to one byte per element
+void vec_unpack_mask(uint8_t *mask, const uint8_t *v0, uint64_t vl)
+{
+    for (uint64_t i = 0; i < vl; i++)
+        mask[i] = (v0[i >> 3] >> (i & 7)) & 1;
+}
+
+/* write the comparison result into the mask register vd. Only the active
+ * elements are updated, and all elements are active if mask is NULL */
+void vec_pack_mask(uint8_t *vd,
+                   const uint8_t *res,
+                   const uint8_t *mask,
+                   uint64_t vl)
+{
+    for (uint64_t i = 0; i < vl; i++) {
+        if (mask && !mask[i])
+            continue;
+        uint8_t bit = 1 << (i & 7);
+        vd[i >> 3] = res[i] ? (vd[i >> 3] | bit) : (vd[i >> 3] & ~bit);
+    }
+}
+
+void vec_mask_logical(vec_mask_op op,
+                      uint8_t *vd,
+                      const uint8_t *vs2,
+                      const uint8_t *vs1,
+                      uint64_t vl)
+{
+    uint64_t len = (vl + 7) >> 3;
+
+    for (uint64_t i = 0; i < len; i++) {
+        uint8_t a = vs2[i], b = vs1[i], r;
+
+        switch (op) {
+        case VMANDN:
+            r = a & ~b;
+            break;
+        case VMAND:
+            r = a & b;
+            break;
+        case VMOR:
+            r = a | b;
+            break;
+        case VMXOR:
+            r = a ^ b;
+            break;
+        case VMORN:
+            r = a | ~b;
+            break;
+        case VMNAND:
+            r = ~(a & b);
+            break;
+        case VMNOR:
+            r = ~(a | b);
+            break;
+        default:
+            r = ~(a ^ b);
+            break;
+        }
+
+        // the tail elements of mask register are kept undisturbed
+        uint8_t keep = 0;
+        if (i == len - 1 && (vl & 7))
+            keep = 0xff << (vl & 7);
+        vd[i] = (vd[i] & keep) | (r & ~keep);
+    }
+}
@@ -100,6 +100,9 @@ static void access_disk(riscv_virtio_blk *virtio_blk)
 
         memcpy(cpu->bus.virtio_blk.rfsimg + (blk_req_sector * SECTOR_SIZE),
                cpu->bus.memory.mem + (desc1.addr - DRAM_BASE), desc1.len);
+        mark_dirty(cpu->bus.virtio_blk.dirty, blk_req_sector * SECTOR_SIZE,
+                   desc1.len);
+        virtio_blk->write_bytes += desc1.len;
     }
     // read device
     else {
@@ -108,7 +111,10 @@ static void access_disk(riscv_virtio_blk *virtio_blk)
         memcpy(cpu->bus.memory.mem + (desc1.addr - DRAM_BASE),
                cpu->bus.virtio_blk.rfsimg + (blk_req_sector * SECTOR_SIZE),
                desc1.len);
+        mark_dirty(cpu->bus.memory.dirty, desc1.addr - DRAM_BASE, desc1.len);
+        virtio_blk->read_bytes += desc1.len;
     }
+    virtio_blk->requests++;
 
     assert(desc2.flags & VIRTQ_DESC_F_WRITE);
 
@@ -153,6 +159,7 @@ bool init_virtio_blk(riscv_virtio_blk *virtio_blk, const char *rfs_name)
     rewind(fp);
 
     virtio_blk->rfsimg = malloc(sz);
+    virtio_blk->rfsimg_size = sz;
     size_t read_size = fread(virtio_blk->rfsimg, sizeof(uint8_t), sz, fp);
 
     if (read_size != sz) {
@@ -325,4 +332,5 @@ void tick_virtio_blk(riscv_virtio_blk *virtio_blk)
 void free_virtio_blk(riscv_virtio_blk *virtio_blk)
 {
     free(virtio_blk->rfsimg);
+    free(virtio_blk->dirty);
 }
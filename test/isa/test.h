@@ -0,0 +1,67 @@
+/* The tests of the extensions which riscv-tests doesn't cover, written in the
+ * same way: each case sets gp to its number before it runs, and the test
+ * reports through .tohost and a0 0 when all the cases pass, or the number of
+ * the case which fails. They are bare-metal programs started at DRAM_BASE in
+ * M-mode, and run by `--riscv-test`.
+ *
+ * The layout is fixed by test/isa/linker.ld: the code is in the first page,
+ * .tohost ends the second one, so that a store across the page boundary could
+ * complete it, and the scratch data starts from the fourth one. */
+
+#define TEST_TOHOST 0x1ff8
+#define TEST_DATA 0x3000
+
+// keep the address where the test is loaded in s11, and fail on any trap
+#define TEST_INIT                 \
+    auipc s11, 0;                 \
+    la t0, fail;                  \
+    csrw mtvec, t0;               \
+    li gp, 0
+
+// check that the register holds the expected value after the code
+#define TEST_CASE(num, reg, expect, code...) \
+    li gp, num;                              \
+    code;                                    \
+    li t6, expect;                           \
+    bne reg, t6, fail
+
+#define MSTATUS_MPP 0x1800
+#define MSTATUS_MPP_S 0x800
+
+// run the code in S-mode, and get the cause of the trap which ends it in a0
+#define TEST_RUN_IN_S(code...)            \
+    la t0, 1f;                            \
+    csrw mtvec, t0;                       \
+    li t0, MSTATUS_MPP;                   \
+    csrc mstatus, t0;                     \
+    li t0, MSTATUS_MPP_S;                 \
+    csrs mstatus, t0;                     \
+    la t0, 2f;                            \
+    csrw mepc, t0;                        \
+    mret;                                 \
+    2: code;                              \
+    j fail;                               \
+    .p2align 2;                           \
+    1: csrr a0, mcause;                   \
+    la t0, fail;                          \
+    csrw mtvec, t0
+
+// the end of the cases, which reports the result to the host
+#define TEST_PASSFAIL            \
+    li gp, 0;                    \
+    .p2align 2;                  \
+fail:                            \
+    mv a0, gp;                   \
+    slli t1, gp, 1;              \
+    ori t1, t1, 1;               \
+    li t0, TEST_TOHOST;          \
+    add t0, s11, t0;             \
+    1: sd t1, 0(t0);             \
+    j 1b
+
+// the locations watched by the host, which should be in every test
+#define TEST_TOHOST_SECTION                \
+    .section .tohost, "aw", @progbits;     \
+    .align 3;                              \
+    tohost: .dword 0;                      \
+    fromhost: .dword 0
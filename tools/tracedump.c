@@ -0,0 +1,233 @@
+/* Convert the binary trace recorded by `emu --trace` to text, see tracer.h.
+ * The instructions are named by the decode table of the emulator, and the
+ * records could be filtered by the range of pc and the privilege mode. With
+ * --stats, the summary of the trace is printed instead of the records.
+ *
+ *   $ build/tracedump [--pc <start>:<end>] [--mode M|S|U] [--stats] <trace> */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "tracer.h"
+
+typedef struct {
+    trace_header header;
+    uint64_t rd_value;
+    uint64_t mem_addr;
+    uint64_t mem_value;
+} trace_entry;
+
+typedef struct {
+    uint64_t records;
+    uint64_t instrs[4];
+    uint64_t loads;
+    uint64_t stores;
+    uint64_t exceptions[STATS_CAUSES];
+    uint64_t interrupts[STATS_CAUSES];
+    uint64_t starts;
+} trace_summary;
+
+static const char mode_chars[] = "US?M";
+
+static bool read_entry(FILE *fp, trace_entry *entry)
+{
+    if (fread(&entry->header, sizeof(trace_header), 1, fp) != 1)
+        return false;
+
+    uint8_t flags = entry->header.flags;
+    if ((flags & TRACE_F_RD) &&
+        fread(&entry->rd_value, sizeof(uint64_t), 1, fp) != 1)
+        return false;
+    if ((flags & TRACE_F_MEM) &&
+        (fread(&entry->mem_addr, sizeof(uint64_t), 1, fp) != 1 ||
+         fread(&entry->mem_value, sizeof(uint64_t), 1, fp) != 1))
+        return false;
+    return true;
+}
+
+static const char *instr_name(riscv_cpu *cpu, uint32_t instr)
+{
+    if (!decode_cpu(cpu, instr)) {
+        cpu->exc.exception = NoException;
+        return "?";
+    }
+    return cpu->instr.name ? cpu->instr.name : "?";
+}
+
+static void print_entry(riscv_cpu *cpu, const trace_entry *entry)
+{
+    const trace_header *h = &entry->header;
+    char mode = mode_chars[h->mode & 0x3];
+
+    switch (h->type) {
+    case TRACE_INSTR:
+        printf("%c %016lx %08x %-12s", mode, h->pc, h->instr,
+               instr_name(cpu, h->instr));
+        if (h->flags & TRACE_F_RD)
+            printf(" x%d=%016lx", h->rd, entry->rd_value);
+        if (h->flags & TRACE_F_MEM)
+            printf(" %s [%016lx]=%016lx",
+                   h->flags & TRACE_F_STORE ? "store" : "load", entry->mem_addr,
+                   entry->mem_value);
+        putchar('\n');
+        break;
+    case TRACE_EXCEPTION:
+        printf("%c %016lx exception %u tval=%016lx\n", mode, h->pc, h->instr,
+               entry->rd_value);
+        break;
+    case TRACE_INTERRUPT:
+        printf("%c %016lx interrupt %u\n", mode, h->pc, h->instr);
+        break;
+    case TRACE_START:
+        printf("%c %016lx start at instret %lu\n", mode, h->pc,
+               entry->rd_value);
+        break;
+    default:
+        printf("%c %016lx unknown record %d\n", mode, h->pc, h->type);
+    }
+}
+
+static void count_entry(trace_summary *summary, const trace_entry *entry)
+{
+    const trace_header *h = &entry->header;
+    summary->records++;
+    switch (h->type) {
+    case TRACE_INSTR:
+        summary->instrs[h->mode & 0x3]++;
+        if (h->flags & TRACE_F_MEM) {
+            if (h->flags & TRACE_F_STORE)
+                summary->stores++;
+            else
+                summary->loads++;
+        }
+        break;
+    case TRACE_EXCEPTION:
+        if (h->instr < STATS_CAUSES)
+            summary->exceptions[h->instr]++;
+        break;
+    case TRACE_INTERRUPT:
+        if (h->instr < STATS_CAUSES)
+            summary->interrupts[h->instr]++;
+        break;
+    case TRACE_START:
+        summary->starts++;
+        break;
+    }
+}
+
+static void print_summary(const trace_summary *summary)
+{
+    printf("records      %lu\n", summary->records);
+    printf("enabled      %lu times\n", summary->starts);
+    for (int mode = 3; mode >= 0; mode--) {
+        if (mode != 2)
+            printf("instrs (%c)   %lu\n", mode_chars[mode],
+                   summary->instrs[mode]);
+    }
+    printf("loads        %lu\n", summary->loads);
+    printf("stores       %lu\n", summary->stores);
+    for (int cause = 0; cause < STATS_CAUSES; cause++) {
+        if (summary->exceptions[cause])
+            printf("exception %-2d %lu\n", cause, summary->exceptions[cause]);
+    }
+    for (int cause = 0; cause < STATS_CAUSES; cause++) {
+        if (summary->interrupts[cause])
+            printf("interrupt %-2d %lu\n", cause, summary->interrupts[cause]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t pc_start = 0, pc_end = UINT64_MAX;
+    int mode_filter = -1;
+    bool stats = false;
+
+    struct option opts[] = {
+        {"pc", 1, NULL, 'p'},
+        {"mode", 1, NULL, 'm'},
+        {"stats", 0, NULL, 's'},
+        {0, 0, 0, 0},
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "p:m:s", opts, NULL)) != -1) {
+        switch (c) {
+        case 'p': {
+            char *end;
+            pc_start = strtoull(optarg, &end, 0);
+            if (*end != ':') {
+                ERROR("The range of pc should be <start>:<end>\n");
+                return 1;
+            }
+            pc_end = strtoull(end + 1, NULL, 0);
+            break;
+        }
+        case 'm': {
+            const char *p = strchr(mode_chars, optarg[0]);
+            if (!optarg[0] || !p || *p == '?') {
+                ERROR("The mode should be M, S or U\n");
+                return 1;
+            }
+            mode_filter = p - mode_chars;
+            break;
+        }
+        case 's':
+            stats = true;
+            break;
+        default:
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        ERROR("Usage: %s [--pc <start>:<end>] [--mode M|S|U] [--stats] "
+              "<trace>\n",
+              argv[0]);
+        return 1;
+    }
+
+    FILE *fp = fopen(argv[optind], "rb");
+    if (!fp) {
+        ERROR("Failed to open %s\n", argv[optind]);
+        return 1;
+    }
+
+    char magic[sizeof(TRACE_MAGIC) - 1];
+    if (fread(magic, sizeof(magic), 1, fp) != 1 ||
+        memcmp(magic, TRACE_MAGIC, sizeof(magic))) {
+        ERROR("%s isn't a trace of the emulator\n", argv[optind]);
+        fclose(fp);
+        return 1;
+    }
+
+    // only the decoder of the CPU is used to name the instructions
+    riscv_cpu *cpu = calloc(1, sizeof(riscv_cpu));
+    if (!cpu || !log_begin(&cpu->logger)) {
+        ERROR("Failed to allocate the decoder\n");
+        fclose(fp);
+        return 1;
+    }
+
+    trace_summary summary = {0};
+    trace_entry entry;
+    while (read_entry(fp, &entry)) {
+        const trace_header *h = &entry.header;
+        if (h->pc < pc_start || h->pc >= pc_end)
+            continue;
+        if (mode_filter >= 0 && h->mode != mode_filter)
+            continue;
+
+        if (stats)
+            count_entry(&summary, &entry);
+        else
+            print_entry(cpu, &entry);
+    }
+    if (stats)
+        print_summary(&summary);
+
+    log_end(cpu->logger);
+    free(cpu);
+    fclose(fp);
+    return 0;
+}